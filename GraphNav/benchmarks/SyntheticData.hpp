@@ -0,0 +1,301 @@
+#if !defined(SYNTHETICDATA_HPP_)
+#define SYNTHETICDATA_HPP_
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "Routing/CSRAdjacency.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <utility>
+#include <vector>
+
+namespace synthetic{
+
+// Generators for maps and graphs of arbitrary size, in the same formats as res/maps/SKERI and
+// res/4thfloor.json. The floor is a square grid of cellPx x cellPx rooms: walls run along the cell
+// borders with a door in the middle of every wall, and the graph has one node in the centre of
+// every room linked to the four neighbouring rooms, so that every edge goes through a door.
+struct GridSpec{
+    int sizePx = 1000;   // width and height of the map images
+    int cellPx = 31;     // room size
+    int doorPx = 9;      // width of the doors
+    int floor = 4;
+    float scale = 10.f;  // pixels per meter
+
+    inline int rooms() const { return sizePx / cellPx; }
+    inline int numNodes() const { return rooms() * rooms(); }
+    inline int roomCentre(int k) const { return k * cellPx + cellPx / 2; }
+};
+
+inline bool fileExists(const std::string& fileName){
+    struct stat st;
+    return stat(fileName.c_str(), &st) == 0;
+}
+
+// walls.bmp, walkable.bmp, rois.bmp, rois.csv, features.yml and info.yml in folder (which must exist)
+inline void writeMap(const GridSpec& spec, const std::string& folder){
+    const int n = spec.rooms();
+    const int doorLo = spec.cellPx / 2 - spec.doorPx / 2;
+    const int doorHi = doorLo + spec.doorPx;
+    cv::Mat walls(spec.sizePx, spec.sizePx, CV_8UC1, cv::Scalar(0));
+    cv::Mat walkable(spec.sizePx, spec.sizePx, CV_8UC1, cv::Scalar(0));
+    cv::Mat rois(spec.sizePx, spec.sizePx, CV_8UC1, cv::Scalar(0));
+    const int end = n * spec.cellPx; // past the last room everything is wall
+    for (int r = 0; r < spec.sizePx; r++){
+        uchar* wallRow = walls.ptr<uchar>(r);
+        uchar* walkableRow = walkable.ptr<uchar>(r);
+        uchar* roiRow = rois.ptr<uchar>(r);
+        int cellR = r / spec.cellPx, inR = r % spec.cellPx;
+        bool doorRow = inR >= doorLo && inR < doorHi;
+        for (int c = 0; c < spec.sizePx; c++){
+            int cellC = c / spec.cellPx, inC = c % spec.cellPx;
+            bool doorCol = inC >= doorLo && inC < doorHi;
+            // walls along the top and left border of every room, the outer ones without doors
+            bool horizontal = inR < 2 && !(cellR > 0 && cellR < n && doorCol);
+            bool vertical = inC < 2 && !(cellC > 0 && cellC < n && doorRow);
+            bool wall = horizontal || vertical || r >= end || c >= end;
+            wallRow[c] = wall ? 255 : 0;
+            walkableRow[c] = wall ? 0 : 255;
+            roiRow[c] = static_cast<uchar>(1 + (cellR * n + cellC) % 254);
+        }
+    }
+    cv::imwrite(folder + "/walls.bmp", walls);
+    cv::imwrite(folder + "/walkable.bmp", walkable);
+    cv::imwrite(folder + "/rois.bmp", rois);
+
+    std::ofstream roisDictionary(folder + "/rois.csv");
+    for (int i = 1; i < 255; i++)
+        roisDictionary << i << ", Room " << i << "\n";
+
+    // a named point of interest in every third room and an exit sign in every tenth
+    std::ofstream features(folder + "/features.yml");
+    bool first = true;
+    auto feature = [&](const std::string& name, const std::string& id, int row, int col){
+        // the features file stores (v, u). The map parser does not accept blank lines, not even a
+        // trailing one, so every block but the first starts with the line break
+        features << (first ? "" : "\n") << "map_feature:\n"
+                 << "\tname: " << name << "\n"
+                 << "\tid: " << id << "\n"
+                 << "\tposition: [" << col / spec.scale << ", " << (spec.sizePx - row) / spec.scale << "]\n"
+                 << "\torientation: [0, 0, 0, 0, 0, 0, 0, 0, 0]\n"
+                 << "\tnormal: [1, 0]";
+        first = false;
+    };
+    for (int k = 0; k < n * n; k++){
+        int row = spec.roomCentre(k / n), col = spec.roomCentre(k % n);
+        if (k % 3 == 0)
+            feature("Room " + std::to_string(k), "aruco_" + std::to_string(k), row, col);
+        if (k % 10 == 0)
+            feature("_", "exit_sign", row + 4, col);
+    }
+
+    std::ofstream info(folder + "/info.yml");
+    info << "building_name: SYNTHETIC\n"
+         << "floor:\n"
+         << "    id: " << spec.floor << "\n"
+         << "    features_file: features.yml\n"
+         << "    walls: walls.bmp\n"
+         << "    walkable: walkable.bmp\n"
+         << "    rois: rois.bmp\n"
+         << "    rois_dictionary: rois.csv\n"
+         << "    scale: " << spec.scale << "\n";
+}
+
+// features file of count ArUco markers laid out like the SKERI ones, every fourth without a normal
+inline std::string featuresText(int count){
+    std::string text;
+    char block[256];
+    for (int k = 0; k < count; k++){
+        int n = std::snprintf(block, sizeof(block), "map_feature:\n\tname: Marker %d\n\tid: aruco %d\n\tposition: [%.10g, %.10g]\n"
+                              "\torientation: [1, 0, 0, 0, 0, -1, 0, 1, 0]\n", k, k, 0.37 * (k % 997), 0.53 * (k / 997) + 0.001 * k);
+        text.append(block, n);
+        if (k % 4 != 3){
+            n = std::snprintf(block, sizeof(block), "\tnormal: [%d, %d]\n", k % 2, k % 2 - 1);
+            text.append(block, n);
+        }
+    }
+    return text;
+}
+
+// graph json (edge list layout) with one node per room, every tenth node is a destination
+inline void writeGraph(const GridSpec& spec, const std::string& fileName){
+    const int n = spec.rooms();
+    std::FILE* fp = std::fopen(fileName.c_str(), "w");
+    if (!fp)
+        return;
+    std::fprintf(fp, "{\"nodes\": [");
+    for (int k = 0; k < n * n; k++)
+        std::fprintf(fp, "%s{\"id\": %d, \"type\": \"%s\", \"position\": [%d, %d], \"floor\": %d, \"label\": \"%d\", \"isDoor\": 0, \"comments\": \"\"}",
+                     k ? ", " : "", k + 1, k % 10 == 0 ? "destination" : "control",
+                     spec.roomCentre(k % n), spec.roomCentre(k / n), spec.floor, k + 1);
+    std::fprintf(fp, "],\n\"edges\": [");
+    bool first = true;
+    auto edge = [&](int a, int b, int angle){
+        std::fprintf(fp, "%s{\"source\": %d, \"target\": %d, \"weight\": %d, \"angle\": %d}", first ? "" : ", ", a + 1, b + 1, spec.cellPx, angle);
+        first = false;
+    };
+    for (int r = 0; r < n; r++){
+        for (int c = 0; c < n; c++){
+            int k = r * n + c;
+            if (c + 1 < n){ edge(k, k + 1, 90); edge(k + 1, k, 270); }
+            if (r + 1 < n){ edge(k, k + n, 180); edge(k + n, k, 0); }
+        }
+    }
+    std::fprintf(fp, "]}\n");
+    std::fclose(fp);
+}
+
+// writes map and graph under root/grid_<size>_<cell> unless they are there already, returns the folder
+inline std::string ensureDataset(const GridSpec& spec, const std::string& root){
+    std::string folder = root + "/grid_" + std::to_string(spec.sizePx) + "_" + std::to_string(spec.cellPx);
+    if (fileExists(folder + "/graph.json"))
+        return folder;
+    mkdir(root.c_str(), 0755);
+    mkdir(folder.c_str(), 0755);
+    writeMap(spec, folder);
+    writeGraph(spec, folder + "/graph.json.tmp");
+    std::rename((folder + "/graph.json.tmp").c_str(), (folder + "/graph.json").c_str());
+    return folder;
+}
+
+// site of numFloors floors that all use the map of ensureDataset(spec, root), under
+// root/site_<size>_<cell>_<floors>; returns the folder
+inline std::string ensureSite(const GridSpec& spec, int numFloors, const std::string& root){
+    std::string grid = ensureDataset(spec, root);
+    std::string gridName = grid.substr(grid.find_last_of('/') + 1);
+    std::string folder = root + "/site_" + std::to_string(spec.sizePx) + "_" + std::to_string(spec.cellPx) + "_" + std::to_string(numFloors);
+    if (fileExists(folder + "/info.yml"))
+        return folder;
+    mkdir(folder.c_str(), 0755);
+    std::ofstream info(folder + "/info.yml.tmp");
+    info << "building_name: SYNTHETIC\n";
+    for (int f = 0; f < numFloors; f++)
+        info << "floor:\n"
+             << "    id: " << f << "\n"
+             << "    features_file: ../" << gridName << "/features.yml\n"
+             << "    walls: ../" << gridName << "/walls.bmp\n"
+             << "    walkable: ../" << gridName << "/walkable.bmp\n"
+             << "    rois: ../" << gridName << "/rois.bmp\n"
+             << "    rois_dictionary: ../" << gridName << "/rois.csv\n"
+             << "    scale: " << spec.scale << "\n";
+    info.close();
+    std::rename((folder + "/info.yml.tmp").c_str(), (folder + "/info.yml").c_str());
+    return folder;
+}
+
+// Routing graph of a campus of buildings x buildings buildings with floors floors each, for the
+// routing benchmarks only (there are no maps). A floor has two parallel corridors of corridorNodes
+// nodes, joined at both ends and in the middle, with a room on the outer side of every corridor
+// node; stairs join the floors at the corridor ends, and the ground floor ends are the entrances,
+// linked by outdoor paths along the streets between the buildings. Positions are campus u,v meters,
+// the same on every floor, and edge weights are lengths in meters (stairs count 8).
+struct CampusSpec{
+    int buildings = 6;       // per side
+    int floors = 5;
+    int corridorNodes = 30;
+    float spacing = 3.f;     // meters between corridor nodes
+    float street = 20.f;     // meters between two buildings
+
+    inline int nodesPerFloor() const { return 4 * corridorNodes; }
+    inline int numNodes() const { return buildings * buildings * (floors * nodesPerFloor() + 4); }
+};
+
+inline navgraph::CSRAdjacency campusAdjacency(const CampusSpec& spec){
+    const int n = spec.corridorNodes;
+    const float width = (n - 1) * spec.spacing, pitch = width + spec.street;
+    std::vector<cv::Point2f> positions;
+    std::vector<std::vector<std::pair<int, float>>> edges;
+    auto node = [&](cv::Point2f p){
+        positions.push_back(p);
+        edges.emplace_back();
+        return static_cast<int>(positions.size()) - 1;
+    };
+    auto link = [&](int a, int b, float w){
+        edges[a].push_back({b, w});
+        edges[b].push_back({a, w});
+    };
+    auto length = [&](int a, int b){
+        cv::Point2f d = positions[a] - positions[b];
+        return std::sqrt(d.x * d.x + d.y * d.y);
+    };
+    // corners of each building, outdoors, by building
+    std::vector<std::vector<int>> corners(spec.buildings * spec.buildings);
+    for (int by = 0; by < spec.buildings; by++){
+        for (int bx = 0; bx < spec.buildings; bx++){
+            cv::Point2f origin(bx * pitch, by * pitch);
+            std::vector<int> previousEnds;
+            for (int f = 0; f < spec.floors; f++){
+                // corridors at v = 4 and v = 8 from the building origin, rooms at v = 0 and v = 12
+                int first = static_cast<int>(positions.size());
+                for (int c = 0; c < 2; c++){
+                    for (int i = 0; i < n; i++){
+                        int k = node(origin + cv::Point2f(i * spec.spacing, 4.f + 4.f * c));
+                        if (i > 0)
+                            link(k - 1, k, spec.spacing);
+                    }
+                }
+                for (int c = 0; c < 2; c++)
+                    for (int i = 0; i < n; i++){
+                        int room = node(origin + cv::Point2f(i * spec.spacing, 12.f * c));
+                        link(first + c * n + i, room, 4.f);
+                    }
+                for (int i : {0, n / 2, n - 1})
+                    link(first + i, first + n + i, 4.f);
+                std::vector<int> ends = {first, first + n - 1};
+                for (size_t e = 0; e < ends.size() && !previousEnds.empty(); e++)
+                    link(previousEnds[e], ends[e], 8.f);
+                if (f == 0){
+                    std::vector<int>& out = corners[by * spec.buildings + bx];
+                    for (int e : ends){
+                        int door = node(positions[e] + cv::Point2f(e == first ? -2.f : 2.f, 0.f));
+                        link(e, door, 2.f);
+                        out.push_back(door);
+                    }
+                    out.push_back(node(origin + cv::Point2f(-2.f, 12.f + spec.street / 2)));
+                    out.push_back(node(origin + cv::Point2f(width + 2.f, 12.f + spec.street / 2)));
+                    link(out[0], out[2], length(out[0], out[2]));
+                    link(out[1], out[3], length(out[1], out[3]));
+                    link(out[2], out[3], length(out[2], out[3]));
+                }
+                previousEnds = ends;
+            }
+        }
+    }
+    // streets between neighbouring buildings
+    for (int by = 0; by < spec.buildings; by++){
+        for (int bx = 0; bx < spec.buildings; bx++){
+            const std::vector<int>& c = corners[by * spec.buildings + bx];
+            if (bx + 1 < spec.buildings){
+                const std::vector<int>& right = corners[by * spec.buildings + bx + 1];
+                link(c[1], right[0], length(c[1], right[0]));
+                link(c[3], right[2], length(c[3], right[2]));
+            }
+            if (by + 1 < spec.buildings){
+                const std::vector<int>& up = corners[(by + 1) * spec.buildings + bx];
+                link(c[2], up[0], length(c[2], up[0]));
+                link(c[3], up[1], length(c[3], up[1]));
+            }
+        }
+    }
+    navgraph::CSRAdjacency g;
+    g.clear();
+    g.positions = positions;
+    for (const auto& list : edges){
+        for (const auto& e : list){
+            g.neighbors.push_back(e.first);
+            g.weights.push_back(e.second);
+        }
+        g.offsets.push_back(static_cast<int>(g.neighbors.size()));
+    }
+    g.computeHeuristicScale();
+    return g;
+}
+
+} // end synthetic namespace
+
+#endif // SYNTHETICDATA_HPP_
@@ -0,0 +1,468 @@
+//
+//  graphnav_bench.cpp
+//  GraphNav
+//
+//  Benchmarks of the query hot paths and of the loading code, on the SKERI maps and on synthetic
+//  grid floors of 1000, 4000 and 10000 pixels (about 1k, 17k and 100k graph nodes).
+//  The dataset argument of every benchmark is the synthetic map size, 0 meaning SKERI, apart from
+//  the campus routing benchmark, which runs on a synthetic graph of many buildings and floors, and
+//  the site loading benchmark, whose floors all use one synthetic map.
+//
+//  graphnav_bench --benchmark_out=results.json --benchmark_out_format=json
+//
+
+#include <benchmark/benchmark.h>
+
+#include "Graph.hpp"
+#include "Maps/MapManager.hpp"
+#include "Utils/AllocCounter.hpp"
+#include "SyntheticData.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+GRAPHNAV_DEFINE_ALLOC_COUNTER
+
+#if !defined(GRAPHNAV_RES_DIR)
+#define GRAPHNAV_RES_DIR "res"
+#endif
+
+namespace {
+
+const int kNumQueries = 4096;
+
+struct Dataset{
+    std::string name;
+    std::string mapFolder;
+    std::string graphFile;
+    int floor;
+    std::shared_ptr<maps::MapManager> maps;
+    std::unique_ptr<navgraph::Graph> graph;
+    // user positions are walkable: a position inside a wall sees no edge, so its snap visits
+    // every segment of the floor before giving up, which is not what the benchmarks are after
+    std::vector<cv::Point2i> pixelQueries;    // walkable pixels
+    std::vector<cv::Point2f> uvQueries;       // the same positions in u,v
+    std::vector<cv::Point2i> pixelQueryEnds;  // 2 to 60 pixels away from pixelQueries
+};
+
+std::string dataRoot(){
+    const char* dir = std::getenv("GRAPHNAV_BENCH_DATA");
+    if (dir)
+        return dir;
+    const char* tmp = std::getenv("TMPDIR");
+    return std::string(tmp ? tmp : "/tmp") + "/graphnav_bench";
+}
+
+// map folder, graph file and floor of a dataset, generating the synthetic ones on first use
+void locate(int sizePx, Dataset& d){
+    if (sizePx == 0){
+        d.name = "SKERI";
+        d.mapFolder = std::string(GRAPHNAV_RES_DIR) + "/maps/SKERI";
+        d.graphFile = std::string(GRAPHNAV_RES_DIR) + "/4thfloor.json";
+        d.floor = 4;
+        return;
+    }
+    synthetic::GridSpec spec;
+    spec.sizePx = sizePx;
+    d.mapFolder = synthetic::ensureDataset(spec, dataRoot());
+    d.graphFile = d.mapFolder + "/graph.json";
+    d.floor = spec.floor;
+    d.name = "grid" + std::to_string(sizePx) + "/" + std::to_string(spec.numNodes()) + "nodes";
+}
+
+// datasets are loaded once and kept for the whole run
+Dataset& dataset(int sizePx){
+    static std::map<int, std::unique_ptr<Dataset>> cache;
+    std::unique_ptr<Dataset>& slot = cache[sizePx];
+    if (slot)
+        return *slot;
+    slot.reset(new Dataset());
+    Dataset& d = *slot;
+    locate(sizePx, d);
+    d.maps = std::make_shared<maps::MapManager>();
+    d.maps->init(d.mapFolder, d.floor);
+    d.graph.reset(new navgraph::Graph(d.graphFile, d.maps));
+
+    std::mt19937 rng(1234);
+    cv::Size size = d.maps->getMapSizePixels(d.floor);
+    std::uniform_int_distribution<int> row(0, size.height - 1), col(0, size.width - 1);
+    std::uniform_real_distribution<float> angle(0.f, 6.2831853f), length(2.f, 60.f);
+    while (static_cast<int>(d.pixelQueries.size()) < kNumQueries){
+        cv::Point2i px(row(rng), col(rng));
+        if (!d.maps->isWalkable(px, d.floor))
+            continue;
+        float a = angle(rng), l = length(rng);
+        cv::Point2i end(px.x + static_cast<int>(l * std::cos(a)), px.y + static_cast<int>(l * std::sin(a)));
+        end.x = std::min(std::max(end.x, 0), size.height - 1);
+        end.y = std::min(std::max(end.y, 0), size.width - 1);
+        d.pixelQueries.push_back(px);
+        d.pixelQueryEnds.push_back(end);
+    }
+    for (const cv::Point2i& px : d.pixelQueries){
+        cv::Point2d uv = d.maps->pixels2uv(px, d.floor);
+        d.uvQueries.push_back(cv::Point2f(static_cast<float>(uv.x), static_cast<float>(uv.y)));
+    }
+    return d;
+}
+
+// heap allocations per iteration, to catch hot paths that start allocating
+void reportAllocations(benchmark::State& state, const allocutils::AllocationScope& scope){
+    state.counters["allocs_per_op"] = benchmark::Counter(static_cast<double>(scope.allocations()), benchmark::Counter::kAvgIterations);
+}
+
+void datasetArgs(benchmark::internal::Benchmark* b){
+    b->ArgName("size")->Arg(0)->Arg(1000)->Arg(4000)->Arg(10000);
+}
+
+void BM_SnapUV2Graph(benchmark::State& state){
+    Dataset& d = dataset(static_cast<int>(state.range(0)));
+    size_t i = 0;
+    allocutils::AllocationScope scope;
+    for (auto _ : state){
+        benchmark::DoNotOptimize(d.graph->snapUV2Graph(d.uvQueries[i], d.floor));
+        i = (i + 1) % d.uvQueries.size();
+    }
+    reportAllocations(state, scope);
+    state.SetLabel(d.name);
+}
+BENCHMARK(BM_SnapUV2Graph)->Apply(datasetArgs);
+
+// batches of 64 positions, with and without the wall test; time and allocations are per position
+void BM_SnapBatch(benchmark::State& state){
+    Dataset& d = dataset(static_cast<int>(state.range(0)));
+    bool checkWalls = state.range(1) != 0;
+    const size_t batch = 64;
+    std::vector<navgraph::Graph::SnapResult> out(batch);
+    size_t i = 0;
+    allocutils::AllocationScope scope;
+    for (auto _ : state){
+        d.graph->snapBatch(d.uvQueries.data() + i, batch, d.floor, out.data(), checkWalls);
+        benchmark::DoNotOptimize(out.data());
+        i = (i + batch) % d.uvQueries.size();
+    }
+    state.SetItemsProcessed(state.iterations() * batch);
+    state.counters["allocs_per_op"] = benchmark::Counter(static_cast<double>(scope.allocations()) / batch, benchmark::Counter::kAvgIterations);
+    state.SetLabel(d.name);
+}
+BENCHMARK(BM_SnapBatch)->ArgNames({"size", "checkWalls"})->ArgsProduct({{0, 1000, 4000, 10000}, {0, 1}});
+
+// fixes of walking users, 6 cm apart (1.2 m/s at 20 Hz), snapped with a session per track
+void BM_SnapTracked(benchmark::State& state){
+    Dataset& d = dataset(static_cast<int>(state.range(0)));
+    bool checkWalls = state.range(1) != 0;
+    const size_t trackLength = 256;
+    std::vector<cv::Point2f> fixes;
+    std::mt19937 rng(99);
+    std::normal_distribution<float> turn(0.f, 0.15f);
+    for (size_t k = 0; k < 64; k++){
+        cv::Point2f p = d.uvQueries[k];
+        float a = 0.f;
+        for (size_t i = 0; i < trackLength; i++){
+            a += turn(rng);
+            cv::Point2f next = p + 0.06f * cv::Point2f(std::cos(a), std::sin(a));
+            if (d.maps->isWalkable(d.maps->uv2pixels(next, d.floor), d.floor))
+                p = next;
+            else
+                a += 1.5707963f;
+            fixes.push_back(p);
+        }
+    }
+    navgraph::Graph::SnapSession session;
+    size_t i = 0;
+    allocutils::AllocationScope scope;
+    for (auto _ : state){
+        if (i % trackLength == 0)
+            session.reset();
+        benchmark::DoNotOptimize(d.graph->snapTracked(session, fixes[i], d.floor, checkWalls));
+        i = (i + 1) % fixes.size();
+    }
+    reportAllocations(state, scope);
+    state.counters["hit_rate"] = static_cast<double>(session.hits) / std::max<uint64_t>(session.hits + session.fallbacks, 1);
+    state.SetLabel(d.name);
+}
+BENCHMARK(BM_SnapTracked)->ArgNames({"size", "checkWalls"})->ArgsProduct({{0, 1000, 4000, 10000}, {0, 1}});
+
+void BM_IsPathCrossingWalls(benchmark::State& state){
+    Dataset& d = dataset(static_cast<int>(state.range(0)));
+    size_t i = 0;
+    allocutils::AllocationScope scope;
+    for (auto _ : state){
+        benchmark::DoNotOptimize(d.maps->isPathCrossingWalls(d.pixelQueries[i], d.pixelQueryEnds[i], d.floor));
+        i = (i + 1) % d.pixelQueries.size();
+    }
+    reportAllocations(state, scope);
+    state.SetLabel(d.name);
+}
+BENCHMARK(BM_IsPathCrossingWalls)->Apply(datasetArgs);
+
+void BM_GetClosestPOI(benchmark::State& state){
+    Dataset& d = dataset(static_cast<int>(state.range(0)));
+    size_t i = 0;
+    allocutils::AllocationScope scope;
+    for (auto _ : state){
+        benchmark::DoNotOptimize(d.maps->getClosestPOI(d.pixelQueries[i], d.floor));
+        i = (i + 1) % d.pixelQueries.size();
+    }
+    reportAllocations(state, scope);
+    state.SetLabel(d.name);
+}
+BENCHMARK(BM_GetClosestPOI)->Apply(datasetArgs);
+
+void BM_FindClosestNodeId(benchmark::State& state){
+    Dataset& d = dataset(static_cast<int>(state.range(0)));
+    size_t i = 0;
+    allocutils::AllocationScope scope;
+    for (auto _ : state){
+        benchmark::DoNotOptimize(d.graph->findClosestNodeId(d.uvQueries[i], d.floor));
+        i = (i + 1) % d.uvQueries.size();
+    }
+    reportAllocations(state, scope);
+    state.SetLabel(d.name);
+}
+BENCHMARK(BM_FindClosestNodeId)->Apply(datasetArgs);
+
+// distance and direction to one destination from walkable positions, a single field lookup.
+// The fields are built on the first run, on SKERI and the smallest grid only
+void BM_GeodesicLookup(benchmark::State& state){
+    Dataset& d = dataset(static_cast<int>(state.range(0)));
+    if (d.graph->getGeodesicFields().empty())
+        d.graph->buildGeodesicFields();
+    int destination = d.graph->nodeId(d.graph->getGeodesicFields().source(0).node);
+    navgraph::GeodesicFields::Lookup lookup;
+    size_t i = 0;
+    allocutils::AllocationScope scope;
+    for (auto _ : state){
+        benchmark::DoNotOptimize(d.graph->getGeodesicDistance(d.uvQueries[i], d.floor, destination, lookup));
+        i = (i + 1) % d.uvQueries.size();
+    }
+    reportAllocations(state, scope);
+    state.SetLabel(d.name);
+}
+BENCHMARK(BM_GeodesicLookup)->ArgName("size")->Arg(0)->Arg(1000);
+
+// users walking their route one node per plan and leaving it one step in eight, each replanning
+// towards their destination: from scratch (incremental = 0) or with a route session (incremental = 1)
+void BM_Replan(benchmark::State& state){
+    Dataset& d = dataset(static_cast<int>(state.range(0)));
+    bool incremental = state.range(1) != 0;
+    const navgraph::CSRAdjacency& adjacency = d.graph->getAdjacency();
+    const size_t trackLength = 64;
+    std::vector<std::pair<int, int>> plans; // source and destination ids
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> node(0, d.graph->numNodes() - 1);
+    while (plans.size() < 16 * trackLength){
+        int src = d.graph->nodeId(node(rng)), dst = d.graph->nodeId(node(rng));
+        if (!d.graph->findRoute(src, dst).found())
+            continue;
+        for (size_t i = 0; i < trackLength; i++){
+            plans.push_back({src, dst});
+            navgraph::Graph::Route route = d.graph->findRoute(src, dst);
+            int next = d.graph->nodeIndex(route.nodeIds[std::min<size_t>(1, route.nodeIds.size() - 1)]);
+            if (rng() % 8 == 0 && adjacency.end(next) > adjacency.begin(next))
+                next = adjacency.neighbors[adjacency.begin(next) + rng() % (adjacency.end(next) - adjacency.begin(next))];
+            src = d.graph->nodeId(next);
+        }
+    }
+    navgraph::AStar astar;
+    std::vector<int> path;
+    uint64_t fullExpanded = 0;
+    for (const auto& p : plans){
+        astar.search(adjacency, d.graph->nodeIndex(p.first), d.graph->nodeIndex(p.second), path);
+        fullExpanded += astar.expandedNodes();
+    }
+
+    navgraph::Graph::RouteSession session;
+    size_t i = 0;
+    uint64_t expanded = 0, count = 0;
+    allocutils::AllocationScope scope;
+    for (auto _ : state){
+        if (incremental){
+            if (i % trackLength == 0)
+                session.reset();
+            benchmark::DoNotOptimize(d.graph->findRoute(session, plans[i].first, plans[i].second));
+            expanded += session.expandedNodes();
+        }
+        else
+            benchmark::DoNotOptimize(d.graph->findRoute(plans[i].first, plans[i].second));
+        count++;
+        i = (i + 1) % plans.size();
+    }
+    reportAllocations(state, scope);
+    if (incremental)
+        state.counters["expanded"] = static_cast<double>(expanded) / std::max<uint64_t>(count, 1);
+    state.counters["full_search_expanded"] = static_cast<double>(fullExpanded) / plans.size();
+    state.SetLabel(d.name);
+}
+BENCHMARK(BM_Replan)->ArgNames({"size", "incremental"})->ArgsProduct({{0, 1000, 4000, 10000}, {0, 1}});
+
+// point to point routes between random nodes of a campus of buildings x buildings buildings of 5
+// floors (see synthetic::CampusSpec): A* with the euclidean heuristic (hierarchy = 0) or through the
+// contraction hierarchy (hierarchy = 1), which is built on first use
+struct Campus{
+    navgraph::CSRAdjacency graph;
+    navgraph::ContractionHierarchy hierarchy;
+    double buildSeconds = 0;
+};
+
+Campus& campus(int buildings){
+    static std::map<int, std::unique_ptr<Campus>> cache;
+    std::unique_ptr<Campus>& slot = cache[buildings];
+    if (!slot){
+        slot.reset(new Campus());
+        synthetic::CampusSpec spec;
+        spec.buildings = buildings;
+        slot->graph = synthetic::campusAdjacency(spec);
+        auto start = std::chrono::steady_clock::now();
+        slot->hierarchy.build(slot->graph);
+        slot->buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return *slot;
+}
+
+void BM_CampusRoute(benchmark::State& state){
+    Campus& c = campus(static_cast<int>(state.range(0)));
+    bool hierarchy = state.range(1) != 0;
+    std::mt19937 rng(17);
+    std::uniform_int_distribution<int> node(0, c.graph.numNodes() - 1);
+    std::vector<std::pair<int, int>> queries(1024);
+    for (auto& q : queries)
+        q = {node(rng), node(rng)};
+    navgraph::AStar astar;
+    navgraph::ContractionHierarchy::Search search;
+    std::vector<int> path;
+    size_t i = 0;
+    uint64_t touched = 0, count = 0;
+    allocutils::AllocationScope scope;
+    for (auto _ : state){
+        const auto& q = queries[i];
+        if (hierarchy){
+            benchmark::DoNotOptimize(c.hierarchy.route(search, q.first, q.second, path));
+            touched += search.settledNodes();
+        }
+        else{
+            benchmark::DoNotOptimize(astar.search(c.graph, q.first, q.second, path));
+            touched += astar.expandedNodes();
+        }
+        count++;
+        i = (i + 1) % queries.size();
+    }
+    reportAllocations(state, scope);
+    state.counters["settled"] = static_cast<double>(touched) / std::max<uint64_t>(count, 1);
+    if (hierarchy)
+        state.counters["build_s"] = c.buildSeconds;
+    state.SetLabel(std::to_string(c.graph.numNodes()) + "nodes");
+}
+BENCHMARK(BM_CampusRoute)->ArgNames({"buildings", "hierarchy"})->ArgsProduct({{3, 6, 12}, {0, 1}});
+
+// ROI labels of recorded positions, one string lookup per position (0) or interned ids in a batch (1)
+void BM_RoiLabel(benchmark::State& state){
+    Dataset& d = dataset(static_cast<int>(state.range(0)));
+    bool batch = state.range(1) != 0;
+    std::vector<int> ids;
+    allocutils::AllocationScope scope;
+    for (auto _ : state){
+        if (batch){
+            d.maps->labelRoiPositions(d.uvQueries, d.floor, ids);
+            benchmark::DoNotOptimize(ids.data());
+        }
+        else{
+            for (const cv::Point2f& uv : d.uvQueries){
+                std::string label = d.maps->getRoiLabelAt(d.maps->uv2pixels(uv, d.floor), d.floor);
+                benchmark::DoNotOptimize(label.data());
+            }
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * d.uvQueries.size()));
+    reportAllocations(state, scope);
+    state.SetLabel(d.name);
+}
+BENCHMARK(BM_RoiLabel)->ArgNames({"size", "batch"})->ArgsProduct({{0, 1000, 4000, 10000}, {0, 1}});
+
+// ROI transitions along a track through the query positions, in segments per second
+void BM_RoiTransitions(benchmark::State& state){
+    Dataset& d = dataset(static_cast<int>(state.range(0)));
+    const size_t trackLength = 64;
+    std::vector<cv::Point2f> track;
+    std::vector<maps::RoiIndex::Transition> transitions;
+    size_t i = 0, found = 0;
+    for (auto _ : state){
+        track.assign(d.uvQueries.begin() + i, d.uvQueries.begin() + i + trackLength);
+        d.maps->getRoiTransitions(track, d.floor, transitions);
+        found += transitions.size();
+        i = (i + trackLength) % (d.uvQueries.size() - trackLength);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * (trackLength - 1)));
+    state.counters["transitions"] = static_cast<double>(found) / std::max<int64_t>(state.iterations(), 1);
+    state.SetLabel(d.name);
+}
+BENCHMARK(BM_RoiTransitions)->Apply(datasetArgs);
+
+void BM_MapManagerInit(benchmark::State& state){
+    Dataset d;
+    locate(static_cast<int>(state.range(0)), d);
+    for (auto _ : state){
+        maps::MapManager mapManager;
+        mapManager.init(d.mapFolder, d.floor);
+        mapManager.preload(d.floor); // rasters are decoded on first use otherwise
+        benchmark::DoNotOptimize(mapManager.getMapSizePixels(d.floor));
+    }
+    state.SetLabel(d.name);
+}
+BENCHMARK(BM_MapManagerInit)->Apply(datasetArgs)->Unit(benchmark::kMillisecond);
+
+// init and decoding of every floor of an 8-floor site, without (0) and with (1) a warm raster cache
+void BM_SiteLoad(benchmark::State& state){
+    const int numFloors = 8;
+    synthetic::GridSpec spec;
+    spec.sizePx = static_cast<int>(state.range(0));
+    std::string folder = synthetic::ensureSite(spec, numFloors, dataRoot());
+    std::string cache = state.range(1) ? dataRoot() + "/raster_cache" : "";
+    auto load = [&](){
+        maps::MapManager mapManager;
+        mapManager.setRasterCache(cache);
+        mapManager.init(folder, 0);
+        mapManager.preloadAll();
+        benchmark::DoNotOptimize(mapManager.residentBytes());
+    };
+    if (!cache.empty())
+        load(); // fills the cache
+    for (auto _ : state)
+        load();
+    state.SetLabel(std::to_string(numFloors) + "x" + std::to_string(spec.sizePx) + "px");
+}
+BENCHMARK(BM_SiteLoad)->ArgNames({"size", "cache"})->ArgsProduct({{1000, 4000}, {0, 1}})->Unit(benchmark::kMillisecond);
+
+void BM_ParseFeatures(benchmark::State& state){
+    std::string text = synthetic::featuresText(static_cast<int>(state.range(0)));
+    size_t parsed = 0;
+    for (auto _ : state){
+        std::multimap<maps::FeatureType, maps::MapFeature> features;
+        maps::parseFeatures(text.data(), text.size(), features);
+        parsed = features.size();
+        benchmark::DoNotOptimize(parsed);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * text.size()));
+    state.counters["features"] = static_cast<double>(parsed);
+}
+BENCHMARK(BM_ParseFeatures)->ArgName("markers")->Arg(1000)->Arg(30000)->Unit(benchmark::kMicrosecond);
+
+void BM_GraphConstructor(benchmark::State& state){
+    Dataset& d = dataset(static_cast<int>(state.range(0)));
+    for (auto _ : state){
+        navgraph::Graph graph(d.graphFile, d.maps);
+        benchmark::DoNotOptimize(graph.numNodes());
+    }
+    state.SetLabel(d.name);
+}
+BENCHMARK(BM_GraphConstructor)->Apply(datasetArgs)->Unit(benchmark::kMillisecond);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -10,10 +10,28 @@
 #define Graph_h
 
 #include "opencv2/core/core.hpp"
-#include <opencv2/highgui/highgui.hpp>
-#include "rapidjson/document.h"
+#include <opencv2/imgproc.hpp>
+#include "Maps/MapManager.hpp"
+#include "Routing/CSRAdjacency.hpp"
+#include "Routing/AStar.hpp"
+#include "Routing/IncrementalPlanner.hpp"
+#include "Routing/DistanceTable.hpp"
+#include "Routing/ContractionHierarchy.hpp"
+#include "Routing/GeodesicFields.hpp"
+#include "Spatial/SegmentGrid.hpp"
+#include "IO/CompiledGraph.hpp"
+#include "IO/GraphJsonReader.hpp"
+#include "Utils/Snapshot.hpp"
+#include "Utils/Metrics.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <fstream>
 #include <map>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <stdexcept>
 
 namespace navgraph{
     
@@ -29,6 +47,21 @@ public:
         cv::Point3f lineCoeffs_cab;
     };
     
+    // what the query paths need to know about a node, kept contiguously by dense node index
+    struct NodeGeometry{
+        cv::Point2f positionUV;
+        int floor;
+        NodeType type;
+        bool isDoor;
+    };
+    
+    // descriptive fields of a node, kept apart from the geometry
+    struct NodeInfo{
+        std::string label;
+        std::string comments;
+    };
+    
+    // a node as read from the json file, only used while loading
     struct Node{
         //  int id;
         NodeType type;
@@ -40,109 +73,550 @@ public:
         std::map<int, Edge> edges;
     };
     
+    struct Route{
+        std::vector<int> nodeIds; // from source to destination, both included
+        float length;             // sum of the edge lengths, negative if there is no route
+        uint64_t version;         // version() of the graph the route was computed on
+        
+        inline bool found() const { return length >= 0; }
+    };
+    
+    // an edge between nodes on two different floors (stairs, elevators), by dense node index
+    struct LinkEdge{
+        int from;
+        int to;
+        float length;
+    };
+    
+    struct SnapResult{
+        cv::Point2f position; // snapped u,v position, the input position if nothing could be snapped to
+        int edge;             // index of the edge segment (see getEdgeSegment), -1 if not snapped
+        float t;              // position along the edge, 0 at the segment's first node and 1 at the second
+    };
+    
+    // State of one track of positions for snapTracked, e.g. one user. A session follows one graph and
+    // the copies made of it (a change to the graph or a different graph resets it) and is not meant to
+    // be shared between threads.
+    struct SnapSession{
+        // counters since the session was created: fixes answered from the neighbourhood of the last
+        // edge, fixes that needed the search over the whole floor, and point to segment tests in the former
+        uint64_t hits = 0;
+        uint64_t fallbacks = 0;
+        uint64_t segmentTests = 0;
+        
+        inline void reset() { edge = -1; structure = 0; walls.reset(); }
+        inline int lastEdge() const { return edge; }
+        inline float lastT() const { return t; }
+        
+    private:
+        friend class Graph;
+        uint64_t structure = 0;        // structure id of the graph the indices below refer to, 0 if none
+        uint64_t version = 0;
+        int floor = 0;
+        int edge = -1;                 // last snapped segment, -1 if none
+        float t = 0;
+        std::vector<int> neighbourhood; // the last segment and those sharing a node with it
+        cv::Point2f anchor;            // position of the last full search
+        float clearance = 0;           // distance from anchor to the nearest segment outside the neighbourhood
+        std::shared_ptr<const maps::AnnotatedMap> walls; // floor map, held while the track stays on the floor
+        std::vector<SegmentGrid::Candidate> candidates;
+    };
+    
+    // Search state of one user's route for findRoute(RouteSession&, ...): the tree towards the
+    // destination is kept and only repaired when the user moves off it or edges change. A session
+    // follows one graph and the copies made of it for runtime changes (see SharedGraph); loading
+    // another graph, moving nodes or a new destination start the search over. Not meant to be
+    // shared between threads.
+    struct RouteSession{
+        // counters since the session was created: plans, plans that had to start over, nodes expanded
+        uint64_t plans = 0;
+        uint64_t fullSearches = 0;
+        uint64_t expandedTotal = 0;
+        
+        inline void reset() { structure = 0; }
+        // nodes expanded by the last plan
+        inline int expandedNodes() const { return planner.expandedNodes(); }
+        
+    private:
+        friend class Graph;
+        uint64_t structure = 0; // structure id of the graph the tree was built on, 0 if none
+        uint64_t version = 0;   // version() whose weights the tree reflects
+        IncrementalPlanner planner;
+    };
+    
+    struct DestinationDistance{
+        int nodeId;
+        float length; // route length, infinity if the destination cannot be reached
+    };
+    
     
     Graph() { ; }
-    Graph(std::string jsonFileName, std::shared_ptr<maps::MapManager> mapManager){
-        rapidjson::Document document;
-        _mapManager = mapManager;
-        std::ifstream infile(jsonFileName);
-        std::string json((std::istreambuf_iterator<char>(infile)),
-                         std::istreambuf_iterator<char>());
-        document.Parse(json.c_str());
-        _parseGraphMatrices(document);
-        _parseNodes(document);
-        _computeLinesCoeffs();
+    // throws std::runtime_error if the json file cannot be read or parsed
+    Graph(std::string jsonFileName, std::shared_ptr<const maps::MapManager> mapManager){
+        std::string error;
+        if (!_loadJson(jsonFileName, mapManager, error))
+            throw std::runtime_error("Graph: cannot parse " + jsonFileName + ": " + error);
+    }
+
+    // Loads a json graph (see IO/GraphJsonReader.hpp) as the constructor does, but reports a file that
+    // cannot be read or parsed by returning false. Whatever the graph held is replaced, its distance
+    // table, geodesic fields and hierarchy included; on failure the graph is left as it was.
+    bool loadJson(const std::string& jsonFileName, std::shared_ptr<const maps::MapManager> mapManager){
+        std::string error;
+        if (!_loadJson(jsonFileName, mapManager, error)){
+            std::cerr << "Graph: cannot parse " << jsonFileName << ": " << error << std::endl;
+            return false;
+        }
+        return true;
+    }
+    
+    // Writes the graph in the binary format of IO/CompiledGraph.hpp, together with the scale and
+    // size of the floor maps the u,v positions were computed with. Closed nodes and edges stay
+    // closed when the file is loaded back.
+    bool saveCompiled(const std::string& fileName) const {
+        std::vector<compiled::FloorRecord> floors;
+        for (const auto& f : _floorNodes){
+            cv::Size size = _mapManager->getMapSizePixels(f.first);
+            floors.push_back({f.first, static_cast<float>(_mapManager->getScale(f.first)), size.width, size.height});
+        }
+        size_t n = _nodeGeometry.size();
+        std::vector<int32_t> floorsOfNodes(n), types(n);
+        std::vector<float> positions(2 * n);
+        std::vector<uint8_t> doors(n);
+        std::vector<uint32_t> stringOffsets(1, 0);
+        std::string strings;
+        for (size_t i = 0; i < n; i++){
+            floorsOfNodes[i] = _nodeGeometry[i].floor;
+            types[i] = _nodeGeometry[i].type;
+            positions[2*i] = _nodeGeometry[i].positionUV.x;
+            positions[2*i+1] = _nodeGeometry[i].positionUV.y;
+            doors[i] = _nodeGeometry[i].isDoor ? 1 : 0;
+            strings += _nodeInfo[i].label;
+            stringOffsets.push_back(static_cast<uint32_t>(strings.size()));
+            strings += _nodeInfo[i].comments;
+            stringOffsets.push_back(static_cast<uint32_t>(strings.size()));
+        }
         
+        compiled::Writer writer;
+        writer.addSection(compiled::FLOORS, floors.data(), floors.size());
+        writer.addSection(compiled::NODE_IDS, _indexToId.data(), n);
+        writer.addSection(compiled::NODE_FLOORS, floorsOfNodes.data(), n);
+        writer.addSection(compiled::POSITIONS, positions.data(), positions.size());
+        writer.addSection(compiled::NODE_TYPES, types.data(), n);
+        writer.addSection(compiled::NODE_DOORS, doors.data(), n);
+        writer.addSection(compiled::EDGE_OFFSETS, _adjacency.offsets.data(), _adjacency.offsets.size());
+        writer.addSection(compiled::NEIGHBORS, _adjacency.neighbors.data(), _adjacency.neighbors.size());
+        writer.addSection(compiled::WEIGHTS, _edgeLength.data(), _edgeLength.size());
+        writer.addSection(compiled::ANGLES, _edgeAngles.data(), _edgeAngles.size());
+        writer.addSection(compiled::STRING_OFFSETS, stringOffsets.data(), stringOffsets.size());
+        writer.addSection(compiled::STRINGS, strings.data(), strings.size());
+        writer.addSection(compiled::NODE_ENABLED, _nodeEnabled.data(), _nodeEnabled.size());
+        writer.addSection(compiled::EDGE_ENABLED, _edgeEnabled.data(), _edgeEnabled.size());
+        // the distance table is only saved if it matches the saved lengths
+        bool saveDistances = !_distancesStale && std::all_of(_edgeEnabled.begin(), _edgeEnabled.end(), [](char e){ return e != 0; }) &&
+                             std::all_of(_nodeEnabled.begin(), _nodeEnabled.end(), [](char e){ return e != 0; });
+        DistanceTable noDistances;
+        const DistanceTable& distances = saveDistances ? *_distances : noDistances;
+        writer.addSection(compiled::DIST_TARGETS, distances.targets().data(), distances.targets().size());
+        writer.addSection(compiled::DIST_TABLE, distances.table().data(), distances.table().size());
+        writer.addSection(compiled::LANDMARKS, distances.landmarks().data(), distances.landmarks().size());
+        writer.addSection(compiled::FROM_LANDMARK, distances.fromLandmark().data(), distances.fromLandmark().size());
+        writer.addSection(compiled::TO_LANDMARK, distances.toLandmark().data(), distances.toLandmark().size());
+        return writer.write(fileName, static_cast<uint32_t>(floors.size()), static_cast<uint32_t>(n),
+                            static_cast<uint32_t>(_adjacency.numEdges()));
+    }
+    
+    // Loads a graph written by saveCompiled: the file is memory mapped, validated and its arrays copied
+    // as they are. Fails if the maps loaded by mapManager differ from the ones the graph was compiled with.
+    // The header and section table are always checked; verifyChecksum also hashes the whole file, which
+    // costs more than the rest of the load on large graphs and is meant for files of unknown origin.
+    // On failure the graph is left as it was.
+    bool loadCompiled(const std::string& fileName, std::shared_ptr<const maps::MapManager> mapManager, bool verifyChecksum = false){
+        GRAPHNAV_METRIC_TIMER(GRAPH_LOAD_LATENCY);
+        GRAPHNAV_METRIC_ADD(GRAPH_LOADS, 1);
+        compiled::Reader reader;
+        std::string error;
+        std::vector<char> nodeEnabled, edgeEnabled;
+        if (!reader.open(fileName, verifyChecksum, error) || !_loadCompiledArrays(reader, *mapManager, nodeEnabled, edgeEnabled, error)){
+            std::cerr << "Graph: cannot load " << fileName << ": " << error << std::endl;
+            return false;
+        }
+        _mapManager = mapManager;
+        _geodesic = std::make_shared<GeodesicFields>();
+        _hierarchy = std::make_shared<ContractionHierarchy>();
+        _buildDerivedData();
+        _restoreEnabled(nodeEnabled, edgeEnabled);
+        std::string hierarchyFile = hierarchyFileName(fileName);
+        if (std::ifstream(hierarchyFile).good())
+            loadHierarchy(hierarchyFile);
+        return true;
+    }
+    
+    // Builds a contraction hierarchy over the edge lengths (see Routing/ContractionHierarchy.hpp) on
+    // numThreads threads, 0 for one per core. findRoute then uses it as long as no edge is shorter than
+    // it was at build time, and no edge that is longer or disabled lies on the route it finds. Meant to
+    // be built offline, e.g. by compile_graph, and saved next to the compiled graph.
+    void buildHierarchy(int numThreads = 0){
+        CSRAdjacency lengths = _adjacency;
+        lengths.weights = _edgeLength;
+        std::shared_ptr<ContractionHierarchy> hierarchy = std::make_shared<ContractionHierarchy>();
+        hierarchy->build(lengths, numThreads);
+        _hierarchy = hierarchy;
+        _countHierarchyChanges();
+    }
+    
+    bool saveHierarchy(const std::string& fileName) const { return _hierarchy->save(fileName); }
+    
+    // loaded by loadCompiled too when it is next to the compiled graph, see hierarchyFileName
+    bool loadHierarchy(const std::string& fileName){
+        std::shared_ptr<ContractionHierarchy> hierarchy = std::make_shared<ContractionHierarchy>();
+        std::string error;
+        if (!hierarchy->load(fileName, _adjacency, error)){
+            std::cerr << "Graph: cannot load " << fileName << ": " << error << std::endl;
+            return false;
+        }
+        _hierarchy = hierarchy;
+        _countHierarchyChanges();
+        return true;
     }
     
+    static std::string hierarchyFileName(const std::string& compiledGraphFileName) { return compiledGraphFileName + ".ch"; }
+    
+    inline const ContractionHierarchy& getHierarchy() const { return *_hierarchy; }
+    
     void _computeLinesCoeffs(){
-        for (auto &n : _nodes){
-            cv::Point3f n1Pos(1, n.second.positionUV.y, n.second.positionUV.x);
-            for (auto &e : _nodes[n.first].edges){
-                cv::Point3f n2Pos(1, _nodes[e.first].positionUV.y, _nodes[e.first].positionUV.x);
-                e.second.lineCoeffs_cab = n1Pos.cross(n2Pos);
+        _edgeLineCoeffs.resize(_adjacency.numEdges());
+        for (int i = 0; i < _adjacency.numNodes(); i++)
+            for (int k = _adjacency.begin(i); k < _adjacency.end(i); k++)
+                _computeLineCoeffs(i, k);
+    }
+    
+    // Precomputes route lengths (see Routing/DistanceTable.hpp): to every node for graphs of up to
+    // maxFullTableNodes nodes, to the Destination nodes only for larger ones, and from/to numLandmarks
+    // landmarks. Runs on numThreads threads, 0 for one per core. Saved and loaded with the compiled graph.
+    void buildDistanceTable(int maxFullTableNodes = 2048, int numLandmarks = 16, int numThreads = 0){
+        std::vector<int> targets;
+        for (int i = 0; i < numNodes(); i++)
+            if (numNodes() <= maxFullTableNodes || _nodeGeometry[i].type == Destination)
+                targets.push_back(i);
+        std::shared_ptr<DistanceTable> distances = std::make_shared<DistanceTable>();
+        distances->build(_adjacency, targets, numLandmarks, numThreads);
+        _distances = distances;
+        _distancesStale = false;
+        _indexDestinations();
+    }
+    
+    inline const DistanceTable& getDistanceTable() const { return *_distances; }
+    
+    // route length from a u,v position to every Destination node, without any search: the position is
+    // snapped to an edge and the lengths read from the distance table through the edge's two nodes.
+    // Returns false if the position cannot be snapped or the table has not been built, or is out of
+    // date because of changes to the graph.
+    bool getDistancesToDestinations(cv::Point2f uvpos, int floor, std::vector<DestinationDistance>& out) const {
+        out.clear();
+        SnapResult res;
+        if (_distances->empty() || _distancesStale || !_floorGrids.count(floor) ||
+            !_snap(uvpos, floor, _mapManager->getMap(floor).get(), res))
+            return false;
+        const Segment& s = _segments[res.edge];
+        const float inf = std::numeric_limits<float>::infinity();
+        float w21 = _edgeWeight(s.n2, s.n1), w12 = _edgeWeight(s.n1, s.n2);
+        float toN1 = (w21 < inf) ? res.t * w21 : inf;
+        float toN2 = (w12 < inf) ? (1.f - res.t) * w12 : inf;
+        const float* d1 = _distances->distancesFrom(s.n1);
+        const float* d2 = _distances->distancesFrom(s.n2);
+        out.reserve(_destinations.size());
+        for (const auto& d : _destinations)
+            out.push_back({_indexToId[d.first], std::min(toN1 + d1[d.second], toN2 + d2[d.second])});
+        return true;
+    }
+    
+    // Builds a geodesic distance field over the walkable space for every Destination node (see
+    // Routing/GeodesicFields.hpp), on cells of cellPx x cellPx pixels and numThreads threads (0: one
+    // per core). Slow on large floors: on a graph shared between threads, build them on a copy and
+    // publish it through a SharedGraph.
+    void buildGeodesicFields(int cellPx = 2, int numThreads = 0){
+        std::vector<GeodesicFields::Source> sources;
+        for (int i = 0; i < numNodes(); i++)
+            if (_nodeGeometry[i].type == Destination)
+                sources.push_back({i, _nodeGeometry[i].floor, _nodeGeometry[i].positionUV});
+        std::shared_ptr<GeodesicFields> fields = std::make_shared<GeodesicFields>();
+        fields->build(*_mapManager, sources, cellPx, numThreads);
+        _geodesic = fields;
+    }
+    
+    inline const GeodesicFields& getGeodesicFields() const { return *_geodesic; }
+    
+    // walking distance (meters) from a u,v position to a Destination node through the walkable space,
+    // and the direction of the first step, with one lookup in the node's geodesic field. Returns false
+    // if the node has no field, has been moved or disabled since it was built, or cannot be reached.
+    // Doors closed in the graph are not walls to the field.
+    bool getGeodesicDistance(cv::Point2f uvpos, int floor, int destinationId, GeodesicFields::Lookup& out) const {
+        int idx = nodeIndex(destinationId);
+        int slot = (idx >= 0) ? _geodesic->fieldSlot(idx) : -1;
+        if (slot < 0 || !_nodeEnabled[idx] || _geodesic->source(slot).uv != _nodeGeometry[idx].positionUV)
+            return false;
+        return _geodesic->lookup(uvpos, floor, slot, out);
+    }
+    
+    // Runtime changes, e.g. closing a door or a corridor for maintenance. A disabled edge, or an edge
+    // of a disabled node, is never routed through, and is not snapped to if closed in both directions.
+    // Only what depends on the changed nodes and edges is recomputed, and every change bumps version().
+    // They return false if the nodes or the edge do not exist, setEdgeLength also if the length is
+    // negative or not finite.
+    // The query methods are const and can run concurrently; these cannot. With a graph shared between
+    // threads, apply them to a copy and publish it through a SharedGraph (see below).
+    bool setEdgeEnabled(int fromId, int toId, bool enabled, bool bothDirections = true){
+        return _updateEdge(fromId, toId, bothDirections, [this, enabled](int k){ _edgeEnabled[k] = enabled; });
+    }
+    
+    bool setEdgeLength(int fromId, int toId, float length, bool bothDirections = true){
+        if (!std::isfinite(length) || length < 0)
+            return false;
+        return _updateEdge(fromId, toId, bothDirections, [this, length](int k){ _edgeLength[k] = length; });
+    }
+    
+    bool setNodeEnabled(int nodeId, bool enabled){
+        int idx = nodeIndex(nodeId);
+        if (idx < 0)
+            return false;
+        _regridNodeSegments(idx, [&](){
+            _nodeEnabled[idx] = enabled;
+            for (int k = _adjacency.begin(idx); k < _adjacency.end(idx); k++)
+                _refreshEdge(k);
+            for (int k = _inOffsets[idx]; k < _inOffsets[idx+1]; k++)
+                _refreshEdge(_inSlots[k]);
+        });
+        _version++;
+        return true;
+    }
+    
+    // moves a node, updating the line coefficients and snapping segments of its edges
+    bool setNodePosition(int nodeId, cv::Point2f uvpos){
+        int idx = nodeIndex(nodeId);
+        if (idx < 0)
+            return false;
+        _regridNodeSegments(idx, [&](){
+            _nodeGeometry[idx].positionUV = uvpos;
+            _adjacency.positions[idx] = uvpos;
+            for (int k = _adjacency.begin(idx); k < _adjacency.end(idx); k++)
+                _refreshEdge(k);
+            for (int k = _inOffsets[idx]; k < _inOffsets[idx+1]; k++)
+                _refreshEdge(_inSlots[k]);
+            for (int k = _nodeSegmentOffsets[idx]; k < _nodeSegmentOffsets[idx+1]; k++){
+                Segment& s = _segments[_nodeSegments[k]];
+                if (s.n1 == idx) s.p1 = uvpos;
+                if (s.n2 == idx) s.p2 = uvpos;
             }
+        });
+        _logChange(-1);
+        _version++;
+        return true;
+    }
+    
+    inline bool isNodeEnabled(int nodeId) const { int idx = nodeIndex(nodeId); return idx >= 0 && _nodeEnabled[idx]; }
+    
+    inline bool isEdgeEnabled(int fromId, int toId) const {
+        int k = _edgeSlot(nodeIndex(fromId), nodeIndex(toId));
+        return k >= 0 && _adjacency.weights[k] != std::numeric_limits<float>::infinity();
+    }
+    
+    // incremented by every change of the graph
+    inline uint64_t version() const { return _version; }
+    
+    // shortest path between two node ids: through the contraction hierarchy when it is built and still
+    // applies (see buildHierarchy), A* over the CSR adjacency otherwise. The A* heuristic is the
+    // euclidean distance, or when the distance table is built the exact distance to dst if it is one
+    // of its targets, the landmark lower bound otherwise.
+    Route findRoute(int srcId, int dstId) const {
+        Route route;
+        route.length = -1;
+        route.version = _version;
+        auto src = _idToIndex.find(srcId);
+        auto dst = _idToIndex.find(dstId);
+        if (src == _idToIndex.end() || dst == _idToIndex.end())
+            return route;
+        
+        if (_hierarchyShorter == 0 && !_hierarchy->empty() && _routeFromHierarchy(src->second, dst->second, route))
+            return route;
+        
+        static thread_local AStar astar;
+        static thread_local std::vector<int> path;
+        int dstIdx = dst->second;
+        const DistanceTable& distances = *_distances;
+        int slot = distances.empty() ? -1 : distances.targetSlot(dstIdx);
+        if (slot >= 0){
+            if (distances.distance(src->second, slot) == std::numeric_limits<float>::infinity())
+                return route;
+            route.length = astar.search(_adjacency, src->second, dstIdx, path, [&distances, slot](int v){
+                return distances.distance(v, slot);
+            });
         }
+        else if (!distances.empty()){
+            route.length = astar.search(_adjacency, src->second, dstIdx, path, [this, &distances, dstIdx](int v){
+                return std::max(_adjacency.heuristic(v, dstIdx), distances.lowerBound(v, dstIdx));
+            });
+        }
+        else
+            route.length = astar.search(_adjacency, src->second, dstIdx, path);
+        route.nodeIds.reserve(path.size());
+        for (int idx : path)
+            route.nodeIds.push_back(_indexToId[idx]);
+        return route;
     }
     
-    // note: uvpos.y is the ascissa, .x the ordinate
-    cv::Point2f snapUV2Graph(cv::Point2f uvpos, int floor, bool checkWalls = false){
-        float minDist = 1e6;
-        int id = -1;
-        int minId = -1;
-        cv::Point2f minpos;
-        for (auto& n : _nodes){
-            for (auto& e : n.second.edges){
-                cv::Point2f pt = projectPointToGraph(n.second, _nodes[e.first], uvpos);
-                if (!_mapManager->isPathCrossingWalls(_mapManager->uv2pixels(uvpos), _mapManager->uv2pixels(pt))){
-                    cv::Point2f diff = uvpos - pt;
-                    float d = (diff.x*diff.x + diff.y*diff.y);
-    //                float d = cv::abs((uvpos.y * e.second.lineCoeffs_cab.y + uvpos.x * e.second.lineCoeffs_cab.z + e.second.lineCoeffs_cab.x)) /
-    //                cv::sqrt(e.second.lineCoeffs_cab.y*e.second.lineCoeffs_cab.y + e.second.lineCoeffs_cab.z*e.second.lineCoeffs_cab.z);
-                    if (d < minDist){
-                        minDist = d;
-                        minId = e.first;
-                        id = n.first;
-                        minpos = pt;
-                    }
-                }
+    // Same, repairing the search tree of the session instead of starting from scratch: after the
+    // user leaves the route or an edge changes, only the part of the tree that depends on it is
+    // expanded again (D* Lite). session.expandedNodes() gives the work done by the call.
+    Route findRoute(RouteSession& session, int srcId, int dstId) const {
+        Route route;
+        route.length = -1;
+        route.version = _version;
+        int src = nodeIndex(srcId), dst = nodeIndex(dstId);
+        if (src < 0 || dst < 0)
+            return route;
+        
+        IncrementalPlanner& planner = session.planner;
+        bool fresh = session.structure != _structureId || planner.goal() != dst
+                  || planner.heuristicScale() != _adjacency.heuristicScale || session.version < _changeLogFloor;
+        if (!fresh && session.version != _version){
+            auto first = std::upper_bound(_changeLog.begin(), _changeLog.end(), session.version,
+                                          [](uint64_t v, const std::pair<uint64_t, int>& e){ return v < e.first; });
+            for (auto it = first; it != _changeLog.end() && !fresh; ++it){
+                if (it->second < 0)
+                    fresh = true;
+                else
+                    planner.edgeChanged(it->second);
             }
         }
-        if (minId > -1 && id > -1)
-            return minpos;
+        if (fresh){
+            planner.reset(_adjacency, dst);
+            session.structure = _structureId;
+            session.fullSearches++;
+        }
+        session.version = _version;
+        
+        static thread_local std::vector<int> path;
+        InEdges in = {_inOffsets.data(), _inSlots.data(), _slotSource.data()};
+        route.length = planner.plan(_adjacency, in, src, path);
+        session.plans++;
+        session.expandedTotal += planner.expandedNodes();
+        GRAPHNAV_METRIC_ADD(ROUTE_PLANS, 1);
+        GRAPHNAV_METRIC_ADD(ROUTE_EXPANDED, planner.expandedNodes());
+        route.nodeIds.reserve(path.size());
+        for (int idx : path)
+            route.nodeIds.push_back(_indexToId[idx]);
+        return route;
+    }
+    
+    inline const CSRAdjacency& getAdjacency() const { return _adjacency; }
+    inline int nodeIndex(int nodeId) const { auto it = _idToIndex.find(nodeId); return it != _idToIndex.end() ? it->second : -1; }
+    inline int nodeId(int nodeIdx) const { return _indexToId[nodeIdx]; }
+    
+    // note: uvpos.y is the ascissa, .x the ordinate. With checkWalls, edges behind a wall are skipped
+    cv::Point2f snapUV2Graph(cv::Point2f uvpos, int floor, bool checkWalls = true) const {
+        SnapResult res;
+        if (_floorGrids.count(floor)){
+            std::shared_ptr<const maps::AnnotatedMap> walls;
+            if (checkWalls)
+                walls = _mapManager->getMap(floor);
+            _snap(uvpos, floor, walls.get(), res);
+        }
         else
-            return uvpos;
-    }
-    
-    //adapted from http://www.alecjacobson.com/weblog/?p=1486
-    cv::Point2f projectPointToGraph(Node n1, Node n2, cv::Point2f pt){
-        cv::Point2f p1 = n1.positionUV;
-        cv::Point2f p2 = n2.positionUV;
-        // vector from p1 to p2
-        cv::Point2f diff = p2 - p1;
-        float diff_squared = diff.dot(diff);
-        if (diff_squared == 0)
-            return p1;
-        else{
-            //vector from A to p
-            cv::Point2f n1toPt = pt - p1;
-            //  from http://stackoverflow.com/questions/849211/
-            //  Consider the line extending the segment, parameterized as A + t (B - A)
-            //  We find projection of point p onto the line.
-            //  It falls where t = [(pt-n1) . (n2-n1)] / |n2-n1|^2
-            float t = n1toPt.dot(diff)/diff_squared;
-            if (t < 0.0)
-                //  "Before" p1 on the line, just return p1
-                return p1;
-            else if (t > 1.)
-                // "After" p2 on the line, just return p2
-                return p2;
-            else
-                return p1 + t * diff;
-        }
-    }
-    
-    
-    cv::Mat plotGraph(int floor, bool pause = false){
+            res.position = uvpos;
+        return res.position;
+    }
+    
+    // snaps count positions at once, results are written to out[0 ... count-1]
+    void snapBatch(const cv::Point2f* uvpos, size_t count, int floor, SnapResult* out, bool checkWalls = true) const {
+        // the floor map is looked up once for the whole batch
+        std::shared_ptr<const maps::AnnotatedMap> walls;
+        if (checkWalls && _floorGrids.count(floor))
+            walls = _mapManager->getMap(floor);
+        for (size_t i = 0; i < count; i++)
+            _snap(uvpos[i], floor, walls.get(), out[i]);
+    }
+    
+    inline void snapBatch(const std::vector<cv::Point2f>& uvpos, int floor, std::vector<SnapResult>& out, bool checkWalls = true) const {
+        out.resize(uvpos.size());
+        snapBatch(uvpos.data(), uvpos.size(), floor, out.data(), checkWalls);
+    }
+    
+    // Snaps the next position of a track, with the same result as snapBatch. Successive fixes of a
+    // track move little, so the segments sharing a node with the last snapped one are tried first:
+    // their answer stands if it is closer than the remaining clearance, i.e. the distance from the
+    // position of the last full search to the nearest other segment, minus how far the track has moved
+    // since. The search over the whole floor only runs when that fails (the track moved on or left).
+    SnapResult snapTracked(SnapSession& session, cv::Point2f uvpos, int floor, bool checkWalls = true) const {
+        GRAPHNAV_METRIC_TIMER(TRACKED_SNAP_LATENCY);
+        SnapResult res;
+        if (session.structure != _structureId || session.version != _version || session.floor != floor){
+            session.reset();
+            session.structure = _structureId;
+            session.version = _version;
+            session.floor = floor;
+        }
+        if (checkWalls && !session.walls && _floorGrids.count(floor))
+            session.walls = _mapManager->getMap(floor);
+        const maps::AnnotatedMap* walls = checkWalls ? session.walls.get() : nullptr;
+        if (session.edge >= 0 && _snapNeighbourhood(session, uvpos, walls, res)){
+            session.hits++;
+            GRAPHNAV_METRIC_ADD(TRACKED_HITS, 1);
+            GRAPHNAV_METRIC_ADD(SNAPS, 1);
+            return res;
+        }
+        session.fallbacks++;
+        GRAPHNAV_METRIC_ADD(TRACKED_FALLBACKS, 1);
+        session.edge = -1;
+        if (!_snap(uvpos, floor, walls, res))
+            return res;
+        _enterNeighbourhood(session, uvpos, floor, res);
+        return res;
+    }
+    
+    inline const Segment& getEdgeSegment(int edge) const { return _segments[edge]; }
+    
+    inline const NodeGeometry& getNodeGeometry(int nodeIdx) const { return _nodeGeometry[nodeIdx]; }
+    inline const NodeInfo& getNodeInfo(int nodeIdx) const { return _nodeInfo[nodeIdx]; }
+    inline int numNodes() const { return static_cast<int>(_nodeGeometry.size()); }
+    
+    // dense indices of the nodes on a floor are the contiguous range [first, second)
+    inline std::pair<int, int> getFloorNodeRange(int floor) const {
+        auto it = _floorNodes.find(floor);
+        return (it != _floorNodes.end()) ? it->second : std::make_pair(0, 0);
+    }
+    
+    inline const std::vector<LinkEdge>& getLinkEdges() const { return _linkEdges; }
+    
+    // projection of pt on the edge between two nodes, given by dense index
+    inline cv::Point2f projectPointToGraph(int n1Idx, int n2Idx, cv::Point2f pt) const {
+        float t;
+        return projectPointToSegment(_nodeGeometry[n1Idx].positionUV, _nodeGeometry[n2Idx].positionUV, pt, t);
+    }
+    
+    inline cv::Point2f projectPointToGraph(const Node& n1, const Node& n2, cv::Point2f pt) const {
+        float t;
+        return projectPointToSegment(n1.positionUV, n2.positionUV, pt, t);
+    }
+    
+    
+    cv::Mat plotGraph(int floor) const {
         // plot graph relative to the specified floor
-        cv::Mat map = _mapManager->getWallsImageRGB();
-        for (const auto& n : _nodes ){
-            if (n.second.floor == floor){
-                cv::Point2i pt = _mapManager->uv2pixels(n.second.positionUV);
-                cv::circle(map, cv::Point2i(pt.y, pt.x), 3, getNodeColor(n.second.type));
-            }
+        cv::Mat map = _mapManager->getWallsImageRGB(floor).clone();
+        std::pair<int, int> range = getFloorNodeRange(floor);
+        for (int i = range.first; i < range.second; i++){
+            const NodeGeometry& n = _nodeGeometry[i];
+            cv::Point2i pt = _mapManager->uv2pixels(n.positionUV, floor);
+            cv::circle(map, cv::Point2i(pt.y, pt.x), 3, getNodeColor(n.type));
         }
-//        cv::imshow("Graph floor " + std::to_string(floor), map);
-//        if (pause)
-//            cv::waitKey(-1);
         return map;
     }
     
-    inline cv::Point2f toUVOrigin(cv::Point2f uv){ //sets origin in lower left corner
-        return cv::Point2f(uv.x, _mapManager->getMapSizePixels().height - uv.y);
+    inline cv::Point2f toUVOrigin(cv::Point2f uv, int floor) const { //sets origin in lower left corner
+        return cv::Point2f(uv.x, _mapManager->getMapSizePixels(floor).height - uv.y);
     }
     
-    cv::Scalar getNodeColor(NodeType type){
+    cv::Scalar getNodeColor(NodeType type) const {
         switch (type){
             case NodeType::Control:
                 return cv::Scalar(0,255,0);
@@ -156,118 +630,694 @@ public:
     }
     
     
-    void showClosestNodeToPoint(int floor, bool checkWalls = false){
-        cv::Mat map = plotGraph(floor);
-        cv::namedWindow("graph");
-        cv::Point2i pt;
-        cv::setMouseCallback( "graph", onMouse, &pt );
+    // closest enabled node; with checkWalls, only nodes in sight of pos (no wall on the straight line
+    // to them) are considered
+    int findClosestNodeId(cv::Point2f pos, int floor, bool checkWalls = false) const {
+        int id = -1;
+        float minDist = 1e6;
+        float d;
+        std::pair<int, int> range = getFloorNodeRange(floor);
+        std::shared_ptr<const maps::AnnotatedMap> walls;
+        if (checkWalls && range.first < range.second)
+            walls = _mapManager->getMap(floor);
+        for (int i = range.first; i < range.second; i++){
+            if (!_nodeEnabled[i])
+                continue;
+            cv::Point2f diff = pos - _nodeGeometry[i].positionUV;
+            d = (diff.x*diff.x + diff.y*diff.y);
+            if (d < minDist && (!walls || !walls->isPathCrossingWalls(walls->uv2pixels(pos), walls->uv2pixels(_nodeGeometry[i].positionUV)))){
+                minDist = d;
+                id = _indexToId[i];
+            }
+        }
+        return id;
+    }
+    
+private:
+    std::shared_ptr<const maps::MapManager> _mapManager;
+    
+    // nodes by dense index, sorted by floor, and their edges in CSR order
+    std::vector<int> _indexToId;
+    std::vector<NodeGeometry> _nodeGeometry; // hot, used by the query paths
+    std::vector<NodeInfo> _nodeInfo;         // cold
+    CSRAdjacency _adjacency;
+    std::vector<float> _edgeAngles;          // by CSR slot, like _adjacency.weights
+    
+    // runtime state: _adjacency.weights holds _edgeLength, or infinity for the edges that are disabled
+    // or have a disabled node
+    std::vector<float> _edgeLength;
+    std::vector<char> _edgeEnabled;
+    std::vector<char> _nodeEnabled;
+    uint64_t _version = 0;
+    
+    // edge weight changes for the route sessions, as (version they appear in, CSR slot), slot -1 when
+    // the session trees cannot be repaired (a node moved). Complete for the versions above
+    // _changeLogFloor; halved when it gets longer than _MAX_CHANGE_LOG. _structureId changes when the
+    // nodes and edges themselves do, and is kept by the copies of the graph.
+    std::vector<std::pair<uint64_t, int>> _changeLog;
+    uint64_t _changeLogFloor = 0;
+    uint64_t _structureId = 0;
+    static const size_t _MAX_CHANGE_LOG = 4096;
+    
+    // derived from the above by _buildDerivedData
+    std::unordered_map<int, int> _idToIndex;
+    std::map<int, std::pair<int, int>> _floorNodes; // floor -> range of dense indices
+    std::vector<LinkEdge> _linkEdges;
+    std::vector<cv::Point3f> _edgeLineCoeffs; // by CSR slot
+    std::vector<int> _slotSource;            // node each CSR slot leaves from
+    std::vector<int> _inOffsets, _inSlots;   // slots of the edges entering each node, CSR-like
+    std::vector<Segment> _segments;          // one per undirected edge
+    std::map<int, std::pair<int, int>> _floorSegments; // floor -> range of segment indices
+    std::map<int, std::shared_ptr<SegmentGrid>> _floorGrids; // shared by the copies of the graph, copied before a change while shared
+    std::vector<int> _nodeSegmentOffsets, _nodeSegments; // segments of each node, CSR-like
+    
+    // snapTracked: u,v distance a track can move from its last full search is about half the margin,
+    // the neighbourhood size bounds the work per fix
+    static constexpr float _TRACK_MARGIN = 1.f;
+    static const size_t _MAX_NEIGHBOURHOOD = 32;
+    
+    // optional precomputed route lengths, and the Destination nodes with their slot in the table.
+    // Once edges get longer or are disabled the table only gives lower bounds (stale); it is
+    // dropped when an edge gets shorter or is enabled.
+    std::shared_ptr<const DistanceTable> _distances = std::make_shared<DistanceTable>(); // shared by the copies of the graph
+    bool _distancesStale = false;
+    std::vector<std::pair<int, int>> _destinations;
+    
+    // optional contraction hierarchy, and the number of edges whose weight is now above or below the
+    // one it was built with. With none below, a route it gives that avoids the former is still the shortest.
+    std::shared_ptr<const ContractionHierarchy> _hierarchy = std::make_shared<ContractionHierarchy>(); // shared by the copies of the graph
+    int _hierarchyLonger = 0;
+    int _hierarchyShorter = 0;
+    
+    // optional geodesic fields of the Destination nodes, by dense node index
+    std::shared_ptr<const GeodesicFields> _geodesic = std::make_shared<GeodesicFields>(); // shared by the copies of the graph
+    
+    // flatten the parsed nodes into the dense arrays. Node ids are mapped to dense indices sorted by
+    // floor, so that every floor is a contiguous range and per-floor queries never look at the others.
+    void _flattenNodes(const std::map<int, Node>& nodes){
+        _indexToId.clear();
+        _nodeGeometry.clear();
+        _nodeInfo.clear();
+        _adjacency.clear();
+        _edgeAngles.clear();
+        
+        for (const auto& n : nodes)
+            _indexToId.push_back(n.first);
+        std::stable_sort(_indexToId.begin(), _indexToId.end(), [&nodes](int a, int b){
+            return nodes.at(a).floor < nodes.at(b).floor;
+        });
+        std::unordered_map<int, int> idToIndex;
+        for (int idx = 0; idx < static_cast<int>(_indexToId.size()); idx++){
+            const Node& n = nodes.at(_indexToId[idx]);
+            idToIndex[_indexToId[idx]] = idx;
+            _nodeGeometry.push_back({n.positionUV, n.floor, n.type, n.isDoor});
+            _nodeInfo.push_back({n.label, n.comments});
+            _adjacency.positions.push_back(n.positionUV);
+        }
+        for (int idx = 0; idx < static_cast<int>(_indexToId.size()); idx++){
+            for (const auto& e : nodes.at(_indexToId[idx]).edges){
+                auto it = idToIndex.find(e.first);
+                if (it == idToIndex.end())
+                    continue; // edge towards a node that is not in the graph
+                _adjacency.neighbors.push_back(it->second);
+                _adjacency.weights.push_back(e.second.length);
+                _edgeAngles.push_back(e.second.angleDeg);
+            }
+            _adjacency.offsets.push_back(static_cast<int>(_adjacency.neighbors.size()));
+        }
+    }
+    
+    // id lookup, floor ranges, link edges (edges between floors), A* heuristic scale, line coefficients and snapping grids
+    void _buildDerivedData(){
+        _idToIndex.clear();
+        _floorNodes.clear();
+        _linkEdges.clear();
+        _edgeLength = _adjacency.weights;
+        _edgeEnabled.assign(_adjacency.numEdges(), 1);
+        _nodeEnabled.assign(numNodes(), 1);
+        _slotSource.resize(_adjacency.numEdges());
+        _inOffsets.assign(numNodes() + 1, 0);
+        for (int idx = 0; idx < static_cast<int>(_indexToId.size()); idx++){
+            _idToIndex[_indexToId[idx]] = idx;
+            auto range = _floorNodes.insert({_nodeGeometry[idx].floor, {idx, idx}}).first;
+            range->second.second = idx + 1;
+            for (int k = _adjacency.begin(idx); k < _adjacency.end(idx); k++){
+                int j = _adjacency.neighbors[k];
+                _slotSource[k] = idx;
+                _inOffsets[j+1]++;
+                if (_nodeGeometry[j].floor != _nodeGeometry[idx].floor)
+                    _linkEdges.push_back({idx, j, _adjacency.weights[k]});
+            }
+        }
+        for (int idx = 0; idx < numNodes(); idx++)
+            _inOffsets[idx+1] += _inOffsets[idx];
+        _inSlots.resize(_adjacency.numEdges());
+        std::vector<int> fill(_inOffsets.begin(), _inOffsets.end() - 1);
+        for (int k = 0; k < _adjacency.numEdges(); k++)
+            _inSlots[fill[_adjacency.neighbors[k]]++] = k;
+        _distancesStale = false;
+        _version++;
+        static std::atomic<uint64_t> structures(0);
+        _structureId = ++structures;
+        _changeLog.clear();
+        _changeLogFloor = _version;
+        _adjacency.computeHeuristicScale();
+        _computeLinesCoeffs();
+        _buildSegmentIndex();
+        _indexDestinations();
+    }
+    
+    void _indexDestinations(){
+        _destinations.clear();
+        if (_distances->empty())
+            return;
+        for (int i = 0; i < numNodes(); i++)
+            if (_nodeGeometry[i].type == Destination && _distances->targetSlot(i) >= 0)
+                _destinations.push_back({i, _distances->targetSlot(i)});
+    }
+    
+    template <typename UpdateFn>
+    bool _updateEdge(int fromId, int toId, bool bothDirections, UpdateFn update){
+        int from = nodeIndex(fromId), to = nodeIndex(toId);
+        int k = _edgeSlot(from, to);
+        if (k < 0)
+            return false;
+        int segment = _segmentOf(from, to);
+        bool wasOpen = segment >= 0 && _isSegmentOpen(_segments[segment]);
+        update(k);
+        _refreshEdge(k);
+        int reverse = bothDirections ? _edgeSlot(to, from) : -1;
+        if (reverse >= 0){
+            update(reverse);
+            _refreshEdge(reverse);
+        }
+        if (segment >= 0)
+            _regridSegment(segment, _segments[segment], wasOpen);
+        _version++;
+        return true;
+    }
+    
+    // recomputes what depends on a single edge after a change of its state, length or end points
+    void _refreshEdge(int slot){
+        int i = _slotSource[slot], j = _adjacency.neighbors[slot];
+        float oldWeight = _adjacency.weights[slot];
+        float weight = (_edgeEnabled[slot] && _nodeEnabled[i] && _nodeEnabled[j]) ? _edgeLength[slot] : std::numeric_limits<float>::infinity();
+        _adjacency.weights[slot] = weight;
+        _computeLineCoeffs(i, slot);
+        
+        // the heuristic must stay below the new length, it can only get looser
+        cv::Point2f diff = _adjacency.positions[j] - _adjacency.positions[i];
+        float d = std::sqrt(diff.x*diff.x + diff.y*diff.y);
+        if (d > 0 && weight / d < _adjacency.heuristicScale)
+            _adjacency.heuristicScale = weight / d;
         
-        cv::imshow("graph", map);
-        cv::waitKey(0);
+        if (weight != oldWeight)
+            _logChange(slot);
+        if (!_hierarchy->empty()){
+            float base = _hierarchy->baseWeight(slot);
+            _hierarchyLonger += (weight > base) - (oldWeight > base);
+            _hierarchyShorter += (weight < base) - (oldWeight < base);
+        }
+        
+        if (weight < oldWeight){
+            _distances = std::make_shared<DistanceTable>();
+            _destinations.clear();
+        }
+        else if (weight > oldWeight)
+            _distancesStale = true;
+        
+        if (_nodeGeometry[i].floor != _nodeGeometry[j].floor)
+            for (LinkEdge& e : _linkEdges)
+                if (e.from == i && e.to == j)
+                    e.length = weight;
+    }
+    
+    void _countHierarchyChanges(){
+        _hierarchyLonger = _hierarchyShorter = 0;
+        for (int k = 0; k < _adjacency.numEdges(); k++){
+            _hierarchyLonger += _adjacency.weights[k] > _hierarchy->baseWeight(k);
+            _hierarchyShorter += _adjacency.weights[k] < _hierarchy->baseWeight(k);
+        }
+    }
+    
+    // findRoute through the hierarchy; false if the route it finds takes an edge that got longer
+    bool _routeFromHierarchy(int src, int dst, Route& route) const {
+        static thread_local ContractionHierarchy::Search search;
+        static thread_local std::vector<int> slots;
+        float length = _hierarchy->route(search, src, dst, slots);
+        if (length < 0)
+            return true; // no edge got shorter, so dst is still out of reach
+        if (_hierarchyLonger > 0)
+            for (int k : slots)
+                if (_adjacency.weights[k] != _hierarchy->baseWeight(k))
+                    return false;
+        route.length = length;
+        route.nodeIds.reserve(slots.size() + 1);
+        route.nodeIds.push_back(_indexToId[src]);
+        for (int k : slots)
+            route.nodeIds.push_back(_indexToId[_adjacency.neighbors[k]]);
+        return true;
+    }
+    
+    // to be called before the change bumps _version
+    void _logChange(int slot){
+        if (_changeLog.size() >= _MAX_CHANGE_LOG){
+            size_t drop = _changeLog.size() / 2;
+            _changeLogFloor = _changeLog[drop - 1].first;
+            while (drop < _changeLog.size() && _changeLog[drop].first == _changeLogFloor)
+                drop++;
+            _changeLog.erase(_changeLog.begin(), _changeLog.begin() + drop);
+        }
+        _changeLog.push_back({_version + 1, slot});
+    }
+    
+    inline void _computeLineCoeffs(int nodeIdx, int slot){
+        const cv::Point2f& p1 = _nodeGeometry[nodeIdx].positionUV;
+        const cv::Point2f& p2 = _nodeGeometry[_adjacency.neighbors[slot]].positionUV;
+        cv::Point3f n1Pos(1, p1.y, p1.x);
+        cv::Point3f n2Pos(1, p2.y, p2.x);
+        _edgeLineCoeffs[slot] = n1Pos.cross(n2Pos);
+    }
+    
+    bool _loadJson(const std::string& jsonFileName, std::shared_ptr<const maps::MapManager> mapManager, std::string& error){
+        GRAPHNAV_METRIC_TIMER(GRAPH_LOAD_LATENCY);
+        GRAPHNAV_METRIC_ADD(GRAPH_LOADS, 1);
+        json::GraphHandler graphJson;
+        if (!json::readGraph(jsonFileName, graphJson, error))
+            return false;
+        _mapManager = mapManager;
+        // what was built for a previous graph does not apply to this one
+        _distances = std::make_shared<DistanceTable>();
+        _geodesic = std::make_shared<GeodesicFields>();
+        _hierarchy = std::make_shared<ContractionHierarchy>();
+        std::map<int, Node> nodes;
+        _parseNodes(graphJson, nodes);
+        _flattenNodes(nodes);
+        _buildDerivedData();
+        return true;
+    }
+
+    // nodeEnabled, edgeEnabled: the saved states, to apply once the derived data is built (see _restoreEnabled)
+    bool _loadCompiledArrays(const compiled::Reader& reader, const maps::MapManager& mapManager,
+                             std::vector<char>& nodeEnabled, std::vector<char>& edgeEnabled, std::string& error){
+        const compiled::Header& h = reader.header();
+        size_t n = h.numNodes, m = h.numEdges;
+        const compiled::FloorRecord* floors = reader.section<compiled::FloorRecord>(compiled::FLOORS, h.numFloors);
+        const int32_t* ids = reader.section<int32_t>(compiled::NODE_IDS, n);
+        const int32_t* nodeFloors = reader.section<int32_t>(compiled::NODE_FLOORS, n);
+        const float* positions = reader.section<float>(compiled::POSITIONS, 2 * n);
+        const int32_t* types = reader.section<int32_t>(compiled::NODE_TYPES, n);
+        const uint8_t* doors = reader.section<uint8_t>(compiled::NODE_DOORS, n);
+        const int32_t* offsets = reader.section<int32_t>(compiled::EDGE_OFFSETS, n + 1);
+        const int32_t* neighbors = reader.section<int32_t>(compiled::NEIGHBORS, m);
+        const float* weights = reader.section<float>(compiled::WEIGHTS, m);
+        const float* angles = reader.section<float>(compiled::ANGLES, m);
+        const uint32_t* stringOffsets = reader.section<uint32_t>(compiled::STRING_OFFSETS, 2 * n + 1);
+        const char* strings = reader.section<char>(compiled::STRINGS, h.sectionSize[compiled::STRINGS]);
+        const char* nodesOpen = reader.section<char>(compiled::NODE_ENABLED, n);
+        const char* edgesOpen = reader.section<char>(compiled::EDGE_ENABLED, m);
+        if (!floors || !ids || !nodeFloors || !positions || !types || !doors || !offsets || !neighbors ||
+            !weights || !angles || !stringOffsets || (!strings && h.sectionSize[compiled::STRINGS] > 0) ||
+            (!nodesOpen && n > 0) || (!edgesOpen && m > 0)){
+            error = "section sizes do not match the header";
+            return false;
+        }
+        
+        for (uint32_t f = 0; f < h.numFloors; f++){
+            if (!mapManager.hasFloor(floors[f].floor)){
+                error = "no map for floor " + std::to_string(floors[f].floor);
+                return false;
+            }
+            cv::Size size = mapManager.getMapSizePixels(floors[f].floor);
+            if (std::abs(mapManager.getScale(floors[f].floor) - floors[f].scale) > 1e-4 * floors[f].scale ||
+                size.width != floors[f].widthPx || size.height != floors[f].heightPx){
+                error = "compiled with a different map for floor " + std::to_string(floors[f].floor);
+                return false;
+            }
+        }
+        if (offsets[0] != 0 || offsets[n] != static_cast<int32_t>(m) || stringOffsets[0] != 0 ||
+            stringOffsets[2*n] != h.sectionSize[compiled::STRINGS]){
+            error = "inconsistent offsets";
+            return false;
+        }
+        for (size_t i = 0; i < n; i++){
+            if (offsets[i] > offsets[i+1] || stringOffsets[2*i] > stringOffsets[2*i+1] || stringOffsets[2*i+1] > stringOffsets[2*i+2] ||
+                types[i] < Control || types[i] > Link || (i > 0 && nodeFloors[i] < nodeFloors[i-1])){
+                error = "corrupted node " + std::to_string(i);
+                return false;
+            }
+        }
+        for (size_t i = 0; i < 2 * n; i++){
+            if (!std::isfinite(positions[i])){
+                error = "corrupted position of node " + std::to_string(i / 2);
+                return false;
+            }
+        }
+        for (size_t k = 0; k < m; k++){
+            if (neighbors[k] < 0 || neighbors[k] >= static_cast<int32_t>(n) || !std::isfinite(weights[k]) || weights[k] < 0){
+                error = "corrupted edge " + std::to_string(k);
+                return false;
+            }
+        }
         
-        cv::Point2f snap = snapUV2Graph(_mapManager->pixels2uv(pt), floor, false);
+        // optional distance layer
+        size_t numTargets = h.sectionSize[compiled::DIST_TARGETS] / sizeof(int32_t);
+        size_t numLandmarks = h.sectionSize[compiled::LANDMARKS] / sizeof(int32_t);
+        const int32_t* targets = reader.section<int32_t>(compiled::DIST_TARGETS, numTargets);
+        const float* table = reader.section<float>(compiled::DIST_TABLE, n * numTargets);
+        const int32_t* landmarks = reader.section<int32_t>(compiled::LANDMARKS, numLandmarks);
+        const float* fromLandmark = reader.section<float>(compiled::FROM_LANDMARK, n * numLandmarks);
+        const float* toLandmark = reader.section<float>(compiled::TO_LANDMARK, n * numLandmarks);
+        if (!targets || !table || !landmarks || !fromLandmark || !toLandmark){
+            error = "distance table sizes do not match the graph";
+            return false;
+        }
+        std::shared_ptr<DistanceTable> distances = std::make_shared<DistanceTable>();
+        if ((numTargets > 0 || numLandmarks > 0) && !distances->assign(static_cast<int>(n), std::vector<int>(targets, targets + numTargets),
+                                    std::vector<float>(table, table + n * numTargets),
+                                    std::vector<int>(landmarks, landmarks + numLandmarks),
+                                    std::vector<float>(fromLandmark, fromLandmark + n * numLandmarks),
+                                    std::vector<float>(toLandmark, toLandmark + n * numLandmarks))){
+            error = "corrupted distance table";
+            return false;
+        }
         
-//        int id = findClosestNodeId(_mapManager->pixels2uv(pt), floor, checkWalls);
-//        if (id > 0){
-        cv::Point2i ptpx = _mapManager->uv2pixels(snap);
-        cv::circle(map, cv::Point2i(ptpx.y, ptpx.x), 3, cv::Scalar(0,255,255));
-        cv::imshow("graph", map);
-        cv::waitKey(-1);
-//        cv::destroyWindow("snapped position");
-        cv::destroyWindow("graph");
-    }
-    
-    // for debugging
-    static void onMouse( int event, int x, int y, int, void* ptr)
-    {
-        if( event != cv::EVENT_LBUTTONDOWN )
+        // every section is valid, the graph is only changed from here on
+        _indexToId.assign(ids, ids + n);
+        _nodeGeometry.resize(n);
+        _nodeInfo.resize(n);
+        _adjacency.positions.resize(n);
+        for (size_t i = 0; i < n; i++){
+            cv::Point2f pos(positions[2*i], positions[2*i+1]);
+            _nodeGeometry[i] = {pos, nodeFloors[i], static_cast<NodeType>(types[i]), doors[i] != 0};
+            _adjacency.positions[i] = pos;
+            _nodeInfo[i].label.assign(strings + stringOffsets[2*i], stringOffsets[2*i+1] - stringOffsets[2*i]);
+            _nodeInfo[i].comments.assign(strings + stringOffsets[2*i+1], stringOffsets[2*i+2] - stringOffsets[2*i+1]);
+        }
+        _adjacency.offsets.assign(offsets, offsets + n + 1);
+        _adjacency.neighbors.assign(neighbors, neighbors + m);
+        _adjacency.weights.assign(weights, weights + m);
+        _edgeAngles.assign(angles, angles + m);
+        _distances = distances;
+        nodeEnabled.assign(nodesOpen, nodesOpen + n);
+        edgeEnabled.assign(edgesOpen, edgesOpen + m);
+        return true;
+    }
+    
+    // closes again the nodes and edges of a loaded graph that were closed when it was saved
+    void _restoreEnabled(const std::vector<char>& nodeEnabled, const std::vector<char>& edgeEnabled){
+        auto open = [](char e){ return e != 0; };
+        if (std::all_of(nodeEnabled.begin(), nodeEnabled.end(), open) && std::all_of(edgeEnabled.begin(), edgeEnabled.end(), open))
             return;
-        cv::Point* p = (cv::Point*)ptr;
-        p->x = y;
-        p->y = x;
-        std::cerr << x << "," << y << "\n";
+        for (size_t i = 0; i < nodeEnabled.size(); i++)
+            _nodeEnabled[i] = open(nodeEnabled[i]);
+        for (int k = 0; k < _adjacency.numEdges(); k++){
+            _edgeEnabled[k] = open(edgeEnabled[k]);
+            bool enabled = _edgeEnabled[k] && _nodeEnabled[_slotSource[k]] && _nodeEnabled[_adjacency.neighbors[k]];
+            _adjacency.weights[k] = enabled ? _edgeLength[k] : std::numeric_limits<float>::infinity();
+        }
+        for (LinkEdge& e : _linkEdges)
+            e.length = _adjacency.weights[_edgeSlot(e.from, e.to)];
+        // no distance table is saved with closed edges, so only the heuristic and the grids are left
+        _adjacency.computeHeuristicScale();
+        _buildSegmentIndex();
     }
     
-    int findClosestNodeId(cv::Point2f pos, int floor, bool checkWalls = false){
-        int id = -1;
-        float minDist = 1e6;
-        float d;
-        for (const auto& n : _nodes){
-            if (n.second.floor == floor){
-                cv::Point2f diff = pos - n.second.positionUV;
-                d = (diff.x*diff.x + diff.y*diff.y);
-                if (d < minDist){
-                    minDist = d;
-                    id = n.first;
+    // The geometrically closest edge comes from the vectorized grid scan; only if the wall test
+    // rejects it are the candidates visited nearest first until one has a clear line of sight.
+    // walls: the map of floor for the wall test, null to skip it
+    bool _snap(const cv::Point2f& uvpos, int floor, const maps::AnnotatedMap* walls, SnapResult& res) const {
+        GRAPHNAV_METRIC_TIMER(SNAP_LATENCY);
+        GRAPHNAV_METRIC_ADD(SNAPS, 1);
+        res.position = uvpos;
+        res.edge = -1;
+        res.t = 0;
+        auto grid = _floorGrids.find(floor);
+        if (grid == _floorGrids.end())
+            return false;
+        
+        SegmentGrid::Candidate best;
+        if (!grid->second->nearest(_segments, uvpos, best))
+            return false;
+        if (walls){
+            const maps::AnnotatedMap& map = *walls;
+            cv::Point2i uvposPx = map.uv2pixels(uvpos);
+            auto visible = [&](const SegmentGrid::Candidate& c){
+                GRAPHNAV_METRIC_ADD(SNAP_WALL_TESTS, 1);
+                return !map.isPathCrossingWalls(uvposPx, map.uv2pixels(c.position));
+            };
+            // the nearest segment has been tested already, the search below skips it
+            int rejected = best.segment;
+            if (!visible(best) && !grid->second->nearest(_segments, uvpos, [&](const SegmentGrid::Candidate& c){ return c.segment != rejected && visible(c); }, best))
+                return false;
+        }
+        res.position = best.position;
+        res.edge = best.segment;
+        res.t = best.t;
+        return true;
+    }
+    
+    // one segment per undirected edge, indexed in a grid per floor; edges joining two floors are not snapped to.
+    // Segments are numbered floor by floor, following the dense node order.
+    void _buildSegmentIndex(){
+        _segments.clear();
+        _floorSegments.clear();
+        _floorGrids.clear();
+        for (const auto& f : _floorNodes){
+            int first = static_cast<int>(_segments.size());
+            for (int i = f.second.first; i < f.second.second; i++){
+                for (int k = _adjacency.begin(i); k < _adjacency.end(i); k++){
+                    int j = _adjacency.neighbors[k];
+                    if (_nodeGeometry[j].floor != f.first)
+                        continue;
+                    // the reverse edge is usually listed too, keep only one of the two
+                    if (j < i && _hasEdge(j, i))
+                        continue;
+                    _segments.push_back({i, j, _nodeGeometry[i].positionUV, _nodeGeometry[j].positionUV});
                 }
             }
-                
+            _floorSegments[f.first] = {first, static_cast<int>(_segments.size())};
+            _buildFloorGrid(f.first);
+        }
+        _nodeSegmentOffsets.assign(numNodes() + 1, 0);
+        for (const Segment& s : _segments){
+            _nodeSegmentOffsets[s.n1 + 1]++;
+            _nodeSegmentOffsets[s.n2 + 1]++;
+        }
+        for (int i = 0; i < numNodes(); i++)
+            _nodeSegmentOffsets[i+1] += _nodeSegmentOffsets[i];
+        _nodeSegments.resize(_nodeSegmentOffsets.back());
+        std::vector<int> cursor(_nodeSegmentOffsets.begin(), _nodeSegmentOffsets.end() - 1);
+        for (int s = 0; s < static_cast<int>(_segments.size()); s++){
+            _nodeSegments[cursor[_segments[s].n1]++] = s;
+            _nodeSegments[cursor[_segments[s].n2]++] = s;
         }
-        return id;
     }
     
-private:
-    cv::Mat _weights;
-    cv::Mat _angles;
-    std::map<int, Graph::Node> _nodes;
-    std::shared_ptr<maps::MapManager> _mapManager;
-    
-    // load weights and angle matrices
-    void _parseGraphMatrices(const rapidjson::Document &document){
-        const rapidjson::Value& w = document["weights"];
-        const rapidjson::Value& a = document["angles"];
-        _weights = cv::Mat::zeros(a.Size(), a.Size(), CV_32F);
-        _angles = cv::Mat::zeros(a.Size(), a.Size(), CV_32F);
-        for (rapidjson::SizeType i = 0; i < a.Size(); i++){
-            float* Wi = _weights.ptr<float>(i);
-            float* Ai = _angles.ptr<float>(i);
-            const rapidjson::Value& ai = a[i];
-            const rapidjson::Value& wi = w[i];
-            for (rapidjson::SizeType j = 0; j < ai.Size(); j++){
-                Wi[j] = wi[j].GetFloat();
-                Ai[j] = ai[j].GetFloat();
+    // a segment is snapped to if it is open in at least one direction
+    inline bool _isSegmentOpen(const Segment& s) const {
+        return _edgeWeight(s.n1, s.n2) < std::numeric_limits<float>::infinity() ||
+               _edgeWeight(s.n2, s.n1) < std::numeric_limits<float>::infinity();
+    }
+    
+    // the nearest accepted segment of the session's neighbourhood, if it is provably the nearest of the floor
+    bool _snapNeighbourhood(SnapSession& session, const cv::Point2f& uvpos, const maps::AnnotatedMap* walls, SnapResult& res) const {
+        cv::Point2f moved = uvpos - session.anchor;
+        float slack = session.clearance - std::sqrt(moved.x*moved.x + moved.y*moved.y);
+        if (!(slack > 0))
+            return false;
+        float slack2 = slack * slack;
+        std::vector<SegmentGrid::Candidate>& candidates = session.candidates;
+        candidates.clear();
+        for (int id : session.neighbourhood){
+            const Segment& s = _segments[id];
+            SegmentGrid::Candidate c;
+            c.segment = id;
+            c.position = projectPointToSegment(s.p1, s.p2, uvpos, c.t);
+            cv::Point2f diff = uvpos - c.position;
+            c.dist2 = diff.x*diff.x + diff.y*diff.y;
+            if (c.dist2 <= slack2)
+                candidates.push_back(c);
+        }
+        session.segmentTests += session.neighbourhood.size();
+        GRAPHNAV_METRIC_ADD(SNAP_SEGMENTS, session.neighbourhood.size());
+        // nearest first, there are only a handful
+        cv::Point2i uvposPx = walls ? walls->uv2pixels(uvpos) : cv::Point2i();
+        while (!candidates.empty()){
+            auto c = std::min_element(candidates.begin(), candidates.end(), [](const SegmentGrid::Candidate& a, const SegmentGrid::Candidate& b){ return a.dist2 < b.dist2; });
+            GRAPHNAV_METRIC_ADD(SNAP_WALL_TESTS, walls ? 1 : 0);
+            if (walls && walls->isPathCrossingWalls(uvposPx, walls->uv2pixels(c->position))){
+                *c = candidates.back();
+                candidates.pop_back();
+                continue;
             }
+            res.position = c->position;
+            res.edge = c->segment;
+            res.t = c->t;
+            session.edge = c->segment;
+            session.t = c->t;
+            return true;
         }
+        return false;
     }
     
-    void _parseNodes(const rapidjson::Document &document){
-        const auto& nodes = document["nodes"][0].GetObject();
-        for(rapidjson::Value::ConstMemberIterator it=nodes.MemberBegin(); it != nodes.MemberEnd(); it++) {
-            int nodeId = it->value["id"].GetInt();
+    // After a full search: the neighbourhood of the snapped segment and its clearance from uvpos.
+    // Besides the segments sharing a node with it, the neighbourhood takes every segment up to
+    // _TRACK_MARGIN farther than the snapped one (those a wall hid from uvpos, say), so that the
+    // track can move about half the margin before it needs another full search.
+    void _enterNeighbourhood(SnapSession& session, const cv::Point2f& uvpos, int floor, const SnapResult& res) const {
+        session.edge = res.edge;
+        session.t = res.t;
+        session.anchor = uvpos;
+        session.neighbourhood.clear();
+        const Segment& last = _segments[res.edge];
+        for (int n : {last.n1, last.n2})
+            for (int k = _nodeSegmentOffsets[n]; k < _nodeSegmentOffsets[n+1]; k++){
+                int id = _nodeSegments[k];
+                if (_isSegmentOpen(_segments[id]) &&
+                    std::find(session.neighbourhood.begin(), session.neighbourhood.end(), id) == session.neighbourhood.end())
+                    session.neighbourhood.push_back(id);
+            }
+        std::vector<int>& local = session.neighbourhood;
+        cv::Point2f snapped = uvpos - res.position;
+        float reach = std::sqrt(snapped.x*snapped.x + snapped.y*snapped.y) + _TRACK_MARGIN;
+        SegmentGrid::Candidate outside;
+        if (_floorGrids.at(floor)->nearest(_segments, uvpos, [&local, reach](const SegmentGrid::Candidate& c){
+                if (std::find(local.begin(), local.end(), c.segment) != local.end())
+                    return false;
+                if (c.dist2 <= reach * reach && local.size() < _MAX_NEIGHBOURHOOD){
+                    local.push_back(c.segment);
+                    return false;
+                }
+                return true; }, outside))
+            session.clearance = std::sqrt(outside.dist2);
+        else
+            session.clearance = std::numeric_limits<float>::infinity();
+    }
+    
+    // grid of the segments of a floor that are open in at least one direction
+    void _buildFloorGrid(int floor){
+        auto range = _floorSegments.find(floor);
+        std::vector<int> floorSegments;
+        if (range != _floorSegments.end()){
+            for (int s = range->second.first; s < range->second.second; s++)
+                if (_isSegmentOpen(_segments[s]))
+                    floorSegments.push_back(s);
+        }
+        if (floorSegments.empty()){
+            _floorGrids.erase(floor);
+            return;
+        }
+        std::shared_ptr<SegmentGrid> grid = std::make_shared<SegmentGrid>();
+        grid->build(_segments, floorSegments);
+        _floorGrids[floor] = grid;
+    }
+    
+    // Updates the floor grid for segment s after a change of its state or end points: before is its
+    // geometry and wasOpen its state before the change. Only the cells of the segment are touched,
+    // the whole floor grid is built again only when it has no spare slot left.
+    void _regridSegment(int s, const Segment& before, bool wasOpen){
+        const Segment& after = _segments[s];
+        bool open = _isSegmentOpen(after);
+        if (wasOpen == open && (!open || (before.p1 == after.p1 && before.p2 == after.p2)))
+            return;
+        int floor = _nodeGeometry[after.n1].floor;
+        auto grid = _floorGrids.find(floor);
+        if (grid == _floorGrids.end()){
+            _buildFloorGrid(floor); // the first open segment of the floor
+            return;
+        }
+        if (grid->second.use_count() > 1)
+            grid->second = std::make_shared<SegmentGrid>(*grid->second);
+        if (wasOpen)
+            grid->second->remove(before, s);
+        if (open && !grid->second->insert(after, s))
+            _buildFloorGrid(floor);
+        else if (grid->second->size() == 0)
+            _floorGrids.erase(grid);
+    }
+    
+    // applies change() to node idx, then updates the floor grid for the segments of the node only
+    template <typename ChangeFn>
+    void _regridNodeSegments(int idx, ChangeFn change){
+        int begin = _nodeSegmentOffsets[idx], end = _nodeSegmentOffsets[idx+1];
+        std::vector<std::pair<Segment, bool>> before;
+        for (int k = begin; k < end; k++){
+            const Segment& s = _segments[_nodeSegments[k]];
+            before.push_back({s, _isSegmentOpen(s)});
+        }
+        change();
+        for (int k = begin; k < end; k++){
+            // a loop lists its segment twice in a row
+            if (k > begin && _nodeSegments[k] == _nodeSegments[k-1])
+                continue;
+            _regridSegment(_nodeSegments[k], before[k - begin].first, before[k - begin].second);
+        }
+    }
+    
+    // segment of the edge between two nodes of the same floor, -1 if there is none
+    inline int _segmentOf(int fromIdx, int toIdx) const {
+        if (fromIdx < 0 || toIdx < 0)
+            return -1;
+        for (int k = _nodeSegmentOffsets[fromIdx]; k < _nodeSegmentOffsets[fromIdx+1]; k++){
+            const Segment& s = _segments[_nodeSegments[k]];
+            if ((s.n1 == fromIdx && s.n2 == toIdx) || (s.n1 == toIdx && s.n2 == fromIdx))
+                return _nodeSegments[k];
+        }
+        return -1;
+    }
+    
+    inline int _edgeSlot(int fromIdx, int toIdx) const {
+        if (fromIdx < 0 || toIdx < 0)
+            return -1;
+        for (int k = _adjacency.begin(fromIdx); k < _adjacency.end(fromIdx); k++)
+            if (_adjacency.neighbors[k] == toIdx)
+                return k;
+        return -1;
+    }
+    
+    inline bool _hasEdge(int fromIdx, int toIdx) const { return _edgeSlot(fromIdx, toIdx) >= 0; }
+    
+    inline float _edgeWeight(int fromIdx, int toIdx) const {
+        int k = _edgeSlot(fromIdx, toIdx);
+        return (k >= 0) ? _adjacency.weights[k] : std::numeric_limits<float>::infinity();
+    }
+    
+    void _parseNodes(const json::GraphHandler& graphJson, std::map<int, Node>& nodesById){
+        for (const json::NodeRecord& n : graphJson.nodes){
             Node node;
-            std::string ntype = it->value["type"].GetString();
-            if (ntype.compare("control") == 0)
+            if (n.type.compare("control") == 0)
                 node.type = NodeType::Control;
-            else if (ntype.compare("destination") == 0)
-                 node.type = NodeType::Destination;
-            else if (ntype.compare("link") == 0)
+            else if (n.type.compare("destination") == 0)
+                node.type = NodeType::Destination;
+            else if (n.type.compare("link") == 0)
                 node.type = NodeType::Link;
-            
-//            node.type = it->value["type"].GetString();
-            node.floor = std::stoi(it->value["floor"].GetString());
-            node.label = it->value["label"].GetString();
-            node.isDoor = it->value["isDoor"].GetInt();
-            node.comments = it->value["comments"].GetString();
-            
-            const auto& pos = it->value["position"].GetArray();
-            //cv::Point2f tmp = _mapManager->pixels2uv(cv::Point2i(pos[1].GetFloat(), pos[0].GetFloat()));
-            node.positionUV = _mapManager->pixels2uv(cv::Point2i(pos[1].GetFloat(), pos[0].GetFloat()));
-            
-            float* wi = _weights.ptr<float>(nodeId-1);
-            float* ai = _angles.ptr<float>(nodeId-1);
-            
-            for (int j = 0; j < _weights.cols; j++){
-                if (wi[j] > 0){
-                    Edge e = { .length = wi[j] * static_cast<float>(_mapManager->getScale(node.floor)), .angleDeg = ai[j]};
-                    node.edges.insert({j+1, e});
-                }
-            }
-            _nodes.insert({it->value["id"].GetInt(), node});
-        
+            node.floor = n.floor;
+            node.label = n.label;
+            node.isDoor = n.isDoor;
+            node.comments = n.comments;
+            node.positionUV = _mapManager->pixels2uv(cv::Point2i(n.y, n.x), n.floor);
+            nodesById.insert({n.id, node});
+        }
+        for (const json::EdgeRecord& e : graphJson.edges){
+            auto it = nodesById.find(e.source);
+            if (it == nodesById.end())
+                continue;
+            Edge edge;
+            edge.length = e.weight * static_cast<float>(_mapManager->getScale(it->second.floor));
+            edge.angleDeg = e.angleDeg;
+            edge.lineCoeffs_cab = cv::Point3f();
+            it->second.edges.insert({e.target, edge});
         }
     }
 };
 
-#endif /* Graph_h */
+// A graph shared by query threads: each takes get() once per batch of queries and runs them on that
+// version without waiting for writers, while changes are applied to a copy and published
+// atomically, e.g.
+//     sharedGraph.update([](Graph& g){ return g.setNodeEnabled(doorId, false); });
+using SharedGraph = syncutils::Snapshot<Graph>;
 
 } // end navgraph namespace
+
+#endif /* Graph_h */
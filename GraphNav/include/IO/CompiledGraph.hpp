@@ -0,0 +1,167 @@
+#if !defined(COMPILEDGRAPH_HPP_)
+#define COMPILEDGRAPH_HPP_
+
+#include "../Utils/Hash.hpp"
+#include "../Utils/MappedFile.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+
+namespace navgraph{
+namespace compiled{
+
+// Layout of a compiled graph file. A fixed header is followed by 8-byte aligned sections of flat,
+// native-endian arrays, addressed by their offset from the start of the file, so the file can be
+// memory mapped and the arrays copied out in bulk without parsing. Nodes are stored by dense index
+// (sorted by floor), edges in CSR order.
+//
+//  floors          FloorRecord[numFloors]      map metadata the node positions were computed with
+//  nodeIds         int32[numNodes]
+//  nodeFloors      int32[numNodes]
+//  positions       float[2*numNodes]           u,v
+//  nodeTypes       int32[numNodes]
+//  nodeDoors       uint8[numNodes]
+//  edgeOffsets     int32[numNodes+1]
+//  neighbors       int32[numEdges]             dense node index
+//  weights         float[numEdges]             edge length
+//  angles          float[numEdges]             degrees
+//  stringOffsets   uint32[2*numNodes+1]        label of node i is string 2i, comments are string 2i+1
+//  strings         char[stringsSize]
+//  nodeEnabled     uint8[numNodes]             0 for a node closed with setNodeEnabled
+//  edgeEnabled     uint8[numEdges]             0 for an edge closed with setEdgeEnabled
+//
+// optional distance layer (see Routing/DistanceTable.hpp), empty sections if not present
+//  distTargets     int32[numTargets]
+//  distTable       float[numNodes*numTargets]
+//  landmarks       int32[numLandmarks]
+//  fromLandmark    float[numNodes*numLandmarks]
+//  toLandmark      float[numNodes*numLandmarks]
+
+const char     MAGIC[8] = {'G', 'N', 'A', 'V', 'G', 'R', 'P', 'H'};
+const uint32_t VERSION = 3;
+
+enum Section { FLOORS = 0, NODE_IDS, NODE_FLOORS, POSITIONS, NODE_TYPES, NODE_DOORS, EDGE_OFFSETS, NEIGHBORS, WEIGHTS, ANGLES, STRING_OFFSETS, STRINGS,
+               NODE_ENABLED, EDGE_ENABLED, DIST_TARGETS, DIST_TABLE, LANDMARKS, FROM_LANDMARK, TO_LANDMARK, NUM_SECTIONS };
+
+struct FloorRecord{
+    int32_t floor;
+    float scale;
+    int32_t widthPx;
+    int32_t heightPx;
+};
+
+struct Header{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t fileSize;
+    uint64_t checksum; // FNV-1a of everything after the header
+    uint32_t numFloors;
+    uint32_t numNodes;
+    uint32_t numEdges;
+    uint32_t reserved;
+    uint64_t sectionOffset[NUM_SECTIONS];
+    uint64_t sectionSize[NUM_SECTIONS]; // in bytes
+};
+
+// Accumulates the sections in memory and writes header and payload in one go
+class Writer{
+public:
+    Writer() : _payload(sizeof(Header), 0) { std::memset(&_header, 0, sizeof(Header)); }
+    
+    template <typename T>
+    void addSection(Section section, const T* data, size_t count){
+        while (_payload.size() % 8 != 0)
+            _payload.push_back(0);
+        _header.sectionOffset[section] = _payload.size();
+        _header.sectionSize[section] = count * sizeof(T);
+        const char* bytes = reinterpret_cast<const char*>(data);
+        _payload.insert(_payload.end(), bytes, bytes + count * sizeof(T));
+    }
+    
+    bool write(const std::string& fileName, uint32_t numFloors, uint32_t numNodes, uint32_t numEdges){
+        std::memcpy(_header.magic, MAGIC, sizeof(MAGIC));
+        _header.version = VERSION;
+        _header.headerSize = sizeof(Header);
+        _header.fileSize = _payload.size();
+        _header.numFloors = numFloors;
+        _header.numNodes = numNodes;
+        _header.numEdges = numEdges;
+        _header.checksum = hashutils::fnv1a64(_payload.data() + sizeof(Header), _payload.size() - sizeof(Header));
+        std::memcpy(_payload.data(), &_header, sizeof(Header));
+        
+        std::ofstream outFile(fileName, std::ofstream::binary | std::ofstream::trunc);
+        outFile.write(_payload.data(), _payload.size());
+        return outFile.good();
+    }
+    
+private:
+    Header _header;
+    std::vector<char> _payload; // starts with room for the header
+};
+
+// Maps a compiled graph file and checks its header, section bounds and (optionally) checksum
+class Reader{
+public:
+    Reader() : _header(nullptr) { ; }
+    
+    bool open(const std::string& fileName, bool verifyChecksum, std::string& error){
+        _header = nullptr;
+        if (!_file.open(fileName)){
+            error = "cannot map " + fileName;
+            return false;
+        }
+        if (_file.size() < sizeof(Header)){
+            error = "file too small";
+            return false;
+        }
+        const Header* h = reinterpret_cast<const Header*>(_file.data());
+        if (std::memcmp(h->magic, MAGIC, sizeof(MAGIC)) != 0){
+            error = "not a compiled graph";
+            return false;
+        }
+        if (h->version != VERSION || h->headerSize != sizeof(Header)){
+            error = "unsupported version " + std::to_string(h->version);
+            return false;
+        }
+        if (h->fileSize != _file.size()){
+            error = "truncated file";
+            return false;
+        }
+        for (int s = 0; s < NUM_SECTIONS; s++){
+            if (h->sectionOffset[s] % 8 != 0 || h->sectionOffset[s] < sizeof(Header) ||
+                h->sectionOffset[s] > h->fileSize || h->sectionSize[s] > h->fileSize - h->sectionOffset[s]){
+                error = "corrupted section table";
+                return false;
+            }
+        }
+        if (verifyChecksum && hashutils::fnv1a64(_file.data() + sizeof(Header), _file.size() - sizeof(Header)) != h->checksum){
+            error = "checksum mismatch";
+            return false;
+        }
+        _header = h;
+        return true;
+    }
+    
+    inline const Header& header() const { return *_header; }
+    
+    // pointer to the section, nullptr if it does not hold exactly count elements of T
+    template <typename T>
+    const T* section(Section s, size_t count) const {
+        if (_header->sectionSize[s] != count * sizeof(T))
+            return nullptr;
+        return reinterpret_cast<const T*>(_file.data() + _header->sectionOffset[s]);
+    }
+    
+private:
+    fileutils::MappedFile _file;
+    const Header* _header;
+};
+
+} // end compiled namespace
+} // end navgraph namespace
+
+#endif // COMPILEDGRAPH_HPP_
@@ -0,0 +1,255 @@
+#if !defined(GRAPHJSONREADER_HPP_)
+#define GRAPHJSONREADER_HPP_
+
+#include "rapidjson/reader.h"
+#include "rapidjson/filereadstream.h"
+#include "rapidjson/error/en.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace navgraph{
+namespace json{
+
+// Streaming reader for the graph json files. Nodes and edges are collected as they are parsed, the
+// document is never held in memory. Two layouts are accepted:
+//
+// edge list (preferred)
+//  { "nodes": [ {"id": 1, "type": "control", "position": [x, y], "floor": 4, "label": "", "isDoor": 0, "comments": ""}, ... ],
+//    "edges": [ {"source": 1, "target": 2, "weight": 128.7, "angle": 90}, ... ] }
+//
+// dense matrices (legacy), row i / column j hold the edge from node id i+1 to node id j+1, zero meaning no edge
+//  { "weights": [[...], ...], "angles": [[...], ...], "nodes": [ { "1": {...}, "2": {...} } ] }
+//
+// Edges are directed in both layouts. Weights are in pixels, positions are in pixels (x, y).
+// Every edge needs a weight, finite and not negative (legacy matrices: positive, zero is no edge);
+// an edge list record without one stops the parse.
+
+struct NodeRecord{
+    int id = -1;
+    std::string type;
+    float x = 0, y = 0;
+    int floor = 0;
+    std::string label;
+    bool isDoor = false;
+    std::string comments;
+};
+
+struct EdgeRecord{
+    int source;
+    int target;
+    float weight;
+    float angleDeg;
+};
+
+class GraphHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, GraphHandler> {
+public:
+    std::vector<NodeRecord> nodes;
+    std::vector<EdgeRecord> edges;
+    std::string error; // why the parse was stopped, if the handler stopped it
+
+    bool StartObject(){
+        Frame parent = _stack.empty() ? Skip : _stack.back();
+        if (_stack.empty())
+            _stack.push_back(Root);
+        else if (parent == Nodes){
+            _stack.push_back(NodeObject);
+            _node = NodeRecord();
+        }
+        else if (parent == NodeObject && _node.id < 0 && _isNodeIdKey(_key)){
+            // legacy layout: the enclosing object maps node ids to nodes
+            _stack.back() = NodeMap;
+            _stack.push_back(NodeObject);
+            _node = NodeRecord();
+        }
+        else if (parent == NodeMap){
+            _stack.push_back(NodeObject);
+            _node = NodeRecord();
+        }
+        else if (parent == Edges){
+            _stack.push_back(EdgeObject);
+            _edge = {-1, -1, std::numeric_limits<float>::quiet_NaN(), 0}; // no weight yet
+        }
+        else
+            _stack.push_back(Skip);
+        return true;
+    }
+
+    bool EndObject(rapidjson::SizeType){
+        if (_stack.back() == NodeObject && _node.id >= 0)
+            nodes.push_back(_node);
+        else if (_stack.back() == EdgeObject && _edge.source >= 0 && _edge.target >= 0){
+            if (!std::isfinite(_edge.weight) || _edge.weight < 0){
+                error = "edge " + std::to_string(_edge.source) + " -> " + std::to_string(_edge.target) + " has no valid weight";
+                return false;
+            }
+            edges.push_back(_edge);
+        }
+        _stack.pop_back();
+        return true;
+    }
+
+    bool StartArray(){
+        Frame parent = _stack.empty() ? Skip : _stack.back();
+        Frame frame = Skip;
+        if (parent == Root){
+            if (_key == "weights") frame = Weights;
+            else if (_key == "angles") frame = Angles;
+            else if (_key == "nodes") frame = Nodes;
+            else if (_key == "edges") frame = Edges;
+        }
+        else if (parent == Weights || parent == Angles){
+            frame = (parent == Weights) ? WeightsRow : AnglesRow;
+            _row = (parent == Weights) ? _weightRows++ : _angleRows++;
+            _col = 0;
+        }
+        else if (parent == NodeObject && _key == "position"){
+            frame = NodePosition;
+            _col = 0;
+        }
+        _stack.push_back(frame);
+        return true;
+    }
+
+    bool EndArray(rapidjson::SizeType){
+        _stack.pop_back();
+        if (_stack.empty())
+            return true;
+        if (_stack.back() == Root && (_key == "weights" || _key == "angles"))
+            _joinMatrices();
+        return true;
+    }
+
+    bool Key(const char* str, rapidjson::SizeType length, bool){
+        _key.assign(str, length);
+        return true;
+    }
+
+    bool Int(int i) { return _number(i); }
+    bool Uint(unsigned u) { return _number(u); }
+    bool Int64(int64_t i) { return _number(static_cast<double>(i)); }
+    bool Uint64(uint64_t u) { return _number(static_cast<double>(u)); }
+    bool Double(double d) { return _number(d); }
+    bool Bool(bool b) { return _number(b ? 1 : 0); }
+
+    bool String(const char* str, rapidjson::SizeType length, bool){
+        if (_stack.empty() || _stack.back() != NodeObject)
+            return true;
+        if (_key == "type") _node.type.assign(str, length);
+        else if (_key == "label") _node.label.assign(str, length);
+        else if (_key == "comments") _node.comments.assign(str, length);
+        else if (_key == "floor") _node.floor = std::atoi(std::string(str, length).c_str());
+        else if (_key == "id") _node.id = std::atoi(std::string(str, length).c_str());
+        return true;
+    }
+
+private:
+    enum Frame { Root, Weights, WeightsRow, Angles, AnglesRow, Nodes, NodeMap, NodeObject, NodePosition, Edges, EdgeObject, Skip };
+
+    struct MatrixEntry{
+        int row, col;
+        float value;
+        bool operator<(const MatrixEntry& other) const { return row < other.row || (row == other.row && col < other.col); }
+    };
+
+    std::vector<Frame> _stack;
+    std::string _key;
+    NodeRecord _node;
+    EdgeRecord _edge;
+    int _row = 0, _col = 0;
+    int _weightRows = 0, _angleRows = 0;
+    // nonzero entries of the legacy matrices, only these are ever stored
+    std::vector<MatrixEntry> _weights, _angles;
+
+    // keys of the legacy node map are node ids
+    static bool _isNodeIdKey(const std::string& key){
+        return !key.empty() && std::all_of(key.begin(), key.end(), [](char c){ return c >= '0' && c <= '9'; });
+    }
+
+    bool _number(double value){
+        if (_stack.empty())
+            return true;
+        switch (_stack.back()){
+            case WeightsRow:
+                if (value != 0)
+                    _weights.push_back({_row, _col, static_cast<float>(value)});
+                _col++;
+                break;
+            case AnglesRow:
+                if (value != 0)
+                    _angles.push_back({_row, _col, static_cast<float>(value)});
+                _col++;
+                break;
+            case NodePosition:
+                if (_col == 0) _node.x = static_cast<float>(value);
+                else if (_col == 1) _node.y = static_cast<float>(value);
+                _col++;
+                break;
+            case NodeObject:
+                if (_key == "id") _node.id = static_cast<int>(value);
+                else if (_key == "floor") _node.floor = static_cast<int>(value);
+                else if (_key == "isDoor") _node.isDoor = value != 0;
+                break;
+            case EdgeObject:
+                if (_key == "source") _edge.source = static_cast<int>(value);
+                else if (_key == "target") _edge.target = static_cast<int>(value);
+                else if (_key == "weight") _edge.weight = static_cast<float>(value);
+                else if (_key == "angle") _edge.angleDeg = static_cast<float>(value);
+                break;
+            default:
+                break;
+        }
+        return true;
+    }
+
+    // once both legacy matrices have been read, turn their nonzero weights into edges
+    void _joinMatrices(){
+        if (_weightRows == 0 || _angleRows == 0)
+            return;
+        std::sort(_weights.begin(), _weights.end());
+        std::sort(_angles.begin(), _angles.end());
+        auto a = _angles.begin();
+        for (const MatrixEntry& w : _weights){
+            while (a != _angles.end() && *a < w)
+                a++;
+            float angle = (a != _angles.end() && a->row == w.row && a->col == w.col) ? a->value : 0.f;
+            if (w.value > 0)
+                edges.push_back({w.row + 1, w.col + 1, w.value, angle});
+        }
+        std::vector<MatrixEntry>().swap(_weights);
+        std::vector<MatrixEntry>().swap(_angles);
+    }
+};
+
+// Parses fileName into handler. Returns false and fills error if the file cannot be read or is not valid json.
+inline bool readGraph(const std::string& fileName, GraphHandler& handler, std::string& error){
+    std::FILE* fp = std::fopen(fileName.c_str(), "rb");
+    if (!fp){
+        error = "cannot open file";
+        return false;
+    }
+    char buffer[65536];
+    rapidjson::FileReadStream stream(fp, buffer, sizeof(buffer));
+    rapidjson::Reader reader;
+    rapidjson::ParseResult result = reader.Parse(stream, handler);
+    std::fclose(fp);
+    if (result.IsError() && !handler.error.empty()){
+        error = handler.error;
+        return false;
+    }
+    if (result.IsError()){
+        error = std::string(rapidjson::GetParseError_En(result.Code())) + " at offset " + std::to_string(result.Offset());
+        return false;
+    }
+    return true;
+}
+
+} // end json namespace
+} // end navgraph namespace
+
+#endif
@@ -1,80 +1,147 @@
 #if !defined(ANNOTATEDMAP_HPP_)
 #define ANNOTATEDMAP_HPP_
 
-#include <opencv2/opencv.hpp>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
 
 #include "MapFeature.hpp"
+#include "MapFiles.hpp"
+#include "BitRaster.hpp"
+#include "RasterCache.hpp"
+#include "RoiIndex.hpp"
+#include "FeatureIndex.hpp"
 #include "../Utils/ParseUtils.hpp" 
+#include "../Utils/Metrics.hpp"
 
 #include <iostream>
 #include <fstream>
 #include <stdio.h>
 #include <string>
 #include <map>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
 
 namespace maps{
-    
-    const std::string _PARSER_FEATURE_TAG = "map_feature";
-    const std::string _PARSER_TYPE_TAG = "id";
-    const std::string _PARSER_POSITION_TAG = "position";
-    const std::string _PARSER_NORMAL_TAG = "normal";
-    const std::string _PARSER_DESCRIPTION_TAG = "name";
-    const std::string _PARSER_DELIMITER = ":";
-    const int         _PARSER_FLOOR_BLOCK_LEN = 5;
 
 class AnnotatedMap{
     
     public:
     
     AnnotatedMap(std::string wallsImageFile, std::string walkableImageFile, std::string mapLandmarksFile, std::string roisImageFile, std::string roisDictionaryFile,
-                 float scale, std::string mapFolder){
+                 float scale, std::string mapFolder, bool buildWallDistanceField = true, bool loadRasters = true, std::string rasterCacheFolder = ""){
             _landmarksFile = mapFolder + '/' + mapLandmarksFile;
             _wallsImageFile = mapFolder + '/' + wallsImageFile;
             _walkableImageFile = mapFolder + '/' + walkableImageFile;
             _roisImageFile = mapFolder + '/' + roisImageFile;
             _roisDictionaryFile = mapFolder + '/' + roisDictionaryFile;
             _scale = scale;
+            _rasterCache = RasterCache(rasterCacheFolder);
 
-            _loadImageData();
+            // without the rasters only the metadata is kept: scale, size (from the image header), features and ROI names
+            if (loadRasters){
+                _loadImageData(buildWallDistanceField);
+            }
+            else
+                _size = _readImageSize(_wallsImageFile);
             _loadFeatures();
             _loadRoisDictionary();
+            _roiIndex.build(_roisImage, _roisDictionary); // without the rasters, only the labels are interned
         }
     
         AnnotatedMap(const AnnotatedMap& annotatedMap) = default;
 
-        inline cv::Mat getWalkableMask() { return _walkMask; }
-        inline cv::Mat getWallsImage()   { return _wallsImage; }
+        // unpacked to 8 bits on every call (0 or 255), meant for drawing
+        inline cv::Mat getWalkableMask() const { return _walkable.toMat(); }
+        inline cv::Mat getWallsImage() const { return _walls.toMat(); }
 
         // Convert u,v position in map to a pixel location in the map image
-        cv::Point2i uv2pixels(cv::Point2d pt){ //assumption: All points in the system are stored row majow, i.e. x denotes rows
+        cv::Point2i uv2pixels(cv::Point2d pt) const { //assumption: All points in the system are stored row majow, i.e. x denotes rows
             cv::Point2i px;
             px.y = _scale * pt.y;
             px.x = _size.height - _scale * pt.x;
             return px;
         }
     
-        inline cv::Size getMapSizePixels()      { return _size; }
-        inline cv::Size getMapSizeMeters()      { return cv::Size(_size.width/_scale, _size.height/_scale); }
-        inline bool isWalkable(cv::Point2i pt)  { if (pt.x < 0 || pt.x >= _size.height || pt.y < 0 || pt.y >= _size.width) return false;
-                                                    bool out; _walkMask.at<unsigned char>(pt.x , pt.y) > 0 ? out = true : out = false; return out; }
-        inline bool isWallAt(cv::Point2i pt)    { if (pt.x < 0 || pt.x >= _size.height || pt.y < 0 || pt.y >= _size.width) return true;
+        inline cv::Size getMapSizePixels() const { return _size; }
+        inline cv::Size getMapSizeMeters() const { return cv::Size(_size.width/_scale, _size.height/_scale); }
+        inline bool isWalkable(cv::Point2i pt) const { if (pt.x < 0 || pt.x >= _size.height || pt.y < 0 || pt.y >= _size.width) return false;
+                                                    return _walkable.test(pt.x, pt.y); }
+        inline bool isWallAt(cv::Point2i pt) const { if (pt.x < 0 || pt.x >= _size.height || pt.y < 0 || pt.y >= _size.width) return true;
 //                                                  cv::Scalar val = _wallsImage.at<uchar>(pt);
 //                                                  cv::Scalar scalar = _wallsImage.at<cv::Scalar_<uchar>>(pt.x, pt.y);
-                                                  bool out; _wallsImage.at<uchar>(pt.x, pt.y) > 0 ? out = true : out = false; return out; }
+                                                  return _walls.test(pt.x, pt.y); }
+    
+        // true if the straight line between two pixels touches a wall (or leaves the map).
+        // Samples one pixel per step along the longer axis, like a float walk from startPt to endPt,
+        // but in 32.32 fixed point so the inner loop is a couple of integer adds and a bit test.
+        // When the wall distance field is available, segments that lie entirely inside the clearance
+        // disc of their midpoint are accepted without walking them.
+        bool isPathCrossingWalls(cv::Point2i startPt, cv::Point2i endPt) const {
+            // the first and last samples are the endpoints themselves, and the map is convex: if they are
+            // inside, every sample in between is too
+            GRAPHNAV_METRIC_ADD(WALL_TESTS, 1);
+            if (!_isInside(startPt) || !_isInside(endPt))
+                return true;
+            int dr = endPt.x - startPt.x;
+            int dc = endPt.y - startPt.y;
+            int span = std::max(abs(dr), abs(dc));  // if more rows than columns then loop over rows; else loop over columns
+            if (span == 0)
+                return _walls.test(startPt.x, startPt.y);
+            
+            // the small bias keeps exact integer positions from being rounded down by the truncated step
+            int64_t r = (static_cast<int64_t>(startPt.x) << 32) + _FIXED_POINT_BIAS;
+            int64_t c = (static_cast<int64_t>(startPt.y) << 32) + _FIXED_POINT_BIAS;
+            int64_t stepR = (static_cast<int64_t>(dr) << 32) / span;
+            int64_t stepC = (static_cast<int64_t>(dc) << 32) / span;
+            
+            if (!_wallDistance.empty()){
+                int mid = span / 2;
+                int midR = static_cast<int>((r + stepR * mid) >> 32);
+                int midC = static_cast<int>((c + stepC * mid) >> 32);
+                int clearance = _wallDistance.at<uchar>(midR, midC);
+                if (clearance == 0)
+                    return true;
+                // every sample is within half a length (plus the rounding of both) from the middle one
+                float halfLength = 0.5f * std::sqrt(static_cast<float>(dr*dr + dc*dc));
+                if (clearance - _SQRT2 > halfLength + 1.f){
+                    GRAPHNAV_METRIC_ADD(WALL_CLEARANCE_ACCEPTS, 1);
+                    return false;
+                }
+            }
+            
+            const uint64_t* walls = _walls.data();
+            size_t stride = _walls.wordsPerRow();
+            for (int k = 0; k <= span; k++){ // k goes from 0 through span; e.g., a span of 2 implies there are 2+1=3 pixels to reach in loop
+                size_t col = static_cast<size_t>(c >> 32);
+                if ((walls[static_cast<size_t>(r >> 32) * stride + (col >> 6)] >> (col & 63)) & 1){
+                    GRAPHNAV_METRIC_ADD(WALL_PIXELS, k + 1);
+                    return true;
+                }
+                r += stepR;
+                c += stepC;
+            }
+            GRAPHNAV_METRIC_ADD(WALL_PIXELS, span + 1);
+            return false;
+        }
     
-        inline std::multimap<FeatureType, MapFeature> getLandmarksList() const { return _landmarks; }
+        inline const std::multimap<FeatureType, MapFeature>& getLandmarksList() const { return _landmarks; }
+        // radius and k-nearest queries over the landmarks, in u,v
+        inline const FeatureIndex& getFeatureIndex() const { return _featureIndex; }
     
-        inline std::string getRoiLabel(int idx) {
+        inline std::string getRoiLabel(int idx) const {
                 auto it = _roisDictionary.find(idx);
                 if (it != _roisDictionary.end())
                     return it->second;
                 else return "";
         }
     
-        void showFeatures(){
-            cv::Mat map;
-            _wallsImage.copyTo(map);
-            cv::cvtColor(map, map, cv::COLOR_GRAY2RGB);
+        // walls image with the exit signs drawn on it
+        cv::Mat drawFeatures() const {
+            cv::Mat map = getWallsImageRGB();
             auto lmarks = _landmarks.find(maps::FeatureType::EXIT_SIGN);
             
             for(auto mf = lmarks; mf != _landmarks.end(); mf++){
@@ -83,40 +150,50 @@ class AnnotatedMap{
                 cv::circle(map, cv::Point(px.y,px.x)  , 3, cv::Scalar(0,150,255));
                 cv::circle(map, cv::Point(px.y,px.x)  , 1, cv::Scalar(0,150,255));
             }
-            cv::imshow("Features", map);
+            return map;
         }
     
-    cv::Point2d pixels2uv(cv::Point2i pt){
+    cv::Point2d pixels2uv(cv::Point2i pt) const {
         cv::Point2d pt_mt;
         pt_mt.y = (pt.y) / _scale;
         pt_mt.x = (_size.height - pt.x) / _scale;
         return pt_mt;
     }
     
-    inline double getScale() { return _scale; }
+    inline double getScale() const { return _scale; }
     
-    cv::Mat getWallsImageRGB() { return _wallsImageRGB; }
+    // converted on every call, the RGB copy is only needed for drawing
+    cv::Mat getWallsImageRGB() const {
+        cv::Mat rgb;
+        cv::cvtColor(_walls.toMat(), rgb, cv::COLOR_GRAY2RGB);
+        return rgb;
+    }
+    
+    inline bool hasRasters() const { return !_walls.empty(); }
+    
+    // memory held by the decoded images
+    size_t rasterBytes() const {
+        size_t bytes = 0;
+        for (const cv::Mat* m : {&_roisImage, &_wallDistance})
+            bytes += m->total() * m->elemSize();
+        bytes += _walls.bytes() + _walkable.bytes() + _roiIndex.bytes();
+        return bytes;
+    }
     
-    inline int getRoiAt(cv::Point2i pt) { return (int) _roisImage.at<unsigned char>(pt.x, pt.y); }
+    // ROI value at pt, 0 outside the image
+    inline int getRoiAt(cv::Point2i pt) const { return _roiIndex.roiAt(pt); }
+    // run-length encoded ROI image with interned labels, for labelling many points or whole tracks
+    inline const RoiIndex& getRoiIndex() const { return _roiIndex; }
     
-    std::string getClosestPOI(cv::Point2i pt){
+    // label of the nearest feature other than an exit sign within 1.5 m of pt
+    std::string getClosestPOI(cv::Point2i pt) const {
+        GRAPHNAV_METRIC_TIMER(POI_LATENCY);
+        GRAPHNAV_METRIC_ADD(POI_QUERIES, 1);
         cv::Point2f pt_mt = pixels2uv(pt);
-        cv::Point2f featPt;
-        double minDist = 1e6;
-        double thrDist = 1.5;
-        std::string label = " ";
-        for (auto it = _landmarks.begin(); it != _landmarks.end(); ++it){
-            if (it->first != EXIT_SIGN){
-                double res = cv::norm(pt_mt-it->second.position);
-                if (res < minDist && res <= thrDist){
-                    minDist = res;
-                    label = it->second.description;
-                }
-            }
-        }
-        
-        if (minDist <= thrDist)
-            return "Near " + label;
+        const double thrDist = 1.5;
+        const MapFeature* poi = _featureIndex.closest(pt_mt, ALL_FEATURES & ~featureMask(EXIT_SIGN), thrDist);
+        if (poi)
+            return "Near " + poi->description;
         else return " ";
     }
     
@@ -130,95 +207,114 @@ class AnnotatedMap{
         std::string _roisImageFile;
         std::string _roisDictionaryFile;
         
-        cv::Mat _wallsImage;
-        cv::Mat _walkMask;
-        cv::Mat _wallsImageRGB;
+        BitRaster _walls;    // nonzero pixels of the walls image
+        BitRaster _walkable; // nonzero pixels of the walkable image
         cv::Mat _roisImage;
+        cv::Mat _wallDistance; // CV_8U, distance in pixels (rounded down, saturated) from each pixel to the closest wall
+        RoiIndex _roiIndex;
+        RasterCache _rasterCache;
+        std::vector<std::shared_ptr<const void>> _cacheFiles; // mapped cache entries _roisImage and _wallDistance point into
     
         cv::Size _size;
     
+        static constexpr float _SQRT2 = 1.41421356f;
+        static const int64_t _FIXED_POINT_BIAS = int64_t(1) << 19;
+    
+        inline bool _isInside(cv::Point2i pt) const { return pt.x >= 0 && pt.x < _size.height && pt.y >= 0 && pt.y < _size.width; }
+    
         std::map<int, std::string> _roisDictionary;
         
         std::multimap<FeatureType, MapFeature> _landmarks;
+        FeatureIndex _featureIndex;
     
     
 
-        void _loadImageData(){
-            _wallsImage = cv::imread(_wallsImageFile, cv::IMREAD_GRAYSCALE);
-            cv::cvtColor(_wallsImage, _wallsImageRGB, cv::COLOR_GRAY2RGB);
-            _walkMask   = cv::imread(_walkableImageFile, cv::IMREAD_GRAYSCALE);
-            _size    = cv::Size(_wallsImage.cols, _wallsImage.rows);
-            _roisImage = cv::imread(_roisImageFile, cv::IMREAD_GRAYSCALE);
+        void _loadImageData(bool buildWallDistanceField){
+            GRAPHNAV_METRIC_TIMER(MAP_LOAD_LATENCY);
+            // the binary layers are packed as soon as they are decoded, the 8-bit images are not kept.
+            // Layers found in the raster cache are mapped instead, and the decoded ones are added to it
+            uint64_t wallsKey = _rasterCache.key(_wallsImageFile);
+            cv::Mat wallsImage;
+            _walls = _rasterCache.loadBits(wallsKey);
+            if (_walls.empty()){
+                wallsImage = cv::imread(_wallsImageFile, cv::IMREAD_GRAYSCALE);
+                _walls = BitRaster(wallsImage);
+                _rasterCache.storeBits(wallsKey, _walls);
+            }
+            uint64_t walkableKey = _rasterCache.key(_walkableImageFile);
+            _walkable = _rasterCache.loadBits(walkableKey);
+            if (_walkable.empty()){
+                _walkable = BitRaster(cv::imread(_walkableImageFile, cv::IMREAD_GRAYSCALE));
+                _rasterCache.storeBits(walkableKey, _walkable);
+            }
+            _size    = cv::Size(_walls.cols(), _walls.rows());
+            uint64_t roisKey = _rasterCache.key(_roisImageFile);
+            _roisImage = _loadCachedPixels(roisKey, RasterCache::PIXELS);
+            if (_roisImage.empty()){
+                _roisImage = cv::imread(_roisImageFile, cv::IMREAD_GRAYSCALE);
+                _rasterCache.storePixels(roisKey, RasterCache::PIXELS, _roisImage);
+            }
+            if (buildWallDistanceField){
+                _wallDistance = _loadCachedPixels(wallsKey, RasterCache::WALL_DISTANCE);
+                if (_wallDistance.empty()){
+                    _buildWallDistanceField(wallsImage.empty() ? _walls.toMat() : wallsImage);
+                    _rasterCache.storePixels(wallsKey, RasterCache::WALL_DISTANCE, _wallDistance);
+                }
+            }
+            GRAPHNAV_METRIC_ADD(MAP_LOADS, 1);
+            GRAPHNAV_METRIC_ADD(MAP_LOAD_BYTES, rasterBytes());
             //cv::threshold(_wallsImage, _wallsImage, 0, 255, cv::THRESH_BINARY);
             //cv::threshold(_walkMask, _walkMask, 0, 255, cv::THRESH_BINARY);
             //cv::imshow("WALK", _walkMask);
         }
     
-        void _loadRoisDictionary() {
-            std::ifstream inFile(_roisDictionaryFile, std::ifstream::in);
-            std::string strLine;
-            while (inFile.good()){
-                getline(inFile, strLine);
-                parseutils::IndexValuePair indexValPair = parseutils::splitIndexValue(strLine, ",");
-                _roisDictionary.insert(indexValPair);
-            }
+        cv::Mat _loadCachedPixels(uint64_t key, RasterCache::Kind kind){
+            std::shared_ptr<const void> file;
+            cv::Mat image = _rasterCache.loadPixels(key, kind, file);
+            if (file)
+                _cacheFiles.push_back(file);
+            return image;
         }
     
-        void _loadFeatures(){ _parseYamlFeaturesFile();}
-    
-        MapFeature _initMapFeature(std::ifstream& inFile){
-            int lineCnt = 0;
-            std::string strLine;
-            MapFeature mapFeature;
-            
-            while (lineCnt < _PARSER_FLOOR_BLOCK_LEN){
-                getline(inFile, strLine);
-                parseutils::KeyValuePair keyValPair = parseutils::splitKeyValue(strLine, _PARSER_DELIMITER);
-                
-                if (keyValPair.first == _PARSER_TYPE_TAG){
-                    std::size_t found = keyValPair.second.find("aruco");
-                    if (found!=std::string::npos)
-                        mapFeature.type = ARUCO;
-                    else if (keyValPair.second == "exit_sign")
-                        mapFeature.type = EXIT_SIGN;
-                }
-                
-                else if (keyValPair.first == _PARSER_DESCRIPTION_TAG)
-                    mapFeature.description = keyValPair.second;
-                
-                else if (keyValPair.first == _PARSER_POSITION_TAG){
-                    std::vector<double> v = parseutils::parseCSVArray<double>(keyValPair.second);
-                    mapFeature.position = cv::Point2f(v[1], v[0]); // the features file has the coord swapped
-                }
-                
-                else if(keyValPair.first == _PARSER_NORMAL_TAG){
-                    std::vector<int> v = parseutils::parseCSVArray<int>(keyValPair.second);
-                    mapFeature.normal = cv::Vec2i(v[0], v[1]);
-            }
-                lineCnt++;
+        // size of an image from the header of bmp and png files, other formats are decoded
+        static cv::Size _readImageSize(const std::string& fileName){
+            unsigned char h[26] = {0};
+            std::ifstream in(fileName, std::ios::binary);
+            in.read(reinterpret_cast<char*>(h), sizeof(h));
+            if (in.gcount() == sizeof(h)){
+                auto le32 = [&](int o){ return static_cast<int32_t>(h[o] | (h[o+1] << 8) | (h[o+2] << 16) | (static_cast<uint32_t>(h[o+3]) << 24)); };
+                auto be32 = [&](int o){ return static_cast<int32_t>((static_cast<uint32_t>(h[o]) << 24) | (h[o+1] << 16) | (h[o+2] << 8) | h[o+3]); };
+                if (h[0] == 'B' && h[1] == 'M')
+                    return cv::Size(le32(18), std::abs(le32(22))); // negative height: top-down rows
+                static const unsigned char png[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+                if (std::equal(png, png + 8, h))
+                    return cv::Size(be32(16), be32(20));
             }
-            return mapFeature;
+            cv::Mat image = cv::imread(fileName, cv::IMREAD_GRAYSCALE);
+            return cv::Size(image.cols, image.rows);
         }
-        
-        // TODO: implement parser to populate _landmarks
-        void _parseYamlFeaturesFile(){
-            
-            std::ifstream inFile(_landmarksFile, std::ifstream::in);
-            std::string strLine;
-
-            while (inFile.good()){
-                getline(inFile, strLine);
-                parseutils::KeyValuePair keyValPair = parseutils::splitKeyValue(strLine, _PARSER_DELIMITER);
-                
-                // parse map features
-                if (keyValPair.first == _PARSER_FEATURE_TAG){
-                    MapFeature mf = _initMapFeature(inFile);
-                    _landmarks.insert(std::make_pair(mf.type, mf));
-                }
-                //std::cout << strLine << std::endl;
+    
+        void _buildWallDistanceField(const cv::Mat& wallsImage){
+            cv::Mat freeSpace, dist;
+            cv::threshold(wallsImage, freeSpace, 0, 255, cv::THRESH_BINARY_INV);
+            cv::distanceTransform(freeSpace, dist, cv::DIST_L2, cv::DIST_MASK_PRECISE);
+            // round down (convertTo would round to nearest), so the stored clearance is never overestimated
+            _wallDistance.create(dist.rows, dist.cols, CV_8U);
+            for (int r = 0; r < dist.rows; r++){
+                const float* d = dist.ptr<float>(r);
+                uchar* out = _wallDistance.ptr<uchar>(r);
+                for (int c = 0; c < dist.cols; c++)
+                    out[c] = static_cast<uchar>(std::min(d[c], 255.f));
             }
-
-            inFile.close();
+        }
+    
+        void _loadRoisDictionary() {
+            parseMappedFile(_roisDictionaryFile, [this](const char* data, size_t size){ parseRoisDictionary(data, size, _roisDictionary); });
+        }
+    
+        void _loadFeatures(){
+            parseMappedFile(_landmarksFile, [this](const char* data, size_t size){ parseFeatures(data, size, _landmarks); });
+            _featureIndex.build(_landmarks);
         }
 
 };
@@ -0,0 +1,75 @@
+#if !defined(BITRASTER_HPP_)
+#define BITRASTER_HPP_
+
+#include <opencv2/core/core.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace maps{
+
+// Binary image packed one bit per pixel, rows padded to whole 64-bit words. Pixel (r, c) is bit
+// c % 64 of word c / 64 of row r. Eight times smaller than the 8-bit mask it is built from, so the
+// rows a line walk touches stay in cache.
+// The words are immutable once built, so copies share them; they may also live in memory owned by
+// someone else, such as a mapped file of the raster cache.
+class BitRaster{
+
+public:
+
+    BitRaster() : _rows(0), _cols(0), _wordsPerRow(0), _data(nullptr) { ; }
+
+    // nonzero pixels of a CV_8U image are set
+    explicit BitRaster(const cv::Mat& image) : _rows(image.rows), _cols(image.cols), _wordsPerRow((image.cols + 63) / 64) {
+        std::shared_ptr<std::vector<uint64_t>> words = std::make_shared<std::vector<uint64_t>>(static_cast<size_t>(_rows) * _wordsPerRow, 0);
+        for (int r = 0; r < _rows; r++){
+            const uchar* px = image.ptr<uchar>(r);
+            uint64_t* row = words->data() + static_cast<size_t>(r) * _wordsPerRow;
+            for (int c = 0; c < _cols; c++)
+                if (px[c])
+                    row[c >> 6] |= uint64_t(1) << (c & 63);
+        }
+        _data = words->data();
+        _owner = std::move(words);
+    }
+
+    // rows x cols raster over words laid out as above, which owner keeps alive
+    BitRaster(int rows, int cols, const uint64_t* words, std::shared_ptr<const void> owner)
+        : _rows(rows), _cols(cols), _wordsPerRow((cols + 63) / 64), _data(words), _owner(std::move(owner)) { ; }
+
+    inline bool empty() const { return _rows == 0; }
+    inline int rows() const { return _rows; }
+    inline int cols() const { return _cols; }
+    inline size_t wordsPerRow() const { return _wordsPerRow; }
+    inline const uint64_t* data() const { return _data; }
+    inline size_t bytes() const { return static_cast<size_t>(_rows) * _wordsPerRow * sizeof(uint64_t); }
+
+    // no bounds check
+    inline bool test(int r, int c) const {
+        return (_data[static_cast<size_t>(r) * _wordsPerRow + (c >> 6)] >> (c & 63)) & 1;
+    }
+
+    // CV_8U image, 255 where the bit is set
+    cv::Mat toMat() const {
+        cv::Mat image(_rows, _cols, CV_8U);
+        for (int r = 0; r < _rows; r++){
+            uchar* px = image.ptr<uchar>(r);
+            for (int c = 0; c < _cols; c++)
+                px[c] = test(r, c) ? 255 : 0;
+        }
+        return image;
+    }
+
+private:
+
+    int _rows;
+    int _cols;
+    size_t _wordsPerRow;
+    const uint64_t* _data;
+    std::shared_ptr<const void> _owner; // keeps _data alive
+};
+
+} // ::maps
+
+#endif // BITRASTER_HPP_
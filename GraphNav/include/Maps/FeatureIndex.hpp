@@ -0,0 +1,220 @@
+#if !defined(FEATUREINDEX_HPP_)
+#define FEATUREINDEX_HPP_
+
+#include "MapFeature.hpp"
+#include "../Utils/Metrics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <vector>
+
+namespace maps{
+
+// set of feature types, e.g. ALL_FEATURES & ~featureMask(EXIT_SIGN)
+typedef unsigned FeatureMask;
+inline FeatureMask featureMask(FeatureType type) { return 1u << type; }
+const FeatureMask ALL_FEATURES = ~0u;
+
+// Uniform grid over the u,v positions of the features of a floor. Radius and k-nearest queries
+// visit only the cells around the query point, and return pointers into the index instead of
+// copies of the features. Features keep the order of the multimap they were built from: among
+// features at the same distance the one that comes first there wins, as in a linear scan.
+class FeatureIndex{
+
+public:
+
+    struct Hit{
+        const MapFeature* feature;
+        double distance; // meters
+    };
+
+    FeatureIndex() : _cellSize(1.f), _cols(0), _rows(0) { ; }
+
+    void build(const std::multimap<FeatureType, MapFeature>& features){
+        _features.clear();
+        for (const auto& f : features)
+            _features.push_back(f.second);
+        _cellOffsets.clear();
+        _cellItems.clear();
+        _cols = _rows = 0;
+        if (_features.empty())
+            return;
+
+        cv::Point2f lo(std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+        cv::Point2f hi(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+        for (const MapFeature& f : _features){
+            lo.x = std::min(lo.x, f.position.x); lo.y = std::min(lo.y, f.position.y);
+            hi.x = std::max(hi.x, f.position.x); hi.y = std::max(hi.y, f.position.y);
+        }
+        // about two features per cell
+        float extent = std::max(std::max(hi.x - lo.x, hi.y - lo.y), 1e-3f);
+        float cellsPerSide = std::min(std::sqrt(_features.size() / 2.f) + 1.f, static_cast<float>(_MAX_CELLS_PER_SIDE));
+        _cellSize = extent / cellsPerSide;
+        _origin = lo;
+        _cols = std::min(static_cast<int>((hi.x - lo.x) / _cellSize) + 1, static_cast<int>(_MAX_CELLS_PER_SIDE));
+        _rows = std::min(static_cast<int>((hi.y - lo.y) / _cellSize) + 1, static_cast<int>(_MAX_CELLS_PER_SIDE));
+
+        // counting sort by cell, keeping the feature order within each cell
+        _cellOffsets.assign(_cols * _rows + 1, 0);
+        for (const MapFeature& f : _features)
+            _cellOffsets[_cell(f.position) + 1]++;
+        for (size_t c = 1; c < _cellOffsets.size(); c++)
+            _cellOffsets[c] += _cellOffsets[c-1];
+        _cellItems.resize(_features.size());
+        std::vector<int> cursor(_cellOffsets.begin(), _cellOffsets.end() - 1);
+        for (int i = 0; i < static_cast<int>(_features.size()); i++)
+            _cellItems[cursor[_cell(_features[i].position)]++] = i;
+    }
+
+    inline size_t size() const { return _features.size(); }
+    inline const std::vector<MapFeature>& features() const { return _features; }
+
+    // calls fn(const MapFeature&, double distance) for every feature of the types in mask within radius of uv, in no particular order
+    template <typename Fn>
+    void forEachWithin(cv::Point2f uv, double radius, FeatureMask mask, Fn fn) const {
+        if (_cols == 0 || !(radius >= 0))
+            return;
+        int c0 = _col(static_cast<float>(uv.x - radius)), c1 = _col(static_cast<float>(uv.x + radius));
+        int r0 = _row(static_cast<float>(uv.y - radius)), r1 = _row(static_cast<float>(uv.y + radius));
+        for (int r = r0; r <= r1; r++){
+            for (int c = c0; c <= c1; c++){
+                int cell = r * _cols + c;
+                for (int k = _cellOffsets[cell]; k < _cellOffsets[cell+1]; k++){
+                    const MapFeature& f = _features[_cellItems[k]];
+                    if (!(mask & featureMask(f.type)))
+                        continue;
+                    double d = _distance(uv, f);
+                    if (d <= radius)
+                        fn(f, d);
+                }
+            }
+        }
+    }
+
+    // features within radius, nearest first
+    void withinRadius(cv::Point2f uv, double radius, FeatureMask mask, std::vector<Hit>& out) const {
+        out.clear();
+        forEachWithin(uv, radius, mask, [&](const MapFeature& f, double d){ out.push_back({&f, d}); });
+        std::sort(out.begin(), out.end(), [this](const Hit& a, const Hit& b){ return _closer(a, b); });
+    }
+
+    // the k features nearest to uv (fewer if there are not as many within maxRadius), nearest first
+    void nearest(cv::Point2f uv, size_t k, FeatureMask mask, std::vector<Hit>& out,
+                 double maxRadius = std::numeric_limits<double>::infinity()) const {
+        out.clear();
+        if (_cols == 0 || k == 0)
+            return;
+        auto closer = [this](const Hit& a, const Hit& b){ return _closer(a, b); };
+        size_t examined = 0;
+        int pc = _col(uv.x), pr = _row(uv.y);
+        int maxRing = std::max(std::max(pc, _cols - 1 - pc), std::max(pr, _rows - 1 - pr));
+        for (int ring = 0; ring <= maxRing; ring++){
+            _forEachCellInRing(pc, pr, ring, [&](int cell){
+                examined += _cellOffsets[cell+1] - _cellOffsets[cell];
+                for (int j = _cellOffsets[cell]; j < _cellOffsets[cell+1]; j++){
+                    const MapFeature& f = _features[_cellItems[j]];
+                    if (!(mask & featureMask(f.type)))
+                        continue;
+                    Hit hit = {&f, _distance(uv, f)};
+                    if (hit.distance > maxRadius)
+                        continue;
+                    // out is a max-heap on distance while it is being filled
+                    if (out.size() < k){
+                        out.push_back(hit);
+                        std::push_heap(out.begin(), out.end(), closer);
+                    }
+                    else if (closer(hit, out.front())){
+                        std::pop_heap(out.begin(), out.end(), closer);
+                        out.back() = hit;
+                        std::push_heap(out.begin(), out.end(), closer);
+                    }
+                }
+            });
+            // everything beyond this ring is farther than the ring bound
+            double bound = _ringBound(uv, pc, pr, ring);
+            if (bound > maxRadius || (out.size() == k && out.front().distance < bound))
+                break;
+        }
+        std::sort_heap(out.begin(), out.end(), closer);
+        GRAPHNAV_METRIC_ADD(POI_FEATURES, examined);
+    }
+
+    // nearest feature of the types in mask within maxRadius, null if there is none
+    const MapFeature* closest(cv::Point2f uv, FeatureMask mask, double maxRadius, double* distance = nullptr) const {
+        static thread_local std::vector<Hit> hits;
+        nearest(uv, 1, mask, hits, maxRadius);
+        if (hits.empty())
+            return nullptr;
+        if (distance)
+            *distance = hits[0].distance;
+        return hits[0].feature;
+    }
+
+private:
+
+    static const int _MAX_CELLS_PER_SIDE = 1024;
+
+    std::vector<MapFeature> _features; // in multimap order
+    cv::Point2f _origin;
+    float _cellSize;
+    int _cols;
+    int _rows;
+    std::vector<int> _cellOffsets; // CSR over cells, row-major
+    std::vector<int> _cellItems;   // feature indices
+
+    // same arithmetic as cv::norm(uv - position)
+    static inline double _distance(cv::Point2f uv, const MapFeature& f){
+        cv::Point2f d = uv - f.position;
+        return std::sqrt(static_cast<double>(d.x) * d.x + static_cast<double>(d.y) * d.y);
+    }
+
+    // by distance, then by position in the multimap
+    inline bool _closer(const Hit& a, const Hit& b) const {
+        return a.distance < b.distance || (a.distance == b.distance && a.feature < b.feature);
+    }
+
+    inline int _col(float x) const { return _clampedCell((x - _origin.x) / _cellSize, _cols); }
+    inline int _row(float y) const { return _clampedCell((y - _origin.y) / _cellSize, _rows); }
+    // clamped while still a float, so huge or infinite coordinates never overflow the cast; NaN gives 0
+    static inline int _clampedCell(float pos, int count){
+        if (!(pos >= 1.f))
+            return 0;
+        if (pos >= static_cast<float>(count - 1))
+            return count - 1;
+        return static_cast<int>(pos);
+    }
+    inline int _cell(cv::Point2f p) const { return _row(p.y) * _cols + _col(p.x); }
+
+    // distance from pt to the outside of the square of cells within ring of (pc, pr);
+    // infinite on the sides where the square already reaches the border of the grid
+    double _ringBound(cv::Point2f pt, int pc, int pr, int ring) const {
+        double bound = std::numeric_limits<double>::infinity();
+        if (pc - ring > 0)
+            bound = std::min(bound, static_cast<double>(pt.x - (_origin.x + (pc - ring) * _cellSize)));
+        if (pc + ring < _cols - 1)
+            bound = std::min(bound, static_cast<double>(_origin.x + (pc + ring + 1) * _cellSize - pt.x));
+        if (pr - ring > 0)
+            bound = std::min(bound, static_cast<double>(pt.y - (_origin.y + (pr - ring) * _cellSize)));
+        if (pr + ring < _rows - 1)
+            bound = std::min(bound, static_cast<double>(_origin.y + (pr + ring + 1) * _cellSize - pt.y));
+        return std::max(bound, 0.0);
+    }
+
+    template <typename CellFn>
+    void _forEachCellInRing(int pc, int pr, int ring, CellFn fn) const {
+        int r0 = pr - ring, r1 = pr + ring, c0 = pc - ring, c1 = pc + ring;
+        for (int r = std::max(r0, 0); r <= std::min(r1, _rows - 1); r++){
+            bool edgeRow = (r == r0 || r == r1);
+            for (int c = c0; c <= c1; c += (edgeRow || c == c1) ? 1 : (c1 - c0)){
+                if (c >= 0 && c < _cols)
+                    fn(r * _cols + c);
+            }
+        }
+    }
+};
+
+} // ::maps
+
+#endif // FEATUREINDEX_HPP_
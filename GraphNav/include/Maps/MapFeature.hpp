@@ -2,7 +2,7 @@
 #define MAPFEATURE_HPP_
 
 #include <stdio.h>
-#include <opencv2/opencv.hpp>
+#include <opencv2/core/core.hpp>
 
 namespace maps{
 
@@ -0,0 +1,114 @@
+#if !defined(MAPFILES_HPP_)
+#define MAPFILES_HPP_
+
+#include "MapFeature.hpp"
+#include "../Utils/MappedFile.hpp"
+#include "../Utils/ParseUtils.hpp"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace maps{
+
+// Parsers of the text files of a map folder. They run over the file mapped in memory and only
+// allocate for what they keep (labels, floor details). Lines are "key: value" pairs, indentation is
+// ignored, keys may come in any order and missing ones leave their defaults; unknown keys and
+// malformed lines are skipped.
+//
+//  info.yml        building_name: <name>, then a "floor:" block per floor running up to the next one
+//  features file   a "map_feature:" block per feature with name, id ("aruco <n>" or "exit_sign"),
+//                  position ([v, u] in meters) and normal ([x, y]); orientation is not used
+//  ROI dictionary  "<index>, <label>" lines; the first label of an index is kept
+
+const std::string _PARSER_LOCATION_NAME_TAG = "building_name";
+const std::string _PARSER_FLOOR_TAG = "floor";
+const std::string _PARSER_FEATURE_TAG = "map_feature";
+const std::string _PARSER_TYPE_TAG = "id";
+const std::string _PARSER_POSITION_TAG = "position";
+const std::string _PARSER_NORMAL_TAG = "normal";
+const std::string _PARSER_DESCRIPTION_TAG = "name";
+
+// maps fileName and passes its bytes to parse(data, size); false if it cannot be mapped (missing or empty)
+template <typename ParseFn>
+bool parseMappedFile(const std::string& fileName, ParseFn parse){
+    fileutils::MappedFile file;
+    if (!file.open(fileName))
+        return false;
+    parse(file.data(), file.size());
+    return true;
+}
+
+// floor blocks of info.yml, in file order
+inline void parseSiteInfo(const char* data, size_t size, std::string& buildingName, std::vector<std::map<std::string, std::string>>& floors){
+    parseutils::LineReader lines(data, size);
+    parseutils::StringRef line, key, value;
+    std::map<std::string, std::string>* floor = nullptr;
+    while (lines.next(line)){
+        if (!parseutils::splitKeyValue(line, ':', key, value))
+            continue;
+        if (key == _PARSER_LOCATION_NAME_TAG)
+            buildingName = value.str();
+        else if (key == _PARSER_FLOOR_TAG){
+            floors.emplace_back();
+            floor = &floors.back();
+        }
+        else if (floor)
+            floor->insert(std::make_pair(key.str(), value.str()));
+    }
+}
+
+// appends the features of a features file to features
+inline void parseFeatures(const char* data, size_t size, std::multimap<FeatureType, MapFeature>& features){
+    parseutils::LineReader lines(data, size);
+    parseutils::StringRef line, key, value;
+    MapFeature feature = MapFeature();
+    bool open = false;
+    while (lines.next(line)){
+        if (!parseutils::splitKeyValue(line, ':', key, value))
+            continue;
+        if (key == _PARSER_FEATURE_TAG){
+            if (open)
+                features.emplace(feature.type, std::move(feature));
+            feature = MapFeature();
+            open = true;
+        }
+        else if (!open)
+            continue;
+        else if (key == _PARSER_TYPE_TAG){
+            if (value.contains("aruco"))
+                feature.type = ARUCO;
+            else if (value == "exit_sign")
+                feature.type = EXIT_SIGN;
+        }
+        else if (key == _PARSER_DESCRIPTION_TAG)
+            feature.description.assign(value.data, value.size);
+        else if (key == _PARSER_POSITION_TAG){
+            double v[2];
+            if (parseutils::parseArray(value, v, 2) == 2)
+                feature.position = cv::Point2f(v[1], v[0]); // the features file has the coord swapped
+        }
+        else if (key == _PARSER_NORMAL_TAG){
+            int v[2];
+            if (parseutils::parseArray(value, v, 2) == 2)
+                feature.normal = cv::Vec2i(v[0], v[1]);
+        }
+    }
+    if (open)
+        features.emplace(feature.type, std::move(feature));
+}
+
+inline void parseRoisDictionary(const char* data, size_t size, std::map<int, std::string>& dictionary){
+    parseutils::LineReader lines(data, size);
+    parseutils::StringRef line, key, value;
+    while (lines.next(line)){
+        int index;
+        if (parseutils::splitKeyValue(line, ',', key, value) && parseutils::parseNumber(key.begin(), key.end(), index))
+            dictionary.insert(std::make_pair(index, value.str()));
+    }
+}
+
+} // ::maps
+
+#endif // MAPFILES_HPP_
@@ -3,17 +3,25 @@
 
 #include "AnnotatedMap.hpp"
 #include "../Utils/ParseUtils.hpp"
+#include "../Utils/WorkStealingPool.hpp"
 #include <opencv2/core/core.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <iostream>
 #include <stdlib.h>
 
 
 namespace maps{
     
-    const std::string _PARSER_LOCATION_NAME_TAG = "building_name";
-    const std::string _PARSER_FLOOR_TAG = "floor";
     const std::string _PARSER_ID_TAG = "id";
     const std::string _PARSER_FEATURES_FILE_TAG = "features_file";
     const std::string _PARSER_WALLS_TAG = "walls";
@@ -21,122 +29,367 @@ namespace maps{
     const std::string _PARSER_ROIS_TAG = "rois";
     const std::string _PARSER_ROIS_DICTIONARY_TAG = "rois_dictionary";
     const std::string _PARSER_SCALE_TAG = "scale";
-    const std::string _PARSER_MAN_DELIMITER = ":";
-    const int         _PARSER_BLOCK_LEN = 7;
 
 using FloorNumber = int;
 
+// Floors are listed eagerly: scale, image size, features and ROI names are read by init. The rasters
+// (walls, walkable and ROI images and the wall distance field) are decoded on the first query that
+// needs them and, when a memory budget is set, the least recently used floors are dropped to stay
+// within it. Queries hold a reference to the floor they use, so eviction never pulls the images
+// from under a running query: the memory is released when the last user is done with it.
+// Floors are opened in parallel, and with a raster cache (see RasterCache.hpp) the rasters decoded
+// once are mapped from disk by later runs instead of being decoded again.
 class MapManager{
 
     public:
       
+        // floor used by the overloads without a floor argument, meant for the interactive tools.
+        // Servers should pass the floor explicitly: the floor-explicit queries can run on any number
+        // of threads at the same time.
         int currentFloor;
 
         MapManager(){_TAG = "MapManager";}
-        //MapManager(const MapManager& mapManager) = default;
+        MapManager(const MapManager&) = delete;
+        MapManager& operator=(const MapManager&) = delete;
     
-        void init(std::string imapFolder, int icurrentFloor){
+        ~MapManager(){
+            {
+                std::lock_guard<std::mutex> lock(_prefetchMutex);
+                _prefetchStop = true;
+            }
+            _prefetchWake.notify_all();
+            if (_prefetchThread.joinable())
+                _prefetchThread.join();
+        }
+    
+        // precomputeWallDistance: build a wall distance field per floor to speed up isPathCrossingWalls.
+        // The floors are opened on numThreads threads, 0 for one per core.
+        void init(std::string imapFolder, int icurrentFloor, bool precomputeWallDistance = true, unsigned numThreads = 0){
             _mapFolder = imapFolder;
+            _precomputeWallDistance = precomputeWallDistance;
             currentFloor = icurrentFloor;
             _mapFile = _mapFolder + "/info.yml";
-            _loadMaps();
+            _loadMaps(numThreads);
+        }
+    
+        // folder of the decoded rasters kept between runs, created if needed; empty (the default)
+        // to always decode the images. Set it before any floor is loaded.
+        inline void setRasterCache(const std::string& folder) { _rasterCacheFolder = folder; }
+        inline const std::string& getRasterCache() const { return _rasterCacheFolder; }
+    
+        // bytes of decoded rasters kept in memory, 0 (the default) for no limit. Can be changed at any time.
+        void setMemoryBudget(size_t bytes){
+            std::lock_guard<std::mutex> lock(_cacheMutex);
+            _budget = bytes;
+            _evict(-1);
         }
+        inline size_t getMemoryBudget() const { std::lock_guard<std::mutex> lock(_cacheMutex); return _budget; }
+    
+        // when a floor is loaded on demand, load the floors just above and below it in the background,
+        // as long as they fit in the budget without evicting anything
+        inline void setPrefetchAdjacentFloors(bool prefetch) { _prefetchAdjacent = prefetch; }
+    
+        // decodes the rasters of floor now instead of on first use
+        inline void preload(int floor) const { getMap(floor); }
+        // decodes the rasters of every floor on numThreads threads, 0 for one per core. With a memory
+        // budget smaller than the whole site, the floors loaded last push the first ones out.
+        void preloadAll(unsigned numThreads = 0) const {
+            _forEachFloor(numThreads, [this](int floor, Floor&){ _acquire(floor, false); });
+        }
+        inline bool isLoaded(int floor) const { return std::atomic_load(&_floors.at(floor)->map) != nullptr; }
+        inline size_t residentBytes() const { std::lock_guard<std::mutex> lock(_cacheMutex); return _resident; }
 
-        inline cv::Point2i uv2pixels(cv::Point2f pt)      { return _maps.at(currentFloor).uv2pixels(pt); }
-        inline cv::Point2i uv2pixels(cv::Vec2f pt)        { return _maps.at(currentFloor).uv2pixels(cv::Point2f(pt[0], pt[1])); }
-        inline cv::Vec2i   uv2pixelsVec(cv::Vec2f pt)     { cv::Point2i tmp = _maps.at(currentFloor).uv2pixels(cv::Point2f(pt[0], pt[1]));
-                                                            return cv::Vec2i(tmp.x, tmp.y);}
-        inline cv::Point2d pixels2uv(cv::Point2i pt) { return _maps.at(currentFloor).pixels2uv(pt); };
-    
-        inline const cv::Mat getWallsImage()            { return _maps.at(currentFloor).getWallsImage(); }
-        inline const cv::Mat getWallsImageRGB()            { return _maps.at(currentFloor).getWallsImageRGB(); }
-    
-        inline cv::Size mapSizeMeters(){ return _maps.at(currentFloor).getMapSizeMeters(); }
-        inline cv::Size getMapSizePixels()      { return _maps.at(currentFloor).getMapSizePixels(); }
-        inline bool isWalkable(cv::Point2i pt) { return _maps.at(currentFloor).isWalkable(pt); }
-        inline bool isWallAt(cv::Point2i pt)   { return _maps.at(currentFloor).isWallAt(pt); }
-        inline std::multimap<FeatureType, MapFeature> getLandmarksList() const { return _maps.at(currentFloor).getLandmarksList(); }
-        inline void showFeatures() { _maps.at(currentFloor).showFeatures();}
-    
-        inline std::string getClosestPOI(cv::Point2i pt) { return _maps.at(currentFloor).getClosestPOI(pt); }
-        inline int getRoiAt(cv::Point2i pt) { return _maps.at(currentFloor).getRoiAt(pt); }
-        inline std::string getRoiLabel(int idx) { return _maps.at(currentFloor).getRoiLabel(idx); }
-        inline std::string getRoiLabelAt(cv::Point2i pt) {
-            std::string label = "" ;
-            int id = _maps.at(currentFloor).getRoiAt(pt);
-            if (id >0)
-                label = getRoiLabel(id);
-            return label;
-        }
-    
-        inline double getScale() { return _maps.at(currentFloor).getScale(); }
-        inline double getScale(int floor) { return _maps.at(floor).getScale(); } // TODO: check key exists
-    
-        bool isPathCrossingWalls(cv::Point2i startPt, cv::Point2i endPt){
-            // iterate over pixels from startPt to endPT to check if walls are in the way of the path
-            int dr = abs(startPt.x - endPt.x);
-            int dc = abs(startPt.y - endPt.y);
-            
-            int span = std::max(dr, dc);  // if more rows than columns then loop over rows; else loop over columns
-            float multiplier;
-            if (span == 0)  //special case: (r1,c1) equals (r2,c2)
-                multiplier = 0.;
-            else
-                multiplier = 1. / span;
-            
-            for ( int k=0; k <= span; k++){ // k goes from 0 through span; e.g., a span of 2 implies there are 2+1=3 pixels to reach in loop
-                float frac = k * multiplier;
-                int r = std::trunc(startPt.x + frac * (endPt.x - startPt.x));
-                int c = std::trunc(startPt.y + frac * (endPt.y - startPt.y));
-                if (isWallAt(cv::Point(r, c))>0)
-                    return true;
-            }
-            return false;
+        // the floor with its rasters, loading them if needed. Keep the pointer for as long as the map is in use.
+        std::shared_ptr<const AnnotatedMap> getMap(int floor) const { return _acquire(floor, true); }
+        inline bool hasFloor(int floor) const { return _floors.count(floor) > 0; }
+        std::vector<int> getFloors() const {
+            std::vector<int> floors;
+            for (const auto& f : _floors)
+                floors.push_back(f.first);
+            return floors;
+        }
+    
+        // metadata queries, these never load rasters
+        inline cv::Point2i uv2pixels(cv::Point2f pt, int floor) const { return _metadata(floor).uv2pixels(pt); }
+        inline cv::Point2d pixels2uv(cv::Point2i pt, int floor) const { return _metadata(floor).pixels2uv(pt); }
+        inline cv::Size mapSizeMeters(int floor) const    { return _metadata(floor).getMapSizeMeters(); }
+        inline cv::Size getMapSizePixels(int floor) const { return _metadata(floor).getMapSizePixels(); }
+        inline double getScale(int floor) const { return _metadata(floor).getScale(); }
+        inline std::string getClosestPOI(cv::Point2i pt, int floor) const { return _metadata(floor).getClosestPOI(pt); }
+        inline const std::multimap<FeatureType, MapFeature>& getLandmarksList(int floor) const { return _metadata(floor).getLandmarksList(); }
+        inline const FeatureIndex& getFeatureIndex(int floor) const { return _metadata(floor).getFeatureIndex(); }
+        // landmarks of the types in mask within radius meters of uv, nearest first
+        inline void getFeaturesWithin(cv::Point2f uv, double radius, int floor, FeatureMask mask, std::vector<FeatureIndex::Hit>& out) const {
+            getFeatureIndex(floor).withinRadius(uv, radius, mask, out);
         }
+        // the k landmarks of the types in mask nearest to uv, nearest first
+        inline void getNearestFeatures(cv::Point2f uv, size_t k, int floor, FeatureMask mask, std::vector<FeatureIndex::Hit>& out) const {
+            getFeatureIndex(floor).nearest(uv, k, mask, out);
+        }
+        inline std::string getRoiLabel(int idx, int floor) const { return _metadata(floor).getRoiLabel(idx); }
+        // interned ROI labels of floor (see RoiIndex), these stay valid for the life of the manager
+        inline const std::string& getRoiLabelName(int labelId, int floor) const { return _metadata(floor).getRoiIndex().label(labelId); }
+        inline int getRoiLabelId(const std::string& label, int floor) const { return _metadata(floor).getRoiIndex().labelId(label); }
+        inline int getNumRoiLabels(int floor) const { return _metadata(floor).getRoiIndex().numLabels(); }
+    
+        // raster queries
+        inline const cv::Mat getWallsImage(int floor) const    { return getMap(floor)->getWallsImage(); }
+        inline const cv::Mat getWallsImageRGB(int floor) const { return getMap(floor)->getWallsImageRGB(); }
+        inline bool isWalkable(cv::Point2i pt, int floor) const { return getMap(floor)->isWalkable(pt); }
+        inline bool isWallAt(cv::Point2i pt, int floor) const   { return getMap(floor)->isWallAt(pt); }
+        inline int getRoiAt(cv::Point2i pt, int floor) const { return getMap(floor)->getRoiAt(pt); }
+        inline std::string getRoiLabelAt(cv::Point2i pt, int floor) const {
+            std::shared_ptr<const AnnotatedMap> map = getMap(floor);
+            const RoiIndex& index = map->getRoiIndex();
+            return index.label(index.labelIdAt(pt));
+        }
+        // ROI label ids of u,v positions, 0 where there is no ROI or outside the map
+        void labelRoiPositions(const std::vector<cv::Point2f>& uv, int floor, std::vector<int>& labelIds) const {
+            std::shared_ptr<const AnnotatedMap> map = getMap(floor);
+            const RoiIndex& index = map->getRoiIndex();
+            labelIds.resize(uv.size());
+            for (size_t i = 0; i < uv.size(); i++)
+                labelIds[i] = index.labelIdAt(map->uv2pixels(cv::Point2d(uv[i].x, uv[i].y)));
+        }
+        // ROI label changes along a track of u,v positions, see RoiIndex::transitions
+        void getRoiTransitions(const std::vector<cv::Point2f>& uvTrack, int floor, std::vector<RoiIndex::Transition>& transitions) const {
+            std::shared_ptr<const AnnotatedMap> map = getMap(floor);
+            std::vector<cv::Point2i> pixels(uvTrack.size());
+            for (size_t i = 0; i < uvTrack.size(); i++)
+                pixels[i] = map->uv2pixels(cv::Point2d(uvTrack[i].x, uvTrack[i].y));
+            map->getRoiIndex().transitions(pixels, transitions);
+        }
+        // walks the line from startPt to endPt and checks whether walls are in the way of the path
+        inline bool isPathCrossingWalls(cv::Point2i startPt, cv::Point2i endPt, int floor) const {
+            return getMap(floor)->isPathCrossingWalls(startPt, endPt);
+        }
+    
+        // same queries on currentFloor
+        inline cv::Point2i uv2pixels(cv::Point2f pt) const      { return uv2pixels(pt, currentFloor); }
+        inline cv::Point2i uv2pixels(cv::Vec2f pt) const        { return uv2pixels(cv::Point2f(pt[0], pt[1]), currentFloor); }
+        inline cv::Vec2i   uv2pixelsVec(cv::Vec2f pt) const     { cv::Point2i tmp = uv2pixels(cv::Point2f(pt[0], pt[1]), currentFloor);
+                                                                  return cv::Vec2i(tmp.x, tmp.y);}
+        inline cv::Point2d pixels2uv(cv::Point2i pt) const { return pixels2uv(pt, currentFloor); };
+    
+        inline const cv::Mat getWallsImage() const            { return getWallsImage(currentFloor); }
+        inline const cv::Mat getWallsImageRGB() const         { return getWallsImageRGB(currentFloor); }
+    
+        inline cv::Size mapSizeMeters() const { return mapSizeMeters(currentFloor); }
+        inline cv::Size getMapSizePixels() const      { return getMapSizePixels(currentFloor); }
+        inline bool isWalkable(cv::Point2i pt) const { return isWalkable(pt, currentFloor); }
+        inline bool isWallAt(cv::Point2i pt) const   { return isWallAt(pt, currentFloor); }
+        inline const std::multimap<FeatureType, MapFeature>& getLandmarksList() const { return getLandmarksList(currentFloor); }
+        inline cv::Mat drawFeatures() const { return getMap(currentFloor)->drawFeatures(); }
+    
+        inline std::string getClosestPOI(cv::Point2i pt) const { return getClosestPOI(pt, currentFloor); }
+        inline int getRoiAt(cv::Point2i pt) const { return getRoiAt(pt, currentFloor); }
+        inline std::string getRoiLabel(int idx) const { return getRoiLabel(idx, currentFloor); }
+        inline std::string getRoiLabelAt(cv::Point2i pt) const { return getRoiLabelAt(pt, currentFloor); }
+    
+        inline double getScale() const { return getScale(currentFloor); }
+        inline bool isPathCrossingWalls(cv::Point2i startPt, cv::Point2i endPt) const { return isPathCrossingWalls(startPt, endPt, currentFloor); }
 
 
     private:
         std::string _mapFolder;
         std::string _mapFile;
         std::string _currentLocationName;
-        std::map<FloorNumber, AnnotatedMap> _maps;
         std::string _TAG;
+        std::string _rasterCacheFolder;
+        bool _precomputeWallDistance = true;
+    
+        struct Floor{
+            std::map<std::string, std::string> details; // the floor block of info.yml
+            std::unique_ptr<AnnotatedMap> metadata;     // no rasters
+            std::shared_ptr<const AnnotatedMap> map;    // with rasters, null until loaded; accessed with std::atomic_load/store
+            std::atomic<uint64_t> lastUse{0};
+            size_t bytes = 0;                           // guarded by _cacheMutex, nonzero while the floor counts towards the budget
+            std::mutex loadMutex;
+        };
+        std::map<FloorNumber, std::unique_ptr<Floor>> _floors; // fixed after init
     
-        void _parseFloorBlock(std::ifstream& inFile, std::map<std::string, std::string>& mapDetails){
-            int lineCnt = 0;
-            std::string strLine;
-        
-            while (lineCnt < _PARSER_BLOCK_LEN){
-                getline(inFile, strLine);
-                mapDetails.insert(parseutils::splitKeyValue(strLine, _PARSER_DELIMITER));
-                lineCnt++;
+        mutable std::mutex _cacheMutex;
+        size_t _budget = 0;
+        mutable size_t _resident = 0;
+        mutable std::atomic<uint64_t> _clock{1}; // ahead of the lastUse every floor starts with
+    
+        std::atomic<bool> _prefetchAdjacent{false};
+        mutable std::mutex _prefetchMutex;
+        mutable std::condition_variable _prefetchWake;
+        mutable std::deque<int> _prefetchQueue;
+        mutable std::thread _prefetchThread;
+        bool _prefetchStop = false;
+    
+        inline const AnnotatedMap& _metadata(int floor) const { return *_floors.at(floor)->metadata; }
+    
+        AnnotatedMap* _openFloor(const std::map<std::string, std::string>& d, bool loadRasters) const {
+            return new AnnotatedMap(d.at(_PARSER_WALLS_TAG), d.at(_PARSER_WALKABLE_TAG), d.at(_PARSER_FEATURES_FILE_TAG), d.at(_PARSER_ROIS_TAG),
+                                    d.at(_PARSER_ROIS_DICTIONARY_TAG), std::stof(d.at(_PARSER_SCALE_TAG)), _mapFolder, _precomputeWallDistance, loadRasters,
+                                    _rasterCacheFolder);
+        }
+    
+        // marks the floor as the most recently used. Only writes when another floor was used in between,
+        // so that queries hammering one floor do not contend on the clock
+        inline void _touch(Floor& f) const {
+            if (f.lastUse.load(std::memory_order_relaxed) != _clock.load(std::memory_order_relaxed))
+                f.lastUse.store(++_clock, std::memory_order_relaxed);
+        }
+    
+        std::shared_ptr<const AnnotatedMap> _acquire(int floor, bool prefetchAdjacent) const {
+            Floor& f = *_floors.at(floor);
+            _touch(f);
+            std::shared_ptr<const AnnotatedMap> map = std::atomic_load(&f.map);
+            if (map)
+                return map;
+            {
+                std::lock_guard<std::mutex> lock(f.loadMutex);
+                map = std::atomic_load(&f.map);
+                if (map)
+                    return map;
+                map.reset(_openFloor(f.details, true));
+                std::atomic_store(&f.map, map);
+                std::lock_guard<std::mutex> cacheLock(_cacheMutex);
+                f.bytes = std::max<size_t>(map->rasterBytes(), 1);
+                _resident += f.bytes;
+                _evict(floor);
+            }
+            if (prefetchAdjacent && _prefetchAdjacent)
+                _prefetchNeighbours(floor);
+            return map;
+        }
+    
+        // drops least recently used floors, other than keep, until the budget is met. Needs _cacheMutex.
+        void _evict(int keep) const {
+            while (_budget > 0 && _resident > _budget){
+                Floor* victim = nullptr;
+                for (auto& f : _floors){
+                    if (f.first == keep || f.second->bytes == 0)
+                        continue;
+                    if (!victim || f.second->lastUse.load(std::memory_order_relaxed) < victim->lastUse.load(std::memory_order_relaxed))
+                        victim = f.second.get();
+                }
+                if (!victim)
+                    return;
+                std::atomic_store(&victim->map, std::shared_ptr<const AnnotatedMap>());
+                GRAPHNAV_METRIC_ADD(MAP_EVICTIONS, 1);
+                _resident -= victim->bytes;
+                victim->bytes = 0;
             }
         }
     
-        void _loadMaps() {
-            
-            std::ifstream inFile(_mapFile, std::ifstream::in);
-            std::string strLine;
-            while (inFile.good()){
-                getline(inFile, strLine);
-                if (strLine.size() > 0){
-                    parseutils::KeyValuePair keyValPair = parseutils::splitKeyValue(strLine, _PARSER_DELIMITER);
-                    
-                    // the tag specifies the name of the building
-                    if (keyValPair.first == _PARSER_LOCATION_NAME_TAG)
-                        _currentLocationName = keyValPair.second;
-                    // parse floor block
-                    else if (keyValPair.first == _PARSER_FLOOR_TAG){
-                        
-                        std::map<std::string, std::string> mapDetails;
-                        _parseFloorBlock(inFile, mapDetails);
-                        
-                        // init Annotated Map Object
-                        _maps.insert(std::make_pair(std::stoi(mapDetails[_PARSER_ID_TAG]), AnnotatedMap(mapDetails[_PARSER_WALLS_TAG], mapDetails[_PARSER_WALKABLE_TAG], mapDetails[_PARSER_FEATURES_FILE_TAG], mapDetails[_PARSER_ROIS_TAG], mapDetails[_PARSER_ROIS_DICTIONARY_TAG], std::stof(mapDetails[_PARSER_SCALE_TAG]), _mapFolder)) );
+        void _prefetchNeighbours(int floor) const {
+            auto it = _floors.find(floor);
+            std::lock_guard<std::mutex> lock(_prefetchMutex);
+            if (it != _floors.begin())
+                _prefetchQueue.push_back(std::prev(it)->first);
+            if (std::next(it) != _floors.end())
+                _prefetchQueue.push_back(std::next(it)->first);
+            if (!_prefetchThread.joinable())
+                _prefetchThread = std::thread(&MapManager::_prefetchLoop, this);
+            _prefetchWake.notify_one();
+        }
+    
+        void _prefetchLoop() const {
+            std::unique_lock<std::mutex> lock(_prefetchMutex);
+            while (true){
+                _prefetchWake.wait(lock, [this]{ return _prefetchStop || !_prefetchQueue.empty(); });
+                if (_prefetchStop)
+                    return;
+                int floor = _prefetchQueue.front();
+                _prefetchQueue.pop_front();
+                lock.unlock();
+                Floor& f = *_floors.at(floor);
+                // ROI image and distance field at one byte per pixel, walls and walkable at one bit
+                cv::Size size = f.metadata->getMapSizePixels();
+                size_t area = static_cast<size_t>(size.area());
+                size_t estimate = area * (_precomputeWallDistance ? 2 : 1) + area / 4;
+                bool fits;
+                {
+                    std::lock_guard<std::mutex> cacheLock(_cacheMutex);
+                    fits = _budget == 0 || _resident + estimate <= _budget;
+                }
+                if (fits && std::atomic_load(&f.map) == nullptr){
+                    std::lock_guard<std::mutex> loadLock(f.loadMutex);
+                    if (std::atomic_load(&f.map) == nullptr){
+                        std::shared_ptr<const AnnotatedMap> map(_openFloor(f.details, true));
+                        std::lock_guard<std::mutex> cacheLock(_cacheMutex);
+                        if (_budget == 0 || _resident + map->rasterBytes() <= _budget){
+                            std::atomic_store(&f.map, map);
+                            f.bytes = std::max<size_t>(map->rasterBytes(), 1);
+                            _resident += f.bytes;
+                        }
                     }
                 }
+                lock.lock();
+            }
+        }
+    
+        // runs job(floor number, floor) for every floor on a pool of numThreads threads (0 for one per
+        // core) and rethrows the first exception a job threw, once all of them are done
+        template <typename Job>
+        void _forEachFloor(unsigned numThreads, Job job) const {
+            if (numThreads == 0)
+                numThreads = std::max(1u, std::thread::hardware_concurrency());
+            numThreads = std::min<unsigned>(numThreads, static_cast<unsigned>(_floors.size()));
+            if (numThreads == 0)
+                return;
+            std::mutex errorMutex;
+            std::exception_ptr error;
+            {
+                syncutils::WorkStealingPool pool(numThreads);
+                for (const auto& f : _floors){
+                    int floor = f.first;
+                    Floor* fp = f.second.get();
+                    pool.submit([&, floor, fp]{
+                        try{
+                            job(floor, *fp);
+                        }
+                        catch (...){
+                            std::lock_guard<std::mutex> lock(errorMutex);
+                            if (!error)
+                                error = std::current_exception();
+                        }
+                    });
+                }
+                pool.wait();
+            }
+            if (error)
+                std::rethrow_exception(error);
+        }
+    
+        // what makes a floor block of info.yml unusable, empty if it has every key _openFloor needs
+        // with a numeric id and scale
+        static std::string _checkFloorBlock(const std::map<std::string, std::string>& d, int& id){
+            for (const std::string* key : {&_PARSER_ID_TAG, &_PARSER_WALLS_TAG, &_PARSER_WALKABLE_TAG, &_PARSER_FEATURES_FILE_TAG,
+                                           &_PARSER_ROIS_TAG, &_PARSER_ROIS_DICTIONARY_TAG, &_PARSER_SCALE_TAG})
+                if (d.find(*key) == d.end())
+                    return "no " + *key;
+            const std::string& idText = d.at(_PARSER_ID_TAG);
+            const std::string& scaleText = d.at(_PARSER_SCALE_TAG);
+            double scale;
+            if (!parseutils::parseNumber(idText.data(), idText.data() + idText.size(), id))
+                return "bad " + _PARSER_ID_TAG + " '" + idText + "'";
+            if (!parseutils::parseNumber(scaleText.data(), scaleText.data() + scaleText.size(), scale) || !(scale > 0))
+                return "bad " + _PARSER_SCALE_TAG + " '" + scaleText + "'";
+            return "";
+        }
+
+        void _loadMaps(unsigned numThreads) {
+            std::vector<std::map<std::string, std::string>> blocks;
+            parseMappedFile(_mapFile, [&](const char* data, size_t size){ parseSiteInfo(data, size, _currentLocationName, blocks); });
+            for (size_t i = 0; i < blocks.size(); i++){
+                int id = 0;
+                std::string problem = _checkFloorBlock(blocks[i], id);
+                if (!problem.empty()){
+                    std::cerr << "MapManager: skipping floor block " << i + 1 << " of " << _mapFile << ": " << problem << std::endl;
+                    continue;
+                }
+                std::unique_ptr<Floor> f(new Floor());
+                f->details = std::move(blocks[i]);
+                _floors[id] = std::move(f);
             }
-            inFile.close();
+            // metadata only, the rasters are loaded on first use
+            _forEachFloor(numThreads, [this](int, Floor& f){ f.metadata.reset(_openFloor(f.details, false)); });
         }
 };
 
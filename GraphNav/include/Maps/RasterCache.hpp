@@ -0,0 +1,198 @@
+#if !defined(RASTERCACHE_HPP_)
+#define RASTERCACHE_HPP_
+
+#include <opencv2/core/core.hpp>
+
+#include "BitRaster.hpp"
+#include "../Utils/Hash.hpp"
+#include "../Utils/MappedFile.hpp"
+#include "../Utils/Metrics.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace maps{
+
+// Decoded floor rasters kept on disk, so that a restart maps them instead of decoding the images
+// again. An entry is named after a hash of the content of the image it comes from and of what was
+// made of it, so edited images get new entries and renamed or copied ones keep theirs:
+//      <folder>/<16 hex digits>.<bits|pixels|walldist>
+// A file is a 64-byte header followed by the rows, each padded to a multiple of 8 bytes; bit rasters
+// and 8-bit images point straight into the mapping. Entries are written to a temporary file and
+// renamed, so loaders running at the same time never see a partial one. Nothing is ever removed:
+// the folder can be emptied at any time the maps are not being loaded.
+class RasterCache{
+
+public:
+
+    enum Kind : uint32_t{
+        BITS = 1,          // BitRaster of the nonzero pixels
+        PIXELS = 2,        // the 8-bit image
+        WALL_DISTANCE = 3  // distance field of the walls image, see AnnotatedMap
+    };
+
+    RasterCache() { ; }
+    explicit RasterCache(std::string folder) : _folder(std::move(folder)) { ; }
+
+    inline bool enabled() const { return !_folder.empty(); }
+    inline const std::string& folder() const { return _folder; }
+
+    // key of the entries made from an image file, 0 if the cache is disabled or the file cannot be read
+    uint64_t key(const std::string& imageFile) const {
+        if (!enabled())
+            return 0;
+        fileutils::MappedFile file;
+        if (!file.open(imageFile))
+            return 0;
+        uint64_t h = hashutils::wordHash64(file.data(), file.size(), file.size());
+        return h == 0 ? 1 : h;
+    }
+
+    // empty if there is no such entry
+    BitRaster loadBits(uint64_t key) const {
+        const FileHeader* h = nullptr;
+        std::shared_ptr<const fileutils::MappedFile> file = _map(key, BITS, h);
+        if (!file)
+            return BitRaster();
+        const uint64_t* words = reinterpret_cast<const uint64_t*>(file->data() + sizeof(FileHeader));
+        return BitRaster(h->rows, h->cols, words, file);
+    }
+
+    // CV_8U image pointing into the mapped entry, which owner keeps alive; empty if there is no such entry
+    cv::Mat loadPixels(uint64_t key, Kind kind, std::shared_ptr<const void>& owner) const {
+        const FileHeader* h = nullptr;
+        std::shared_ptr<const fileutils::MappedFile> file = _map(key, kind, h);
+        if (!file)
+            return cv::Mat();
+        owner = file;
+        // the image is never written through: AnnotatedMap only reads its rasters
+        uchar* pixels = reinterpret_cast<uchar*>(const_cast<char*>(file->data() + sizeof(FileHeader)));
+        return cv::Mat(h->rows, h->cols, CV_8U, pixels, h->rowBytes);
+    }
+
+    bool storeBits(uint64_t key, const BitRaster& raster) const {
+        if (key == 0 || raster.empty())
+            return false;
+        size_t rowBytes = raster.wordsPerRow() * sizeof(uint64_t);
+        const char* data = reinterpret_cast<const char*>(raster.data());
+        return _store(key, BITS, raster.rows(), raster.cols(), rowBytes, [&](int r){ return data + r * rowBytes; });
+    }
+
+    bool storePixels(uint64_t key, Kind kind, const cv::Mat& image) const {
+        if (key == 0 || image.empty() || image.type() != CV_8U)
+            return false;
+        return _store(key, kind, image.rows, image.cols, image.cols, [&](int r){ return reinterpret_cast<const char*>(image.ptr<uchar>(r)); });
+    }
+
+    std::string fileName(uint64_t key, Kind kind) const {
+        static const char* suffix[] = {"", "bits", "pixels", "walldist"};
+        char name[40];
+        std::snprintf(name, sizeof(name), "%016llx.%s", static_cast<unsigned long long>(key), suffix[kind]);
+        return _folder + '/' + name;
+    }
+
+private:
+
+    struct FileHeader{
+        char magic[8];
+        uint32_t version;
+        uint32_t kind;
+        uint64_t key;
+        int32_t rows;
+        int32_t cols;
+        uint64_t rowBytes;     // multiple of 8
+        uint64_t payloadBytes; // rows * rowBytes
+        char reserved[16];
+    };
+    static_assert(sizeof(FileHeader) == 64, "the rows must start 64-byte aligned");
+
+    // bump when the layout or the wall distance field changes
+    static const uint32_t _VERSION = 1;
+    static const char* _magic() { return "GNAVRAS1"; }
+
+    std::string _folder;
+
+    std::shared_ptr<const fileutils::MappedFile> _map(uint64_t key, Kind kind, const FileHeader*& header) const {
+        if (key == 0 || !enabled())
+            return nullptr;
+        std::shared_ptr<fileutils::MappedFile> file = std::make_shared<fileutils::MappedFile>();
+        if (!file->open(fileName(key, kind)) || file->size() < sizeof(FileHeader))
+            return nullptr;
+        const FileHeader* h = reinterpret_cast<const FileHeader*>(file->data());
+        // BitRaster has no stride of its own: bit rows must be exactly the whole words of the columns
+        size_t minRowBytes = kind == BITS ? (static_cast<size_t>(h->cols) + 63) / 64 * 8 : static_cast<size_t>(h->cols);
+        if (std::memcmp(h->magic, _magic(), sizeof(h->magic)) != 0 || h->version != _VERSION || h->kind != kind || h->key != key ||
+            h->rows <= 0 || h->cols <= 0 || h->rowBytes % 8 != 0 || h->rowBytes < minRowBytes ||
+            (kind == BITS && h->rowBytes != minRowBytes) ||
+            h->payloadBytes != h->rows * h->rowBytes || file->size() != sizeof(FileHeader) + h->payloadBytes)
+            return nullptr;
+        header = h;
+        GRAPHNAV_METRIC_ADD(MAP_CACHE_HITS, 1);
+        return file;
+    }
+
+    // creates the folder and any missing parent, as mkdir -p does
+    bool _makeFolder() const {
+        for (size_t slash = _folder.find('/', 1); ; slash = _folder.find('/', slash + 1)){
+            std::string path = _folder.substr(0, slash);
+            if (::mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+                return false;
+            if (slash == std::string::npos)
+                break;
+        }
+        struct stat st;
+        return ::stat(_folder.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+    }
+
+    template <typename RowFn>
+    bool _store(uint64_t key, Kind kind, int rows, int cols, size_t rowBytes, RowFn row) const {
+        if (!_makeFolder())
+            return false;
+        FileHeader h;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, _magic(), sizeof(h.magic));
+        h.version = _VERSION;
+        h.kind = kind;
+        h.key = key;
+        h.rows = rows;
+        h.cols = cols;
+        h.rowBytes = (rowBytes + 7) / 8 * 8;
+        h.payloadBytes = static_cast<uint64_t>(rows) * h.rowBytes;
+
+        std::string target = fileName(key, kind);
+        std::string temporary = target + ".tmp" + std::to_string(::getpid()) + "_" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        {
+            std::ofstream outFile(temporary, std::ofstream::binary | std::ofstream::trunc);
+            outFile.write(reinterpret_cast<const char*>(&h), sizeof(h));
+            const char padding[8] = {0};
+            for (int r = 0; r < rows; r++){
+                outFile.write(row(r), rowBytes);
+                outFile.write(padding, h.rowBytes - rowBytes);
+            }
+            if (!outFile.good()){
+                outFile.close();
+                std::remove(temporary.c_str());
+                return false;
+            }
+        }
+        if (std::rename(temporary.c_str(), target.c_str()) != 0){
+            std::remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+};
+
+} // ::maps
+
+#endif // RASTERCACHE_HPP_
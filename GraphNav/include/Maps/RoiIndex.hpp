@@ -0,0 +1,189 @@
+#if !defined(ROIINDEX_HPP_)
+#define ROIINDEX_HPP_
+
+#include <opencv2/core/core.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace maps{
+
+// Run-length encoded ROI image of a floor, with the ROI labels interned. Every row is a sorted list
+// of runs of one ROI value, so a point lookup is a binary search over the few runs of its row, and
+// a walk along a row skips whole runs. Queries answer label ids: 0 for no ROI (value 0, a value
+// without a label in the dictionary, or a pixel outside the image) and 1, 2, ... for the distinct
+// labels of the dictionary, in the order of their first ROI value. Values sharing a label share the id.
+// Points are pixels with x the row and y the column, as everywhere else in AnnotatedMap.
+class RoiIndex{
+
+public:
+
+    // a change of label along a polyline
+    struct Transition{
+        int from;          // label id left
+        int to;            // label id entered
+        int segment;       // the change happens between polyline points segment and segment + 1
+        cv::Point2i pixel; // first pixel with the new label
+    };
+
+    RoiIndex() : _rows(0), _cols(0) { std::fill(_labelOf, _labelOf + 256, 0); }
+
+    // rois is the CV_8U ROI image, which may be empty to intern the labels only
+    void build(const cv::Mat& rois, const std::map<int, std::string>& dictionary){
+        _labels.assign(1, std::string());
+        _labelIds.clear();
+        std::fill(_labelOf, _labelOf + 256, 0);
+        for (const auto& entry : dictionary){
+            if (entry.first <= 0 || entry.first > 255 || entry.second.empty())
+                continue;
+            auto it = _labelIds.find(entry.second);
+            if (it == _labelIds.end()){
+                it = _labelIds.insert(std::make_pair(entry.second, static_cast<int>(_labels.size()))).first;
+                _labels.push_back(entry.second);
+            }
+            _labelOf[entry.first] = it->second;
+        }
+
+        _rows = rois.rows;
+        _cols = rois.cols;
+        _rowOffsets.assign(1, 0);
+        _starts.clear();
+        _values.clear();
+        for (int r = 0; r < _rows; r++){
+            const uchar* px = rois.ptr<uchar>(r);
+            for (int c = 0; c < _cols; c++){
+                if (c == 0 || px[c] != px[c-1]){
+                    _starts.push_back(c);
+                    _values.push_back(px[c]);
+                }
+            }
+            _rowOffsets.push_back(static_cast<uint32_t>(_starts.size()));
+        }
+    }
+
+    inline bool empty() const { return _rows == 0; }
+    inline size_t numRuns() const { return _starts.size(); }
+    inline size_t bytes() const { return _rowOffsets.size() * sizeof(uint32_t) + _starts.size() * sizeof(int32_t) + _values.size(); }
+
+    // interned labels, id 0 being the empty label of no ROI
+    inline int numLabels() const { return static_cast<int>(_labels.size()); }
+    inline const std::string& label(int labelId) const { return _labels[labelId]; }
+    // id of a label, -1 if no ROI has it
+    inline int labelId(const std::string& label) const {
+        auto it = _labelIds.find(label);
+        return it == _labelIds.end() ? -1 : it->second;
+    }
+    // id of the label of an ROI value
+    inline int labelOfRoi(int roi) const { return roi > 0 && roi < 256 ? _labelOf[roi] : 0; }
+
+    // ROI value at pt, 0 outside the image
+    inline int roiAt(cv::Point2i pt) const {
+        int start, end;
+        return _run(pt.x, pt.y, start, end);
+    }
+    inline int labelIdAt(cv::Point2i pt) const { return _labelOf[roiAt(pt)]; }
+
+    // label ids of count points
+    void labelPoints(const cv::Point2i* points, size_t count, int* labelIds) const {
+        for (size_t i = 0; i < count; i++)
+            labelIds[i] = labelIdAt(points[i]);
+    }
+    void labelPoints(const std::vector<cv::Point2i>& points, std::vector<int>& labelIds) const {
+        labelIds.resize(points.size());
+        labelPoints(points.data(), points.size(), labelIds.data());
+    }
+
+    // Label changes along the polyline, in order (the label of the first point is labelIdAt(polyline[0])).
+    // The segments are sampled one pixel per step along their longer axis, as isPathCrossingWalls does.
+    void transitions(const std::vector<cv::Point2i>& polyline, std::vector<Transition>& out) const {
+        out.clear();
+        if (polyline.empty())
+            return;
+        int current = labelIdAt(polyline[0]);
+        for (size_t i = 0; i + 1 < polyline.size(); i++)
+            _walk(polyline[i], polyline[i+1], static_cast<int>(i), current, out);
+    }
+
+private:
+
+    static const int64_t _FIXED_POINT_BIAS = int64_t(1) << 19; // as in AnnotatedMap
+    static const int _FAR = INT_MAX / 2;
+
+    int _rows;
+    int _cols;
+    std::vector<uint32_t> _rowOffsets; // runs of row r: [_rowOffsets[r], _rowOffsets[r+1])
+    std::vector<int32_t> _starts;      // first column of every run
+    std::vector<uint8_t> _values;      // ROI value of every run
+    int _labelOf[256];                 // label id of every ROI value
+    std::vector<std::string> _labels;
+    std::map<std::string, int> _labelIds;
+
+    // ROI value at (r, c) and the columns [start, end) around c that have it in row r; outside the
+    // image the value is 0 and the range reaches the image border, or is unbounded on rows outside
+    inline int _run(int r, int c, int& start, int& end) const {
+        if (r < 0 || r >= _rows){
+            start = -_FAR;
+            end = _FAR;
+            return 0;
+        }
+        if (c < 0 || c >= _cols){
+            start = c < 0 ? -_FAR : _cols;
+            end = c < 0 ? 0 : _FAR;
+            return 0;
+        }
+        const int32_t* first = _starts.data() + _rowOffsets[r];
+        const int32_t* last = _starts.data() + _rowOffsets[r+1];
+        const int32_t* it = std::upper_bound(first, last, c) - 1;
+        start = *it;
+        end = it + 1 < last ? it[1] : _cols;
+        return _values[it - _starts.data()];
+    }
+
+    // samples a to b after a itself, appending a transition wherever the label differs from current
+    void _walk(cv::Point2i a, cv::Point2i b, int segment, int& current, std::vector<Transition>& out) const {
+        int dr = b.x - a.x;
+        int dc = b.y - a.y;
+        int span = std::max(std::abs(dr), std::abs(dc));
+        if (span == 0)
+            return;
+        int64_t r0 = (static_cast<int64_t>(a.x) << 32) + _FIXED_POINT_BIAS;
+        int64_t c0 = (static_cast<int64_t>(a.y) << 32) + _FIXED_POINT_BIAS;
+        int64_t stepR = (static_cast<int64_t>(dr) << 32) / span;
+        int64_t stepC = (static_cast<int64_t>(dc) << 32) / span;
+        bool alongRows = std::abs(dc) >= std::abs(dr); // columns change by one every step, rows rarely
+        int sign = dc < 0 ? -1 : 1;
+
+        for (int64_t k = 1; k <= span; ){
+            int row = static_cast<int>((r0 + k * stepR) >> 32);
+            int col = static_cast<int>((c0 + k * stepC) >> 32);
+            int start, end;
+            int id = _labelOf[_run(row, col, start, end)];
+            if (id != current){
+                out.push_back({current, id, segment, cv::Point2i(row, col)});
+                current = id;
+            }
+            if (!alongRows){
+                k++;
+                continue;
+            }
+            // the next samples keep the label until they leave the run or the row
+            int64_t leaveRun = sign > 0 ? end - col : col - start + 1;
+            int64_t leaveRow = INT64_MAX;
+            int64_t rowTop = static_cast<int64_t>(row) << 32;
+            if (stepR > 0)
+                leaveRow = (rowTop + (int64_t(1) << 32) - r0 + stepR - 1) / stepR - k;
+            else if (stepR < 0)
+                leaveRow = (r0 - rowTop + 1 - stepR - 1) / -stepR - k;
+            k += std::max<int64_t>(1, std::min(leaveRun, leaveRow));
+        }
+    }
+};
+
+} // ::maps
+
+#endif // ROIINDEX_HPP_
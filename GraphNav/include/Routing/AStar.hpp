@@ -0,0 +1,163 @@
+#if !defined(ASTAR_HPP_)
+#define ASTAR_HPP_
+
+#include "CSRAdjacency.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+namespace navgraph{
+
+// A* search over a CSRAdjacency. The scratch buffers are kept between queries and reset
+// lazily through a generation stamp, so a query never touches (or clears) nodes it does not reach.
+// With heuristicScale == 0 the search degenerates to Dijkstra. Edges of infinite weight are skipped.
+class AStar{
+    
+public:
+    
+    AStar() : _generation(0), _expanded(0) { ; }
+    
+    // fills path with the dense indices from src to dst (both included) and returns the route length;
+    // returns a negative length and an empty path if dst cannot be reached
+    float search(const CSRAdjacency& graph, int src, int dst, std::vector<int>& path){
+        return search(graph, src, dst, path, [&graph, dst](int v){ return graph.heuristic(v, dst); });
+    }
+    
+    // same, with a caller provided heuristic h(v) estimating the distance from v to dst;
+    // it must be consistent (h(u) <= w(u,v) + h(v)) for the route to be the shortest
+    template <typename HeuristicFn>
+    float search(const CSRAdjacency& graph, int src, int dst, std::vector<int>& path, HeuristicFn heuristic){
+        path.clear();
+        _expanded = 0;
+        if (src < 0 || dst < 0 || src >= graph.numNodes() || dst >= graph.numNodes())
+            return -1.f;
+        _reset(graph.numNodes());
+        
+        _visit(src);
+        _cost[src] = 0.f;
+        _parent[src] = -1;
+        _push(heuristic(src), src);
+        
+        while (!_heap.empty()){
+            HeapEntry top = _heap.front();
+            std::pop_heap(_heap.begin(), _heap.end(), _greater);
+            _heap.pop_back();
+            int u = top.node;
+            if (_closed[u])
+                continue; // stale entry
+            _closed[u] = true;
+            _expanded++;
+            if (u == dst)
+                break;
+            for (int k = graph.begin(u); k < graph.end(u); k++){
+                if (graph.weights[k] == std::numeric_limits<float>::infinity())
+                    continue; // disabled edge
+                int v = graph.neighbors[k];
+                float c = _cost[u] + graph.weights[k];
+                if (!_visit(v) || (!_closed[v] && c < _cost[v])){
+                    _cost[v] = c;
+                    _parent[v] = u;
+                    _push(c + heuristic(v), v);
+                }
+            }
+        }
+        
+        if (!_isVisited(dst) || !_closed[dst])
+            return -1.f;
+        for (int v = dst; v != -1; v = _parent[v])
+            path.push_back(v);
+        std::reverse(path.begin(), path.end());
+        return _cost[dst];
+    }
+    
+    // Dijkstra from src to every node: dist[v] is the length of the shortest path from src to v,
+    // infinity if v cannot be reached
+    void distancesFrom(const CSRAdjacency& graph, int src, std::vector<float>& dist){
+        dist.assign(graph.numNodes(), std::numeric_limits<float>::infinity());
+        _expanded = 0;
+        if (src < 0 || src >= graph.numNodes())
+            return;
+        _reset(graph.numNodes());
+        _visit(src);
+        _cost[src] = 0.f;
+        _push(0.f, src);
+        while (!_heap.empty()){
+            HeapEntry top = _heap.front();
+            std::pop_heap(_heap.begin(), _heap.end(), _greater);
+            _heap.pop_back();
+            int u = top.node;
+            if (_closed[u])
+                continue;
+            _closed[u] = true;
+            _expanded++;
+            dist[u] = _cost[u];
+            for (int k = graph.begin(u); k < graph.end(u); k++){
+                if (graph.weights[k] == std::numeric_limits<float>::infinity())
+                    continue; // disabled edge
+                int v = graph.neighbors[k];
+                float c = _cost[u] + graph.weights[k];
+                if (!_visit(v) || (!_closed[v] && c < _cost[v])){
+                    _cost[v] = c;
+                    _push(c, v);
+                }
+            }
+        }
+    }
+    
+    // number of nodes settled by the last search
+    inline int expandedNodes() const { return _expanded; }
+    
+private:
+    
+    struct HeapEntry{
+        float f;
+        int node;
+    };
+    
+    std::vector<float> _cost;
+    std::vector<int> _parent;
+    std::vector<char> _closed;
+    std::vector<unsigned> _stamp;
+    std::vector<HeapEntry> _heap;
+    unsigned _generation;
+    int _expanded;
+    
+    static bool _greater(const HeapEntry& a, const HeapEntry& b) { return a.f > b.f; }
+    
+    void _reset(int numNodes){
+        if (static_cast<int>(_stamp.size()) != numNodes){
+            _cost.assign(numNodes, 0.f);
+            _parent.assign(numNodes, -1);
+            _closed.assign(numNodes, 0);
+            _stamp.assign(numNodes, 0);
+            _generation = 0;
+        }
+        if (++_generation == 0){ // wrapped around, stamps are no longer meaningful
+            std::fill(_stamp.begin(), _stamp.end(), 0);
+            _generation = 1;
+        }
+        _heap.clear();
+    }
+    
+    inline bool _isVisited(int v) const { return _stamp[v] == _generation; }
+    
+    // marks v as reached in the current search, returns whether it was already
+    inline bool _visit(int v){
+        if (_stamp[v] == _generation)
+            return true;
+        _stamp[v] = _generation;
+        _closed[v] = false;
+        _cost[v] = std::numeric_limits<float>::max();
+        return false;
+    }
+    
+    inline void _push(float f, int v){
+        _heap.push_back({f, v});
+        std::push_heap(_heap.begin(), _heap.end(), _greater);
+    }
+};
+
+} // end navgraph namespace
+
+#endif // ASTAR_HPP_
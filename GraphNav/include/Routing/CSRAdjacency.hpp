@@ -0,0 +1,84 @@
+#if !defined(CSRADJACENCY_HPP_)
+#define CSRADJACENCY_HPP_
+
+#include "opencv2/core/core.hpp"
+
+#include <vector>
+#include <limits>
+#include <cmath>
+
+namespace navgraph{
+
+// Compact adjacency of the navigation graph in compressed sparse row form.
+// Nodes are addressed by a dense index in [0, numNodes()); the neighbors of node i
+// are neighbors[offsets[i]] ... neighbors[offsets[i+1]-1], with matching weights.
+struct CSRAdjacency{
+
+    std::vector<int> offsets;
+    std::vector<int> neighbors;
+    std::vector<float> weights;
+    std::vector<cv::Point2f> positions; // u,v position of each node, used by the A* heuristic
+    
+    // largest factor k such that k * |pos(a) - pos(b)| <= weight(a,b) on every edge:
+    // k times the euclidean distance is then a consistent A* heuristic regardless of the edge units
+    float heuristicScale = 0.f;
+    
+    inline int numNodes() const { return static_cast<int>(positions.size()); }
+    inline int numEdges() const { return static_cast<int>(neighbors.size()); }
+    inline int begin(int idx) const { return offsets[idx]; }
+    inline int end(int idx) const { return offsets[idx+1]; }
+    
+    inline float heuristic(int from, int to) const {
+        cv::Point2f diff = positions[to] - positions[from];
+        return heuristicScale * std::sqrt(diff.x*diff.x + diff.y*diff.y);
+    }
+    
+    void clear(){
+        offsets.assign(1, 0);
+        neighbors.clear();
+        weights.clear();
+        positions.clear();
+        heuristicScale = 0.f;
+    }
+    
+    // same graph with every edge reversed; positions and heuristicScale are kept
+    CSRAdjacency transposed() const {
+        CSRAdjacency t;
+        t.positions = positions;
+        t.heuristicScale = heuristicScale;
+        t.offsets.assign(numNodes() + 1, 0);
+        for (int k = 0; k < numEdges(); k++)
+            t.offsets[neighbors[k] + 1]++;
+        for (int i = 0; i < numNodes(); i++)
+            t.offsets[i+1] += t.offsets[i];
+        t.neighbors.resize(numEdges());
+        t.weights.resize(numEdges());
+        std::vector<int> fill(t.offsets.begin(), t.offsets.end() - 1);
+        for (int i = 0; i < numNodes(); i++){
+            for (int k = begin(i); k < end(i); k++){
+                int slot = fill[neighbors[k]]++;
+                t.neighbors[slot] = i;
+                t.weights[slot] = weights[k];
+            }
+        }
+        return t;
+    }
+    
+    // to be called once all the rows have been appended
+    void computeHeuristicScale(){
+        float scale = std::numeric_limits<float>::max();
+        for (int i = 0; i < numNodes(); i++){
+            for (int k = begin(i); k < end(i); k++){
+                cv::Point2f diff = positions[neighbors[k]] - positions[i];
+                float d = std::sqrt(diff.x*diff.x + diff.y*diff.y);
+                if (d > 0)
+                    scale = std::min(scale, weights[k] / d);
+            }
+        }
+        heuristicScale = (scale == std::numeric_limits<float>::max()) ? 0.f : scale;
+    }
+};
+
+} // end navgraph namespace
+
+#endif // CSRADJACENCY_HPP_
@@ -0,0 +1,644 @@
+#if !defined(CONTRACTIONHIERARCHY_HPP_)
+#define CONTRACTIONHIERARCHY_HPP_
+
+#include "CSRAdjacency.hpp"
+#include "../Utils/Hash.hpp"
+#include "../Utils/MappedFile.hpp"
+#include "../Utils/WorkStealingPool.hpp"
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+namespace navgraph{
+
+// Contraction hierarchy over a CSRAdjacency (Geisberger et al.). Nodes are contracted one after the
+// other, least important first, adding shortcut edges that keep the distances between the remaining
+// nodes; a query is then a bidirectional Dijkstra that only goes up the hierarchy, settling a few
+// hundred nodes where a flat search over many floors and buildings settles most of the graph.
+// Nothing is specific to floors or buildings: the link and door nodes through which the traffic
+// goes end up at the top on their own.
+// The hierarchy refers to the dense node indices and CSR slots of the graph it was built from, and
+// to its weights at that time (baseWeight): routes are shortest for those weights only.
+class ContractionHierarchy{
+
+public:
+
+    // an upward edge: node is the higher end, via the node a shortcut bypasses, or -1 - slot for an
+    // edge of the graph
+    struct Edge{
+        int node;
+        float weight;
+        int via;
+    };
+
+    // scratch buffers of one query, reset lazily like AStar's; one per thread
+    class Search{
+    public:
+        Search() : _generation(0), _settled(0) { ; }
+        // nodes settled by the last query, both directions
+        inline int settledNodes() const { return _settled; }
+    private:
+        friend class ContractionHierarchy;
+        struct HeapEntry{
+            float d;
+            int node;
+        };
+        std::vector<float> _dist[2];
+        std::vector<int> _parent[2];     // index in _up (forward) or _down (backward) of the edge that reached the node
+        std::vector<unsigned> _stamp[2];
+        std::vector<HeapEntry> _heap[2];
+        std::vector<int> _chain;
+        unsigned _generation;
+        int _settled;
+    };
+
+    ContractionHierarchy() : _numNodes(0), _structureHash(0) { ; }
+
+    // contracts every node, the witness searches and priority updates of each round running on
+    // numThreads threads (0: one per core). Edges of infinite weight are left out.
+    void build(const CSRAdjacency& graph, int numThreads = 0){
+        _numNodes = graph.numNodes();
+        _structureHash = structureHash(graph);
+        _baseWeights = graph.weights;
+        _rank.assign(_numNodes, -1);
+
+        // working graph of the nodes not contracted yet, parallel edges merged
+        Work w;
+        w.out.assign(_numNodes, {});
+        w.in.assign(_numNodes, {});
+        w.level.assign(_numNodes, 0);
+        w.priority.assign(_numNodes, 0);
+        w.excluded.assign(_numNodes, 0);
+        for (int u = 0; u < _numNodes; u++)
+            for (int k = graph.begin(u); k < graph.end(u); k++)
+                if (graph.weights[k] != std::numeric_limits<float>::infinity() && graph.neighbors[k] != u)
+                    _addEdge(w, u, {graph.neighbors[k], graph.weights[k], -1 - k, 1});
+
+        std::vector<int> remaining(_numNodes);
+        for (int v = 0; v < _numNodes; v++)
+            remaining[v] = v;
+        // one pool for the whole build, and one witness search state per pool thread kept across rounds
+        syncutils::WorkStealingPool pool(static_cast<unsigned>(std::max(numThreads, 0)));
+        std::vector<Witness> witnesses(pool.size());
+        _parallelFor(pool, witnesses, _numNodes, [&](Witness& witness, int i){
+            w.priority[i] = _priority(w, witness, i);
+        });
+
+        std::vector<std::vector<Edge>> up(_numNodes), down(_numNodes);
+        std::vector<int> selected;
+        std::vector<std::vector<Shortcut>> shortcuts;
+        std::vector<int> touched;
+        int nextRank = 0;
+        while (!remaining.empty()){
+            // independent set of nodes less important than all their neighbours
+            selected.clear();
+            for (int v : remaining)
+                if (_isLocalMinimum(w, v))
+                    selected.push_back(v);
+            for (int v : selected)
+                w.excluded[v] = 1;
+            shortcuts.assign(selected.size(), {});
+            _parallelFor(pool, witnesses, static_cast<int>(selected.size()), [&](Witness& witness, int i){
+                _contract(w, witness, selected[i], &shortcuts[i]);
+            });
+
+            touched.clear();
+            for (size_t i = 0; i < selected.size(); i++){
+                int v = selected[i];
+                for (const WorkEdge& e : w.out[v])
+                    up[v].push_back({e.node, e.weight, e.via});
+                for (const WorkEdge& e : w.in[v])
+                    down[v].push_back({e.node, e.weight, e.via});
+                auto detach = [&](int n){
+                    w.level[n] = std::max(w.level[n], w.level[v] + 1);
+                    touched.push_back(n);
+                };
+                for (const WorkEdge& e : w.in[v]){
+                    _eraseEdge(w.out[e.node], v);
+                    detach(e.node);
+                }
+                for (const WorkEdge& e : w.out[v]){
+                    _eraseEdge(w.in[e.node], v);
+                    detach(e.node);
+                }
+                for (const Shortcut& s : shortcuts[i])
+                    _addEdge(w, s.from, {s.to, s.weight, v, s.hops});
+                std::vector<WorkEdge>().swap(w.out[v]);
+                std::vector<WorkEdge>().swap(w.in[v]);
+                _rank[v] = nextRank++;
+            }
+            for (int v : selected)
+                w.excluded[v] = 0;
+            remaining.erase(std::remove_if(remaining.begin(), remaining.end(), [this](int v){ return _rank[v] >= 0; }), remaining.end());
+
+            std::sort(touched.begin(), touched.end());
+            touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+            _parallelFor(pool, witnesses, static_cast<int>(touched.size()), [&](Witness& witness, int i){
+                w.priority[touched[i]] = _priority(w, witness, touched[i]);
+            });
+        }
+
+        _flatten(up, _upOffsets, _up);
+        _flatten(down, _downOffsets, _down);
+        _indexLowerEnds();
+    }
+
+    void clear() { *this = ContractionHierarchy(); }
+
+    inline bool empty() const { return _numNodes == 0; }
+    inline int numNodes() const { return _numNodes; }
+    inline size_t numEdges() const { return _up.size() + _down.size(); }
+    inline float baseWeight(int slot) const { return _baseWeights[slot]; }
+    inline int rank(int node) const { return _rank[node]; }
+
+    // hash of the nodes and edges of a graph, not of its weights
+    static uint64_t structureHash(const CSRAdjacency& graph){
+        uint64_t h = hashutils::fnv1a64(graph.offsets.data(), graph.offsets.size() * sizeof(int));
+        return hashutils::fnv1a64(graph.neighbors.data(), graph.neighbors.size() * sizeof(int), h);
+    }
+
+    // whether the hierarchy was built from a graph with the nodes and edges of graph
+    inline bool matches(const CSRAdjacency& graph) const {
+        return !empty() && _numNodes == graph.numNodes() && _baseWeights.size() == graph.weights.size() && _structureHash == structureHash(graph);
+    }
+
+    // shortest path from src to dst for the base weights: fills slots with the CSR slots of its
+    // edges, from src on, and returns its length (the base weights summed from src, as AStar does);
+    // a negative length and no slots if dst cannot be reached
+    float route(Search& search, int src, int dst, std::vector<int>& slots) const {
+        slots.clear();
+        search._settled = 0;
+        if (empty() || src < 0 || dst < 0 || src >= _numNodes || dst >= _numNodes)
+            return -1.f;
+        if (src == dst)
+            return 0.f;
+        _reset(search);
+        _reach(search, 0, src, 0.f, -1);
+        _reach(search, 1, dst, 0.f, -1);
+
+        const float inf = std::numeric_limits<float>::infinity();
+        float best = inf;
+        int meet = -1;
+        for (;;){
+            float top[2];
+            for (int dir = 0; dir < 2; dir++){
+                top[dir] = search._heap[dir].empty() ? inf : search._heap[dir].front().d;
+                if (top[dir] >= best)
+                    top[dir] = inf; // this direction cannot improve on best any more
+            }
+            if (top[0] == inf && top[1] == inf)
+                break;
+            int dir = (top[0] <= top[1]) ? 0 : 1;
+            std::vector<Search::HeapEntry>& heap = search._heap[dir];
+            Search::HeapEntry entry = heap.front();
+            std::pop_heap(heap.begin(), heap.end(), _greater);
+            heap.pop_back();
+            int u = entry.node;
+            if (entry.d > search._dist[dir][u])
+                continue; // stale entry
+            search._settled++;
+            if (_reached(search, 1 - dir, u) && entry.d + search._dist[1-dir][u] < best){
+                best = entry.d + search._dist[1-dir][u];
+                meet = u;
+            }
+            // forward goes up along _up and is stalled by the edges coming down into u (_down),
+            // backward the other way round
+            const std::vector<int>& relaxOffsets = dir == 0 ? _upOffsets : _downOffsets;
+            const std::vector<Edge>& relax = dir == 0 ? _up : _down;
+            const std::vector<int>& stallOffsets = dir == 0 ? _downOffsets : _upOffsets;
+            const std::vector<Edge>& stall = dir == 0 ? _down : _up;
+            bool stalled = false;
+            for (int k = stallOffsets[u]; k < stallOffsets[u+1] && !stalled; k++)
+                stalled = _reached(search, dir, stall[k].node) && search._dist[dir][stall[k].node] + stall[k].weight < entry.d;
+            if (stalled)
+                continue;
+            for (int k = relaxOffsets[u]; k < relaxOffsets[u+1]; k++){
+                float d = entry.d + relax[k].weight;
+                int v = relax[k].node;
+                if (!_reached(search, dir, v) || d < search._dist[dir][v])
+                    _reach(search, dir, v, d, k);
+            }
+        }
+        if (meet < 0)
+            return -1.f;
+
+        // src ... meet through the forward parents, meet ... dst through the backward ones
+        std::vector<int>& chain = search._chain;
+        chain.clear();
+        for (int v = meet; search._parent[0][v] >= 0; ){
+            int k = search._parent[0][v];
+            chain.push_back(k);
+            v = _upSource(k);
+        }
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it){
+            int k = *it;
+            _unpack(_upSource(k), _up[k].node, _up[k].via, slots);
+        }
+        for (int v = meet; search._parent[1][v] >= 0; ){
+            int k = search._parent[1][v];
+            int next = _downTarget(k);
+            _unpack(v, next, _down[k].via, slots);
+            v = next;
+        }
+        float length = 0.f;
+        for (int slot : slots)
+            length += _baseWeights[slot];
+        return length;
+    }
+
+    // File next to the graph: a header, then 8-byte aligned flat arrays, as in IO/CompiledGraph.hpp
+    //  rank        int32[numNodes]
+    //  upOffsets   int32[numNodes+1]    up    Edge[numUp]
+    //  downOffsets int32[numNodes+1]    down  Edge[numDown]
+    //  baseWeights float[numSlots]
+    bool save(const std::string& fileName) const {
+        FileHeader h;
+        std::memset(&h, 0, sizeof(h));
+        std::memcpy(h.magic, _magic(), sizeof(h.magic));
+        h.version = _VERSION;
+        h.numNodes = static_cast<uint32_t>(_numNodes);
+        h.numSlots = static_cast<uint32_t>(_baseWeights.size());
+        h.numUp = _up.size();
+        h.numDown = _down.size();
+        h.structureHash = _structureHash;
+        std::vector<char> payload;
+        _append(payload, _rank);
+        _append(payload, _upOffsets);
+        _append(payload, _up);
+        _append(payload, _downOffsets);
+        _append(payload, _down);
+        _append(payload, _baseWeights);
+        h.checksum = hashutils::fnv1a64(payload.data(), payload.size());
+        std::ofstream outFile(fileName, std::ofstream::binary | std::ofstream::trunc);
+        outFile.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        outFile.write(payload.data(), payload.size());
+        return outFile.good();
+    }
+
+    // loads a hierarchy written by save, which must have been built from a graph with the nodes and
+    // edges of graph
+    bool load(const std::string& fileName, const CSRAdjacency& graph, std::string& error){
+        fileutils::MappedFile file;
+        if (!file.open(fileName)){
+            error = "cannot map " + fileName;
+            return false;
+        }
+        FileHeader h;
+        if (file.size() < sizeof(h)){
+            error = "file too small";
+            return false;
+        }
+        std::memcpy(&h, file.data(), sizeof(h));
+        if (std::memcmp(h.magic, _magic(), sizeof(h.magic)) != 0 || h.version != _VERSION){
+            error = "not a contraction hierarchy of this version";
+            return false;
+        }
+        if (h.numNodes != static_cast<uint32_t>(graph.numNodes()) || h.numSlots != graph.weights.size() || h.structureHash != structureHash(graph)){
+            error = "built from another graph";
+            return false;
+        }
+        const char* payload = file.data() + sizeof(h);
+        size_t size = file.size() - sizeof(h);
+        if (hashutils::fnv1a64(payload, size) != h.checksum){
+            error = "checksum mismatch";
+            return false;
+        }
+        ContractionHierarchy ch;
+        size_t pos = 0;
+        if (!_read(payload, size, pos, h.numNodes, ch._rank) || !_read(payload, size, pos, h.numNodes + 1, ch._upOffsets) ||
+            !_read(payload, size, pos, h.numUp, ch._up) || !_read(payload, size, pos, h.numNodes + 1, ch._downOffsets) ||
+            !_read(payload, size, pos, h.numDown, ch._down) || !_read(payload, size, pos, h.numSlots, ch._baseWeights) ||
+            !ch._isValid()){
+            error = "corrupted file";
+            return false;
+        }
+        ch._indexLowerEnds();
+        ch._numNodes = static_cast<int>(h.numNodes);
+        ch._structureHash = h.structureHash;
+        *this = std::move(ch);
+        return true;
+    }
+
+private:
+
+    struct FileHeader{
+        char magic[8];
+        uint32_t version;
+        uint32_t numNodes;
+        uint32_t numSlots;
+        uint32_t reserved;
+        uint64_t numUp;
+        uint64_t numDown;
+        uint64_t structureHash;
+        uint64_t checksum; // FNV-1a of everything after the header
+    };
+
+    static inline const char* _magic() { return "GNAVCH01"; }
+    static const uint32_t _VERSION = 1;
+
+    // witness searches give up after settling this many nodes, keeping the shortcut
+    static const int _MAX_WITNESS_SETTLED = 500;
+
+    int _numNodes;
+    uint64_t _structureHash;
+    std::vector<int> _rank;
+    std::vector<int> _upOffsets, _downOffsets; // CSR by the lower end of the edges
+    std::vector<Edge> _up;                     // edges from the node to higher ones
+    std::vector<Edge> _down;                   // edges from higher nodes to the node
+    std::vector<int> _upSources;               // lower end of each edge of _up
+    std::vector<int> _downTargets;             // lower end of each edge of _down
+    std::vector<float> _baseWeights;           // by CSR slot of the graph
+
+    struct Shortcut{
+        int from;
+        int to;
+        float weight;
+        int hops;
+    };
+
+    struct WorkEdge{
+        int node;
+        float weight;
+        int via;
+        int hops; // edges of the graph it stands for
+    };
+
+    struct Work{
+        std::vector<std::vector<WorkEdge>> out, in; // edges between nodes not contracted yet
+        std::vector<int> level;                     // depth of the contracted nodes below
+        std::vector<float> priority;
+        std::vector<char> excluded;             // being contracted in the current round
+    };
+
+    struct Witness{
+        std::vector<float> dist;
+        std::vector<unsigned> stamp;
+        std::vector<Search::HeapEntry> heap;
+        unsigned generation = 0;
+    };
+
+    static bool _greater(const Search::HeapEntry& a, const Search::HeapEntry& b) { return a.d > b.d; }
+
+    inline int _upSource(int k) const { return _upSources[k]; }
+    inline int _downTarget(int k) const { return _downTargets[k]; }
+
+    static void _addEdge(Work& w, int from, WorkEdge e){
+        for (WorkEdge& o : w.out[from]){
+            if (o.node == e.node){
+                if (e.weight < o.weight){
+                    o = e;
+                    for (WorkEdge& i : w.in[e.node])
+                        if (i.node == from)
+                            i = {from, e.weight, e.via, e.hops};
+                }
+                return;
+            }
+        }
+        w.out[from].push_back(e);
+        w.in[e.node].push_back({from, e.weight, e.via, e.hops});
+    }
+
+    static void _eraseEdge(std::vector<WorkEdge>& edges, int node){
+        for (size_t i = 0; i < edges.size(); i++){
+            if (edges[i].node == node){
+                edges[i] = edges.back();
+                edges.pop_back();
+                return;
+            }
+        }
+    }
+
+    inline bool _isLocalMinimum(const Work& w, int v) const {
+        auto before = [&w](int a, int b){ return w.priority[a] < w.priority[b] || (w.priority[a] == w.priority[b] && a < b); };
+        for (const WorkEdge& e : w.out[v])
+            if (!before(v, e.node))
+                return false;
+        for (const WorkEdge& e : w.in[v])
+            if (!before(v, e.node))
+                return false;
+        return true;
+    }
+
+    // shortcuts v's contraction needs: u -> v -> x unless a path from u to x as short avoids v and the
+    // nodes of the round; only counted, with the edges of the graph they stand for, if out is null
+    static int _contract(const Work& w, Witness& witness, int v, std::vector<Shortcut>* out, int* hops = nullptr){
+        int count = 0;
+        for (const WorkEdge& in : w.in[v]){
+            int u = in.node;
+            float limit = 0.f;
+            bool anyTarget = false; // zero-weight edges (co-located nodes) still need their witness search
+            for (const WorkEdge& o : w.out[v]){
+                if (o.node != u){
+                    limit = std::max(limit, in.weight + o.weight);
+                    anyTarget = true;
+                }
+            }
+            if (!anyTarget)
+                continue;
+            _witnessSearch(w, witness, u, v, limit);
+            for (const WorkEdge& o : w.out[v]){
+                if (o.node == u)
+                    continue;
+                float through = in.weight + o.weight;
+                bool found = witness.stamp[o.node] == witness.generation && witness.dist[o.node] <= through;
+                if (!found){
+                    count++;
+                    if (out)
+                        out->push_back({u, o.node, through, in.hops + o.hops});
+                    if (hops)
+                        *hops += in.hops + o.hops;
+                }
+            }
+        }
+        return count;
+    }
+
+    // Dijkstra from u without going through v or the excluded nodes, up to limit
+    static void _witnessSearch(const Work& w, Witness& witness, int u, int v, float limit){
+        size_t n = w.out.size();
+        if (witness.stamp.size() != n){
+            witness.dist.assign(n, 0.f);
+            witness.stamp.assign(n, 0);
+            witness.generation = 0;
+        }
+        if (++witness.generation == 0){
+            std::fill(witness.stamp.begin(), witness.stamp.end(), 0);
+            witness.generation = 1;
+        }
+        witness.heap.clear();
+        witness.stamp[u] = witness.generation;
+        witness.dist[u] = 0.f;
+        witness.heap.push_back({0.f, u});
+        int settled = 0;
+        while (!witness.heap.empty() && settled < _MAX_WITNESS_SETTLED){
+            Search::HeapEntry top = witness.heap.front();
+            std::pop_heap(witness.heap.begin(), witness.heap.end(), _greater);
+            witness.heap.pop_back();
+            if (top.d > witness.dist[top.node])
+                continue;
+            if (top.d > limit)
+                break;
+            settled++;
+            for (const WorkEdge& e : w.out[top.node]){
+                if (e.node == v || w.excluded[e.node])
+                    continue;
+                float d = top.d + e.weight;
+                if (witness.stamp[e.node] != witness.generation || d < witness.dist[e.node]){
+                    witness.stamp[e.node] = witness.generation;
+                    witness.dist[e.node] = d;
+                    witness.heap.push_back({d, e.node});
+                    std::push_heap(witness.heap.begin(), witness.heap.end(), _greater);
+                }
+            }
+        }
+    }
+
+    // edges added over edges removed, the same counting the edges of the graph they stand for, and
+    // the depth below the node to spread the contraction evenly (as in RoutingKit)
+    static float _priority(const Work& w, Witness& witness, int v){
+        int addedHops = 0, removedHops = 0;
+        int added = _contract(w, witness, v, nullptr, &addedHops);
+        int removed = static_cast<int>(w.in[v].size() + w.out[v].size());
+        for (const WorkEdge& e : w.in[v])
+            removedHops += e.hops;
+        for (const WorkEdge& e : w.out[v])
+            removedHops += e.hops;
+        if (removed == 0)
+            return static_cast<float>(w.level[v]);
+        return w.level[v] + static_cast<float>(added) / removed + static_cast<float>(addedHops) / removedHops;
+    }
+
+    void _flatten(const std::vector<std::vector<Edge>>& lists, std::vector<int>& offsets, std::vector<Edge>& edges){
+        offsets.assign(1, 0);
+        edges.clear();
+        for (const auto& l : lists){
+            edges.insert(edges.end(), l.begin(), l.end());
+            offsets.push_back(static_cast<int>(edges.size()));
+        }
+    }
+
+    void _indexLowerEnds(){
+        _upSources.resize(_up.size());
+        _downTargets.resize(_down.size());
+        for (int v = 0; v + 1 < static_cast<int>(_upOffsets.size()); v++)
+            for (int k = _upOffsets[v]; k < _upOffsets[v+1]; k++)
+                _upSources[k] = v;
+        for (int v = 0; v + 1 < static_cast<int>(_downOffsets.size()); v++)
+            for (int k = _downOffsets[v]; k < _downOffsets[v+1]; k++)
+                _downTargets[k] = v;
+    }
+
+    // edges of the graph from a to b; a shortcut through m is a -> m (an edge coming down into m)
+    // followed by m -> b (an edge going up from m)
+    void _unpack(int a, int b, int via, std::vector<int>& slots) const {
+        if (via < 0){
+            slots.push_back(-1 - via);
+            return;
+        }
+        for (int k = _downOffsets[via]; k < _downOffsets[via+1]; k++){
+            if (_down[k].node == a){
+                _unpack(a, via, _down[k].via, slots);
+                break;
+            }
+        }
+        for (int k = _upOffsets[via]; k < _upOffsets[via+1]; k++){
+            if (_up[k].node == b){
+                _unpack(via, b, _up[k].via, slots);
+                break;
+            }
+        }
+    }
+
+    void _reset(Search& s) const {
+        if (s._stamp[0].size() != static_cast<size_t>(_numNodes)){
+            for (int dir = 0; dir < 2; dir++){
+                s._dist[dir].assign(_numNodes, 0.f);
+                s._parent[dir].assign(_numNodes, -1);
+                s._stamp[dir].assign(_numNodes, 0);
+            }
+            s._generation = 0;
+        }
+        if (++s._generation == 0){
+            for (int dir = 0; dir < 2; dir++)
+                std::fill(s._stamp[dir].begin(), s._stamp[dir].end(), 0);
+            s._generation = 1;
+        }
+        s._heap[0].clear();
+        s._heap[1].clear();
+    }
+
+    static inline bool _reached(const Search& s, int dir, int v) { return s._stamp[dir][v] == s._generation; }
+
+    static inline void _reach(Search& s, int dir, int v, float d, int parent){
+        s._stamp[dir][v] = s._generation;
+        s._dist[dir][v] = d;
+        s._parent[dir][v] = parent;
+        s._heap[dir].push_back({d, v});
+        std::push_heap(s._heap[dir].begin(), s._heap[dir].end(), _greater);
+    }
+
+    // bounds of everything a query or an unpacking indexes
+    bool _isValid() const {
+        auto validCSR = [this](const std::vector<int>& offsets, const std::vector<Edge>& edges){
+            if (offsets.front() != 0 || offsets.back() != static_cast<int>(edges.size()))
+                return false;
+            for (size_t v = 0; v + 1 < offsets.size(); v++)
+                if (offsets[v] > offsets[v+1])
+                    return false;
+            for (const Edge& e : edges)
+                if (e.node < 0 || e.node >= static_cast<int>(_rank.size()) || e.via >= static_cast<int>(_rank.size()) ||
+                    (e.via < 0 && -1 - e.via >= static_cast<int>(_baseWeights.size())))
+                    return false;
+            return true;
+        };
+        return validCSR(_upOffsets, _up) && validCSR(_downOffsets, _down);
+    }
+
+    template <typename T>
+    static void _append(std::vector<char>& payload, const std::vector<T>& data){
+        const char* bytes = reinterpret_cast<const char*>(data.data());
+        payload.insert(payload.end(), bytes, bytes + data.size() * sizeof(T));
+        while (payload.size() % 8 != 0)
+            payload.push_back(0);
+    }
+
+    template <typename T>
+    static bool _read(const char* payload, size_t size, size_t& pos, uint64_t count, std::vector<T>& data){
+        if (count > (size - pos) / sizeof(T))
+            return false;
+        data.resize(count);
+        std::memcpy(data.data(), payload + pos, count * sizeof(T));
+        pos = std::min(size, pos + (count * sizeof(T) + 7) / 8 * 8);
+        return true;
+    }
+
+    // runs job(witness, j) for j in [0, numJobs) as up to one task per pool thread, task t claiming
+    // jobs one at a time and searching with witnesses[t]; small rounds run on the calling thread
+    template <typename JobFn>
+    static void _parallelFor(syncutils::WorkStealingPool& pool, std::vector<Witness>& witnesses, int numJobs, JobFn job){
+        int numTasks = std::min(static_cast<int>(witnesses.size()), std::max(numJobs / 64, 1));
+        std::atomic<int> nextJob(0);
+        auto task = [&](int t){
+            Witness& witness = witnesses[t];
+            for (int j = nextJob++; j < numJobs; j = nextJob++)
+                job(witness, j);
+        };
+        if (numTasks <= 1){
+            task(0);
+            return;
+        }
+        for (int t = 0; t < numTasks; t++)
+            pool.submit([&task, t](){ task(t); });
+        pool.wait();
+    }
+};
+
+} // end navgraph namespace
+
+#endif // CONTRACTIONHIERARCHY_HPP_
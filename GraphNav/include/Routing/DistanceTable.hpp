@@ -0,0 +1,193 @@
+#if !defined(DISTANCETABLE_HPP_)
+#define DISTANCETABLE_HPP_
+
+#include "CSRAdjacency.hpp"
+#include "AStar.hpp"
+#include "../Utils/WorkStealingPool.hpp"
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <atomic>
+
+namespace navgraph{
+
+// Precomputed shortest path lengths over a CSRAdjacency.
+// - exact distances from every node to a set of target nodes, stored node-major so that the
+//   distances from one node to all the targets are contiguous
+// - ALT landmarks: distances from and to a few landmark nodes, giving by the triangle inequality
+//   a consistent lower bound of the distance between any two nodes
+// The table refers to the dense node indices of the graph it was built from.
+class DistanceTable{
+
+public:
+
+    DistanceTable() : _numNodes(0) { ; }
+
+    // runs one Dijkstra per target (on the reversed graph) and two per landmark, spread over
+    // numThreads threads (0: one per core)
+    void build(const CSRAdjacency& graph, const std::vector<int>& targets, int numLandmarks, int numThreads = 0){
+        _numNodes = graph.numNodes();
+        _targets = targets;
+        _targetSlot.assign(_numNodes, -1);
+        for (int k = 0; k < static_cast<int>(_targets.size()); k++)
+            _targetSlot[_targets[k]] = k;
+        _table.assign(static_cast<size_t>(_numNodes) * _targets.size(), 0.f);
+
+        CSRAdjacency reversed = graph.transposed();
+        _selectLandmarks(graph, std::min(numLandmarks, _numNodes));
+        _fromLandmark.assign(static_cast<size_t>(_numNodes) * _landmarks.size(), 0.f);
+        _toLandmark.assign(static_cast<size_t>(_numNodes) * _landmarks.size(), 0.f);
+
+        // one job per target and per landmark direction
+        int numTargets = static_cast<int>(_targets.size());
+        int numLandmarkJobs = 2 * static_cast<int>(_landmarks.size());
+        _parallelFor(numTargets + numLandmarkJobs, numThreads, [&](AStar& search, std::vector<float>& dist, int job){
+            if (job < numTargets){
+                search.distancesFrom(reversed, _targets[job], dist); // dist[v] = d(v, target)
+                _scatter(dist, _table, numTargets, job);
+            }
+            else if ((job - numTargets) % 2 == 0){
+                int l = (job - numTargets) / 2;
+                search.distancesFrom(graph, _landmarks[l], dist);
+                _scatter(dist, _fromLandmark, static_cast<int>(_landmarks.size()), l);
+            }
+            else{
+                int l = (job - numTargets) / 2;
+                search.distancesFrom(reversed, _landmarks[l], dist);
+                _scatter(dist, _toLandmark, static_cast<int>(_landmarks.size()), l);
+            }
+        });
+    }
+
+    // restores a table from its arrays (see the accessors below), returns false if the sizes do not match
+    bool assign(int numNodes, const std::vector<int>& targets, const std::vector<float>& table,
+                const std::vector<int>& landmarks, const std::vector<float>& fromLandmark, const std::vector<float>& toLandmark){
+        size_t n = static_cast<size_t>(numNodes);
+        if (table.size() != n * targets.size() || fromLandmark.size() != n * landmarks.size() || toLandmark.size() != n * landmarks.size())
+            return false;
+        for (int v : targets)
+            if (v < 0 || v >= numNodes) return false;
+        for (int v : landmarks)
+            if (v < 0 || v >= numNodes) return false;
+        _numNodes = numNodes;
+        _targets = targets;
+        _targetSlot.assign(_numNodes, -1);
+        for (int k = 0; k < static_cast<int>(_targets.size()); k++)
+            _targetSlot[_targets[k]] = k;
+        _table = table;
+        _landmarks = landmarks;
+        _fromLandmark = fromLandmark;
+        _toLandmark = toLandmark;
+        return true;
+    }
+
+    void clear() { assign(0, {}, {}, {}, {}, {}); }
+
+    inline bool empty() const { return _numNodes == 0; }
+    inline int numNodes() const { return _numNodes; }
+    inline int numTargets() const { return static_cast<int>(_targets.size()); }
+    inline int numLandmarks() const { return static_cast<int>(_landmarks.size()); }
+
+    // slot of node among the targets, -1 if it is not one
+    inline int targetSlot(int node) const { return _targetSlot[node]; }
+
+    // shortest path length from node to the target in slot, infinity if unreachable
+    inline float distance(int node, int slot) const { return _table[static_cast<size_t>(node) * _targets.size() + slot]; }
+
+    // the distances from node to every target, in slot order
+    inline const float* distancesFrom(int node) const { return _table.data() + static_cast<size_t>(node) * _targets.size(); }
+
+    // lower bound of the distance from one node to another:
+    // d(from,to) >= d(L,to) - d(L,from) and d(from,to) >= d(from,L) - d(to,L) for every landmark L
+    inline float lowerBound(int from, int to) const {
+        const size_t numL = _landmarks.size();
+        const float* fromL1 = _fromLandmark.data() + from * numL;
+        const float* fromL2 = _fromLandmark.data() + to * numL;
+        const float* toL1 = _toLandmark.data() + from * numL;
+        const float* toL2 = _toLandmark.data() + to * numL;
+        float bound = 0.f;
+        for (size_t l = 0; l < numL; l++){
+            // unreachable pairs (infinite terms) give no information
+            float a = fromL2[l] - fromL1[l];
+            float b = toL1[l] - toL2[l];
+            if (a > bound && a != std::numeric_limits<float>::infinity()) bound = a;
+            if (b > bound && b != std::numeric_limits<float>::infinity()) bound = b;
+        }
+        return bound;
+    }
+
+    inline const std::vector<int>& targets() const { return _targets; }
+    inline const std::vector<float>& table() const { return _table; }
+    inline const std::vector<int>& landmarks() const { return _landmarks; }
+    inline const std::vector<float>& fromLandmark() const { return _fromLandmark; }
+    inline const std::vector<float>& toLandmark() const { return _toLandmark; }
+
+private:
+
+    int _numNodes;
+    std::vector<int> _targets;
+    std::vector<int> _targetSlot; // by node, -1 if not a target
+    std::vector<float> _table;    // [node * numTargets + slot]
+    std::vector<int> _landmarks;
+    std::vector<float> _fromLandmark; // [node * numLandmarks + l] = d(landmark l, node)
+    std::vector<float> _toLandmark;   // [node * numLandmarks + l] = d(node, landmark l)
+
+    static void _scatter(const std::vector<float>& dist, std::vector<float>& out, int stride, int column){
+        for (size_t v = 0; v < dist.size(); v++)
+            out[v * stride + column] = dist[v];
+    }
+
+    // farthest point selection: each landmark is the node whose shortest path distance from the
+    // landmarks chosen so far is the largest. Nodes no landmark reaches count as the farthest,
+    // so every connected component gets one.
+    void _selectLandmarks(const CSRAdjacency& graph, int numLandmarks){
+        _landmarks.clear();
+        if (numLandmarks <= 0 || _numNodes == 0)
+            return;
+        AStar search;
+        std::vector<float> dist, closest(_numNodes, std::numeric_limits<float>::infinity());
+        int next = 0;
+        while (static_cast<int>(_landmarks.size()) < numLandmarks){
+            _landmarks.push_back(next);
+            search.distancesFrom(graph, next, dist);
+            for (int v = 0; v < _numNodes; v++)
+                closest[v] = std::min(closest[v], dist[v]);
+            next = -1;
+            float farthest = 0.f;
+            for (int v = 0; v < _numNodes; v++){
+                if (closest[v] > farthest){
+                    farthest = closest[v];
+                    next = v;
+                }
+            }
+            if (next < 0)
+                break; // every node is a landmark already
+        }
+    }
+
+    // the jobs are claimed in order by one task per pool thread, each with its own search
+    template <typename JobFn>
+    static void _parallelFor(int numJobs, int numThreads, JobFn job){
+        std::atomic<int> nextJob(0);
+        auto task = [&](){
+            AStar search;
+            std::vector<float> dist;
+            for (int j = nextJob++; j < numJobs; j = nextJob++)
+                job(search, dist, j);
+        };
+        if (numJobs <= 1 || numThreads == 1){
+            task();
+            return;
+        }
+        syncutils::WorkStealingPool pool(static_cast<unsigned>(std::max(numThreads, 0)));
+        int numTasks = std::min(static_cast<int>(pool.size()), numJobs);
+        for (int t = 0; t < numTasks; t++)
+            pool.submit(task);
+        pool.wait();
+    }
+};
+
+} // end navgraph namespace
+
+#endif // DISTANCETABLE_HPP_
@@ -0,0 +1,331 @@
+#if !defined(GEODESICFIELDS_HPP_)
+#define GEODESICFIELDS_HPP_
+
+#include "../Maps/MapManager.hpp"
+#include "../Utils/WorkStealingPool.hpp"
+
+#include <opencv2/core/core.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <queue>
+#include <vector>
+
+namespace navgraph{
+
+// Geodesic distance fields over the walkable space of the floor maps: for each source (a
+// destination node), the length in meters of the shortest 8-connected walk from every walkable
+// cell to the source, going around the walls. A lookup gives the distance and the direction to
+// walk in from any walkable position without snapping to the graph or searching it.
+// The floors are sampled on a grid of cellPx x cellPx pixel cells, a step between two neighbouring
+// cells being allowed if the line between their centres does not cross a wall (diagonal steps
+// also need both orthogonal detours, so the walk never cuts a wall corner). Each field is stored
+// in tiles of 32 x 32 cells as offsets from the smallest distance in the tile: 8 bits of a quarter
+// cell where the distances within the tile span less than 64 cells (no wall splits it), 16 bits of
+// the longest distance / 65534 elsewhere. Tiles that cannot reach the source take no memory.
+class GeodesicFields{
+
+public:
+
+    struct Source{
+        int node;         // dense node index in the graph the fields were built for
+        int floor;
+        cv::Point2f uv;
+    };
+
+    struct Lookup{
+        float distance;        // meters, within about a cell of the exact geodesic distance
+        cv::Point2f direction; // unit u,v vector of the first step towards the source
+    };
+
+    GeodesicFields() : _cellPx(1) { ; }
+
+    // one field per source, computed in parallel on numThreads threads (0: one per core)
+    void build(const maps::MapManager& mapManager, const std::vector<Source>& sources, int cellPx = 2, int numThreads = 0){
+        _cellPx = std::max(cellPx, 1);
+        _sources = sources;
+        _fields.assign(sources.size(), Field());
+        _floors.clear();
+        _slotByNode.clear();
+        for (int s = 0; s < static_cast<int>(sources.size()); s++){
+            _slotByNode[sources[s].node] = s;
+            _floors[sources[s].floor] = nullptr;
+        }
+        syncutils::WorkStealingPool pool(static_cast<unsigned>(std::max(numThreads, 0)));
+        for (auto& f : _floors){
+            std::shared_ptr<FloorGrid>* grid = &f.second;
+            int floor = f.first;
+            pool.submit([this, grid, floor, &mapManager](){ *grid = _buildFloorGrid(*mapManager.getMap(floor)); });
+        }
+        pool.wait();
+        for (int s = 0; s < static_cast<int>(sources.size()); s++)
+            pool.submit([this, s](){ _buildField(s); });
+        pool.wait();
+    }
+
+    inline bool empty() const { return _fields.empty(); }
+    inline size_t numFields() const { return _fields.size(); }
+    inline int cellPx() const { return _cellPx; }
+    inline const Source& source(int slot) const { return _sources[slot]; }
+
+    // slot of the field of a node, -1 if it has none
+    inline int fieldSlot(int node) const { auto it = _slotByNode.find(node); return it != _slotByNode.end() ? it->second : -1; }
+
+    // memory held by the fields and the floor grids
+    size_t bytes() const {
+        size_t bytes = 0;
+        for (const Field& f : _fields)
+            bytes += f.data.size() + f.tiles.size() * sizeof(Tile);
+        for (const auto& f : _floors)
+            bytes += f.second->moves.size();
+        return bytes;
+    }
+
+    // false if uv is on another floor than the source, outside the map, or cannot reach the source
+    bool lookup(cv::Point2f uv, int floor, int slot, Lookup& out) const {
+        const Source& src = _sources[slot];
+        if (floor != src.floor)
+            return false;
+        const Field& field = _fields[slot];
+        const FloorGrid& grid = *_floors.at(floor);
+        // same rounding as AnnotatedMap::uv2pixels
+        int row = static_cast<int>(grid.heightPx - grid.scale * uv.x) / _cellPx;
+        int col = static_cast<int>(grid.scale * uv.y) / _cellPx;
+        if (row < 0 || row >= grid.rows || col < 0 || col >= grid.cols)
+            return false;
+        float value = _value(field, row, col);
+        if (value == std::numeric_limits<float>::infinity())
+            return false;
+        out.distance = value;
+
+        // steepest descent over the allowed steps, straight to the source from its own cell
+        int best = -1;
+        float bestValue = value;
+        uint8_t moves = grid.moves[static_cast<size_t>(row) * grid.cols + col];
+        for (int k = 0; k < 8; k++){
+            if (!(moves & (1 << k)))
+                continue;
+            float v = _value(field, row + _dr(k), col + _dc(k));
+            if (v < bestValue){
+                bestValue = v;
+                best = k;
+            }
+        }
+        cv::Point2f dir = (best >= 0) ? cv::Point2f(static_cast<float>(-_dr(best)), static_cast<float>(_dc(best))) : src.uv - uv;
+        float norm = std::sqrt(dir.x * dir.x + dir.y * dir.y);
+        out.direction = (norm > 0) ? dir * (1.f / norm) : cv::Point2f(0.f, 0.f);
+        return true;
+    }
+
+private:
+
+    // the 8 steps, k and 7 - k going in opposite directions
+    static inline int _dr(int k) { static const int dr[8] = {-1, -1, -1,  0, 0,  1, 1, 1}; return dr[k]; }
+    static inline int _dc(int k) { static const int dc[8] = {-1,  0,  1, -1, 1, -1, 0, 1}; return dc[k]; }
+    static const uint16_t _UNREACHABLE = 0xFFFF; // in both tile widths, 0xFF in 8-bit tiles
+    static const int _TILE_SHIFT = 5; // 32 x 32 cells
+
+    struct FloorGrid{
+        int rows;
+        int cols;
+        int heightPx;
+        double scale;               // pixels per meter, as the map has it for the same rounding
+        std::vector<uint8_t> moves; // per cell, bit k set if step k is allowed
+    };
+
+    struct Tile{
+        int32_t offset; // in data, -1 if no cell of the tile reaches the source
+        float base;     // smallest distance in the tile
+        bool wide;      // 16-bit values
+    };
+
+    struct Field{
+        float unit;       // meters per step of the 16-bit tiles
+        float fineUnit;   // meters per step of the 8-bit tiles
+        int tilesPerRow;
+        std::vector<Tile> tiles;
+        std::vector<uint8_t> data;
+    };
+
+    int _cellPx;
+    std::vector<Source> _sources;
+    std::vector<Field> _fields; // by slot
+    std::map<int, std::shared_ptr<FloorGrid>> _floors;
+    std::map<int, int> _slotByNode;
+
+    inline cv::Point2i _cellCentre(int row, int col) const { return cv::Point2i(row * _cellPx + _cellPx / 2, col * _cellPx + _cellPx / 2); }
+
+    // distance in meters, infinity if unreachable
+    static inline float _value(const Field& field, int row, int col){
+        const Tile& tile = field.tiles[(row >> _TILE_SHIFT) * field.tilesPerRow + (col >> _TILE_SHIFT)];
+        if (tile.offset < 0)
+            return std::numeric_limits<float>::infinity();
+        const int mask = (1 << _TILE_SHIFT) - 1;
+        int k = ((row & mask) << _TILE_SHIFT) + (col & mask);
+        if (tile.wide){
+            uint16_t q = reinterpret_cast<const uint16_t*>(field.data.data() + tile.offset)[k];
+            return (q == _UNREACHABLE) ? std::numeric_limits<float>::infinity() : tile.base + q * field.unit;
+        }
+        uint8_t q = field.data[tile.offset + k];
+        return (q == 0xFF) ? std::numeric_limits<float>::infinity() : tile.base + q * field.fineUnit;
+    }
+
+    std::shared_ptr<FloorGrid> _buildFloorGrid(const maps::AnnotatedMap& map) const {
+        std::shared_ptr<FloorGrid> grid = std::make_shared<FloorGrid>();
+        cv::Size size = map.getMapSizePixels();
+        grid->rows = size.height / _cellPx;
+        grid->cols = size.width / _cellPx;
+        grid->heightPx = size.height;
+        grid->scale = map.getScale();
+        const int rows = grid->rows, cols = grid->cols;
+        grid->moves.assign(static_cast<size_t>(rows) * cols, 0);
+
+        std::vector<char> walkable(static_cast<size_t>(rows) * cols);
+        for (int r = 0; r < rows; r++)
+            for (int c = 0; c < cols; c++){
+                cv::Point2i px = _cellCentre(r, c);
+                walkable[static_cast<size_t>(r) * cols + c] = map.isWalkable(px) && !map.isWallAt(px);
+            }
+        auto inside = [rows, cols](int r, int c){ return r >= 0 && r < rows && c >= 0 && c < cols; };
+        // orthogonal steps (1, 3, 4, 6) first, the diagonal ones depend on them
+        for (int r = 0; r < rows; r++)
+            for (int c = 0; c < cols; c++){
+                size_t i = static_cast<size_t>(r) * cols + c;
+                if (!walkable[i])
+                    continue;
+                for (int k : {4, 6}){
+                    int r2 = r + _dr(k), c2 = c + _dc(k);
+                    if (!inside(r2, c2) || !walkable[static_cast<size_t>(r2) * cols + c2])
+                        continue;
+                    if (map.isPathCrossingWalls(_cellCentre(r, c), _cellCentre(r2, c2)))
+                        continue;
+                    grid->moves[i] |= 1 << k;
+                    grid->moves[static_cast<size_t>(r2) * cols + c2] |= 1 << (7 - k);
+                }
+            }
+        auto allowed = [&](int r, int c, int k){ return (grid->moves[static_cast<size_t>(r) * cols + c] >> k) & 1; };
+        for (int r = 0; r < rows; r++)
+            for (int c = 0; c < cols; c++){
+                for (int k : {5, 7}){
+                    // down-left or down-right: down then sideways, and sideways then down
+                    int side = (_dc(k) < 0) ? 3 : 4;
+                    int r2 = r + 1, c2 = c + _dc(k);
+                    if (!inside(r2, c2) || !allowed(r, c, 6) || !allowed(r, c, side) ||
+                        !allowed(r + 1, c, side) || !allowed(r, c2, 6))
+                        continue;
+                    grid->moves[static_cast<size_t>(r) * cols + c] |= 1 << k;
+                    grid->moves[static_cast<size_t>(r2) * cols + c2] |= 1 << (7 - k);
+                }
+            }
+        return grid;
+    }
+
+    // Dijkstra over the cells from the cell of the source (or, if that is not walkable, from the
+    // nearest ring of walkable cells around it), then quantization into tiles
+    void _buildField(int slot){
+        const Source& src = _sources[slot];
+        const FloorGrid& grid = *_floors.at(src.floor);
+        const float inf = std::numeric_limits<float>::infinity();
+        const float step = static_cast<float>(_cellPx / grid.scale);
+        const float stepLength[8] = {step * 1.41421356f, step, step * 1.41421356f, step, step, step * 1.41421356f, step, step * 1.41421356f};
+        static thread_local std::vector<float> dist;
+        dist.assign(static_cast<size_t>(grid.rows) * grid.cols, inf);
+
+        typedef std::pair<float, int> QueueItem;
+        std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+        auto cellUV = [&](int r, int c){
+            cv::Point2i px = _cellCentre(r, c);
+            return cv::Point2f((grid.heightPx - px.x) / grid.scale, px.y / grid.scale);
+        };
+        int srcRow = static_cast<int>(grid.heightPx - grid.scale * src.uv.x) / _cellPx;
+        int srcCol = static_cast<int>(grid.scale * src.uv.y) / _cellPx;
+        const int maxSeedRing = 8;
+        for (int ring = 0; ring <= maxSeedRing && queue.empty(); ring++){
+            for (int r = srcRow - ring; r <= srcRow + ring; r++)
+                for (int c = srcCol - ring; c <= srcCol + ring; c++){
+                    if (std::max(std::abs(r - srcRow), std::abs(c - srcCol)) != ring || r < 0 || r >= grid.rows || c < 0 || c >= grid.cols)
+                        continue;
+                    size_t i = static_cast<size_t>(r) * grid.cols + c;
+                    if (!grid.moves[i]) // walkable cells with no way out are as good as walls
+                        continue;
+                    cv::Point2f d = cellUV(r, c) - src.uv;
+                    dist[i] = std::sqrt(d.x * d.x + d.y * d.y);
+                    queue.push(QueueItem(dist[i], static_cast<int>(i)));
+                }
+        }
+        float maxDist = 0.f;
+        while (!queue.empty()){
+            QueueItem item = queue.top();
+            queue.pop();
+            int i = item.second;
+            if (item.first > dist[i])
+                continue;
+            maxDist = item.first;
+            int r = i / grid.cols, c = i % grid.cols;
+            uint8_t moves = grid.moves[i];
+            for (int k = 0; k < 8; k++){
+                if (!(moves & (1 << k)))
+                    continue;
+                int j = (r + _dr(k)) * grid.cols + (c + _dc(k));
+                float d = item.first + stepLength[k];
+                if (d < dist[j]){
+                    dist[j] = d;
+                    queue.push(QueueItem(d, j));
+                }
+            }
+        }
+
+        Field& field = _fields[slot];
+        field.unit = std::max(maxDist / (_UNREACHABLE - 1), 1e-6f);
+        field.fineUnit = step / 4;
+        const int tileSize = 1 << _TILE_SHIFT;
+        const int tileRows = (grid.rows + tileSize - 1) >> _TILE_SHIFT;
+        field.tilesPerRow = (grid.cols + tileSize - 1) >> _TILE_SHIFT;
+        field.tiles.assign(static_cast<size_t>(tileRows) * field.tilesPerRow, Tile{-1, 0.f, false});
+        field.data.clear();
+        for (int tr = 0; tr < tileRows; tr++)
+            for (int tc = 0; tc < field.tilesPerRow; tc++){
+                int r0 = tr * tileSize, c0 = tc * tileSize;
+                int r1 = std::min(r0 + tileSize, grid.rows), c1 = std::min(c0 + tileSize, grid.cols);
+                float lo = inf, hi = 0.f;
+                for (int r = r0; r < r1; r++)
+                    for (int c = c0; c < c1; c++){
+                        float d = dist[static_cast<size_t>(r) * grid.cols + c];
+                        if (d < inf){
+                            lo = std::min(lo, d);
+                            hi = std::max(hi, d);
+                        }
+                    }
+                if (lo == inf)
+                    continue;
+                Tile& tile = field.tiles[static_cast<size_t>(tr) * field.tilesPerRow + tc];
+                tile.base = lo;
+                tile.wide = (hi - lo) / field.fineUnit > 254.f;
+                tile.offset = static_cast<int32_t>(field.data.size()); // stays even, tiles are 1 or 2 KB
+                field.data.resize(field.data.size() + (tile.wide ? 2 : 1) * (tileSize * tileSize), 0xFF);
+                uint8_t* narrow = field.data.data() + tile.offset;
+                uint16_t* wide = reinterpret_cast<uint16_t*>(narrow);
+                for (int r = r0; r < r1; r++)
+                    for (int c = c0; c < c1; c++){
+                        float d = dist[static_cast<size_t>(r) * grid.cols + c];
+                        if (d == inf)
+                            continue;
+                        int k = ((r - r0) << _TILE_SHIFT) + (c - c0);
+                        if (tile.wide)
+                            wide[k] = static_cast<uint16_t>(std::min(std::lround((d - lo) / field.unit), static_cast<long>(_UNREACHABLE - 1)));
+                        else
+                            narrow[k] = static_cast<uint8_t>(std::lround((d - lo) / field.fineUnit));
+                    }
+            }
+        field.data.shrink_to_fit();
+    }
+};
+
+} // end navgraph namespace
+
+#endif // GEODESICFIELDS_HPP_
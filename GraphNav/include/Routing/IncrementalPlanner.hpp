@@ -0,0 +1,320 @@
+#if !defined(INCREMENTALPLANNER_HPP_)
+#define INCREMENTALPLANNER_HPP_
+
+#include "CSRAdjacency.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace navgraph{
+
+// edges entering each node of a CSRAdjacency: the slots of the edges into v are
+// slots[offsets[v]] ... slots[offsets[v+1]-1], and sources[slot] is the node a slot leaves from
+struct InEdges{
+    const int* offsets;
+    const int* slots;
+    const int* sources;
+};
+
+// D* Lite (Koenig and Likhachev) towards a fixed destination. The search runs backward from the
+// destination and its tree is kept between plans: when the start moves or edge weights change,
+// only the nodes whose distance to the destination is affected are expanded again. Edges of
+// infinite weight are skipped, the heuristic is the euclidean one of the adjacency.
+// Memory is 16 bytes per node of the graph; like AStar the buffers are reset lazily with a
+// generation stamp, so starting over towards another destination does not touch every node.
+class IncrementalPlanner{
+
+public:
+
+    IncrementalPlanner() : _goal(-1), _start(-1), _last(-1), _km(0.f), _scale(0.f), _generation(0), _expanded(0) { ; }
+
+    // starts over towards goal; the next plan is a full search
+    void reset(const CSRAdjacency& graph, int goal){
+        _resetBuffers(graph.numNodes());
+        _pending.clear();
+        _goal = goal;
+        _start = _last = -1;
+        _km = 0.f;
+        _scale = graph.heuristicScale;
+        if (goal < 0 || goal >= graph.numNodes())
+            return;
+        _visit(goal);
+        _rhs[goal] = 0.f;
+        _insert(goal, {_heuristic(graph, goal), 0.f});
+    }
+
+    // destination of the tree, -1 before the first reset
+    inline int goal() const { return _goal; }
+
+    // heuristic scale the tree was built with: keys computed with another one are no longer ordered
+    inline float heuristicScale() const { return _scale; }
+
+    // the weight of slot changed (it may have become infinite); applied by the next plan
+    inline void edgeChanged(int slot) { _pending.push_back(slot); }
+
+    // shortest path from start to the goal given the weights of graph, which must be those of the
+    // last plan apart from the slots reported through edgeChanged. Fills path with the dense indices
+    // from start to the goal (both included) and returns the route length; returns a negative
+    // length and an empty path if the goal cannot be reached
+    float plan(const CSRAdjacency& graph, const InEdges& in, int start, std::vector<int>& path){
+        path.clear();
+        _expanded = 0;
+        if (_goal < 0 || start < 0 || start >= graph.numNodes())
+            return -1.f;
+
+        // keys already in the queue were computed from the previous start: rather than updating all
+        // of them, every new key gets the bound on how much closer the old start was added
+        if (_last >= 0 && start != _last)
+            _km += _scale * _distance(graph, _last, start);
+        _start = _last = start;
+        _visit(start);
+
+        for (int slot : _pending){
+            int u = in.sources[slot];
+            if (u != _goal && _visit(u)){ // a node never reached keeps rhs = infinity either way
+                _rhs[u] = _bestSuccessor(graph, u);
+                _updateVertex(graph, u);
+            }
+        }
+        _pending.clear();
+
+        _computeShortestPath(graph, in);
+        if (_rhs[start] == _INF)
+            return -1.f;
+
+        // descend g from the start; the length is summed forward, as AStar does
+        float length = 0.f;
+        path.push_back(start);
+        for (int u = start; u != _goal; ){
+            int next = -1, nextSlot = -1;
+            float best = _INF;
+            for (int k = graph.begin(u); k < graph.end(u); k++){
+                int v = graph.neighbors[k];
+                float c = graph.weights[k] + _g(v);
+                if (c < best){
+                    best = c;
+                    next = v;
+                    nextSlot = k;
+                }
+            }
+            if (next < 0 || static_cast<int>(path.size()) > graph.numNodes()){ // cannot happen on a consistent tree
+                path.clear();
+                return -1.f;
+            }
+            length += graph.weights[nextSlot];
+            path.push_back(next);
+            u = next;
+        }
+        return length;
+    }
+
+    // number of nodes expanded by the last plan
+    inline int expandedNodes() const { return _expanded; }
+
+private:
+
+    struct Key{
+        float k1, k2;
+        inline bool operator<(const Key& o) const { return k1 < o.k1 || (k1 == o.k1 && k2 < o.k2); }
+    };
+
+    struct HeapEntry{
+        Key key;
+        int node;
+    };
+
+    static constexpr float _INF = std::numeric_limits<float>::infinity();
+
+    int _goal;
+    int _start;
+    int _last;   // start the keys in the queue were last corrected for
+    float _km;
+    float _scale;
+    std::vector<float> _gValue;
+    std::vector<float> _rhs;
+    std::vector<int> _heapPos; // position in _heap, -1 if not queued
+    std::vector<unsigned> _stamp;
+    std::vector<HeapEntry> _heap; // binary min-heap on the keys
+    std::vector<int> _pending;
+    unsigned _generation;
+    int _expanded;
+
+    void _resetBuffers(int numNodes){
+        if (static_cast<int>(_stamp.size()) != numNodes){
+            _gValue.assign(numNodes, std::numeric_limits<float>::infinity());
+            _rhs.assign(numNodes, std::numeric_limits<float>::infinity());
+            _heapPos.assign(numNodes, -1);
+            _stamp.assign(numNodes, 0);
+            _generation = 0;
+        }
+        if (++_generation == 0){ // wrapped around, stamps are no longer meaningful
+            std::fill(_stamp.begin(), _stamp.end(), 0);
+            _generation = 1;
+        }
+        _heap.clear();
+    }
+
+    // marks v as reached by the current tree, returns whether it was already
+    inline bool _visit(int v){
+        if (_stamp[v] == _generation)
+            return true;
+        _stamp[v] = _generation;
+        _gValue[v] = _rhs[v] = _INF;
+        _heapPos[v] = -1;
+        return false;
+    }
+
+    inline float _g(int v) const { return _stamp[v] == _generation ? _gValue[v] : _INF; }
+
+    static inline float _distance(const CSRAdjacency& graph, int a, int b){
+        cv::Point2f diff = graph.positions[b] - graph.positions[a];
+        return std::sqrt(diff.x*diff.x + diff.y*diff.y);
+    }
+
+    inline float _heuristic(const CSRAdjacency& graph, int v) const {
+        return _start < 0 ? 0.f : _scale * _distance(graph, _start, v);
+    }
+
+    inline Key _key(const CSRAdjacency& graph, int v) const {
+        float m = std::min(_gValue[v], _rhs[v]);
+        return {m + _heuristic(graph, v) + _km, m};
+    }
+
+    inline float _bestSuccessor(const CSRAdjacency& graph, int u) const {
+        float best = _INF;
+        for (int k = graph.begin(u); k < graph.end(u); k++)
+            best = std::min(best, graph.weights[k] + _g(graph.neighbors[k]));
+        return best;
+    }
+
+    // queues u if it is inconsistent, with its current key, and dequeues it otherwise
+    void _updateVertex(const CSRAdjacency& graph, int u){
+        bool queued = _heapPos[u] >= 0;
+        if (_gValue[u] != _rhs[u]){
+            if (queued)
+                _update(u, _key(graph, u));
+            else
+                _insert(u, _key(graph, u));
+        }
+        else if (queued)
+            _remove(u);
+    }
+
+    void _computeShortestPath(const CSRAdjacency& graph, const InEdges& in){
+        while (!_heap.empty() && (_heap[0].key < _key(graph, _start) || _rhs[_start] != _gValue[_start])){
+            int u = _heap[0].node;
+            Key old = _heap[0].key;
+            Key now = _key(graph, u);
+            if (old < now){ // the start moved since u was queued
+                _update(u, now);
+                continue;
+            }
+            _expanded++;
+            if (_gValue[u] > _rhs[u]){
+                // overconsistent: u settles, its predecessors may get shorter through it
+                _gValue[u] = _rhs[u];
+                _remove(u);
+                for (int j = in.offsets[u]; j < in.offsets[u+1]; j++){
+                    int slot = in.slots[j];
+                    int s = in.sources[slot];
+                    float c = graph.weights[slot] + _gValue[u];
+                    _visit(s);
+                    if (s != _goal && c < _rhs[s]){
+                        _rhs[s] = c;
+                        _updateVertex(graph, s);
+                    }
+                }
+            }
+            else{
+                // underconsistent: u got longer, so may have every node whose best successor it was
+                float gOld = _gValue[u];
+                _gValue[u] = _INF;
+                for (int j = in.offsets[u]; j < in.offsets[u+1]; j++){
+                    int slot = in.slots[j];
+                    int s = in.sources[slot];
+                    if (!_visit(s))
+                        continue;
+                    if (s != _goal && _rhs[s] == graph.weights[slot] + gOld){
+                        _rhs[s] = _bestSuccessor(graph, s);
+                        _updateVertex(graph, s);
+                    }
+                }
+                if (u != _goal)
+                    _rhs[u] = _bestSuccessor(graph, u);
+                _updateVertex(graph, u);
+            }
+        }
+    }
+
+    // indexed binary heap
+
+    inline void _place(int pos, const HeapEntry& e){
+        _heap[pos] = e;
+        _heapPos[e.node] = pos;
+    }
+
+    void _siftUp(int pos){
+        HeapEntry e = _heap[pos];
+        while (pos > 0){
+            int parent = (pos - 1) / 2;
+            if (!(e.key < _heap[parent].key))
+                break;
+            _place(pos, _heap[parent]);
+            pos = parent;
+        }
+        _place(pos, e);
+    }
+
+    void _siftDown(int pos){
+        HeapEntry e = _heap[pos];
+        int n = static_cast<int>(_heap.size());
+        for (;;){
+            int child = 2 * pos + 1;
+            if (child >= n)
+                break;
+            if (child + 1 < n && _heap[child+1].key < _heap[child].key)
+                child++;
+            if (!(_heap[child].key < e.key))
+                break;
+            _place(pos, _heap[child]);
+            pos = child;
+        }
+        _place(pos, e);
+    }
+
+    inline void _insert(int v, Key key){
+        _heap.push_back({key, v});
+        _siftUp(static_cast<int>(_heap.size()) - 1);
+    }
+
+    inline void _update(int v, Key key){
+        int pos = _heapPos[v];
+        bool up = key < _heap[pos].key;
+        _heap[pos].key = key;
+        if (up)
+            _siftUp(pos);
+        else
+            _siftDown(pos);
+    }
+
+    void _remove(int v){
+        int pos = _heapPos[v];
+        _heapPos[v] = -1;
+        HeapEntry last = _heap.back();
+        _heap.pop_back();
+        if (pos == static_cast<int>(_heap.size()))
+            return;
+        _heap[pos] = last;
+        _heapPos[last.node] = pos;
+        if (pos > 0 && last.key < _heap[(pos - 1) / 2].key)
+            _siftUp(pos);
+        else
+            _siftDown(pos);
+    }
+};
+
+} // end navgraph namespace
+
+#endif // INCREMENTALPLANNER_HPP_
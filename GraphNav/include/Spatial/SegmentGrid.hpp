@@ -0,0 +1,327 @@
+#if !defined(SEGMENTGRID_HPP_)
+#define SEGMENTGRID_HPP_
+
+#include "opencv2/core/core.hpp"
+#include "SegmentKernels.hpp"
+#include "../Utils/Metrics.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace navgraph{
+
+// an undirected graph edge as a straight segment in u,v coordinates
+struct Segment{
+    int n1; // dense node index of the first endpoint
+    int n2; // dense node index of the second endpoint
+    cv::Point2f p1;
+    cv::Point2f p2;
+};
+
+// closest point to pt on the segment p1-p2, t is the position along the segment in [0,1]
+// adapted from http://www.alecjacobson.com/weblog/?p=1486
+inline cv::Point2f projectPointToSegment(const cv::Point2f& p1, const cv::Point2f& p2, const cv::Point2f& pt, float& t){
+    // vector from p1 to p2
+    cv::Point2f diff = p2 - p1;
+    float diff_squared = diff.dot(diff);
+    if (diff_squared == 0){
+        t = 0;
+        return p1;
+    }
+    //  from http://stackoverflow.com/questions/849211/
+    //  Consider the line extending the segment, parameterized as A + t (B - A)
+    //  We find projection of point p onto the line.
+    //  It falls where t = [(pt-n1) . (n2-n1)] / |n2-n1|^2
+    t = (pt - p1).dot(diff)/diff_squared;
+    if (t < 0.0){
+        //  "Before" p1 on the line, just return p1
+        t = 0;
+        return p1;
+    }
+    else if (t > 1.){
+        // "After" p2 on the line, just return p2
+        t = 1;
+        return p2;
+    }
+    return p1 + t * diff;
+}
+
+// Uniform grid over the bounding boxes of a set of segments (typically the edges of one floor).
+// Every cell lists the segments whose bounding box overlaps it, stored CSR-style in one array,
+// together with a structure-of-arrays copy of their geometry so a cell can be scanned with SIMD.
+// Cells keep a few spare slots so single segments can be inserted and removed in place.
+// Queries visit the cells in rings of growing radius around the query point and hand the
+// candidates to the caller nearest first, so expensive checks (e.g. wall ray tests) only run
+// on the few segments that can still beat the current best.
+class SegmentGrid{
+    
+public:
+    
+    struct Candidate{
+        float dist2;
+        int segment; // index in the segment list the grid was built from
+        float t;
+        cv::Point2f position;
+    };
+    
+    SegmentGrid() : _cellSize(1.f), _cols(0), _rows(0), _size(0) { ; }
+    
+    // segments: the whole segment list, ids: the subset to index
+    void build(const std::vector<Segment>& segments, const std::vector<int>& ids, float segmentsPerCell = _SEGMENTS_PER_CELL){
+        _cellOffsets.clear();
+        _cellCounts.clear();
+        _cellItems.clear();
+        _cols = _rows = 0;
+        _size = static_cast<int>(ids.size());
+        if (ids.empty())
+            return;
+        
+        cv::Point2f lo(std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+        cv::Point2f hi(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+        for (int id : ids){
+            const Segment& s = segments[id];
+            lo.x = std::min(lo.x, std::min(s.p1.x, s.p2.x));
+            lo.y = std::min(lo.y, std::min(s.p1.y, s.p2.y));
+            hi.x = std::max(hi.x, std::max(s.p1.x, s.p2.x));
+            hi.y = std::max(hi.y, std::max(s.p1.y, s.p2.y));
+        }
+        // a few segments per cell (at least one vector of the kernel), capped to keep the grid small on degenerate inputs
+        float extent = std::max(std::max(hi.x - lo.x, hi.y - lo.y), 1e-3f);
+        float cellsPerSide = std::sqrt(ids.size() / std::max(segmentsPerCell, 1.f)) + 1.f;
+        _cellSize = extent / std::min(cellsPerSide, static_cast<float>(_MAX_CELLS_PER_SIDE));
+        _origin = lo;
+        _cols = std::min(static_cast<int>((hi.x - lo.x) / _cellSize) + 1, static_cast<int>(_MAX_CELLS_PER_SIDE));
+        _rows = std::min(static_cast<int>((hi.y - lo.y) / _cellSize) + 1, static_cast<int>(_MAX_CELLS_PER_SIDE));
+        
+        // counting pass, then fill
+        _cellCounts.assign(_cols * _rows, 0);
+        for (int id : ids)
+            _forEachCellOf(segments[id], [this](int cell){ _cellCounts[cell]++; });
+        _cellOffsets.assign(_cols * _rows + 1, 0);
+        for (size_t c = 0; c < _cellCounts.size(); c++)
+            _cellOffsets[c+1] = _cellOffsets[c] + _cellCounts[c] + _CELL_SLACK;
+        size_t n = _cellOffsets.back();
+        _cellItems.assign(n, -1);
+        _x1.assign(n, 0.f); _y1.assign(n, 0.f); _dx.assign(n, 0.f); _dy.assign(n, 0.f); _invLen2.assign(n, 0.f);
+        std::fill(_cellCounts.begin(), _cellCounts.end(), 0);
+        for (int id : ids)
+            _forEachCellOf(segments[id], [&](int cell){ _store(_cellOffsets[cell] + _cellCounts[cell]++, segments[id], id); });
+    }
+    
+    inline bool empty() const { return _cols == 0; }
+    
+    // number of segments indexed
+    inline int size() const { return _size; }
+    
+    // Adds segment id with its current geometry s, only touching the cells its bounding box overlaps.
+    // Returns false and leaves the grid unchanged if one of these cells has no spare slot left,
+    // or if the grid is empty; build it again in that case.
+    bool insert(const Segment& s, int id){
+        if (empty())
+            return false;
+        bool fits = true;
+        _forEachCellOf(s, [&](int cell){ fits = fits && _cellOffsets[cell] + _cellCounts[cell] < _cellOffsets[cell+1]; });
+        if (!fits)
+            return false;
+        _forEachCellOf(s, [&](int cell){ _store(_cellOffsets[cell] + _cellCounts[cell]++, s, id); });
+        _size++;
+        return true;
+    }
+    
+    // Removes segment id, s being the geometry it was inserted with. The last item of each cell
+    // takes its slot, so the cells stay packed for the kernel.
+    void remove(const Segment& s, int id){
+        if (empty())
+            return;
+        bool found = false;
+        _forEachCellOf(s, [&](int cell){
+            int begin = _cellOffsets[cell], last = begin + _cellCounts[cell] - 1;
+            for (int k = begin; k <= last; k++){
+                if (_cellItems[k] != id)
+                    continue;
+                _cellItems[k] = _cellItems[last]; _x1[k] = _x1[last]; _y1[k] = _y1[last];
+                _dx[k] = _dx[last]; _dy[k] = _dy[last]; _invLen2[k] = _invLen2[last];
+                _cellItems[last] = -1;
+                _cellCounts[cell]--;
+                found = true;
+                return;
+            }
+        });
+        if (found)
+            _size--;
+    }
+    
+    // Finds the segment closest to pt among those accepted by accept(const Candidate&).
+    // Candidates are offered in increasing distance, the first accepted one is the answer.
+    // segments must be the list the grid was built from. Returns false if no segment is accepted.
+    template <typename AcceptFn>
+    bool nearest(const std::vector<Segment>& segments, const cv::Point2f& pt, AcceptFn accept, Candidate& result) const {
+        if (empty())
+            return false;
+        
+        static thread_local std::vector<unsigned> stamps;
+        static thread_local unsigned generation = 0;
+        static thread_local std::vector<Candidate> heap;
+        if (stamps.size() < segments.size())
+            stamps.resize(segments.size(), 0);
+        if (++generation == 0){
+            std::fill(stamps.begin(), stamps.end(), 0);
+            generation = 1;
+        }
+        heap.clear();
+        
+        size_t collected = 0;
+        int pc = _col(pt.x), pr = _row(pt.y);
+        int maxRing = _maxRing(pc, pr);
+        for (int ring = 0; ring <= maxRing; ring++){
+            _forEachCellInRing(pc, pr, ring, [&](int cell){
+                collected += _cellCounts[cell];
+                _collect(segments, cell, pt, stamps, generation, heap);
+            });
+            float bound2 = _ringBound2(pt, pc, pr, ring);
+            while (!heap.empty() && heap.front().dist2 <= bound2){
+                Candidate best = heap.front();
+                std::pop_heap(heap.begin(), heap.end(), _farther);
+                heap.pop_back();
+                if (accept(best)){
+                    result = best;
+                    GRAPHNAV_METRIC_ADD(SNAP_SEGMENTS, collected);
+                    return true;
+                }
+            }
+        }
+        GRAPHNAV_METRIC_ADD(SNAP_SEGMENTS, collected);
+        return false;
+    }
+    
+    // Closest segment to pt by geometry alone. Each cell is scanned with the vectorized kernel
+    // and the search stops at the first ring that cannot hold anything closer.
+    bool nearest(const std::vector<Segment>& segments, const cv::Point2f& pt, Candidate& result) const {
+        if (empty())
+            return false;
+        kernels::SegmentsSoA soa = {_x1.data(), _y1.data(), _dx.data(), _dy.data(), _invLen2.data()};
+        float bestDist2 = std::numeric_limits<float>::max();
+        int bestSlot = -1;
+        size_t scanned = 0, vectorized = 0;
+        int pc = _col(pt.x), pr = _row(pt.y);
+        int maxRing = _maxRing(pc, pr);
+        for (int ring = 0; ring <= maxRing; ring++){
+            _forEachCellInRing(pc, pr, ring, [&](int cell){
+                scanned += _cellCounts[cell];
+                vectorized += kernels::nearestSegment(soa, _cellOffsets[cell], _cellOffsets[cell] + _cellCounts[cell], pt.x, pt.y, bestDist2, bestSlot);
+            });
+            if (bestSlot >= 0 && bestDist2 <= _ringBound2(pt, pc, pr, ring))
+                break;
+        }
+        GRAPHNAV_METRIC_ADD(SNAP_SEGMENTS, scanned);
+        GRAPHNAV_METRIC_ADD(SNAP_SEGMENTS_VECTORIZED, vectorized);
+        if (bestSlot < 0)
+            return false;
+        result.segment = _cellItems[bestSlot];
+        const Segment& s = segments[result.segment];
+        result.position = projectPointToSegment(s.p1, s.p2, pt, result.t);
+        cv::Point2f diff = pt - result.position;
+        result.dist2 = diff.x*diff.x + diff.y*diff.y;
+        return true;
+    }
+    
+private:
+    
+    static const int _MAX_CELLS_PER_SIDE = 1024;
+    static constexpr float _SEGMENTS_PER_CELL = kernels::VECTOR_LANES > 4 ? kernels::VECTOR_LANES : 4;
+    static const int _CELL_SLACK = 2; // spare slots per cell for in-place inserts
+    
+    cv::Point2f _origin;
+    float _cellSize;
+    int _cols;
+    int _rows;
+    int _size;
+    std::vector<int> _cellOffsets; // slot range of each cell, including its spare slots
+    std::vector<int> _cellCounts; // used slots of each cell, packed at the start of its range
+    std::vector<int> _cellItems;
+    // geometry of the segment in each _cellItems slot
+    std::vector<float> _x1, _y1, _dx, _dy, _invLen2;
+    
+    static bool _farther(const Candidate& a, const Candidate& b) { return a.dist2 > b.dist2; }
+    
+    inline int _col(float x) const { return std::min(std::max(static_cast<int>((x - _origin.x) / _cellSize), 0), _cols - 1); }
+    inline int _row(float y) const { return std::min(std::max(static_cast<int>((y - _origin.y) / _cellSize), 0), _rows - 1); }
+    
+    // calls fn(cellIndex) for every cell overlapped by the bounding box of s
+    template <typename CellFn>
+    inline void _forEachCellOf(const Segment& s, CellFn fn) const {
+        int c0 = _col(std::min(s.p1.x, s.p2.x)), c1 = _col(std::max(s.p1.x, s.p2.x));
+        int r0 = _row(std::min(s.p1.y, s.p2.y)), r1 = _row(std::max(s.p1.y, s.p2.y));
+        for (int r = r0; r <= r1; r++)
+            for (int c = c0; c <= c1; c++)
+                fn(r * _cols + c);
+    }
+    
+    // writes segment id and its geometry s into one slot
+    inline void _store(int slot, const Segment& s, int id){
+        cv::Point2f d = s.p2 - s.p1;
+        float len2 = d.dot(d);
+        _cellItems[slot] = id;
+        _x1[slot] = s.p1.x;
+        _y1[slot] = s.p1.y;
+        _dx[slot] = d.x;
+        _dy[slot] = d.y;
+        _invLen2[slot] = (len2 > 0) ? 1.f / len2 : 0.f;
+    }
+    
+    inline int _maxRing(int pc, int pr) const { return std::max(std::max(pc, _cols - 1 - pc), std::max(pr, _rows - 1 - pr)); }
+    
+    // squared distance from pt to the closest cell outside the rings visited so far
+    inline float _ringBound2(const cv::Point2f& pt, int pc, int pr, int ring) const {
+        float bound = std::numeric_limits<float>::max();
+        if (pc - ring > 0)
+            bound = std::min(bound, pt.x - (_origin.x + (pc - ring) * _cellSize));
+        if (pc + ring < _cols - 1)
+            bound = std::min(bound, _origin.x + (pc + ring + 1) * _cellSize - pt.x);
+        if (pr - ring > 0)
+            bound = std::min(bound, pt.y - (_origin.y + (pr - ring) * _cellSize));
+        if (pr + ring < _rows - 1)
+            bound = std::min(bound, _origin.y + (pr + ring + 1) * _cellSize - pt.y);
+        if (bound == std::numeric_limits<float>::max())
+            return bound; // the whole grid has been visited
+        bound = std::max(bound, 0.f);
+        return bound * bound;
+    }
+    
+    // calls fn(cellIndex) for every cell of the grid at Chebyshev distance ring from (pc, pr)
+    template <typename CellFn>
+    inline void _forEachCellInRing(int pc, int pr, int ring, CellFn fn) const {
+        int r0 = pr - ring, r1 = pr + ring, c0 = pc - ring, c1 = pc + ring;
+        for (int r = std::max(r0, 0); r <= std::min(r1, _rows - 1); r++){
+            bool edgeRow = (r == r0 || r == r1);
+            int step = edgeRow ? 1 : std::max(c1 - c0, 1); // inner rows: only the two border cells of the ring
+            for (int c = c0; c <= c1; c += step){
+                if (c >= 0 && c < _cols)
+                    fn(r * _cols + c);
+            }
+        }
+    }
+    
+    void _collect(const std::vector<Segment>& segments, int cell, const cv::Point2f& pt, std::vector<unsigned>& stamps, unsigned generation, std::vector<Candidate>& heap) const {
+        for (int k = _cellOffsets[cell]; k < _cellOffsets[cell] + _cellCounts[cell]; k++){
+            int id = _cellItems[k];
+            if (stamps[id] == generation)
+                continue;
+            stamps[id] = generation;
+            const Segment& s = segments[id];
+            Candidate c;
+            c.segment = id;
+            c.position = projectPointToSegment(s.p1, s.p2, pt, c.t);
+            cv::Point2f diff = pt - c.position;
+            c.dist2 = diff.x*diff.x + diff.y*diff.y;
+            heap.push_back(c);
+            std::push_heap(heap.begin(), heap.end(), _farther);
+        }
+    }
+};
+
+} // end navgraph namespace
+
+#endif // SEGMENTGRID_HPP_
@@ -0,0 +1,145 @@
+#if !defined(SEGMENTKERNELS_HPP_)
+#define SEGMENTKERNELS_HPP_
+
+#if defined(__AVX2__) || defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include <limits>
+
+namespace navgraph{
+namespace kernels{
+
+// segments measured at once by the widest vector path compiled in
+#if defined(__AVX2__) || defined(__AVX__)
+const int VECTOR_LANES = 8;
+#elif defined(__SSE2__) || defined(_M_X64)
+const int VECTOR_LANES = 4;
+#else
+const int VECTOR_LANES = 1;
+#endif
+
+// Segments in structure-of-arrays form: segment k goes from (x1[k], y1[k]) to (x1[k]+dx[k], y1[k]+dy[k]),
+// invLen2[k] is 1/|d|^2, or 0 for degenerate segments (the projection then clamps to the first endpoint).
+struct SegmentsSoA{
+    const float* x1;
+    const float* y1;
+    const float* dx;
+    const float* dy;
+    const float* invLen2;
+};
+
+// squared distance from (px,py) to segment k
+inline float pointSegmentDist2(const SegmentsSoA& s, int k, float px, float py){
+    float ex = px - s.x1[k];
+    float ey = py - s.y1[k];
+    float t = (ex * s.dx[k] + ey * s.dy[k]) * s.invLen2[k];
+    t = t < 0.f ? 0.f : (t > 1.f ? 1.f : t);
+    ex -= t * s.dx[k];
+    ey -= t * s.dy[k];
+    return ex*ex + ey*ey;
+}
+
+// Finds the segment in [begin, end) closest to (px,py). bestDist2/bestIdx are only updated if a
+// segment strictly closer than bestDist2 is found, so the function can be chained over several runs.
+// With AVX the run goes 8 at a time, what is left 4 at a time with SSE, then one by one.
+// The vector paths keep the index of every lane as an int32, so any int index is exact.
+// Returns how many segments went through the vector paths.
+inline int nearestSegment(const SegmentsSoA& s, int begin, int end, float px, float py, float& bestDist2, int& bestIdx){
+    int k = begin;
+#if defined(__AVX2__) || defined(__AVX__)
+    if (end - k >= 8){
+        const __m256 vpx = _mm256_set1_ps(px), vpy = _mm256_set1_ps(py);
+        const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.f);
+        __m256 vbest = _mm256_set1_ps(std::numeric_limits<float>::max());
+        __m256i vidx = _mm256_setzero_si256();
+        const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        for (; k + 8 <= end; k += 8){
+            __m256 dx = _mm256_loadu_ps(s.dx + k), dy = _mm256_loadu_ps(s.dy + k);
+            __m256 ex = _mm256_sub_ps(vpx, _mm256_loadu_ps(s.x1 + k));
+            __m256 ey = _mm256_sub_ps(vpy, _mm256_loadu_ps(s.y1 + k));
+            __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(ex, dx), _mm256_mul_ps(ey, dy)), _mm256_loadu_ps(s.invLen2 + k));
+            t = _mm256_min_ps(_mm256_max_ps(t, zero), one);
+            ex = _mm256_sub_ps(ex, _mm256_mul_ps(t, dx));
+            ey = _mm256_sub_ps(ey, _mm256_mul_ps(t, dy));
+            __m256 d2 = _mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_mul_ps(ey, ey));
+            __m256 closer = _mm256_cmp_ps(d2, vbest, _CMP_LT_OQ);
+            vbest = _mm256_blendv_ps(vbest, d2, closer);
+#if defined(__AVX2__)
+            __m256i idx = _mm256_add_epi32(lane, _mm256_set1_epi32(k));
+            vidx = _mm256_blendv_epi8(vidx, idx, _mm256_castps_si256(closer));
+#else
+            // no 256-bit integer ops: add per half, and blend the index bits as floats (bit exact)
+            __m128i idxLo = _mm_add_epi32(_mm256_castsi256_si128(lane), _mm_set1_epi32(k));
+            __m128i idxHi = _mm_add_epi32(_mm256_extractf128_si256(lane, 1), _mm_set1_epi32(k));
+            __m256i idx = _mm256_insertf128_si256(_mm256_castsi128_si256(idxLo), idxHi, 1);
+            vidx = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(vidx), _mm256_castsi256_ps(idx), closer));
+#endif
+        }
+        float d2s[8];
+        int idxs[8];
+        _mm256_storeu_ps(d2s, vbest);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(idxs), vidx);
+        for (int l = 0; l < 8; l++)
+            if (d2s[l] < bestDist2){
+                bestDist2 = d2s[l];
+                bestIdx = idxs[l];
+            }
+    }
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+    if (end - k >= 4){
+        const __m128 vpx = _mm_set1_ps(px), vpy = _mm_set1_ps(py);
+        const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+        __m128 vbest = _mm_set1_ps(std::numeric_limits<float>::max());
+        __m128i vidx = _mm_setzero_si128();
+        const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+        for (; k + 4 <= end; k += 4){
+            __m128 dx = _mm_loadu_ps(s.dx + k), dy = _mm_loadu_ps(s.dy + k);
+            __m128 ex = _mm_sub_ps(vpx, _mm_loadu_ps(s.x1 + k));
+            __m128 ey = _mm_sub_ps(vpy, _mm_loadu_ps(s.y1 + k));
+            __m128 t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(ex, dx), _mm_mul_ps(ey, dy)), _mm_loadu_ps(s.invLen2 + k));
+            t = _mm_min_ps(_mm_max_ps(t, zero), one);
+            ex = _mm_sub_ps(ex, _mm_mul_ps(t, dx));
+            ey = _mm_sub_ps(ey, _mm_mul_ps(t, dy));
+            __m128 d2 = _mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey));
+            __m128 closer = _mm_cmplt_ps(d2, vbest);
+            vbest = _mm_or_ps(_mm_and_ps(closer, d2), _mm_andnot_ps(closer, vbest));
+            __m128i idx = _mm_add_epi32(lane, _mm_set1_epi32(k));
+#if defined(__SSE4_1__)
+            vidx = _mm_blendv_epi8(vidx, idx, _mm_castps_si128(closer));
+#else
+            __m128i mask = _mm_castps_si128(closer);
+            vidx = _mm_or_si128(_mm_and_si128(mask, idx), _mm_andnot_si128(mask, vidx));
+#endif
+        }
+        float d2s[4];
+        int idxs[4];
+        _mm_storeu_ps(d2s, vbest);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(idxs), vidx);
+        for (int l = 0; l < 4; l++)
+            if (d2s[l] < bestDist2){
+                bestDist2 = d2s[l];
+                bestIdx = idxs[l];
+            }
+    }
+#endif
+    int vectorized = k - begin;
+    for (; k < end; k++){
+        float d2 = pointSegmentDist2(s, k, px, py);
+        if (d2 < bestDist2){
+            bestDist2 = d2;
+            bestIdx = k;
+        }
+    }
+    return vectorized;
+}
+
+} // end kernels namespace
+} // end navgraph namespace
+
+#endif // SEGMENTKERNELS_HPP_
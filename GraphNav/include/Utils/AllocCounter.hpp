@@ -0,0 +1,56 @@
+#ifndef AllocCounter_h
+#define AllocCounter_h
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Counts heap allocations made through the global operator new, to check that a code path does not allocate.
+// The counting operators must be defined in exactly one translation unit of the program, by expanding
+// GRAPHNAV_DEFINE_ALLOC_COUNTER at global scope; without it the counter simply stays at zero.
+//
+//      allocutils::AllocationScope scope;
+//      graph.snapUV2Graph(pos, floor);
+//      assert(scope.allocations() == 0);
+
+namespace allocutils{
+    
+    inline std::atomic<size_t>& allocationCounter(){
+        static std::atomic<size_t> counter(0);
+        return counter;
+    }
+    
+    inline size_t allocationCount() { return allocationCounter().load(std::memory_order_relaxed); }
+    
+    // allocations made (by any thread) since construction
+    class AllocationScope{
+    public:
+        AllocationScope() : _start(allocationCount()) { ; }
+        inline size_t allocations() const { return allocationCount() - _start; }
+    private:
+        size_t _start;
+    };
+    
+} // ::allocutils
+
+// The operators are kept out of line: once inlined, gcc pairs the free with the operator new of
+// the caller and warns (-Wmismatched-new-delete) although both go through malloc.
+#if defined(__GNUC__)
+#define GRAPHNAV_ALLOC_NOINLINE __attribute__((noinline))
+#else
+#define GRAPHNAV_ALLOC_NOINLINE
+#endif
+
+#define GRAPHNAV_DEFINE_ALLOC_COUNTER \
+    GRAPHNAV_ALLOC_NOINLINE void* operator new(std::size_t size){ \
+        allocutils::allocationCounter().fetch_add(1, std::memory_order_relaxed); \
+        if (void* p = std::malloc(size ? size : 1)) return p; \
+        throw std::bad_alloc(); \
+    } \
+    GRAPHNAV_ALLOC_NOINLINE void* operator new[](std::size_t size){ return operator new(size); } \
+    GRAPHNAV_ALLOC_NOINLINE void operator delete(void* p) noexcept { std::free(p); } \
+    GRAPHNAV_ALLOC_NOINLINE void operator delete[](void* p) noexcept { std::free(p); } \
+    GRAPHNAV_ALLOC_NOINLINE void operator delete(void* p, std::size_t) noexcept { std::free(p); } \
+    GRAPHNAV_ALLOC_NOINLINE void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+#endif /* AllocCounter_h */
@@ -0,0 +1,52 @@
+#ifndef Hash_h
+#define Hash_h
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+namespace hashutils{
+    
+    const uint64_t FNV1A64_OFFSET = 14695981039346656037ULL;
+    const uint64_t FNV1A64_PRIME = 1099511628211ULL;
+    
+    // 64 bit FNV-1a; pass the previous result as seed to hash data in several chunks
+    inline uint64_t fnv1a64(const void* data, size_t size, uint64_t seed = FNV1A64_OFFSET){
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        uint64_t h = seed;
+        for (size_t i = 0; i < size; i++){
+            h ^= p[i];
+            h *= FNV1A64_PRIME;
+        }
+        return h;
+    }
+    
+    // 64 bit hash of 8-byte words, several times faster than fnv1a64 on large buffers; meant for
+    // keying files by their content, not for adversarial input. Depends on the byte order.
+    inline uint64_t wordHash64(const void* data, size_t size, uint64_t seed = 0){
+        const uint64_t K1 = 0x9E3779B97F4A7C15ULL, K2 = 0xC2B2AE3D27D4EB4FULL;
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        uint64_t h = seed ^ (size * K1);
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8){
+            uint64_t w;
+            std::memcpy(&w, p + i, 8);
+            w *= K2;
+            h ^= ((w << 31) | (w >> 33)) * K1;
+            h = ((h << 27) | (h >> 37)) * 5 + 0x52dce729;
+        }
+        uint64_t tail = 0;
+        for (int shift = 0; i < size; i++, shift += 8)
+            tail |= uint64_t(p[i]) << shift;
+        h ^= tail * K2;
+        // murmur3 finalizer
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        return h ^ (h >> 33);
+    }
+    
+} // ::hashutils
+
+#endif /* Hash_h */
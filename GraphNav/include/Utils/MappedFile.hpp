@@ -0,0 +1,72 @@
+#ifndef MappedFile_h
+#define MappedFile_h
+
+#include <string>
+#include <cstddef>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fileutils{
+    
+    // read-only memory mapping of a whole file, unmapped on destruction
+    class MappedFile{
+    public:
+        MappedFile() : _data(nullptr), _size(0) { ; }
+        explicit MappedFile(const std::string& fileName) : _data(nullptr), _size(0) { open(fileName); }
+        ~MappedFile() { close(); }
+        
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&& other) noexcept : _data(other._data), _size(other._size) { other._data = nullptr; other._size = 0; }
+        MappedFile& operator=(MappedFile&& other) noexcept {
+            if (this != &other){
+                close();
+                _data = other._data;
+                _size = other._size;
+                other._data = nullptr;
+                other._size = 0;
+            }
+            return *this;
+        }
+        
+        bool open(const std::string& fileName){
+            close();
+            int fd = ::open(fileName.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size <= 0){
+                ::close(fd);
+                return false;
+            }
+            void* addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd); // the mapping stays valid
+            if (addr == MAP_FAILED)
+                return false;
+            _data = static_cast<const char*>(addr);
+            _size = static_cast<size_t>(st.st_size);
+            return true;
+        }
+        
+        void close(){
+            if (_data != nullptr)
+                munmap(const_cast<char*>(_data), _size);
+            _data = nullptr;
+            _size = 0;
+        }
+        
+        inline bool isOpen() const { return _data != nullptr; }
+        inline const char* data() const { return _data; }
+        inline size_t size() const { return _size; }
+        
+    private:
+        const char* _data;
+        size_t _size;
+    };
+    
+} // ::fileutils
+
+#endif /* MappedFile_h */
@@ -0,0 +1,282 @@
+#if !defined(METRICS_HPP_)
+#define METRICS_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Counters and latency histograms of the hot paths (snapping, wall tests, POI queries, map and
+// graph loading). Compiled in only when GRAPHNAV_METRICS is defined (cmake -DGRAPHNAV_METRICS=ON);
+// otherwise the macros below expand to nothing and do not even evaluate their arguments.
+// Every thread updates its own block with plain (relaxed load + store) adds; a snapshot sums the
+// blocks, so the hot paths never contend on a shared cache line.
+//
+//      GRAPHNAV_METRIC_ADD(SNAP_SEGMENTS, scanned);
+//      GRAPHNAV_METRIC_TIMER(SNAP_LATENCY); // records until the end of the scope
+//      std::string text = metricsutils::prometheusText();
+
+namespace metricsutils{
+
+enum CounterId{
+    SNAPS, SNAP_SEGMENTS, SNAP_SEGMENTS_VECTORIZED, SNAP_WALL_TESTS, TRACKED_HITS, TRACKED_FALLBACKS,
+    WALL_TESTS, WALL_PIXELS, WALL_CLEARANCE_ACCEPTS,
+    POI_QUERIES, POI_FEATURES,
+    ROUTE_PLANS, ROUTE_EXPANDED,
+    MAP_LOADS, MAP_LOAD_BYTES, MAP_CACHE_HITS, MAP_EVICTIONS, GRAPH_LOADS,
+    NUM_COUNTERS
+};
+
+enum HistogramId{
+    SNAP_LATENCY, TRACKED_SNAP_LATENCY, POI_LATENCY, MAP_LOAD_LATENCY, GRAPH_LOAD_LATENCY,
+    NUM_HISTOGRAMS
+};
+
+struct MetricInfo{
+    const char* name;
+    const char* help;
+};
+
+inline const MetricInfo& counterInfo(CounterId id){
+    static const MetricInfo info[NUM_COUNTERS] = {
+        {"graphnav_snaps_total", "Positions snapped to the graph"},
+        {"graphnav_snap_segments_total", "Segments examined by the snap searches"},
+        {"graphnav_snap_segments_vectorized_total", "Segments of the snap grid scans measured by the vector kernel"},
+        {"graphnav_snap_wall_tests_total", "Wall ray tests made by the snap searches"},
+        {"graphnav_tracked_snap_hits_total", "Tracked snaps answered from the last edge's neighbourhood"},
+        {"graphnav_tracked_snap_fallbacks_total", "Tracked snaps that needed a search of the whole floor"},
+        {"graphnav_wall_tests_total", "Calls to isPathCrossingWalls"},
+        {"graphnav_wall_pixels_total", "Pixels stepped by the wall ray tests"},
+        {"graphnav_wall_clearance_accepts_total", "Wall ray tests accepted by the wall distance field without stepping"},
+        {"graphnav_poi_queries_total", "Closest POI queries"},
+        {"graphnav_poi_features_total", "Features examined by the closest POI and landmark queries"},
+        {"graphnav_route_plans_total", "Routes planned with a route session"},
+        {"graphnav_route_expanded_total", "Nodes expanded by the route session plans"},
+        {"graphnav_map_loads_total", "Floors whose rasters were loaded, decoded or from the raster cache"},
+        {"graphnav_map_load_bytes_total", "Memory of the floor rasters decoded"},
+        {"graphnav_map_cache_hits_total", "Floor rasters mapped from the raster cache instead of decoded"},
+        {"graphnav_map_evictions_total", "Floor rasters dropped to stay within the memory budget"},
+        {"graphnav_graph_loads_total", "Graphs loaded from json or compiled files"},
+    };
+    return info[id];
+}
+
+inline const MetricInfo& histogramInfo(HistogramId id){
+    static const MetricInfo info[NUM_HISTOGRAMS] = {
+        {"graphnav_snap_latency_seconds", "Time to snap one position with a search of the floor"},
+        {"graphnav_tracked_snap_latency_seconds", "Time to snap one position of a track"},
+        {"graphnav_poi_latency_seconds", "Time to find the closest POI"},
+        {"graphnav_map_load_latency_seconds", "Time to load the rasters of a floor"},
+        {"graphnav_graph_load_latency_seconds", "Time to load a graph"},
+    };
+    return info[id];
+}
+
+// latencies in nanoseconds, 4 buckets per power of two: values below 4 have their own bucket,
+// value v in [2^e, 2^(e+1)) goes to 4 * (e - 1) + the two bits of v after the leading one
+const int NUM_BUCKETS = 4 * 40;
+
+inline int bucketOf(uint64_t ns){
+    if (ns < 4)
+        return static_cast<int>(ns);
+    int e = 63 - __builtin_clzll(ns);
+    return std::min(4 * (e - 1) + static_cast<int>((ns >> (e - 2)) & 3), NUM_BUCKETS - 1);
+}
+
+// smallest value of the next bucket
+inline double bucketUpperBound(int bucket){
+    if (bucket < 4)
+        return bucket + 1;
+    int e = bucket / 4 + 1, sub = bucket % 4;
+    return std::ldexp(1.0 + (sub + 1) / 4.0, e);
+}
+
+struct Snapshot{
+    uint64_t counters[NUM_COUNTERS] = {};
+    uint64_t buckets[NUM_HISTOGRAMS][NUM_BUCKETS] = {};
+    uint64_t sums[NUM_HISTOGRAMS] = {}; // ns
+
+    uint64_t count(HistogramId h) const {
+        uint64_t n = 0;
+        for (int b = 0; b < NUM_BUCKETS; b++)
+            n += buckets[h][b];
+        return n;
+    }
+
+    // upper bound of the bucket holding the p-th quantile, in seconds
+    double quantile(HistogramId h, double p) const {
+        uint64_t n = count(h), seen = 0;
+        if (n == 0)
+            return 0;
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * n)));
+        for (int b = 0; b < NUM_BUCKETS; b++){
+            seen += buckets[h][b];
+            if (seen >= rank)
+                return bucketUpperBound(b) * 1e-9;
+        }
+        return bucketUpperBound(NUM_BUCKETS - 1) * 1e-9;
+    }
+};
+
+class Registry{
+public:
+    struct Block{
+        std::atomic<uint64_t> counters[NUM_COUNTERS];
+        std::atomic<uint64_t> buckets[NUM_HISTOGRAMS][NUM_BUCKETS];
+        std::atomic<uint64_t> sums[NUM_HISTOGRAMS];
+
+        Block(){
+            for (auto& c : counters) c.store(0, std::memory_order_relaxed);
+            for (auto& h : buckets) for (auto& b : h) b.store(0, std::memory_order_relaxed);
+            for (auto& s : sums) s.store(0, std::memory_order_relaxed);
+        }
+
+        // only the owning thread writes, readers may see a slightly old value
+        static inline void add(std::atomic<uint64_t>& v, uint64_t n){ v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+
+        void addTo(Snapshot& s) const {
+            for (int c = 0; c < NUM_COUNTERS; c++)
+                s.counters[c] += counters[c].load(std::memory_order_relaxed);
+            for (int h = 0; h < NUM_HISTOGRAMS; h++){
+                for (int b = 0; b < NUM_BUCKETS; b++)
+                    s.buckets[h][b] += buckets[h][b].load(std::memory_order_relaxed);
+                s.sums[h] += sums[h].load(std::memory_order_relaxed);
+            }
+        }
+    };
+
+    static Registry& instance(){
+        static Registry* registry = new Registry(); // never destroyed, threads may outlive static destruction
+        return *registry;
+    }
+
+    // block of the calling thread
+    static Block& local(){
+        static thread_local Owner owner;
+        return *owner.block;
+    }
+
+    Snapshot snapshot(){
+        Snapshot s;
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (const Block* b : _blocks)
+            b->addTo(s);
+        for (int c = 0; c < NUM_COUNTERS; c++)
+            s.counters[c] += _retired.counters[c];
+        for (int h = 0; h < NUM_HISTOGRAMS; h++){
+            for (int b = 0; b < NUM_BUCKETS; b++)
+                s.buckets[h][b] += _retired.buckets[h][b];
+            s.sums[h] += _retired.sums[h];
+        }
+        return s;
+    }
+
+private:
+    std::mutex _mutex;
+    std::vector<Block*> _blocks;
+    Snapshot _retired; // what threads that have exited recorded
+
+    // registers the thread's block, folds it into _retired when the thread exits
+    struct Owner{
+        Block* block;
+        Owner() : block(new Block()){
+            Registry& r = instance();
+            std::lock_guard<std::mutex> lock(r._mutex);
+            r._blocks.push_back(block);
+        }
+        ~Owner(){
+            Registry& r = instance();
+            std::lock_guard<std::mutex> lock(r._mutex);
+            block->addTo(r._retired);
+            r._blocks.erase(std::find(r._blocks.begin(), r._blocks.end(), block));
+            delete block;
+        }
+    };
+};
+
+inline void add(CounterId id, uint64_t n) { Registry::Block::add(Registry::local().counters[id], n); }
+
+inline void record(HistogramId id, uint64_t ns){
+    Registry::Block& b = Registry::local();
+    Registry::Block::add(b.buckets[id][bucketOf(ns)], 1);
+    Registry::Block::add(b.sums[id], ns);
+}
+
+class ScopedTimer{
+public:
+    explicit ScopedTimer(HistogramId id) : _id(id), _start(std::chrono::steady_clock::now()) { ; }
+    ~ScopedTimer(){
+        record(_id, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count()));
+    }
+private:
+    HistogramId _id;
+    std::chrono::steady_clock::time_point _start;
+};
+
+// Prometheus text exposition format. Every histogram has the same buckets at every scrape, one per
+// power of two up to 2^40 ns; the last bucket, which also holds the clamped values, is only in +Inf
+inline std::string prometheusText(const Snapshot& s = Registry::instance().snapshot()){
+    std::string out;
+    char buf[256];
+    for (int c = 0; c < NUM_COUNTERS; c++){
+        const MetricInfo& info = counterInfo(static_cast<CounterId>(c));
+        snprintf(buf, sizeof(buf), "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", info.name, info.help, info.name, info.name,
+                 static_cast<unsigned long long>(s.counters[c]));
+        out += buf;
+    }
+    for (int h = 0; h < NUM_HISTOGRAMS; h++){
+        const MetricInfo& info = histogramInfo(static_cast<HistogramId>(h));
+        snprintf(buf, sizeof(buf), "# HELP %s %s\n# TYPE %s histogram\n", info.name, info.help, info.name);
+        out += buf;
+        uint64_t cumulative = 0, total = s.count(static_cast<HistogramId>(h));
+        for (int b = 0; b < NUM_BUCKETS - 1; b++){
+            cumulative += s.buckets[h][b];
+            if (b % 4 == 3){
+                snprintf(buf, sizeof(buf), "%s_bucket{le=\"%g\"} %llu\n", info.name, bucketUpperBound(b) * 1e-9, static_cast<unsigned long long>(cumulative));
+                out += buf;
+            }
+        }
+        snprintf(buf, sizeof(buf), "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %g\n%s_count %llu\n", info.name, static_cast<unsigned long long>(total),
+                 info.name, s.sums[h] * 1e-9, info.name, static_cast<unsigned long long>(total));
+        out += buf;
+    }
+    return out;
+}
+
+// {"counters": {"<name>": n, ...}, "histograms": {"<name>": {"count": n, "sum": s, "p50": s, "p90": s, "p99": s}, ...}}
+inline std::string json(const Snapshot& s = Registry::instance().snapshot()){
+    std::string out = "{\"counters\": {";
+    char buf[256];
+    for (int c = 0; c < NUM_COUNTERS; c++){
+        snprintf(buf, sizeof(buf), "%s\"%s\": %llu", c ? ", " : "", counterInfo(static_cast<CounterId>(c)).name, static_cast<unsigned long long>(s.counters[c]));
+        out += buf;
+    }
+    out += "}, \"histograms\": {";
+    for (int h = 0; h < NUM_HISTOGRAMS; h++){
+        HistogramId id = static_cast<HistogramId>(h);
+        snprintf(buf, sizeof(buf), "%s\"%s\": {\"count\": %llu, \"sum\": %g, \"p50\": %g, \"p90\": %g, \"p99\": %g}", h ? ", " : "",
+                 histogramInfo(id).name, static_cast<unsigned long long>(s.count(id)), s.sums[h] * 1e-9,
+                 s.quantile(id, 0.5), s.quantile(id, 0.9), s.quantile(id, 0.99));
+        out += buf;
+    }
+    return out + "}}";
+}
+
+} // ::metricsutils
+
+#if defined(GRAPHNAV_METRICS)
+#define GRAPHNAV_METRIC_CONCAT_(a, b) a##b
+#define GRAPHNAV_METRIC_CONCAT(a, b) GRAPHNAV_METRIC_CONCAT_(a, b)
+#define GRAPHNAV_METRIC_ADD(id, n) metricsutils::add(metricsutils::id, (n))
+#define GRAPHNAV_METRIC_TIMER(id) metricsutils::ScopedTimer GRAPHNAV_METRIC_CONCAT(graphnavTimer, __LINE__)(metricsutils::id)
+#else
+#define GRAPHNAV_METRIC_ADD(id, n) ((void)sizeof(n))
+#define GRAPHNAV_METRIC_TIMER(id) ((void)0)
+#endif
+
+#endif // METRICS_HPP_
@@ -14,8 +14,15 @@
 #include <stdlib.h>
 
 #include <algorithm>
+#include <cassert>
 #include <cctype>
+#include <climits>
+#include <cstdint>
+#include <cstring>
 #include <locale>
+#include <sstream>
+#include <string>
+#include <vector>
 
 namespace parseutils{
     
@@ -62,7 +69,7 @@ namespace parseutils{
         return s;
     }
     
-    static KeyValuePair splitKeyValue(std::string strLine, std::string delimiter){
+    static inline KeyValuePair splitKeyValue(std::string strLine, std::string delimiter){
         
         assert(strLine.length() > 0);
         
@@ -74,7 +81,7 @@ namespace parseutils{
         return kv;
     }
     
-    static IndexValuePair splitIndexValue(std::string strLine, std::string delimiter){
+    static inline IndexValuePair splitIndexValue(std::string strLine, std::string delimiter){
         
         IndexValuePair kv;
         if(strLine.length() > 0){
@@ -137,6 +144,186 @@ namespace parseutils{
     
     
     
+    //** Allocation-free scanning, for the map file parsers (Maps/MapFiles.hpp)
+    
+    // Non-owning view of a run of characters. Stands in for std::string_view, the library builds as C++14.
+    struct StringRef{
+        static const size_t npos = static_cast<size_t>(-1);
+        
+        const char* data;
+        size_t size;
+        
+        StringRef() : data(nullptr), size(0) { ; }
+        StringRef(const char* d, size_t n) : data(d), size(n) { ; }
+        StringRef(const char* s) : data(s), size(std::strlen(s)) { ; }
+        StringRef(const std::string& s) : data(s.data()), size(s.size()) { ; }
+        
+        inline bool empty() const { return size == 0; }
+        inline const char* begin() const { return data; }
+        inline const char* end() const { return data + size; }
+        inline std::string str() const { return std::string(data, size); }
+        
+        inline size_t find(char c, size_t from = 0) const {
+            if (from >= size)
+                return npos;
+            const void* p = std::memchr(data + from, c, size - from);
+            return p ? static_cast<size_t>(static_cast<const char*>(p) - data) : npos;
+        }
+        inline bool contains(StringRef s) const {
+            return std::search(begin(), end(), s.begin(), s.end()) != end() || s.empty();
+        }
+        inline StringRef substr(size_t pos, size_t n = npos) const {
+            pos = std::min(pos, size);
+            return StringRef(data + pos, std::min(n, size - pos));
+        }
+        // without leading and trailing whitespace, as trim
+        inline StringRef trimmed() const {
+            const char* b = begin();
+            const char* e = end();
+            while (b < e && std::isspace(static_cast<unsigned char>(*b)))
+                b++;
+            while (e > b && std::isspace(static_cast<unsigned char>(e[-1])))
+                e--;
+            return StringRef(b, static_cast<size_t>(e - b));
+        }
+    };
+    
+    inline bool operator==(StringRef a, StringRef b) { return a.size == b.size && std::memcmp(a.data, b.data, a.size) == 0; }
+    inline bool operator!=(StringRef a, StringRef b) { return !(a == b); }
+    
+    // lines of a buffer, without the '\n'; the last line needs no line break
+    class LineReader{
+    public:
+        LineReader(const char* data, size_t size) : _pos(data), _end(data + size) { ; }
+        
+        bool next(StringRef& line){
+            if (_pos >= _end)
+                return false;
+            const char* eol = static_cast<const char*>(std::memchr(_pos, '\n', static_cast<size_t>(_end - _pos)));
+            if (!eol)
+                eol = _end;
+            line = StringRef(_pos, static_cast<size_t>(eol - _pos));
+            _pos = eol + 1;
+            return true;
+        }
+        
+    private:
+        const char* _pos;
+        const char* _end;
+    };
+    
+    // splits line at the first delimiter and trims both sides; false if there is no delimiter
+    static inline bool splitKeyValue(StringRef line, char delimiter, StringRef& key, StringRef& value){
+        size_t found = line.find(delimiter);
+        if (found == StringRef::npos)
+            return false;
+        key = line.substr(0, found).trimmed();
+        value = line.substr(found + 1).trimmed();
+        return true;
+    }
+    
+    // Number at the start of [first, last), like std::from_chars: returns the end of the number, or
+    // nullptr (value untouched) if the range does not start with one or it is out of range.
+    static inline const char* parseNumber(const char* first, const char* last, int& value){
+        const char* p = first;
+        bool negative = p < last && *p == '-';
+        if (p < last && (*p == '-' || *p == '+'))
+            p++;
+        const char* digits = p;
+        long long v = 0;
+        for (; p < last && *p >= '0' && *p <= '9'; p++){
+            v = v * 10 + (*p - '0');
+            if (v > static_cast<long long>(INT_MAX) + 1)
+                return nullptr;
+        }
+        if (p == digits || (!negative && v > INT_MAX))
+            return nullptr;
+        value = static_cast<int>(negative ? -v : v);
+        return p;
+    }
+    
+    // decimal floating point ([sign] digits [. digits] [e [sign] digits]), rounded as strtod and iostreams do
+    static inline const char* parseNumber(const char* first, const char* last, double& value){
+        const char* p = first;
+        bool negative = p < last && *p == '-';
+        if (p < last && (*p == '-' || *p == '+'))
+            p++;
+        uint64_t mantissa = 0;
+        int numDigits = 0, fractionDigits = 0;
+        for (; p < last && *p >= '0' && *p <= '9'; p++, numDigits++)
+            mantissa = mantissa * 10 + (*p - '0');
+        if (p < last && *p == '.'){
+            for (p++; p < last && *p >= '0' && *p <= '9'; p++, numDigits++, fractionDigits++)
+                mantissa = mantissa * 10 + (*p - '0');
+        }
+        if (numDigits == 0)
+            return nullptr;
+        int exponent = 0, exponentDigits = 0;
+        if (p < last && (*p == 'e' || *p == 'E')){
+            const char* mark = p++;
+            bool negativeExponent = p < last && *p == '-';
+            if (p < last && (*p == '-' || *p == '+'))
+                p++;
+            for (; p < last && *p >= '0' && *p <= '9'; p++, exponentDigits++)
+                exponent = std::min(exponent * 10 + (*p - '0'), 100000);
+            if (exponentDigits == 0)
+                p = mark; // not an exponent, the number ends before the 'e'
+            if (negativeExponent)
+                exponent = -exponent;
+        }
+        // up to 15 digits and a power of ten up to 1e22 are both exact doubles, so one multiplication
+        // or division rounds as strtod does (Clinger's fast path)
+        static const double powersOfTen[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                             1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+        int power = exponent - fractionDigits;
+        if (numDigits <= 15 && power >= -22 && power <= 22){
+            double m = static_cast<double>(mantissa);
+            value = power < 0 ? m / powersOfTen[-power] : m * powersOfTen[power];
+            if (negative)
+                value = -value;
+            return p;
+        }
+        // strtod needs a terminated string: numbers are copied to the stack, only absurdly long ones allocate
+        size_t n = static_cast<size_t>(p - first);
+        char buffer[64];
+        std::string longNumber;
+        const char* text = buffer;
+        if (n < sizeof(buffer)){
+            std::memcpy(buffer, first, n);
+            buffer[n] = '\0';
+        }
+        else{
+            longNumber.assign(first, n);
+            text = longNumber.c_str();
+        }
+        value = std::strtod(text, nullptr);
+        return p;
+    }
+    
+    // values of "[a, b, ...]" (brackets optional, separated by commas and/or spaces) into out, up to
+    // maxCount; returns how many were read, stopping at the first one that is not a number
+    template <typename T>
+    static inline size_t parseArray(StringRef s, T* out, size_t maxCount){
+        s = s.trimmed();
+        if (!s.empty() && *s.begin() == '[')
+            s = s.substr(1);
+        if (!s.empty() && s.end()[-1] == ']')
+            s = s.substr(0, s.size - 1);
+        const char* p = s.begin();
+        size_t count = 0;
+        while (count < maxCount){
+            while (p < s.end() && (*p == ',' || std::isspace(static_cast<unsigned char>(*p))))
+                p++;
+            if (p == s.end())
+                break;
+            p = parseNumber(p, s.end(), out[count]);
+            if (!p)
+                break;
+            count++;
+        }
+        return count;
+    }
+    
 } // ::utils
 
 #endif /* ParseUtils_h */
@@ -0,0 +1,78 @@
+#if !defined(SNAPSHOT_HPP_)
+#define SNAPSHOT_HPP_
+
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+namespace syncutils{
+
+// Read-copy-update holder for an immutable object shared by many threads.
+// Readers take the current version with get() and keep using it as long as they hold the pointer;
+// they never wait for a writer to copy or change the object. A writer copies the current version,
+// changes the copy and publishes it atomically; concurrent writers are serialized.
+// get() and the publication go through std::atomic_load/atomic_store on the shared_ptr, which
+// libstdc++ implements with a mutex taken from a small pool hashed by address: each get() briefly
+// locks it and bumps the reference count. Readers should call get() once per batch of queries
+// and run the whole batch on that version, not once per query.
+template <typename T>
+class Snapshot{
+public:
+    Snapshot() { ; }
+    explicit Snapshot(std::shared_ptr<const T> value) : _value(std::move(value)) { ; }
+    
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+    
+    inline std::shared_ptr<const T> get() const { return std::atomic_load(&_value); }
+    
+    void set(std::shared_ptr<const T> value){
+        std::lock_guard<std::mutex> lock(_writeMutex);
+        std::atomic_store(&_value, std::move(value));
+    }
+    
+    // publishes a copy of the current version modified by update(T&); returns what update returns.
+    // update may return void; if it returns a bool, false means it failed and the copy is dropped.
+    template <typename UpdateFn>
+    auto update(UpdateFn update) -> decltype(update(std::declval<T&>())) {
+        using Result = decltype(update(std::declval<T&>()));
+        std::lock_guard<std::mutex> lock(_writeMutex);
+        std::shared_ptr<T> copy = std::make_shared<T>(*std::atomic_load(&_value));
+        return _apply(update, copy, std::is_void<Result>(), std::is_same<Result, bool>());
+    }
+    
+private:
+    template <typename UpdateFn>
+    void _apply(UpdateFn& update, std::shared_ptr<T>& copy, std::true_type /*void*/, std::false_type){
+        update(*copy);
+        _publish(copy);
+    }
+    
+    template <typename UpdateFn>
+    bool _apply(UpdateFn& update, std::shared_ptr<T>& copy, std::false_type, std::true_type /*bool*/){
+        bool done = update(*copy);
+        if (done)
+            _publish(copy);
+        return done;
+    }
+    
+    template <typename UpdateFn>
+    auto _apply(UpdateFn& update, std::shared_ptr<T>& copy, std::false_type, std::false_type) -> decltype(update(*copy)) {
+        auto result = update(*copy);
+        _publish(copy);
+        return result;
+    }
+    
+    inline void _publish(std::shared_ptr<T>& copy){
+        std::atomic_store(&_value, std::shared_ptr<const T>(std::move(copy)));
+    }
+    
+
+    std::shared_ptr<const T> _value;
+    std::mutex _writeMutex;
+};
+
+} // end syncutils namespace
+
+#endif // SNAPSHOT_HPP_
@@ -0,0 +1,137 @@
+#if !defined(WORKSTEALINGPOOL_HPP_)
+#define WORKSTEALINGPOOL_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace syncutils{
+
+// Fixed pool of worker threads, each with its own task deque. A worker runs its own tasks newest
+// first (they are likely to touch data still in its cache) and, when it runs out, steals the oldest
+// task of another worker. Tasks submitted from outside the pool are spread round robin.
+class WorkStealingPool{
+public:
+    // numThreads == 0: one thread per core
+    explicit WorkStealingPool(unsigned numThreads = 0) : _queued(0), _unfinished(0), _stop(false), _nextQueue(0) {
+        if (numThreads == 0)
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < numThreads; i++)
+            _queues.emplace_back(new Queue());
+        for (unsigned i = 0; i < numThreads; i++)
+            _threads.emplace_back(&WorkStealingPool::_run, this, static_cast<int>(i));
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // runs the tasks still queued, then stops the workers
+    ~WorkStealingPool(){
+        wait();
+        {
+            std::lock_guard<std::mutex> lock(_sleepMutex);
+            _stop = true;
+        }
+        _wake.notify_all();
+        for (auto& t : _threads)
+            t.join();
+    }
+
+    void submit(std::function<void()> task){
+        int self = (_currentPool() == this) ? _currentWorker() : -1;
+        size_t q = (self >= 0) ? static_cast<size_t>(self) : _nextQueue++ % _queues.size();
+        _unfinished++;
+        {
+            std::lock_guard<std::mutex> lock(_queues[q]->mutex);
+            _queues[q]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(_sleepMutex);
+            _queued++;
+        }
+        _wake.notify_one();
+    }
+
+    // blocks until every task submitted so far has run
+    void wait(){
+        std::unique_lock<std::mutex> lock(_idleMutex);
+        _idle.wait(lock, [this]{ return _unfinished.load() == 0; });
+    }
+
+    inline unsigned size() const { return static_cast<unsigned>(_threads.size()); }
+
+private:
+    struct Queue{
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::vector<std::thread> _threads;
+    std::mutex _sleepMutex;
+    std::condition_variable _wake;
+    std::mutex _idleMutex;
+    std::condition_variable _idle;
+    size_t _queued;                  // tasks in the deques, guarded by _sleepMutex
+    std::atomic<size_t> _unfinished; // queued or running
+    bool _stop;                      // guarded by _sleepMutex
+    std::atomic<size_t> _nextQueue;
+
+    static WorkStealingPool*& _currentPool() { static thread_local WorkStealingPool* pool = nullptr; return pool; }
+    static int& _currentWorker() { static thread_local int worker = -1; return worker; }
+
+    bool _pop(int self, std::function<void()>& task){
+        {
+            Queue& own = *_queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()){
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < _queues.size(); k++){
+            Queue& victim = *_queues[(self + k) % _queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()){
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void _run(int self){
+        _currentPool() = this;
+        _currentWorker() = self;
+        std::function<void()> task;
+        while (true){
+            {
+                std::unique_lock<std::mutex> lock(_sleepMutex);
+                _wake.wait(lock, [this]{ return _stop || _queued > 0; });
+                if (_queued == 0) // stopping
+                    return;
+                _queued--; // claims one task, which some deque is guaranteed to hold
+            }
+            while (!_pop(self, task))
+                std::this_thread::yield(); // lost a race for the task to another worker, rescan
+            task();
+            task = nullptr;
+            if (--_unfinished == 0){
+                std::lock_guard<std::mutex> lock(_idleMutex);
+                _idle.notify_all();
+            }
+        }
+    }
+};
+
+} // end syncutils namespace
+
+#endif // WORKSTEALINGPOOL_HPP_
@@ -0,0 +1,52 @@
+#if !defined(GRAPHVIEWER_HPP_)
+#define GRAPHVIEWER_HPP_
+
+#include "../Graph.hpp"
+#include <opencv2/highgui/highgui.hpp>
+
+#include <iostream>
+
+namespace navgraph{
+namespace viz{
+
+// Interactive debugging windows. This is the only part of the project that needs opencv_highgui,
+// the graph and the maps only draw into images.
+
+// for debugging
+inline void onMouse( int event, int x, int y, int, void* ptr)
+{
+    if( event != cv::EVENT_LBUTTONDOWN )
+        return;
+    cv::Point* p = (cv::Point*)ptr;
+    p->x = y;
+    p->y = x;
+    std::cerr << x << "," << y << "\n";
+}
+
+// shows the graph of floor, waits for a click and a key, then shows where the clicked point snaps to
+inline void showClosestNodeToPoint(const Graph& graph, const maps::MapManager& mapManager, int floor){
+    cv::Mat map = graph.plotGraph(floor);
+    cv::namedWindow("graph");
+    cv::Point2i pt;
+    cv::setMouseCallback( "graph", onMouse, &pt );
+    
+    cv::imshow("graph", map);
+    cv::waitKey(0);
+    
+    cv::Point2f snap = graph.snapUV2Graph(mapManager.pixels2uv(pt, floor), floor);
+    
+    cv::Point2i ptpx = mapManager.uv2pixels(snap, floor);
+    cv::circle(map, cv::Point2i(ptpx.y, ptpx.x), 3, cv::Scalar(0,255,255));
+    cv::imshow("graph", map);
+    cv::waitKey(-1);
+    cv::destroyWindow("graph");
+}
+
+inline void showFeatures(const maps::MapManager& mapManager, int floor){
+    cv::imshow("Features", mapManager.getMap(floor)->drawFeatures());
+}
+
+} // end viz namespace
+} // end navgraph namespace
+
+#endif // GRAPHVIEWER_HPP_
@@ -8,21 +8,24 @@
 
 #include <iostream>
 #include "opencv2/core/core.hpp"
-#include <opencv2/highgui/highgui.hpp>
-#include "rapidjson/document.h"
 #include <fstream>
 #include "include/Maps/MapManager.hpp"
 #include "include/Graph.hpp"
+#include "include/Viz/GraphViewer.hpp"
 
 int main(int argc, const char * argv[]) {
     std::string jsonfile = "/Users/gio/Documents/workspace/GraphNav/GraphNav/res/4thfloor.json";
     std::shared_ptr<maps::MapManager> mapManager = std::shared_ptr<maps::MapManager>(new maps::MapManager());
     int floor = 4;
     std::string mapFolder = "/Users/gio/Documents/workspace/GraphNav/GraphNav/res/maps/SKERI";
+    if (argc >= 3){
+        jsonfile = argv[1];
+        mapFolder = argv[2];
+    }
     mapManager->init(mapFolder, 4);
     navgraph::Graph navGraph(jsonfile, mapManager);
-   // navGraph.plotGraph(4, true);
+   // navGraph.plotGraph(4);
     while (1)
-        navGraph.showClosestNodeToPoint(4);
+        navgraph::viz::showClosestNodeToPoint(navGraph, *mapManager, floor);
     return 0;
 }
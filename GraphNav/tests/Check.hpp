@@ -0,0 +1,55 @@
+#if !defined(CHECK_HPP_)
+#define CHECK_HPP_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// Minimal checks for the ctest suite: every test program runs its cases in main, a failed CHECK
+// reports file, line and expression and the program exits nonzero at the end (see testResult).
+// GRAPHNAV_RES_DIR is the res folder of the sources, GRAPHNAV_TEST_DIR a scratch folder of the build;
+// both default to folders relative to GraphNav/ for programs built by hand.
+
+#if !defined(GRAPHNAV_RES_DIR)
+#define GRAPHNAV_RES_DIR "res"
+#endif
+#if !defined(GRAPHNAV_TEST_DIR)
+#define GRAPHNAV_TEST_DIR "."
+#endif
+
+namespace testutils{
+
+inline int& failures() { static int count = 0; return count; }
+
+inline bool check(bool ok, const char* expression, const char* file, int line){
+    if (!ok && failures()++ < 20)
+        std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expression);
+    return ok;
+}
+
+// relative tolerance, with 1 as the smallest scale
+inline bool near(double a, double b, double tolerance){
+    return std::fabs(a - b) <= tolerance * std::max(1.0, std::max(std::fabs(a), std::fabs(b)));
+}
+
+inline std::string resDir() { return GRAPHNAV_RES_DIR; }
+inline std::string scratchDir() { return GRAPHNAV_TEST_DIR; }
+
+// runs a test case, reporting its name when it adds failures
+template <typename Fn>
+void run(const char* name, Fn fn){
+    int before = failures();
+    fn();
+    std::fprintf(stderr, "%s %s\n", failures() == before ? "[ ok ]" : "[FAIL]", name);
+}
+
+inline int testResult() { return failures() == 0 ? EXIT_SUCCESS : EXIT_FAILURE; }
+
+} // ::testutils
+
+#define CHECK(expression) testutils::check(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
+#define CHECK_NEAR(a, b, tolerance) testutils::check(testutils::near((a), (b), (tolerance)), #a " ~ " #b, __FILE__, __LINE__)
+
+#endif // CHECK_HPP_
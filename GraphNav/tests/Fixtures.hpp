@@ -0,0 +1,52 @@
+#if !defined(FIXTURES_HPP_)
+#define FIXTURES_HPP_
+
+#include "Check.hpp"
+#include "Graph.hpp"
+
+#include <functional>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <vector>
+
+// Data and reference searches shared by the test programs that load the graph.
+
+namespace testutils{
+
+// the maps of the SKERI building from floor 4, loaded once per program
+inline std::shared_ptr<maps::MapManager> skeriMaps(){
+    static std::shared_ptr<maps::MapManager> m;
+    if (!m){
+        m = std::make_shared<maps::MapManager>();
+        m->init(resDir() + "/maps/SKERI", 4);
+    }
+    return m;
+}
+
+// Dijkstra distances from src
+inline std::vector<float> dijkstra(const navgraph::CSRAdjacency& g, int src){
+    std::vector<float> dist(g.numNodes(), std::numeric_limits<float>::infinity());
+    typedef std::pair<float, int> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+    dist[src] = 0;
+    heap.push({0.f, src});
+    while (!heap.empty()){
+        Entry top = heap.top();
+        heap.pop();
+        if (top.first > dist[top.second])
+            continue;
+        for (int k = g.begin(top.second); k < g.end(top.second); k++){
+            float d = top.first + g.weights[k];
+            if (d < dist[g.neighbors[k]]){
+                dist[g.neighbors[k]] = d;
+                heap.push({d, g.neighbors[k]});
+            }
+        }
+    }
+    return dist;
+}
+
+} // ::testutils
+
+#endif // FIXTURES_HPP_
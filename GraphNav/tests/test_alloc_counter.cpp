@@ -0,0 +1,97 @@
+//
+//  test_alloc_counter.cpp
+//  GraphNav
+//
+//  The allocation counter used by the benchmarks: what it counts, and that the paths it is meant to
+//  watch (snapping, routing into reused buffers) do not allocate.
+//
+
+#include "Check.hpp"
+#include "Graph.hpp"
+#include "Utils/AllocCounter.hpp"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+GRAPHNAV_DEFINE_ALLOC_COUNTER
+
+namespace {
+
+void* volatile sink;
+
+void countsAllocations(){
+    allocutils::AllocationScope empty;
+    CHECK(empty.allocations() == 0);
+
+    // every pointer escapes to sink, a new/delete pair the compiler can see through may be left out
+    std::vector<std::unique_ptr<int>> values(10);
+    std::unique_ptr<int[]> array;
+    allocutils::AllocationScope scope;
+    for (auto& v : values){
+        v.reset(new int(1));
+        sink = v.get();
+    }
+    array.reset(new int[16]);
+    sink = array.get();
+    CHECK(scope.allocations() == 11);
+    values.clear();
+    array.reset();
+    // freeing is not counted
+    CHECK(scope.allocations() == 11);
+
+    allocutils::AllocationScope inner;
+    std::vector<int> grown;
+    for (int i = 0; i < 1000; i++)
+        grown.push_back(i);
+    CHECK(inner.allocations() > 0 && inner.allocations() <= 11);
+    CHECK(scope.allocations() == 11 + inner.allocations());
+}
+
+void countsOtherThreads(){
+    allocutils::AllocationScope scope;
+    size_t spawn;
+    {
+        allocutils::AllocationScope threadSetup;
+        std::thread t([]{
+            std::vector<std::unique_ptr<int>> values(100);
+            for (int i = 0; i < 100; i++)
+                values[i].reset(new int(i));
+        });
+        t.join();
+        spawn = threadSetup.allocations();
+    }
+    CHECK(spawn >= 101);
+    CHECK(scope.allocations() == spawn);
+}
+
+// the hot paths the benchmarks report as allocation free
+void hotPathsDoNotAllocate(){
+    std::shared_ptr<maps::MapManager> mapManager = std::make_shared<maps::MapManager>();
+    mapManager->init(testutils::resDir() + "/maps/SKERI", 4);
+    navgraph::Graph g(testutils::resDir() + "/4thfloor.json", mapManager);
+    std::vector<cv::Point2f> positions;
+    for (int i = 0; i < 100; i++)
+        positions.push_back(cv::Point2f(10.f + i * 0.2f, 5.f + (i % 7) * 0.5f));
+    std::vector<navgraph::Graph::SnapResult> out(positions.size());
+    // the search scratch buffers are thread local and grow to the largest query once
+    for (const cv::Point2f& uv : positions)
+        g.snapUV2Graph(uv, 4);
+
+    allocutils::AllocationScope scope;
+    for (const cv::Point2f& uv : positions){
+        g.snapUV2Graph(uv, 4);
+        g.snapUV2Graph(uv, 4, false);
+    }
+    g.snapBatch(positions.data(), positions.size(), 4, out.data());
+    CHECK(scope.allocations() == 0);
+}
+
+} // namespace
+
+int main(){
+    testutils::run("counts allocations in scope", countsAllocations);
+    testutils::run("counts allocations of other threads", countsOtherThreads);
+    testutils::run("snapping does not allocate", hotPathsDoNotAllocate);
+    return testutils::testResult();
+}
@@ -0,0 +1,326 @@
+//
+//  test_distances.cpp
+//  GraphNav
+//
+//  Precomputed distances against searches done here: the distance table and its landmark bounds
+//  against Dijkstra, and the geodesic fields against a Dijkstra over the cells of the floor.
+//
+
+#include "Check.hpp"
+#include "Fixtures.hpp"
+#include "Graph.hpp"
+
+#include <queue>
+#include <random>
+
+using navgraph::CSRAdjacency;
+using navgraph::DistanceTable;
+using navgraph::GeodesicFields;
+using navgraph::Graph;
+using testutils::skeriMaps;
+using testutils::dijkstra;
+
+namespace {
+
+bool sameDistance(float a, float b){
+    return (std::isinf(a) && std::isinf(b)) || testutils::near(a, b, 1e-5);
+}
+
+void tableMatchesDijkstra(const CSRAdjacency& g, const DistanceTable& table, const std::vector<int>& targets){
+    CHECK(table.numNodes() == g.numNodes());
+    CHECK(table.targets() == targets);
+    std::vector<std::vector<float>> from(g.numNodes());
+    for (int v = 0; v < g.numNodes(); v++)
+        from[v] = dijkstra(g, v);
+    for (int v = 0; v < g.numNodes(); v++){
+        for (int slot = 0; slot < table.numTargets(); slot++){
+            CHECK(table.targetSlot(targets[slot]) == slot);
+            CHECK(sameDistance(table.distance(v, slot), from[v][targets[slot]]));
+            CHECK(table.distancesFrom(v)[slot] == table.distance(v, slot));
+        }
+        // the landmark bounds never overestimate
+        for (int w = 0; w < g.numNodes(); w++)
+            CHECK(table.lowerBound(v, w) <= from[v][w] * (1 + 1e-5f) + 1e-5f);
+        CHECK(table.lowerBound(v, v) == 0);
+    }
+}
+
+void distanceTableOnSkeri(){
+    Graph g(testutils::resDir() + "/4thfloor.json", skeriMaps());
+    const CSRAdjacency& adj = g.getAdjacency();
+    std::vector<int> all, destinations;
+    for (int v = 0; v < g.numNodes(); v++){
+        all.push_back(v);
+        if (g.getNodeGeometry(v).type == Graph::Destination)
+            destinations.push_back(v);
+    }
+    CHECK(!destinations.empty());
+
+    // the same table on one thread or several
+    g.buildDistanceTable(2048, 8, 1);
+    CHECK(g.getDistanceTable().numLandmarks() == 8);
+    tableMatchesDijkstra(adj, g.getDistanceTable(), all);
+    DistanceTable parallel;
+    parallel.build(adj, all, 8, 3);
+    CHECK(parallel.table() == g.getDistanceTable().table());
+    CHECK(parallel.fromLandmark() == g.getDistanceTable().fromLandmark() && parallel.toLandmark() == g.getDistanceTable().toLandmark());
+
+    // above maxFullTableNodes only the destinations are targets
+    g.buildDistanceTable(1, 4, 2);
+    tableMatchesDijkstra(adj, g.getDistanceTable(), destinations);
+
+    // rebuilt from its arrays, or not if they do not fit together
+    const DistanceTable& built = g.getDistanceTable();
+    DistanceTable copy;
+    CHECK(copy.assign(built.numNodes(), built.targets(), built.table(), built.landmarks(), built.fromLandmark(), built.toLandmark()));
+    CHECK(copy.table() == built.table() && copy.lowerBound(0, g.numNodes() - 1) == built.lowerBound(0, g.numNodes() - 1));
+    CHECK(!copy.assign(built.numNodes() + 1, built.targets(), built.table(), built.landmarks(), built.fromLandmark(), built.toLandmark()));
+    CHECK(!copy.assign(built.numNodes(), {built.numNodes()}, std::vector<float>(built.numNodes()), {}, {}, {}));
+}
+
+// edges of a disconnected random graph, some one way
+void distanceTableOnRandomGraphs(){
+    for (int trial = 0; trial < 20; trial++){
+        std::mt19937 rng(trial);
+        int n = 2 + static_cast<int>(rng() % 60);
+        CSRAdjacency g;
+        g.offsets.assign(1, 0);
+        for (int u = 0; u < n; u++){
+            for (int e = 0, m = static_cast<int>(rng() % 4); e < m; e++){
+                g.neighbors.push_back(static_cast<int>(rng() % n));
+                g.weights.push_back(static_cast<float>(rng() % 100) / 10.f);
+            }
+            g.offsets.push_back(g.numEdges());
+            g.positions.push_back(cv::Point2f(0, 0));
+        }
+        std::vector<int> targets;
+        for (int v = 0; v < n; v += 1 + trial % 3)
+            targets.push_back(v);
+        DistanceTable table;
+        table.build(g, targets, 1 + trial % 5, 1 + trial % 3);
+        tableMatchesDijkstra(g, table, targets);
+    }
+}
+
+// from a snapped position, the table gives the route length through either end of the edge
+void destinationDistances(){
+    Graph g(testutils::resDir() + "/4thfloor.json", skeriMaps());
+    const CSRAdjacency& adj = g.getAdjacency();
+    std::vector<Graph::DestinationDistance> out;
+    CHECK(!g.getDistancesToDestinations(cv::Point2f(10.f, 10.f), 4, out) && out.empty());
+    g.buildDistanceTable();
+
+    auto weight = [&adj](int from, int to){
+        float w = std::numeric_limits<float>::infinity();
+        for (int k = adj.begin(from); k < adj.end(from); k++)
+            if (adj.neighbors[k] == to)
+                w = std::min(w, adj.weights[k]);
+        return w;
+    };
+    cv::Size size = skeriMaps()->getMapSizePixels(4);
+    double scale = skeriMaps()->getScale(4);
+    std::mt19937 rng(37);
+    std::uniform_real_distribution<float> u(0.f, size.height / scale), v(0.f, size.width / scale);
+    int answered = 0;
+    for (int q = 0; q < 300; q++){
+        cv::Point2f uv(u(rng), v(rng));
+        Graph::SnapResult snap;
+        g.snapBatch(&uv, 1, 4, &snap);
+        bool ok = g.getDistancesToDestinations(uv, 4, out);
+        CHECK(ok == (snap.edge >= 0));
+        if (!ok)
+            continue;
+        answered++;
+        const navgraph::Segment& s = g.getEdgeSegment(snap.edge);
+        std::vector<float> fromN1 = dijkstra(adj, s.n1), fromN2 = dijkstra(adj, s.n2);
+        int count = 0;
+        for (int n = 0; n < g.numNodes(); n++){
+            if (g.getNodeGeometry(n).type != Graph::Destination)
+                continue;
+            auto it = std::find_if(out.begin(), out.end(), [&](const Graph::DestinationDistance& d){ return d.nodeId == g.nodeId(n); });
+            if (!CHECK(it != out.end()))
+                continue;
+            count++;
+            float expected = std::min(snap.t * weight(s.n2, s.n1) + fromN1[n], (1 - snap.t) * weight(s.n1, s.n2) + fromN2[n]);
+            CHECK(sameDistance(it->length, expected));
+        }
+        CHECK(count == static_cast<int>(out.size()));
+    }
+    CHECK(answered > 50);
+
+    // a longer edge leaves the table stale, a shorter one drops it; either way it has to be rebuilt
+    int a = 0, b = adj.neighbors[adj.begin(0)];
+    cv::Point2f uv = g.getNodeGeometry(a).positionUV;
+    CHECK(g.getDistancesToDestinations(uv, 4, out));
+    CHECK(g.setEdgeLength(g.nodeId(a), g.nodeId(b), weight(a, b) * 2));
+    CHECK(!g.getDistancesToDestinations(uv, 4, out));
+    g.buildDistanceTable();
+    CHECK(g.getDistancesToDestinations(uv, 4, out));
+    CHECK(g.setEdgeLength(g.nodeId(a), g.nodeId(b), weight(a, b) / 4));
+    CHECK(!g.getDistancesToDestinations(uv, 4, out));
+    CHECK(g.getDistanceTable().empty());
+}
+
+// Dijkstra over the cells of a floor with the steps GeodesicFields documents, in meters
+struct CellGrid{
+    int cellPx, rows, cols;
+    float step;
+    std::vector<char> walkable;
+    std::vector<uint8_t> moves; // bit k: step k, as in dr/dc below, is allowed
+
+    static int dr(int k) { static const int d[8] = {-1, -1, -1,  0, 0,  1, 1, 1}; return d[k]; }
+    static int dc(int k) { static const int d[8] = {-1,  0,  1, -1, 1, -1, 0, 1}; return d[k]; }
+    cv::Point2i centre(int r, int c) const { return cv::Point2i(r * cellPx + cellPx / 2, c * cellPx + cellPx / 2); }
+
+    CellGrid(const maps::AnnotatedMap& map, int cellPx) : cellPx(cellPx){
+        rows = map.getMapSizePixels().height / cellPx;
+        cols = map.getMapSizePixels().width / cellPx;
+        step = static_cast<float>(cellPx / map.getScale());
+        walkable.assign(rows * cols, 0);
+        for (int r = 0; r < rows; r++)
+            for (int c = 0; c < cols; c++)
+                walkable[r * cols + c] = map.isWalkable(centre(r, c)) && !map.isWallAt(centre(r, c));
+        auto open = [&](int r, int c, int k){
+            int r2 = r + dr(k), c2 = c + dc(k);
+            return r2 >= 0 && r2 < rows && c2 >= 0 && c2 < cols && walkable[r * cols + c] && walkable[r2 * cols + c2] &&
+                   !map.isPathCrossingWalls(centre(r, c), centre(r2, c2));
+        };
+        moves.assign(rows * cols, 0);
+        for (int r = 0; r < rows; r++)
+            for (int c = 0; c < cols; c++)
+                for (int k : {1, 3, 4, 6})
+                    if (open(r, c, k))
+                        moves[r * cols + c] |= 1 << k;
+        // a diagonal step goes both ways around the corner it cuts
+        for (int r = 0; r < rows; r++)
+            for (int c = 0; c < cols; c++)
+                for (int k : {0, 2, 5, 7}){
+                    int vertical = dr(k) < 0 ? 1 : 6, horizontal = dc(k) < 0 ? 3 : 4;
+                    int r2 = r + dr(k), c2 = c + dc(k);
+                    if (r2 >= 0 && r2 < rows && c2 >= 0 && c2 < cols && (moves[r * cols + c] >> vertical & 1) && (moves[r * cols + c] >> horizontal & 1) &&
+                        (moves[(r + dr(k)) * cols + c] >> horizontal & 1) && (moves[r * cols + c + dc(k)] >> vertical & 1))
+                        moves[r * cols + c] |= 1 << k;
+                }
+    }
+
+    // seeded from the nearest ring of cells around the source's cell with a way out
+    std::vector<float> distances(const maps::AnnotatedMap& map, cv::Point2f uv) const {
+        const float inf = std::numeric_limits<float>::infinity();
+        std::vector<float> dist(rows * cols, inf);
+        typedef std::pair<float, int> Entry;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+        cv::Point2i px = map.uv2pixels(uv);
+        int row = px.x / cellPx, col = px.y / cellPx;
+        for (int ring = 0; ring <= 8 && heap.empty(); ring++)
+            for (int r = row - ring; r <= row + ring; r++)
+                for (int c = col - ring; c <= col + ring; c++){
+                    if (std::max(std::abs(r - row), std::abs(c - col)) != ring || r < 0 || r >= rows || c < 0 || c >= cols || !moves[r * cols + c])
+                        continue;
+                    cv::Point2i p = centre(r, c);
+                    cv::Point2f d = cv::Point2f((map.getMapSizePixels().height - p.x) / map.getScale(), p.y / map.getScale()) - uv;
+                    dist[r * cols + c] = std::sqrt(d.x * d.x + d.y * d.y);
+                    heap.push({dist[r * cols + c], r * cols + c});
+                }
+        while (!heap.empty()){
+            Entry top = heap.top();
+            heap.pop();
+            if (top.first > dist[top.second])
+                continue;
+            for (int k = 0; k < 8; k++){
+                if (!(moves[top.second] >> k & 1))
+                    continue;
+                int next = top.second + dr(k) * cols + dc(k);
+                float d = top.first + (k == 1 || k == 3 || k == 4 || k == 6 ? step : step * 1.41421356f);
+                if (d < dist[next]){
+                    dist[next] = d;
+                    heap.push({d, next});
+                }
+            }
+        }
+        return dist;
+    }
+};
+
+void geodesicFieldsOnSkeri(){
+    Graph g(testutils::resDir() + "/4thfloor.json", skeriMaps());
+    const int cellPx = 3;
+    g.buildGeodesicFields(cellPx, 2);
+    const GeodesicFields& fields = g.getGeodesicFields();
+    std::shared_ptr<const maps::AnnotatedMap> map = skeriMaps()->getMap(4);
+    CellGrid grid(*map, cellPx);
+    CHECK(fields.cellPx() == cellPx && fields.bytes() > 0);
+
+    int numFields = 0;
+    std::mt19937 rng(41);
+    for (int n = 0; n < g.numNodes(); n++){
+        if (g.getNodeGeometry(n).type != Graph::Destination){
+            CHECK(fields.fieldSlot(n) == -1);
+            continue;
+        }
+        int slot = fields.fieldSlot(n);
+        if (!CHECK(slot >= 0))
+            continue;
+        numFields++;
+        // a handful of fields against the reference, every cell of them
+        if (numFields > 6 && rng() % 4 != 0)
+            continue;
+        cv::Point2f source = g.getNodeGeometry(n).positionUV;
+        std::vector<float> expected = grid.distances(*map, source);
+        // half a quantization step, of a quarter cell or of the longest distance in 65534 steps
+        float longest = 0;
+        for (float d : expected)
+            if (d < std::numeric_limits<float>::infinity())
+                longest = std::max(longest, d);
+        float tolerance = std::max(grid.step / 8, longest / 65534 / 2) + 1e-4f;
+        int reached = 0;
+        for (int r = 0; r < grid.rows; r++)
+            for (int c = 0; c < grid.cols; c++){
+                cv::Point2i px = grid.centre(r, c);
+                cv::Point2f uv = map->pixels2uv(px);
+                GeodesicFields::Lookup lookup = {0.f, cv::Point2f()};
+                bool found = g.getGeodesicDistance(uv, 4, g.nodeId(n), lookup);
+                float d = expected[r * grid.cols + c];
+                if (!CHECK(found == (d < std::numeric_limits<float>::infinity())) || !found)
+                    continue;
+                reached++;
+                CHECK(std::fabs(lookup.distance - d) <= tolerance);
+                // never shorter than the straight line, up to the half cell the source is seeded from
+                cv::Point2f diff = uv - source;
+                CHECK(lookup.distance >= std::sqrt(diff.x * diff.x + diff.y * diff.y) - grid.step - tolerance);
+                float norm = std::sqrt(lookup.direction.x * lookup.direction.x + lookup.direction.y * lookup.direction.y);
+                CHECK(std::fabs(norm - 1) < 1e-4 || (norm == 0 && d < grid.step));
+            }
+        CHECK(reached > 0);
+    }
+    CHECK(numFields == static_cast<int>(fields.numFields()));
+
+    // other floors and positions off the map have no distance
+    int dest = -1;
+    for (int n = 0; n < g.numNodes() && dest < 0; n++)
+        if (g.getNodeGeometry(n).type == Graph::Destination)
+            dest = n;
+    GeodesicFields::Lookup lookup;
+    cv::Point2f uv = g.getNodeGeometry(dest).positionUV;
+    CHECK(g.getGeodesicDistance(uv, 4, g.nodeId(dest), lookup));
+    CHECK(!g.getGeodesicDistance(uv, 3, g.nodeId(dest), lookup));
+    CHECK(!g.getGeodesicDistance(cv::Point2f(-5.f, -5.f), 4, g.nodeId(dest), lookup));
+    CHECK(!g.getGeodesicDistance(uv, 4, g.nodeId(dest) + 100000, lookup));
+
+    // a disabled or moved destination drops its field until it is built again
+    CHECK(g.setNodeEnabled(g.nodeId(dest), false));
+    CHECK(!g.getGeodesicDistance(uv, 4, g.nodeId(dest), lookup));
+    CHECK(g.setNodeEnabled(g.nodeId(dest), true));
+    CHECK(g.getGeodesicDistance(uv, 4, g.nodeId(dest), lookup));
+    CHECK(g.setNodePosition(g.nodeId(dest), uv + cv::Point2f(0.5f, 0.f)));
+    CHECK(!g.getGeodesicDistance(uv, 4, g.nodeId(dest), lookup));
+}
+
+} // namespace
+
+int main(){
+    testutils::run("distance table matches Dijkstra on SKERI", distanceTableOnSkeri);
+    testutils::run("distance table matches Dijkstra on random graphs", distanceTableOnRandomGraphs);
+    testutils::run("distances to destinations match the routes through the snapped edge", destinationDistances);
+    testutils::run("geodesic fields match a Dijkstra over the cells", geodesicFieldsOnSkeri);
+    return testutils::testResult();
+}
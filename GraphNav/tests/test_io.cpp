@@ -0,0 +1,430 @@
+//
+//  test_io.cpp
+//  GraphNav
+//
+//  Readers and writers: the map file parsers on SKERI and on malformed input, number parsing,
+//  the streaming graph json reader and the compiled graph format.
+//
+
+#include "Check.hpp"
+#include "Graph.hpp"
+#include "Maps/MapFiles.hpp"
+#include "Maps/MapManager.hpp"
+#include "rapidjson/document.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+namespace {
+
+std::string skeriFolder() { return testutils::resDir() + "/maps/SKERI"; }
+
+std::string writeFile(const std::string& name, const std::string& content){
+    std::string fileName = testutils::scratchDir() + "/" + name;
+    std::ofstream(fileName, std::ofstream::binary | std::ofstream::trunc) << content;
+    return fileName;
+}
+
+void siteInfoOfSkeri(){
+    std::string building;
+    std::vector<std::map<std::string, std::string>> floors;
+    CHECK(maps::parseMappedFile(skeriFolder() + "/info.yml", [&](const char* data, size_t size){ maps::parseSiteInfo(data, size, building, floors); }));
+    CHECK(building == "SKERI");
+    CHECK(floors.size() == 2);
+    if (floors.size() != 2)
+        return;
+    CHECK(floors[0].at("id") == "4" && floors[1].at("id") == "3");
+    CHECK(floors[0].at("walls") == "walls_4.bmp" && floors[0].at("rois_dictionary") == "rois_4.csv");
+    CHECK(floors[1].at("features_file") == "mapFeatures_3.yml" && floors[1].at("scale") == "11.73");
+
+    maps::MapManager m;
+    m.init(skeriFolder(), 4);
+    CHECK(m.getFloors().size() == 2 && m.hasFloor(3) && m.hasFloor(4));
+    CHECK_NEAR(m.getScale(4), 11.23, 1e-6);
+    CHECK_NEAR(m.getScale(3), 11.73, 1e-6);
+}
+
+void featuresOfSkeri(){
+    std::multimap<maps::FeatureType, maps::MapFeature> floor4, floor3;
+    CHECK(maps::parseMappedFile(skeriFolder() + "/mapFeatures_4.yml", [&](const char* data, size_t size){ maps::parseFeatures(data, size, floor4); }));
+    CHECK(maps::parseMappedFile(skeriFolder() + "/mapFeatures_3.yml", [&](const char* data, size_t size){ maps::parseFeatures(data, size, floor3); }));
+    CHECK(floor4.size() == 22);
+    CHECK(floor3.size() == 50);
+    // the first exit sign of floor 4: position [6.198, 5.490], normal [1, 0]; positions are stored v, u
+    auto exitSign = floor4.find(maps::EXIT_SIGN);
+    CHECK(exitSign != floor4.end());
+    if (exitSign != floor4.end()){
+        CHECK(exitSign->second.position == cv::Point2f(5.490f, 6.198f));
+        CHECK(exitSign->second.normal[0] == 1 && exitSign->second.normal[1] == 0);
+        CHECK(exitSign->second.description == "_");
+    }
+    for (const auto& f : floor3)
+        CHECK(f.first == f.second.type);
+    // six floor 4 blocks have no normal line. The old reader took 5 lines per block: it swallowed the
+    // header after three of them and lost the feature that followed (Conference Room, Secondary Stairwell
+    // to 3rd floor, Bill's Office), 19 features in all. All six load now with the default normal.
+    const char* noNormal[] = {"Stairwell to lower levels", "Conference Room", "Huiying's office",
+                              "Secondary Stairwell to 3rd floor", "Josh's office", "Bill's Office"};
+    for (const char* name : noNormal){
+        auto named = [name](const std::pair<const maps::FeatureType, maps::MapFeature>& e){ return e.second.description == name; };
+        auto f = std::find_if(floor4.begin(), floor4.end(), named);
+        CHECK(std::count_if(floor4.begin(), floor4.end(), named) == 1);
+        if (CHECK(f != floor4.end()))
+            CHECK(f->first == maps::ARUCO && f->second.normal == cv::Vec2d(0, 0));
+    }
+
+    std::map<int, std::string> rois;
+    CHECK(maps::parseMappedFile(skeriFolder() + "/rois_4.csv", [&](const char* data, size_t size){ maps::parseRoisDictionary(data, size, rois); }));
+    // values 10 and 24 are unused, 33 has an empty name
+    CHECK(rois.size() == 31 && !rois.count(10) && !rois.count(24));
+    CHECK(rois.count(1) && rois.at(1) == "2");
+    CHECK(rois.count(26) && rois.at(26) == "11");
+    CHECK(rois.count(33) && rois.at(33).empty());
+}
+
+// keys in any order, CRLF line ends, tabs, comments, junk lines and a missing final newline
+void malformedFiles(){
+    std::string text =
+        "# markers\r\n"
+        "map_feature:\r\n"
+        "\tposition: [1.5, -2]\r\n"
+        "\tid: aruco 12\r\n"
+        "\tname:   Room 7  \r\n"
+        "this line has no key\r\n"
+        "map_feature:\n"
+        "    normal: [0, -1]\n"
+        "    id: exit_sign\n"
+        "    position: [3e1, .25]\n"
+        "map_feature:\n"
+        "    name: no position";
+    std::multimap<maps::FeatureType, maps::MapFeature> features;
+    maps::parseFeatures(text.data(), text.size(), features);
+    CHECK(features.size() == 3);
+    auto aruco = features.equal_range(maps::ARUCO);
+    std::vector<const maps::MapFeature*> markers;
+    for (auto it = aruco.first; it != aruco.second; ++it)
+        markers.push_back(&it->second);
+    CHECK(markers.size() == 2);
+    if (markers.size() == 2){
+        CHECK(markers[0]->description == "Room 7" && markers[0]->position == cv::Point2f(-2.f, 1.5f));
+        CHECK(markers[1]->description == "no position");
+    }
+    auto exitSign = features.find(maps::EXIT_SIGN);
+    CHECK(exitSign != features.end() && exitSign->second.position == cv::Point2f(0.25f, 30.f) && exitSign->second.normal[0] == 0 && exitSign->second.normal[1] == -1);
+
+    std::string csv = "1, hall\n\n2,room b\r\nthree, nothing\n1, duplicate\n4";
+    std::map<int, std::string> dictionary;
+    maps::parseRoisDictionary(csv.data(), csv.size(), dictionary);
+    CHECK(dictionary.size() == 2 && dictionary[1] == "hall" && dictionary[2] == "room b");
+
+    // floor blocks missing a key or with a bad id are skipped, the others load
+    std::string folder = testutils::scratchDir();
+    std::ifstream skeriInfo(skeriFolder() + "/info.yml");
+    std::stringstream info;
+    info << skeriInfo.rdbuf();
+    std::string site = info.str();
+    std::string prefix = "../" + skeriFolder().substr(skeriFolder().find_last_of('/') + 1) + "/";
+    for (const char* key : {"features_file: ", "walls: ", "walkable: ", "rois: ", "rois_dictionary: "})
+        for (size_t pos = site.find(key); pos != std::string::npos; pos = site.find(key, pos + 1))
+            site.insert(pos + std::strlen(key), prefix);
+    site += "floor:\n    id: 5\n    walls: walls_4.bmp\nfloor:\n    id: five\n    scale: 11.23\n";
+    std::string siteFolder = folder + "/incomplete_site";
+    ::mkdir(siteFolder.c_str(), 0755);
+    // the SKERI images are referenced from next to it
+    std::string linkTarget = skeriFolder();
+    std::string link = folder + "/" + skeriFolder().substr(skeriFolder().find_last_of('/') + 1);
+    ::symlink(linkTarget.c_str(), link.c_str());
+    writeFile("incomplete_site/info.yml", site);
+    maps::MapManager m;
+    m.init(siteFolder, 4);
+    CHECK(m.getFloors().size() == 2 && m.hasFloor(3) && m.hasFloor(4));
+}
+
+void numbersMatchStrtod(){
+    std::mt19937 rng(23);
+    const char* fixed[] = {"0", "-0", "1", "12.5", "-3.25e2", "1e-5", "123456789012345678", "0.1", "9007199254740993", "2.2250738585072014e-308", "1.7976931348623157e308", ".5", "5."};
+    std::vector<std::string> inputs(fixed, fixed + sizeof(fixed) / sizeof(fixed[0]));
+    for (int i = 0; i < 5000; i++){
+        char buf[64];
+        double v = std::ldexp(static_cast<double>(rng()) / rng.max() - 0.5, static_cast<int>(rng() % 120) - 60);
+        std::snprintf(buf, sizeof(buf), i % 2 ? "%.17g" : "%.6f", v);
+        inputs.push_back(buf);
+    }
+    for (const std::string& s : inputs){
+        double value = -12345, expected = std::strtod(s.c_str(), nullptr);
+        const char* end = parseutils::parseNumber(s.data(), s.data() + s.size(), value);
+        CHECK(end == s.data() + s.size());
+        CHECK(value == expected);
+    }
+    int i = 0;
+    std::string text = "-42abc";
+    CHECK(parseutils::parseNumber(text.data(), text.data() + text.size(), i) == text.data() + 3 && i == -42);
+    text = "x1";
+    CHECK(parseutils::parseNumber(text.data(), text.data() + text.size(), i) == nullptr && i == -42);
+    text = "99999999999";
+    CHECK(parseutils::parseNumber(text.data(), text.data() + text.size(), i) == nullptr);
+}
+
+// the legacy matrices of 4thfloor.json, read with the DOM, against the streaming reader
+void legacyGraphJson(){
+    std::string fileName = testutils::resDir() + "/4thfloor.json";
+    navgraph::json::GraphHandler handler;
+    std::string error;
+    CHECK(navgraph::json::readGraph(fileName, handler, error));
+    CHECK(handler.nodes.size() == 21);
+
+    std::ifstream in(fileName);
+    std::stringstream text;
+    text << in.rdbuf();
+    rapidjson::Document doc;
+    doc.Parse(text.str().c_str());
+    CHECK(!doc.HasParseError());
+    size_t expectedEdges = 0;
+    const rapidjson::Value& weights = doc["weights"];
+    const rapidjson::Value& angles = doc["angles"];
+    for (rapidjson::SizeType r = 0; r < weights.Size(); r++){
+        for (rapidjson::SizeType c = 0; c < weights[r].Size(); c++){
+            if (weights[r][c].GetDouble() <= 0)
+                continue;
+            expectedEdges++;
+            bool found = false;
+            for (const navgraph::json::EdgeRecord& e : handler.edges)
+                found |= e.source == static_cast<int>(r) + 1 && e.target == static_cast<int>(c) + 1 &&
+                         e.weight == weights[r][c].GetFloat() && e.angleDeg == angles[r][c].GetFloat();
+            CHECK(found);
+        }
+    }
+    CHECK(handler.edges.size() == expectedEdges);
+    const rapidjson::Value& nodes = doc["nodes"][0];
+    for (const navgraph::json::NodeRecord& n : handler.nodes){
+        std::string key = std::to_string(n.id);
+        CHECK(nodes.HasMember(key.c_str()));
+        if (nodes.HasMember(key.c_str()))
+            CHECK(n.floor == 4 && n.label == nodes[key.c_str()]["label"].GetString());
+    }
+}
+
+void edgeListGraphJson(){
+    std::string fileName = writeFile("edges.json", R"({
+        "version": {"major": 1},
+        "nodes": [
+            {"id": 1, "type": "control", "position": [10, 20], "floor": 4, "label": "a", "isDoor": 1, "meta": {"2": {"id": 99}}},
+            {"id": "2", "type": "destination", "position": [30.5, 20], "floor": "4", "label": "b", "comments": "c"},
+            {"type": "control", "position": [1, 1], "floor": 4}
+        ],
+        "edges": [
+            {"source": 1, "target": 2, "weight": 20.5, "angle": 90, "extra": [1, 2]},
+            {"source": 2, "target": 1, "weight": 20.5, "angle": 270},
+            {"target": 1, "weight": 3}
+        ]
+    })");
+    navgraph::json::GraphHandler handler;
+    std::string error;
+    CHECK(navgraph::json::readGraph(fileName, handler, error));
+    CHECK(handler.nodes.size() == 2);
+    if (handler.nodes.size() == 2){
+        const navgraph::json::NodeRecord& a = handler.nodes[0];
+        const navgraph::json::NodeRecord& b = handler.nodes[1];
+        CHECK(a.id == 1 && a.type == "control" && a.x == 10 && a.y == 20 && a.floor == 4 && a.label == "a" && a.isDoor);
+        CHECK(b.id == 2 && b.type == "destination" && b.x == 30.5f && b.floor == 4 && b.comments == "c" && !b.isDoor);
+    }
+    CHECK(handler.edges.size() == 2);
+    if (handler.edges.size() == 2)
+        CHECK(handler.edges[0].source == 1 && handler.edges[0].target == 2 && handler.edges[0].weight == 20.5f && handler.edges[0].angleDeg == 90);
+
+    // the legacy node map: an object of nodes keyed by id
+    fileName = writeFile("node_map.json", R"({"weights": [[0, 5], [5, 0]], "angles": [[0, 90], [270, 0]],
+        "nodes": [{"1": {"id": 1, "type": "control", "position": [0, 0], "floor": 4}, "2": {"id": 2, "type": "link", "position": [5, 0], "floor": 4}}]})");
+    navgraph::json::GraphHandler legacy;
+    CHECK(navgraph::json::readGraph(fileName, legacy, error));
+    CHECK(legacy.nodes.size() == 2 && legacy.edges.size() == 2);
+}
+
+void graphJsonErrors(){
+    std::shared_ptr<maps::MapManager> mapManager = std::make_shared<maps::MapManager>();
+    mapManager->init(skeriFolder(), 4);
+    std::string fileName = writeFile("truncated.json", R"({"nodes": [{"id": 1, "position": [)");
+    navgraph::json::GraphHandler handler;
+    std::string error;
+    CHECK(!navgraph::json::readGraph(fileName, handler, error) && !error.empty());
+    CHECK(!navgraph::json::readGraph(testutils::scratchDir() + "/missing.json", handler, error));
+
+    bool threw = false;
+    try{
+        navgraph::Graph graph(fileName, mapManager);
+    }
+    catch (const std::runtime_error&){
+        threw = true;
+    }
+    CHECK(threw);
+    navgraph::Graph graph;
+    CHECK(!graph.loadJson(fileName, mapManager));
+
+    // edges without a weight, or with a negative or non-finite one, are refused with the edge named
+    const char* badWeights[] = {R"("weight": -2)", R"("angle": 90)", R"("weight": 1e300)"};
+    for (const char* weight : badWeights){
+        fileName = writeFile("bad_weight.json", std::string(R"({"nodes": [{"id": 1, "position": [0, 0], "floor": 4}, {"id": 2, "position": [5, 0], "floor": 4}],
+            "edges": [{"source": 1, "target": 2, "weight": 5}, {"source": 2, "target": 1, )") + weight + "}]}");
+        navgraph::json::GraphHandler bad;
+        CHECK(!navgraph::json::readGraph(fileName, bad, error) && error.find("edge 2 -> 1") != std::string::npos);
+        CHECK(!graph.loadJson(fileName, mapManager));
+    }
+    fileName = writeFile("zero_weight.json", R"({"nodes": [{"id": 1, "position": [0, 0], "floor": 4}, {"id": 2, "position": [5, 0], "floor": 4}],
+        "edges": [{"source": 1, "target": 2, "weight": 0}]})");
+    navgraph::json::GraphHandler zero;
+    CHECK(navgraph::json::readGraph(fileName, zero, error) && zero.edges.size() == 1);
+    CHECK(graph.loadJson(testutils::resDir() + "/4thfloor.json", mapManager) && graph.numNodes() == 21);
+}
+
+void compiledRoundTrip(){
+    std::shared_ptr<maps::MapManager> mapManager = std::make_shared<maps::MapManager>();
+    mapManager->init(skeriFolder(), 4);
+    navgraph::Graph original(testutils::resDir() + "/4thfloor.json", mapManager);
+    std::string fileName = testutils::scratchDir() + "/4thfloor.gnav";
+    CHECK(original.saveCompiled(fileName));
+
+    navgraph::Graph loaded;
+    CHECK(loaded.loadCompiled(fileName, mapManager, true));
+    CHECK(loaded.numNodes() == original.numNodes());
+    const navgraph::CSRAdjacency& a = original.getAdjacency();
+    const navgraph::CSRAdjacency& b = loaded.getAdjacency();
+    CHECK(a.offsets == b.offsets && a.neighbors == b.neighbors && a.weights == b.weights && a.heuristicScale == b.heuristicScale);
+    for (int i = 0; i < original.numNodes() && i < loaded.numNodes(); i++){
+        const navgraph::Graph::NodeGeometry& g1 = original.getNodeGeometry(i);
+        const navgraph::Graph::NodeGeometry& g2 = loaded.getNodeGeometry(i);
+        CHECK(original.nodeId(i) == loaded.nodeId(i));
+        CHECK(g1.positionUV == g2.positionUV && g1.floor == g2.floor && g1.type == g2.type && g1.isDoor == g2.isDoor);
+        CHECK(original.getNodeInfo(i).label == loaded.getNodeInfo(i).label && original.getNodeInfo(i).comments == loaded.getNodeInfo(i).comments);
+    }
+    std::mt19937 rng(29);
+    for (int q = 0; q < 200; q++){
+        int src = original.nodeId(static_cast<int>(rng() % original.numNodes()));
+        int dst = original.nodeId(static_cast<int>(rng() % original.numNodes()));
+        navgraph::Graph::Route r1 = original.findRoute(src, dst), r2 = loaded.findRoute(src, dst);
+        CHECK(r1.length == r2.length && r1.nodeIds == r2.nodeIds);
+        cv::Point2f uv(static_cast<float>(rng() % 400) / 10.f, static_cast<float>(rng() % 200) / 10.f);
+        CHECK(original.snapUV2Graph(uv, 4) == loaded.snapUV2Graph(uv, 4));
+    }
+
+    // a flipped payload byte fails the checksum, a truncated file fails even without it
+    std::ifstream in(fileName, std::ifstream::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::string corrupted = bytes;
+    corrupted[corrupted.size() - 3] ^= 0x40;
+    navgraph::Graph bad;
+    CHECK(!bad.loadCompiled(writeFile("corrupted.gnav", corrupted), mapManager, true));
+    CHECK(!bad.loadCompiled(writeFile("truncated.gnav", bytes.substr(0, bytes.size() / 2)), mapManager));
+    CHECK(!bad.loadCompiled(writeFile("empty.gnav", ""), mapManager));
+}
+
+// closed nodes and edges are saved as they are and stay closed once loaded
+void compiledKeepsClosures(){
+    std::shared_ptr<maps::MapManager> mapManager = std::make_shared<maps::MapManager>();
+    mapManager->init(skeriFolder(), 4);
+    navgraph::Graph original(testutils::resDir() + "/4thfloor.json", mapManager);
+    const navgraph::CSRAdjacency& a = original.getAdjacency();
+    int from = original.nodeId(0), to = original.nodeId(a.neighbors[a.begin(0)]);
+    int closedNode = original.nodeId(original.numNodes() / 2);
+    if (closedNode == to)
+        closedNode = original.nodeId(original.numNodes() / 2 + 1);
+    CHECK(original.setEdgeEnabled(from, to, false, false));
+    CHECK(original.setNodeEnabled(closedNode, false));
+    std::string fileName = testutils::scratchDir() + "/4thfloor_closed.gnav";
+    CHECK(original.saveCompiled(fileName));
+
+    navgraph::Graph loaded;
+    CHECK(loaded.loadCompiled(fileName, mapManager, true));
+    CHECK(!loaded.isEdgeEnabled(from, to) && loaded.isEdgeEnabled(to, from));
+    CHECK(!loaded.isNodeEnabled(closedNode) && loaded.isNodeEnabled(from));
+    const navgraph::CSRAdjacency& b = loaded.getAdjacency();
+    CHECK(a.weights == b.weights && a.heuristicScale <= b.heuristicScale);
+    std::mt19937 rng(31);
+    for (int q = 0; q < 200; q++){
+        int src = original.nodeId(static_cast<int>(rng() % original.numNodes()));
+        int dst = original.nodeId(static_cast<int>(rng() % original.numNodes()));
+        navgraph::Graph::Route r1 = original.findRoute(src, dst), r2 = loaded.findRoute(src, dst);
+        CHECK(r1.nodeIds.empty() == r2.nodeIds.empty());
+        if (!r1.nodeIds.empty() && !r2.nodeIds.empty())
+            CHECK_NEAR(r1.length, r2.length, 1e-3f);
+        cv::Point2f uv(static_cast<float>(rng() % 400) / 10.f, static_cast<float>(rng() % 200) / 10.f);
+        CHECK(original.snapUV2Graph(uv, 4) == loaded.snapUV2Graph(uv, 4));
+    }
+
+    // opened again, the loaded graph routes as the graph that was never closed
+    navgraph::Graph fresh(testutils::resDir() + "/4thfloor.json", mapManager);
+    CHECK(loaded.setEdgeEnabled(from, to, true, false) && loaded.setNodeEnabled(closedNode, true));
+    CHECK(fresh.getAdjacency().weights == b.weights);
+    CHECK_NEAR(fresh.findRoute(from, closedNode).length, loaded.findRoute(from, closedNode).length, 1e-3f);
+}
+
+// overwrites count values of a section of a compiled file in place, so the header still matches
+template <typename T>
+std::string patchSection(std::string bytes, navgraph::compiled::Section section, size_t index, T value){
+    navgraph::compiled::Header h;
+    std::memcpy(&h, bytes.data(), sizeof(h));
+    std::memcpy(&bytes[h.sectionOffset[section] + index * sizeof(T)], &value, sizeof(T));
+    return bytes;
+}
+
+// a file that fails to load, checksum or not, leaves the graph as it was
+void compiledFailuresKeepTheGraph(){
+    std::shared_ptr<maps::MapManager> mapManager = std::make_shared<maps::MapManager>();
+    mapManager->init(skeriFolder(), 4);
+    navgraph::Graph original(testutils::resDir() + "/4thfloor.json", mapManager);
+    original.buildDistanceTable(2048, 4, 1);
+    std::string fileName = testutils::scratchDir() + "/4thfloor_distances.gnav";
+    CHECK(original.saveCompiled(fileName));
+    std::ifstream in(fileName, std::ifstream::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    navgraph::Graph loaded;
+    CHECK(loaded.loadCompiled(fileName, mapManager) && !loaded.getDistanceTable().empty());
+    const navgraph::CSRAdjacency& a = loaded.getAdjacency();
+    const std::vector<float> weights = a.weights;
+    const std::vector<cv::Point2f> positions = a.positions;
+    const float nan = std::numeric_limits<float>::quiet_NaN(), inf = std::numeric_limits<float>::infinity();
+    std::vector<std::string> broken = {
+        patchSection(bytes, navgraph::compiled::WEIGHTS, 3, nan),
+        patchSection(bytes, navgraph::compiled::WEIGHTS, 5, -1.f),
+        patchSection(bytes, navgraph::compiled::WEIGHTS, 0, inf),
+        patchSection(bytes, navgraph::compiled::POSITIONS, 7, nan),
+        patchSection(bytes, navgraph::compiled::POSITIONS, 0, -inf),
+        patchSection(bytes, navgraph::compiled::NEIGHBORS, 2, int32_t(original.numNodes())),
+        patchSection(bytes, navgraph::compiled::DIST_TARGETS, 0, int32_t(-3)),
+    };
+    for (size_t k = 0; k < broken.size(); k++){
+        CHECK(!loaded.loadCompiled(writeFile("broken.gnav", broken[k]), mapManager));
+        CHECK(loaded.numNodes() == original.numNodes() && !loaded.getDistanceTable().empty());
+        CHECK(a.weights == weights && a.positions == positions);
+        for (int i = 0; i < loaded.numNodes(); i++)
+            CHECK(loaded.getNodeGeometry(i).positionUV == positions[i]);
+    }
+    std::mt19937 rng(37);
+    for (int q = 0; q < 100; q++){
+        int src = original.nodeId(static_cast<int>(rng() % original.numNodes()));
+        int dst = original.nodeId(static_cast<int>(rng() % original.numNodes()));
+        navgraph::Graph::Route r1 = original.findRoute(src, dst), r2 = loaded.findRoute(src, dst);
+        CHECK(r1.length == r2.length && r1.nodeIds == r2.nodeIds);
+    }
+}
+
+} // namespace
+
+int main(){
+    testutils::run("site info of SKERI", siteInfoOfSkeri);
+    testutils::run("features and ROI names of SKERI", featuresOfSkeri);
+    testutils::run("malformed map files", malformedFiles);
+    testutils::run("numbers parse as strtod does", numbersMatchStrtod);
+    testutils::run("legacy graph json", legacyGraphJson);
+    testutils::run("edge list graph json", edgeListGraphJson);
+    testutils::run("graph json errors reach the caller", graphJsonErrors);
+    testutils::run("compiled graph round trip", compiledRoundTrip);
+    testutils::run("compiled graphs keep closed nodes and edges", compiledKeepsClosures);
+    testutils::run("failed compiled loads keep the graph", compiledFailuresKeepTheGraph);
+    return testutils::testResult();
+}
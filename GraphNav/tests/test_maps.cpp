@@ -0,0 +1,204 @@
+//
+//  test_maps.cpp
+//  GraphNav
+//
+//  Floor rasters loaded on demand within a memory budget, least recently used first out, and the
+//  raster cache that maps them from disk on later runs.
+//
+
+#include "Check.hpp"
+#include "Maps/MapManager.hpp"
+#include "Maps/RasterCache.hpp"
+#include "../benchmarks/SyntheticData.hpp"
+
+#include <cstring>
+#include <random>
+
+namespace {
+
+// three floors of the same synthetic map, so they all take the same memory
+std::string site(){
+    synthetic::GridSpec spec;
+    spec.sizePx = 240;
+    return synthetic::ensureSite(spec, 3, testutils::scratchDir());
+}
+
+void lruBudget(){
+    maps::MapManager m;
+    m.init(site(), 0);
+    CHECK(m.getFloors() == std::vector<int>({0, 1, 2}));
+    for (int f : m.getFloors())
+        CHECK(!m.isLoaded(f));
+    CHECK(m.residentBytes() == 0);
+    // metadata queries do not load anything
+    CHECK(m.getMapSizePixels(1).width == 240 && m.getScale(2) > 0);
+    CHECK(!m.isLoaded(1) && !m.isLoaded(2));
+
+    std::shared_ptr<const maps::AnnotatedMap> first = m.getMap(0);
+    size_t floorBytes = first->rasterBytes();
+    CHECK(floorBytes > 0 && m.isLoaded(0) && m.residentBytes() == floorBytes);
+
+    // room for two floors
+    m.setMemoryBudget(floorBytes * 5 / 2);
+    CHECK(m.getMemoryBudget() == floorBytes * 5 / 2);
+    m.getMap(1);
+    CHECK(m.isLoaded(0) && m.isLoaded(1) && m.residentBytes() == 2 * floorBytes);
+    m.isWalkable(cv::Point2i(10, 10), 0); // 0 is now used more recently than 1
+    m.getMap(2);
+    CHECK(m.isLoaded(0) && !m.isLoaded(1) && m.isLoaded(2));
+    CHECK(m.residentBytes() == 2 * floorBytes);
+    m.getMap(1);
+    CHECK(!m.isLoaded(0) && m.isLoaded(1) && m.isLoaded(2));
+
+    // an evicted floor stays usable for whoever still holds it, and loads again with the same answers
+    cv::Size size = first->getMapSizePixels();
+    std::mt19937 rng(43);
+    for (int q = 0; q < 500; q++){
+        cv::Point2i a(rng() % size.height, rng() % size.width), b(rng() % size.height, rng() % size.width);
+        CHECK(first->isPathCrossingWalls(a, b) == m.isPathCrossingWalls(a, b, 0));
+        CHECK(first->isWalkable(a) == m.isWalkable(a, 2));
+    }
+    CHECK(m.isLoaded(0) && m.residentBytes() == 2 * floorBytes);
+
+    // a smaller budget evicts right away, the floor just used is kept even if it does not fit
+    m.setMemoryBudget(floorBytes / 2);
+    CHECK(m.residentBytes() <= floorBytes);
+    m.getMap(2);
+    CHECK(m.isLoaded(2) && !m.isLoaded(0) && !m.isLoaded(1) && m.residentBytes() == floorBytes);
+
+    // no budget, no eviction
+    m.setMemoryBudget(0);
+    m.preloadAll(2);
+    CHECK(m.isLoaded(0) && m.isLoaded(1) && m.isLoaded(2) && m.residentBytes() == 3 * floorBytes);
+}
+
+// floors loading on many threads at once, each loaded once
+void concurrentLoads(){
+    maps::MapManager m;
+    m.init(site(), 0);
+    std::vector<std::shared_ptr<const maps::AnnotatedMap>> seen(8);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++)
+        threads.emplace_back([&m, &seen, t]{ seen[t] = m.getMap(t % 3); });
+    for (std::thread& t : threads)
+        t.join();
+    for (int t = 0; t < 8; t++)
+        CHECK(seen[t] == m.getMap(t % 3));
+    CHECK(m.residentBytes() == 3 * seen[0]->rasterBytes());
+}
+
+std::vector<std::string> cacheFiles(const maps::RasterCache& cache, const std::string& image){
+    uint64_t key = cache.key(image);
+    return {cache.fileName(key, maps::RasterCache::BITS), cache.fileName(key, maps::RasterCache::PIXELS), cache.fileName(key, maps::RasterCache::WALL_DISTANCE)};
+}
+
+void rasterCacheEntries(){
+    std::string folder = testutils::scratchDir() + "/raster_cache_entries";
+    maps::RasterCache cache(folder), disabled;
+    CHECK(cache.enabled() && !disabled.enabled());
+    CHECK(disabled.key(testutils::resDir() + "/maps/SKERI/walls_4.bmp") == 0);
+    CHECK(cache.key(testutils::resDir() + "/maps/SKERI/no_such_file.bmp") == 0);
+    uint64_t key = cache.key(testutils::resDir() + "/maps/SKERI/walls_4.bmp");
+    CHECK(key != 0 && key != cache.key(testutils::resDir() + "/maps/SKERI/walls_3.bmp"));
+
+    std::mt19937 rng(47);
+    cv::Mat image(53, 101, CV_8U);
+    for (int r = 0; r < image.rows; r++)
+        for (int c = 0; c < image.cols; c++)
+            image.at<uchar>(r, c) = (rng() % 4 == 0) ? static_cast<uchar>(rng() % 256) : 0;
+    // a key of its own, so earlier runs do not matter
+    uint64_t own = (static_cast<uint64_t>(rng()) << 32) | rng();
+    std::remove(cache.fileName(own, maps::RasterCache::BITS).c_str());
+    std::remove(cache.fileName(own, maps::RasterCache::PIXELS).c_str());
+    CHECK(cache.loadBits(own).empty());
+    CHECK(cache.storeBits(own, maps::BitRaster(image)) && cache.storePixels(own, maps::RasterCache::PIXELS, image));
+    CHECK(!cache.storePixels(0, maps::RasterCache::PIXELS, image) && !cache.storePixels(own, maps::RasterCache::PIXELS, cv::Mat()));
+
+    maps::BitRaster bits = cache.loadBits(own);
+    std::shared_ptr<const void> owner;
+    cv::Mat pixels = cache.loadPixels(own, maps::RasterCache::PIXELS, owner);
+    CHECK(bits.rows() == image.rows && bits.cols() == image.cols && owner);
+    CHECK(pixels.rows == image.rows && pixels.cols == image.cols);
+    bool same = true;
+    for (int r = 0; r < image.rows; r++)
+        for (int c = 0; c < image.cols; c++)
+            same = same && bits.test(r, c) == (image.at<uchar>(r, c) != 0) && pixels.at<uchar>(r, c) == image.at<uchar>(r, c);
+    CHECK(same);
+    // an entry of one kind is not one of another, and a truncated one is no entry
+    CHECK(cache.loadPixels(own, maps::RasterCache::WALL_DISTANCE, owner).empty());
+    {
+        std::ofstream truncated(cache.fileName(own, maps::RasterCache::PIXELS), std::ofstream::binary | std::ofstream::trunc);
+        truncated.write("GNAVRAS1", 8);
+    }
+    CHECK(cache.loadPixels(own, maps::RasterCache::PIXELS, owner).empty());
+
+    // bit rows padded wider than whole words of the columns would be read at the wrong offsets
+    {
+        std::string name = cache.fileName(own, maps::RasterCache::BITS);
+        std::ifstream in(name, std::ifstream::binary);
+        std::string header(64, '\0');
+        in.read(&header[0], 64);
+        in.close();
+        uint64_t rowBytes = bits.wordsPerRow() * 8 + 8, payloadBytes = rowBytes * image.rows;
+        std::memcpy(&header[32], &rowBytes, 8);     // FileHeader::rowBytes
+        std::memcpy(&header[40], &payloadBytes, 8); // FileHeader::payloadBytes
+        // renamed over the entry, which bits still maps
+        std::ofstream wide(name + ".wide", std::ofstream::binary | std::ofstream::trunc);
+        wide << header << std::string(payloadBytes, '\0');
+        wide.close();
+        std::rename((name + ".wide").c_str(), name.c_str());
+    }
+    CHECK(cache.loadBits(own).empty());
+
+    // a nested folder is created with its parents
+    std::string nested = testutils::scratchDir() + "/raster_cache_nested_" + std::to_string(rng()) + "/a/b";
+    maps::RasterCache deep(nested);
+    CHECK(deep.storeBits(own, maps::BitRaster(image)) && !deep.loadBits(own).empty());
+}
+
+// a second run maps what the first one decoded, and answers the same
+void cachedFloorsAnswerTheSame(){
+    std::string folder = testutils::scratchDir() + "/raster_cache_skeri";
+    std::string skeri = testutils::resDir() + "/maps/SKERI";
+    maps::RasterCache cache(folder);
+    for (const char* image : {"/walls_4.bmp", "/walkable_4.bmp", "/rois_4.bmp"})
+        for (const std::string& file : cacheFiles(cache, skeri + image))
+            std::remove(file.c_str());
+
+    maps::MapManager decoded, first, second;
+    decoded.init(skeri, 4);
+    first.setRasterCache(folder);
+    first.init(skeri, 4);
+    first.preload(4);
+    auto exists = [](const std::string& file){ return synthetic::fileExists(file); };
+    CHECK(exists(cacheFiles(cache, skeri + "/walls_4.bmp")[0]) && exists(cacheFiles(cache, skeri + "/walls_4.bmp")[2]));
+    CHECK(exists(cacheFiles(cache, skeri + "/walkable_4.bmp")[0]));
+    CHECK(exists(cacheFiles(cache, skeri + "/rois_4.bmp")[1]));
+    second.setRasterCache(folder);
+    second.init(skeri, 4);
+    CHECK(second.getRasterCache() == folder);
+
+    cv::Size size = decoded.getMapSizePixels(4);
+    CHECK(second.getMapSizePixels(4) == size);
+    std::mt19937 rng(53);
+    for (int q = 0; q < 3000; q++){
+        cv::Point2i a(rng() % size.height, rng() % size.width), b(rng() % size.height, rng() % size.width);
+        if (q % 2)
+            b = a + cv::Point2i(rng() % 41 - 20, rng() % 41 - 20);
+        bool crossing = decoded.isPathCrossingWalls(a, b, 4);
+        CHECK(first.isPathCrossingWalls(a, b, 4) == crossing && second.isPathCrossingWalls(a, b, 4) == crossing);
+        CHECK(second.isWalkable(a, 4) == decoded.isWalkable(a, 4) && second.isWallAt(a, 4) == decoded.isWallAt(a, 4));
+        CHECK(second.getRoiAt(a, 4) == decoded.getRoiAt(a, 4));
+    }
+    CHECK(second.getMap(4)->rasterBytes() == decoded.getMap(4)->rasterBytes());
+}
+
+} // namespace
+
+int main(){
+    testutils::run("floors are evicted least recently used first", lruBudget);
+    testutils::run("floors load once under concurrent queries", concurrentLoads);
+    testutils::run("raster cache entries", rasterCacheEntries);
+    testutils::run("cached floors answer as decoded ones", cachedFloorsAnswerTheSame);
+    return testutils::testResult();
+}
@@ -0,0 +1,225 @@
+//
+//  test_metrics.cpp
+//  GraphNav
+//
+//  The hot path metrics, compiled in here whatever the build says: what the counters count, the
+//  histogram buckets, and the exported text.
+//
+
+#if !defined(GRAPHNAV_METRICS)
+#define GRAPHNAV_METRICS
+#endif
+
+#include "Check.hpp"
+#include "Fixtures.hpp"
+#include "Graph.hpp"
+#include "Utils/Metrics.hpp"
+#include "../benchmarks/SyntheticData.hpp"
+
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
+
+using namespace metricsutils;
+
+namespace {
+
+void bucketsCoverEveryValue(){
+    for (uint64_t ns = 0; ns < 5000; ns++){
+        int b = bucketOf(ns);
+        CHECK(b >= 0 && b < NUM_BUCKETS);
+        CHECK(ns < bucketUpperBound(b) && (b == 0 || ns >= bucketUpperBound(b - 1)));
+    }
+    for (int e = 2; e < 64; e++)
+        for (uint64_t ns : {(uint64_t(1) << e) - 1, uint64_t(1) << e, (uint64_t(1) << e) + (uint64_t(1) << (e - 1))}){
+            int b = bucketOf(ns);
+            CHECK(b >= 0 && b < NUM_BUCKETS);
+            // the last bucket also holds everything above the range
+            CHECK(b == NUM_BUCKETS - 1 || (ns < bucketUpperBound(b) && ns >= bucketUpperBound(b - 1)));
+        }
+    for (int b = 1; b < NUM_BUCKETS; b++)
+        CHECK(bucketUpperBound(b) > bucketUpperBound(b - 1));
+}
+
+// counts and histograms are summed over every thread, also those that have exited
+void countersAddUp(){
+    Snapshot before = Registry::instance().snapshot();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+        threads.emplace_back([t]{
+            for (int i = 0; i <= t; i++){
+                add(POI_QUERIES, 10);
+                record(POI_LATENCY, 1000);
+            }
+        });
+    for (std::thread& t : threads)
+        t.join();
+    add(POI_QUERIES, 1);
+    record(POI_LATENCY, 5000);
+    Snapshot after = Registry::instance().snapshot();
+    CHECK(after.counters[POI_QUERIES] - before.counters[POI_QUERIES] == 101);
+    CHECK(after.count(POI_LATENCY) - before.count(POI_LATENCY) == 11);
+    CHECK(after.sums[POI_LATENCY] - before.sums[POI_LATENCY] == 15000);
+    CHECK(after.buckets[POI_LATENCY][bucketOf(1000)] - before.buckets[POI_LATENCY][bucketOf(1000)] == 10);
+
+    Snapshot s;
+    for (int i = 0; i < 90; i++)
+        s.buckets[SNAP_LATENCY][bucketOf(100)]++;
+    for (int i = 0; i < 10; i++)
+        s.buckets[SNAP_LATENCY][bucketOf(100000)]++;
+    CHECK(s.quantile(SNAP_LATENCY, 0.5) == bucketUpperBound(bucketOf(100)) * 1e-9);
+    CHECK(s.quantile(SNAP_LATENCY, 0.9) == bucketUpperBound(bucketOf(100)) * 1e-9);
+    CHECK(s.quantile(SNAP_LATENCY, 0.99) == bucketUpperBound(bucketOf(100000)) * 1e-9);
+    CHECK(s.quantile(POI_LATENCY, 0.5) == 0);
+}
+
+// the instrumented paths count what they do
+void hotPathsAreCounted(){
+    std::shared_ptr<maps::MapManager> m = std::make_shared<maps::MapManager>();
+    m->init(testutils::resDir() + "/maps/SKERI", 4);
+    Snapshot before = Registry::instance().snapshot();
+    navgraph::Graph g(testutils::resDir() + "/4thfloor.json", m);
+    std::vector<cv::Point2f> positions;
+    for (int i = 0; i < 50; i++)
+        positions.push_back(cv::Point2f(10.f + i * 0.1f, 20.f));
+    std::vector<navgraph::Graph::SnapResult> out;
+    g.snapBatch(positions, 4, out);
+    navgraph::Graph::SnapSession session;
+    for (const cv::Point2f& uv : positions)
+        g.snapTracked(session, uv, 4);
+    Snapshot after = Registry::instance().snapshot();
+    auto added = [&](CounterId c){ return after.counters[c] - before.counters[c]; };
+    CHECK(added(GRAPH_LOADS) == 1 && after.count(GRAPH_LOAD_LATENCY) == before.count(GRAPH_LOAD_LATENCY) + 1);
+    CHECK(added(MAP_LOADS) == 1);
+    CHECK(added(SNAPS) == 100);
+    CHECK(added(TRACKED_HITS) + added(TRACKED_FALLBACKS) == 50 && added(TRACKED_HITS) == session.hits);
+    CHECK(after.count(SNAP_LATENCY) - before.count(SNAP_LATENCY) == 50 + session.fallbacks);
+    CHECK(after.count(TRACKED_SNAP_LATENCY) - before.count(TRACKED_SNAP_LATENCY) == 50);
+    CHECK(added(WALL_TESTS) >= added(SNAP_WALL_TESTS) && added(SNAP_WALL_TESTS) > 0);
+    CHECK(added(WALL_CLEARANCE_ACCEPTS) <= added(WALL_TESTS));
+}
+
+// a snap whose nearest edge is behind a wall runs the wall test on it once, then only on the edges
+// after it: never more tests than the edges up to the first visible one (near ties counted in)
+void snapTestsEachEdgeOnce(){
+    std::shared_ptr<maps::MapManager> m = testutils::skeriMaps();
+    navgraph::Graph g(testutils::resDir() + "/4thfloor.json", m);
+    std::shared_ptr<const maps::AnnotatedMap> map = m->getMap(4);
+    const navgraph::CSRAdjacency& adj = g.getAdjacency();
+    std::set<std::pair<int, int>> edges;
+    std::pair<int, int> range = g.getFloorNodeRange(4);
+    for (int i = range.first; i < range.second; i++)
+        for (int k = adj.begin(i); k < adj.end(i); k++)
+            if (g.getNodeGeometry(adj.neighbors[k]).floor == 4 && adj.weights[k] != std::numeric_limits<float>::infinity())
+                edges.insert({std::min(i, adj.neighbors[k]), std::max(i, adj.neighbors[k])});
+
+    cv::Size size = m->getMapSizePixels(4);
+    double scale = m->getScale(4);
+    std::mt19937 rng(31);
+    std::uniform_real_distribution<float> u(0.f, size.height / scale), v(0.f, size.width / scale);
+    int rejected = 0;
+    for (int q = 0; q < 300; q++){
+        cv::Point2f uv(u(rng), v(rng));
+        std::vector<std::pair<float, bool>> candidates; // distance, visible
+        for (const std::pair<int, int>& e : edges){
+            float t;
+            cv::Point2f p = navgraph::projectPointToSegment(g.getNodeGeometry(e.first).positionUV, g.getNodeGeometry(e.second).positionUV, uv, t);
+            cv::Point2f d = p - uv;
+            candidates.push_back({std::sqrt(d.x*d.x + d.y*d.y), !map->isPathCrossingWalls(map->uv2pixels(uv), map->uv2pixels(p))});
+        }
+        std::sort(candidates.begin(), candidates.end());
+        auto firstVisible = std::min_element(candidates.begin(), candidates.end(), [](const std::pair<float, bool>& a, const std::pair<float, bool>& b){
+            return a.second != b.second ? a.second : a.first < b.first;
+        });
+        size_t expected = candidates.size();
+        if (firstVisible != candidates.end() && firstVisible->second)
+            expected = static_cast<size_t>(std::count_if(candidates.begin(), candidates.end(), [&](const std::pair<float, bool>& c){ return c.first <= firstVisible->first + 1e-4f; }));
+        rejected += !candidates.empty() && !candidates.front().second;
+
+        uint64_t before = Registry::instance().snapshot().counters[SNAP_WALL_TESTS];
+        navgraph::Graph::SnapResult res;
+        g.snapBatch(&uv, 1, 4, &res);
+        CHECK(Registry::instance().snapshot().counters[SNAP_WALL_TESTS] - before <= expected);
+    }
+    CHECK(rejected > 0);
+}
+
+// The grid scans of a large floor go through the vector kernel, whatever instruction set the build
+// targets (-march=native in the release preset): cells hold at least one vector of segments, and
+// the 4-wide path takes the runs the 8-wide one leaves.
+void snapScansAreVectorized(){
+    synthetic::GridSpec spec;
+    spec.sizePx = 600;
+    std::string folder = synthetic::ensureDataset(spec, testutils::scratchDir());
+    std::shared_ptr<maps::MapManager> m = std::make_shared<maps::MapManager>();
+    m->init(folder, spec.floor);
+    navgraph::Graph g(folder + "/graph.json", m);
+    std::mt19937 rng(37);
+    std::uniform_real_distribution<float> uv(0.f, spec.sizePx / spec.scale);
+    std::vector<cv::Point2f> positions;
+    for (int q = 0; q < 2000; q++)
+        positions.push_back(cv::Point2f(uv(rng), uv(rng)));
+    std::vector<navgraph::Graph::SnapResult> out;
+    Snapshot before = Registry::instance().snapshot();
+    g.snapBatch(positions, spec.floor, out, false);
+    Snapshot after = Registry::instance().snapshot();
+    uint64_t scanned = after.counters[SNAP_SEGMENTS] - before.counters[SNAP_SEGMENTS];
+    uint64_t vectorized = after.counters[SNAP_SEGMENTS_VECTORIZED] - before.counters[SNAP_SEGMENTS_VECTORIZED];
+    CHECK(scanned > 0);
+    if (navgraph::kernels::VECTOR_LANES > 1)
+        CHECK(vectorized * 2 > scanned);
+    else
+        CHECK(vectorized == 0);
+}
+
+// one line per bucket boundary; the same boundaries for every histogram and at every scrape
+std::vector<std::string> bucketBounds(const std::string& text, const std::string& histogram){
+    std::vector<std::string> bounds;
+    std::istringstream lines(text);
+    std::string line, prefix = histogram + "_bucket{le=\"";
+    while (std::getline(lines, line))
+        if (line.compare(0, prefix.size(), prefix) == 0)
+            bounds.push_back(line.substr(prefix.size(), line.find('"', prefix.size()) - prefix.size()));
+    return bounds;
+}
+
+void prometheusBucketsAreFixed(){
+    Snapshot empty, some;
+    some.buckets[SNAP_LATENCY][bucketOf(5000)] = 3;
+    some.buckets[SNAP_LATENCY][NUM_BUCKETS - 1] = 1;
+    some.buckets[POI_LATENCY][bucketOf(70)] = 2;
+    some.sums[SNAP_LATENCY] = 15000;
+    std::string emptyText = prometheusText(empty), someText = prometheusText(some);
+    std::vector<std::string> expected = bucketBounds(emptyText, histogramInfo(SNAP_LATENCY).name);
+    CHECK(expected.size() == NUM_BUCKETS / 4);
+    CHECK(!expected.empty() && expected.back() == "+Inf");
+    for (int h = 0; h < NUM_HISTOGRAMS; h++){
+        CHECK(bucketBounds(emptyText, histogramInfo(static_cast<HistogramId>(h)).name) == expected);
+        CHECK(bucketBounds(someText, histogramInfo(static_cast<HistogramId>(h)).name) == expected);
+    }
+    // cumulative counts: 5 us is below 8.192 us, the clamped value only in +Inf
+    std::string snap = histogramInfo(SNAP_LATENCY).name;
+    CHECK(someText.find(snap + "_bucket{le=\"4.096e-06\"} 0\n") != std::string::npos);
+    CHECK(someText.find(snap + "_bucket{le=\"8.192e-06\"} 3\n") != std::string::npos);
+    CHECK(someText.find(snap + "_bucket{le=\"1099.51\"} 3\n") != std::string::npos);
+    CHECK(someText.find(snap + "_bucket{le=\"+Inf\"} 4\n") != std::string::npos);
+    CHECK(someText.find(snap + "_count 4\n") != std::string::npos);
+    CHECK(someText.find(std::string("# TYPE ") + counterInfo(SNAPS).name + " counter\n") != std::string::npos);
+
+    std::string json = metricsutils::json(some);
+    CHECK(json.find(std::string("\"") + snap + "\": {\"count\": 4") != std::string::npos);
+    CHECK(json.front() == '{' && json.back() == '}');
+}
+
+} // namespace
+
+int main(){
+    testutils::run("histogram buckets cover every value", bucketsCoverEveryValue);
+    testutils::run("counters add up over threads", countersAddUp);
+    testutils::run("hot paths are counted", hotPathsAreCounted);
+    testutils::run("snapping tests each edge for walls once", snapTestsEachEdgeOnce);
+    testutils::run("snap grid scans are vectorized", snapScansAreVectorized);
+    testutils::run("prometheus buckets are fixed", prometheusBucketsAreFixed);
+    return testutils::testResult();
+}
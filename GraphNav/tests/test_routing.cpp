@@ -0,0 +1,366 @@
+//
+//  test_routing.cpp
+//  GraphNav
+//
+//  Routes against searches done here: A* against Dijkstra, runtime changes, route sessions (D* Lite)
+//  and the contraction hierarchy against plain A*, on the SKERI graph, a synthetic floor, a
+//  synthetic campus and small random graphs full of zero-weight edges.
+//
+
+#include "Check.hpp"
+#include "Fixtures.hpp"
+#include "Graph.hpp"
+#include "../benchmarks/SyntheticData.hpp"
+
+#include <random>
+
+using navgraph::AStar;
+using navgraph::CSRAdjacency;
+using navgraph::ContractionHierarchy;
+using navgraph::Graph;
+using testutils::dijkstra;
+
+namespace {
+
+struct Dataset{
+    std::shared_ptr<maps::MapManager> maps;
+    std::string graphFile;
+    int floor;
+};
+
+Dataset skeri(){
+    Dataset d{std::make_shared<maps::MapManager>(), testutils::resDir() + "/4thfloor.json", 4};
+    d.maps->init(testutils::resDir() + "/maps/SKERI", d.floor);
+    return d;
+}
+
+Dataset grid(){
+    synthetic::GridSpec spec;
+    spec.sizePx = 600;
+    std::string folder = synthetic::ensureDataset(spec, testutils::scratchDir());
+    Dataset d{std::make_shared<maps::MapManager>(), folder + "/graph.json", spec.floor};
+    d.maps->init(folder, d.floor);
+    return d;
+}
+
+// sum of the weights along a route of node ids, negative if two consecutive nodes are not joined
+float routeWeight(const Graph& g, const std::vector<int>& nodeIds){
+    const CSRAdjacency& adj = g.getAdjacency();
+    float length = 0;
+    for (size_t i = 0; i + 1 < nodeIds.size(); i++){
+        int u = g.nodeIndex(nodeIds[i]), v = g.nodeIndex(nodeIds[i+1]);
+        int best = -1;
+        for (int k = adj.begin(u); k < adj.end(u); k++)
+            if (adj.neighbors[k] == v && (best < 0 || adj.weights[k] < adj.weights[best]))
+                best = k;
+        if (best < 0)
+            return -1;
+        length += adj.weights[best];
+    }
+    return length;
+}
+
+// a route agrees with A* on the current weights: same length, and a real path of that length
+void checkRoute(const Graph& g, const Graph::Route& route, int srcIdx, int dstIdx){
+    static AStar astar;
+    std::vector<int> path;
+    float expected = astar.search(g.getAdjacency(), srcIdx, dstIdx, path);
+    CHECK(route.found() == (expected >= 0));
+    if (!route.found() || expected < 0)
+        return;
+    CHECK_NEAR(route.length, expected, 1e-4);
+    CHECK(route.nodeIds.front() == g.nodeId(srcIdx) && route.nodeIds.back() == g.nodeId(dstIdx));
+    CHECK_NEAR(routeWeight(g, route.nodeIds), route.length, 1e-3);
+}
+
+// random graphs in the plane, edges at least as long as the straight line (times some factor)
+void astarOnRandomGraphs(){
+    for (int trial = 0; trial < 40; trial++){
+        std::mt19937 rng(100 + trial);
+        std::uniform_real_distribution<float> coordinate(0.f, 50.f), stretch(1.f, 3.f);
+        int n = 2 + static_cast<int>(rng() % 80);
+        float unit = 0.1f + (rng() % 100) / 10.f;
+        CSRAdjacency g;
+        g.offsets.assign(1, 0);
+        for (int u = 0; u < n; u++)
+            g.positions.push_back(cv::Point2f(coordinate(rng), coordinate(rng)));
+        for (int u = 0; u < n; u++){
+            for (int e = 0, m = static_cast<int>(rng() % 5); e < m; e++){
+                int v = static_cast<int>(rng() % n);
+                cv::Point2f diff = g.positions[v] - g.positions[u];
+                g.neighbors.push_back(v);
+                g.weights.push_back(unit * stretch(rng) * std::sqrt(diff.x * diff.x + diff.y * diff.y));
+            }
+            g.offsets.push_back(g.numEdges());
+        }
+        g.computeHeuristicScale();
+        AStar astar;
+        std::vector<int> path;
+        for (int a = 0; a < n; a++){
+            std::vector<float> dist = dijkstra(g, a);
+            for (int b = 0; b < n; b++){
+                float length = astar.search(g, a, b, path);
+                if (!CHECK(length < 0 ? std::isinf(dist[b]) : testutils::near(length, dist[b], 1e-5)) || length < 0)
+                    continue;
+                // the path is a chain of edges adding up to the length
+                float sum = 0;
+                for (size_t i = 0; i + 1 < path.size(); i++){
+                    float w = std::numeric_limits<float>::infinity();
+                    for (int k = g.begin(path[i]); k < g.end(path[i]); k++)
+                        if (g.neighbors[k] == path[i+1])
+                            w = std::min(w, g.weights[k]);
+                    sum += w;
+                }
+                CHECK(path.front() == a && path.back() == b);
+                CHECK_NEAR(sum, length, 1e-4);
+            }
+        }
+    }
+}
+
+void astarOnSkeri(const Dataset& d){
+    Graph g(d.graphFile, d.maps);
+    const CSRAdjacency& adj = g.getAdjacency();
+    CHECK(g.numNodes() > 0 && adj.heuristicScale > 0);
+    for (int a = 0; a < g.numNodes(); a++){
+        std::vector<float> dist = dijkstra(adj, a);
+        for (int b = 0; b < g.numNodes(); b++){
+            Graph::Route route = g.findRoute(g.nodeId(a), g.nodeId(b));
+            CHECK(route.found() != std::isinf(dist[b]));
+            if (route.found()){
+                CHECK_NEAR(route.length, dist[b], 1e-5);
+                CHECK(route.nodeIds.front() == g.nodeId(a) && route.nodeIds.back() == g.nodeId(b));
+                CHECK_NEAR(routeWeight(g, route.nodeIds), route.length, 1e-4);
+            }
+        }
+    }
+    CHECK(!g.findRoute(g.nodeId(0), -12345).found() && g.findRoute(g.nodeId(0), -12345).nodeIds.empty());
+}
+
+// closing and re-weighting edges and nodes at runtime, and what the changes refuse
+void runtimeUpdates(const Dataset& d){
+    Graph g(d.graphFile, d.maps);
+    const CSRAdjacency& adj = g.getAdjacency();
+    int u = 0;
+    while (adj.end(u) - adj.begin(u) < 2)
+        u++;
+    int v = adj.neighbors[adj.begin(u)];
+    int uId = g.nodeId(u), vId = g.nodeId(v);
+    float length = adj.weights[adj.begin(u)], scale = adj.heuristicScale;
+    uint64_t version = g.version();
+
+    // lengths that are negative or not numbers leave the graph as it was
+    for (float bad : {-5.f, -1e-3f, std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()})
+        CHECK(!g.setEdgeLength(uId, vId, bad));
+    CHECK(g.version() == version && adj.weights[adj.begin(u)] == length && adj.heuristicScale == scale);
+    CHECK(!g.setEdgeLength(uId, -1, 1.f) && !g.setEdgeEnabled(-1, vId, false) && !g.setNodeEnabled(-1, false));
+    CHECK(g.version() == version);
+
+    CHECK(g.setEdgeLength(uId, vId, 0.f));
+    CHECK(adj.weights[adj.begin(u)] == 0.f && g.version() > version);
+    CHECK(g.setEdgeLength(uId, vId, length * 3, false));
+    CHECK(adj.weights[adj.begin(u)] == length * 3);
+    CHECK(g.setEdgeEnabled(uId, vId, false, false));
+    CHECK(!g.isEdgeEnabled(uId, vId));
+    checkRoute(g, g.findRoute(uId, vId), u, v);
+    CHECK(g.setEdgeEnabled(uId, vId, true));
+    CHECK(g.isEdgeEnabled(uId, vId) && adj.weights[adj.begin(u)] == length * 3);
+
+    // a disabled node is neither routed through nor the closest node
+    cv::Point2f at = g.getNodeGeometry(u).positionUV;
+    int floor = g.getNodeGeometry(u).floor;
+    CHECK(g.findClosestNodeId(at, floor) == uId);
+    CHECK(g.setNodeEnabled(uId, false));
+    CHECK(!g.isNodeEnabled(uId));
+    int closest = g.findClosestNodeId(at, floor);
+    CHECK(closest != uId && closest >= 0 && g.isNodeEnabled(closest));
+    closest = g.findClosestNodeId(at, floor, true);
+    CHECK(closest != uId);
+    CHECK(!g.findRoute(uId, vId).found() && !g.findRoute(vId, uId).found());
+    for (int k = 0; k < 100; k++){
+        int a = static_cast<int>((k * 7919) % g.numNodes()), b = static_cast<int>((k * 104729 + 3) % g.numNodes());
+        Graph::Route route = g.findRoute(g.nodeId(a), g.nodeId(b));
+        checkRoute(g, route, a, b);
+        CHECK(std::find(route.nodeIds.begin(), route.nodeIds.end(), uId) == route.nodeIds.end());
+    }
+    CHECK(g.setNodeEnabled(uId, true));
+    CHECK(g.findClosestNodeId(at, floor) == uId);
+
+    // a moved node is found at its new position
+    CHECK(g.setNodePosition(uId, at + cv::Point2f(0.25f, 0.25f)));
+    CHECK(g.getNodeGeometry(u).positionUV == at + cv::Point2f(0.25f, 0.25f));
+    CHECK(g.findClosestNodeId(at + cv::Point2f(0.25f, 0.25f), floor) == uId);
+    CHECK(!g.setNodePosition(-1, at));
+}
+
+void hierarchyMatchesAStar(const Dataset& d, int numQueries){
+    Graph g(d.graphFile, d.maps);
+    g.buildHierarchy();
+    CHECK(!g.getHierarchy().empty());
+    int n = g.numNodes();
+    std::mt19937 rng(3);
+    for (int q = 0; q < numQueries; q++){
+        int a = static_cast<int>(rng() % n), b = static_cast<int>(rng() % n);
+        checkRoute(g, g.findRoute(g.nodeId(a), g.nodeId(b)), a, b);
+    }
+
+    // after runtime changes findRoute falls back to A* where the hierarchy no longer applies
+    const CSRAdjacency& adj = g.getAdjacency();
+    for (int step = 0; step < 50; step++){
+        int u = static_cast<int>(rng() % n);
+        if (adj.end(u) == adj.begin(u))
+            continue;
+        int v = adj.neighbors[adj.begin(u)];
+        if (step % 3 == 0)
+            g.setEdgeEnabled(g.nodeId(u), g.nodeId(v), rng() % 2 != 0);
+        else if (step % 3 == 1)
+            g.setEdgeLength(g.nodeId(u), g.nodeId(v), adj.weights[adj.begin(u)] * (0.5f + (rng() % 100) / 50.f));
+        else
+            g.setNodeEnabled(g.nodeId(u), rng() % 3 != 0);
+        int a = static_cast<int>(rng() % n), b = static_cast<int>(rng() % n);
+        checkRoute(g, g.findRoute(g.nodeId(a), g.nodeId(b)), a, b);
+    }
+
+    // a saved hierarchy loads back onto the same graph and answers the same
+    Graph fresh(d.graphFile, d.maps);
+    fresh.buildHierarchy();
+    std::string file = testutils::scratchDir() + "/routing_test.ch";
+    CHECK(fresh.saveHierarchy(file));
+    Graph loaded(d.graphFile, d.maps);
+    CHECK(loaded.loadHierarchy(file));
+    CHECK(loaded.getHierarchy().numEdges() == fresh.getHierarchy().numEdges());
+    for (int q = 0; q < numQueries / 4; q++){
+        int a = static_cast<int>(rng() % n), b = static_cast<int>(rng() % n);
+        Graph::Route r1 = fresh.findRoute(g.nodeId(a), g.nodeId(b)), r2 = loaded.findRoute(g.nodeId(a), g.nodeId(b));
+        CHECK(r1.found() == r2.found() && r1.length == r2.length);
+    }
+}
+
+// loading another graph into a graph drops the hierarchy and tables built for the previous one
+void reloadDropsDerivedData(const Dataset& first, const Dataset& second){
+    Graph g(first.graphFile, first.maps);
+    g.buildHierarchy();
+    g.buildDistanceTable();
+    CHECK(!g.getHierarchy().empty() && !g.getDistanceTable().empty());
+    CHECK(g.loadJson(second.graphFile, second.maps));
+    CHECK(g.getHierarchy().empty() && g.getDistanceTable().empty() && g.getGeodesicFields().empty());
+    int n = g.numNodes();
+    std::mt19937 rng(5);
+    for (int q = 0; q < 100; q++){
+        int a = static_cast<int>(rng() % n), b = static_cast<int>(rng() % n);
+        checkRoute(g, g.findRoute(g.nodeId(a), g.nodeId(b)), a, b);
+    }
+}
+
+// co-located nodes (e.g. the two ends of an elevator link) are joined by zero-weight edges, which
+// the contraction must keep shortcuts for
+void hierarchyWithZeroWeights(){
+    for (int trial = 0; trial < 60; trial++){
+        std::mt19937 rng(trial);
+        int n = 5 + static_cast<int>(rng() % 50);
+        std::vector<std::vector<std::pair<int, float>>> edges(n);
+        for (int e = 0, m = n * (1 + static_cast<int>(rng() % 3)); e < m; e++){
+            int a = static_cast<int>(rng() % n), b = static_cast<int>(rng() % n);
+            float w = rng() % 3 == 0 ? 1.f + rng() % 5 : 0.f;
+            if (a == b)
+                continue;
+            edges[a].push_back({b, w});
+            if (rng() % 2)
+                edges[b].push_back({a, w});
+        }
+        CSRAdjacency g;
+        g.offsets.assign(1, 0);
+        for (int u = 0; u < n; u++){
+            for (auto& e : edges[u]){
+                g.neighbors.push_back(e.first);
+                g.weights.push_back(e.second);
+            }
+            g.offsets.push_back(g.numEdges());
+            g.positions.push_back(cv::Point2f(0, 0));
+        }
+        ContractionHierarchy ch;
+        ch.build(g, 1 + trial % 2);
+        ContractionHierarchy::Search search;
+        std::vector<int> slots;
+        for (int a = 0; a < n; a++){
+            std::vector<float> dist = dijkstra(g, a);
+            for (int b = 0; b < n; b++){
+                float length = ch.route(search, a, b, slots);
+                CHECK(length < 0 ? std::isinf(dist[b]) : length == dist[b]);
+            }
+        }
+    }
+}
+
+// multi-building, multi-floor graph with stairs and outdoor paths
+void hierarchyOnCampus(){
+    synthetic::CampusSpec spec;
+    spec.buildings = 3;
+    spec.floors = 3;
+    spec.corridorNodes = 12;
+    CSRAdjacency g = synthetic::campusAdjacency(spec);
+    ContractionHierarchy ch;
+    ch.build(g, 2);
+    ContractionHierarchy::Search search;
+    AStar astar;
+    std::vector<int> slots, path;
+    std::mt19937 rng(5);
+    for (int q = 0; q < 300; q++){
+        int a = static_cast<int>(rng() % g.numNodes()), b = static_cast<int>(rng() % g.numNodes());
+        CHECK_NEAR(ch.route(search, a, b, slots), astar.search(g, a, b, path), 1e-4);
+    }
+}
+
+// a user walking towards a destination, sometimes off the route, while edges and nodes change
+void sessionMatchesAStar(const Dataset& d, int numSessions){
+    Graph g(d.graphFile, d.maps);
+    const CSRAdjacency& adj = g.getAdjacency();
+    int n = g.numNodes();
+    std::mt19937 rng(7);
+    for (int s = 0; s < numSessions; s++){
+        Graph::RouteSession session;
+        int dst = static_cast<int>(rng() % n), src = static_cast<int>(rng() % n);
+        for (int step = 0; step < 40; step++){
+            int op = static_cast<int>(rng() % 10);
+            Graph::Route current = g.findRoute(g.nodeId(src), g.nodeId(dst));
+            if (op < 5 && current.found() && current.nodeIds.size() > 2){
+                src = g.nodeIndex(current.nodeIds[1]);
+                if (rng() % 3 == 0 && adj.end(src) > adj.begin(src))
+                    src = adj.neighbors[adj.begin(src) + static_cast<int>(rng() % (adj.end(src) - adj.begin(src)))];
+            }
+            else if (op < 8){
+                int u = static_cast<int>(rng() % n);
+                if (adj.end(u) > adj.begin(u)){
+                    int v = adj.neighbors[adj.begin(u)];
+                    if (op < 7)
+                        g.setEdgeEnabled(g.nodeId(u), g.nodeId(v), rng() % 2 != 0);
+                    else
+                        g.setEdgeLength(g.nodeId(u), g.nodeId(v), 0.5f + (rng() % 100) / 10.f, rng() % 2 != 0);
+                }
+            }
+            else if (op < 9)
+                g.setNodeEnabled(g.nodeId(static_cast<int>(rng() % n)), rng() % 3 != 0);
+            else
+                src = static_cast<int>(rng() % n);
+            checkRoute(g, g.findRoute(session, g.nodeId(src), g.nodeId(dst)), src, dst);
+        }
+        CHECK(session.plans == 40);
+    }
+}
+
+} // namespace
+
+int main(){
+    Dataset small = skeri(), large = grid();
+    testutils::run("A* matches Dijkstra on random graphs", astarOnRandomGraphs);
+    testutils::run("A* matches Dijkstra on SKERI", [&]{ astarOnSkeri(small); });
+    testutils::run("runtime updates on SKERI", [&]{ runtimeUpdates(small); });
+    testutils::run("hierarchy matches A* on SKERI", [&]{ hierarchyMatchesAStar(small, 400); });
+    testutils::run("hierarchy matches A* on a synthetic floor", [&]{ hierarchyMatchesAStar(large, 400); });
+    testutils::run("hierarchy keeps zero-weight shortcuts", hierarchyWithZeroWeights);
+    testutils::run("loading another graph drops the hierarchy", [&]{ reloadDropsDerivedData(large, small); });
+    testutils::run("hierarchy matches A* on a synthetic campus", hierarchyOnCampus);
+    testutils::run("route sessions match A* on SKERI", [&]{ sessionMatchesAStar(small, 20); });
+    testutils::run("route sessions match A* on a synthetic floor", [&]{ sessionMatchesAStar(large, 20); });
+    return testutils::testResult();
+}
@@ -0,0 +1,133 @@
+//
+//  test_shared_graph.cpp
+//  GraphNav
+//
+//  A graph shared through a SharedGraph: readers keep the version they took while a writer
+//  publishes changes, and queries running on many threads answer as they do on one.
+//
+
+#include "Check.hpp"
+#include "Fixtures.hpp"
+#include "Graph.hpp"
+
+#include <atomic>
+#include <random>
+#include <thread>
+
+using navgraph::Graph;
+using navgraph::SharedGraph;
+using testutils::skeriMaps;
+
+namespace {
+
+// an edge of the graph, by node ids
+std::pair<int, int> someEdge(const Graph& g, int k){
+    const navgraph::CSRAdjacency& adj = g.getAdjacency();
+    int u = k % g.numNodes();
+    while (adj.end(u) == adj.begin(u))
+        u = (u + 1) % g.numNodes();
+    return {g.nodeId(u), g.nodeId(adj.neighbors[adj.begin(u)])};
+}
+
+void readersKeepTheirVersion(){
+    SharedGraph shared(std::make_shared<const Graph>(testutils::resDir() + "/4thfloor.json", skeriMaps()));
+    std::shared_ptr<const Graph> before = shared.get();
+    std::pair<int, int> edge = someEdge(*before, 0);
+    CHECK(before->isEdgeEnabled(edge.first, edge.second));
+
+    bool changed = shared.update([&edge](Graph& g){ return g.setEdgeEnabled(edge.first, edge.second, false); });
+    CHECK(changed);
+    std::shared_ptr<const Graph> after = shared.get();
+    CHECK(after != before);
+    CHECK(before->isEdgeEnabled(edge.first, edge.second) && !after->isEdgeEnabled(edge.first, edge.second));
+    CHECK(after->version() > before->version());
+
+    // an update that fails is not published
+    CHECK(!shared.update([](Graph& g){ return g.setEdgeEnabled(-1, -2, false); }));
+    CHECK(shared.get() == after);
+
+    // one that returns nothing always is
+    shared.update([&edge](Graph& g){ g.setEdgeEnabled(edge.first, edge.second, true); });
+    CHECK(shared.get() != after && shared.get()->isEdgeEnabled(edge.first, edge.second));
+    CHECK(shared.update([](Graph& g){ return g.numNodes(); }) == after->numNodes());
+
+    shared.set(before);
+    CHECK(shared.get() == before);
+}
+
+// readers route and snap on whatever version they get while a writer toggles edges; every answer
+// must be the one of the version the reader holds
+void concurrentReadersAndWriter(){
+    SharedGraph shared(std::make_shared<const Graph>(testutils::resDir() + "/4thfloor.json", skeriMaps()));
+    const int numNodes = shared.get()->numNodes();
+    std::atomic<bool> stop(false);
+    std::atomic<int> mismatches(0), queries(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++)
+        readers.emplace_back([&, t]{
+            std::mt19937 rng(100 + t);
+            navgraph::AStar astar;
+            std::vector<int> path;
+            while (!stop || queries < 400){
+                std::shared_ptr<const Graph> g = shared.get();
+                int a = static_cast<int>(rng() % numNodes), b = static_cast<int>(rng() % numNodes);
+                Graph::Route route = g->findRoute(g->nodeId(a), g->nodeId(b));
+                float expected = astar.search(g->getAdjacency(), a, b, path);
+                if (route.version != g->version() || route.found() != (expected >= 0) ||
+                    (route.found() && !testutils::near(route.length, expected, 1e-4)))
+                    mismatches++;
+                cv::Point2f uv = g->getNodeGeometry(a).positionUV + cv::Point2f(0.3f, -0.2f);
+                Graph::SnapResult batch;
+                g->snapBatch(&uv, 1, g->getNodeGeometry(a).floor, &batch);
+                if (g->snapUV2Graph(uv, g->getNodeGeometry(a).floor) != batch.position)
+                    mismatches++;
+                queries++;
+            }
+        });
+    std::mt19937 rng(7);
+    for (int step = 0; step < 200; step++){
+        std::pair<int, int> edge = someEdge(*shared.get(), static_cast<int>(rng() % numNodes));
+        bool enabled = rng() % 2 != 0;
+        shared.update([&](Graph& g){ return g.setEdgeEnabled(edge.first, edge.second, enabled); });
+        std::this_thread::yield();
+    }
+    stop = true;
+    for (std::thread& t : readers)
+        t.join();
+    CHECK(mismatches == 0);
+    CHECK(queries >= 400);
+}
+
+// the maps answer the same from many threads, loading their floors on first use
+void concurrentMapQueries(){
+    maps::MapManager m;
+    m.init(testutils::resDir() + "/maps/SKERI", 4);
+    cv::Size size = m.getMapSizePixels(4);
+    std::vector<std::pair<cv::Point2i, cv::Point2i>> segments;
+    std::mt19937 rng(11);
+    for (int q = 0; q < 2000; q++)
+        segments.push_back({cv::Point2i(rng() % size.height, rng() % size.width), cv::Point2i(rng() % size.height, rng() % size.width)});
+    std::vector<std::vector<char>> answers(4, std::vector<char>(segments.size()));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+        threads.emplace_back([&, t]{
+            for (size_t q = 0; q < segments.size(); q++)
+                answers[t][q] = m.isPathCrossingWalls(segments[q].first, segments[q].second, 4) ? 1 : 0;
+        });
+    for (std::thread& t : threads)
+        t.join();
+    std::shared_ptr<const maps::AnnotatedMap> map = m.getMap(4);
+    for (size_t q = 0; q < segments.size(); q++){
+        char expected = map->isPathCrossingWalls(segments[q].first, segments[q].second) ? 1 : 0;
+        CHECK(answers[0][q] == expected && answers[1][q] == expected && answers[2][q] == expected && answers[3][q] == expected);
+    }
+}
+
+} // namespace
+
+int main(){
+    testutils::run("readers keep the version they took", readersKeepTheirVersion);
+    testutils::run("concurrent readers see consistent versions", concurrentReadersAndWriter);
+    testutils::run("concurrent map queries", concurrentMapQueries);
+    return testutils::testResult();
+}
@@ -0,0 +1,263 @@
+//
+//  test_snapping.cpp
+//  GraphNav
+//
+//  Snapping against brute force over every edge of the floor: single positions through the segment
+//  grid, batches through the vector kernel, and tracks through snap sessions.
+//
+
+#include "Check.hpp"
+#include "Fixtures.hpp"
+#include "Graph.hpp"
+#include "Spatial/SegmentKernels.hpp"
+
+#include <random>
+
+using navgraph::Graph;
+using testutils::skeriMaps;
+
+namespace {
+
+double distance(cv::Point2f a, cv::Point2f b){
+    cv::Point2f d = a - b;
+    return std::sqrt(static_cast<double>(d.x) * d.x + static_cast<double>(d.y) * d.y);
+}
+
+// the points of every edge of floor open in at least one direction closest to uv, nearest first
+std::vector<std::pair<double, cv::Point2f>> closestPoints(const Graph& g, cv::Point2f uv, int floor){
+    const navgraph::CSRAdjacency& adj = g.getAdjacency();
+    std::vector<std::pair<double, cv::Point2f>> points;
+    std::pair<int, int> range = g.getFloorNodeRange(floor);
+    for (int i = range.first; i < range.second; i++)
+        for (int k = adj.begin(i); k < adj.end(i); k++){
+            int j = adj.neighbors[k];
+            if (g.getNodeGeometry(j).floor != floor || adj.weights[k] == std::numeric_limits<float>::infinity())
+                continue;
+            float t;
+            cv::Point2f p = navgraph::projectPointToSegment(g.getNodeGeometry(i).positionUV, g.getNodeGeometry(j).positionUV, uv, t);
+            points.push_back({distance(p, uv), p});
+        }
+    std::stable_sort(points.begin(), points.end(), [](const std::pair<double, cv::Point2f>& a, const std::pair<double, cv::Point2f>& b){
+        return a.first < b.first;
+    });
+    return points;
+}
+
+bool visible(const maps::AnnotatedMap& map, cv::Point2f from, cv::Point2f to){
+    return !map.isPathCrossingWalls(map.uv2pixels(from), map.uv2pixels(to));
+}
+
+// a snap result is a point of the edge it names, as near to uv as the nearest (visible) brute force point
+void checkSnap(const Graph& g, cv::Point2f uv, int floor, bool checkWalls, const Graph::SnapResult& res){
+    std::shared_ptr<const maps::AnnotatedMap> map = skeriMaps()->getMap(floor);
+    std::vector<std::pair<double, cv::Point2f>> points = closestPoints(g, uv, floor);
+    auto expected = points.begin();
+    while (checkWalls && expected != points.end() && !visible(*map, uv, expected->second))
+        ++expected;
+    if (expected == points.end()){
+        CHECK(res.edge == -1 && res.position == uv);
+        return;
+    }
+    if (!CHECK(res.edge >= 0))
+        return;
+    CHECK_NEAR(distance(res.position, uv), expected->first, 1e-5);
+    const navgraph::Segment& s = g.getEdgeSegment(res.edge);
+    CHECK(g.getNodeGeometry(s.n1).floor == floor && g.getNodeGeometry(s.n2).floor == floor);
+    CHECK(res.t >= 0 && res.t <= 1);
+    CHECK(distance(res.position, s.p1 + res.t * (s.p2 - s.p1)) < 1e-4);
+    CHECK(!checkWalls || visible(*map, uv, res.position));
+}
+
+// positions over the whole floor and beyond it, and close to the nodes where the edges meet
+std::vector<cv::Point2f> queryPositions(const Graph& g, int floor, int count, unsigned seed){
+    cv::Size size = skeriMaps()->getMapSizePixels(floor);
+    double scale = skeriMaps()->getScale(floor);
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> u(-2.f, size.height / scale + 2.f), v(-2.f, size.width / scale + 2.f), jitter(-0.5f, 0.5f);
+    std::pair<int, int> range = g.getFloorNodeRange(floor);
+    std::vector<cv::Point2f> positions;
+    for (int q = 0; q < count; q++){
+        if (q % 3 == 0 && range.second > range.first){
+            int n = range.first + static_cast<int>(rng() % (range.second - range.first));
+            positions.push_back(g.getNodeGeometry(n).positionUV + cv::Point2f(jitter(rng), jitter(rng)));
+        }
+        else
+            positions.push_back(cv::Point2f(u(rng), v(rng)));
+    }
+    return positions;
+}
+
+void snapMatchesBruteForce(){
+    Graph g(testutils::resDir() + "/4thfloor.json", skeriMaps());
+    std::vector<Graph::SnapResult> out;
+    for (bool checkWalls : {false, true}){
+        std::vector<cv::Point2f> positions = queryPositions(g, 4, 3000, checkWalls ? 2 : 1);
+        g.snapBatch(positions, 4, out, checkWalls);
+        for (size_t q = 0; q < positions.size(); q++){
+            checkSnap(g, positions[q], 4, checkWalls, out[q]);
+            CHECK(g.snapUV2Graph(positions[q], 4, checkWalls) == out[q].position);
+        }
+    }
+    // a floor without edges leaves the positions where they are
+    g.snapBatch(std::vector<cv::Point2f>{cv::Point2f(1.f, 2.f)}, 7, out);
+    CHECK(out[0].edge == -1 && out[0].position == cv::Point2f(1.f, 2.f));
+    CHECK(g.snapUV2Graph(cv::Point2f(1.f, 2.f), 7) == cv::Point2f(1.f, 2.f));
+}
+
+// edges closed in both directions are not snapped to, those closed in one direction still are
+void snapSkipsClosedEdges(){
+    Graph g(testutils::resDir() + "/4thfloor.json", skeriMaps());
+    const navgraph::CSRAdjacency& adj = g.getAdjacency();
+    std::mt19937 rng(3);
+    for (int step = 0; step < 40; step++){
+        int u = static_cast<int>(rng() % g.numNodes());
+        if (adj.end(u) == adj.begin(u))
+            continue;
+        int v = adj.neighbors[adj.begin(u) + static_cast<int>(rng() % (adj.end(u) - adj.begin(u)))];
+        if (step % 4 == 3)
+            g.setNodeEnabled(g.nodeId(u), false);
+        else
+            g.setEdgeEnabled(g.nodeId(u), g.nodeId(v), false, step % 2 == 0);
+    }
+    std::vector<cv::Point2f> positions = queryPositions(g, 4, 1000, 4);
+    std::vector<Graph::SnapResult> out;
+    g.snapBatch(positions, 4, out);
+    for (size_t q = 0; q < positions.size(); q++)
+        checkSnap(g, positions[q], 4, true, out[q]);
+}
+
+// the floor grid is updated in place: edges closed and opened again, nodes moved (also out of the
+// grid), and a copy taken before the changes still snaps to the edges it had
+void snapFollowsChanges(){
+    Graph g(testutils::resDir() + "/4thfloor.json", skeriMaps());
+    Graph before = g;
+    const navgraph::CSRAdjacency& adj = g.getAdjacency();
+    std::mt19937 rng(29);
+    std::uniform_real_distribution<float> shift(-3.f, 3.f);
+    for (int step = 0; step < 300; step++){
+        int u = static_cast<int>(rng() % g.numNodes());
+        if (g.getNodeGeometry(u).floor != 4 || adj.end(u) == adj.begin(u))
+            continue;
+        int v = adj.neighbors[adj.begin(u) + static_cast<int>(rng() % (adj.end(u) - adj.begin(u)))];
+        cv::Point2f at = g.getNodeGeometry(u).positionUV;
+        switch (step % 5){
+            case 0: g.setEdgeEnabled(g.nodeId(u), g.nodeId(v), rng() % 2 != 0, step % 2 == 0); break;
+            case 1: g.setNodeEnabled(g.nodeId(u), rng() % 3 != 0); break;
+            case 2: g.setNodePosition(g.nodeId(u), at + cv::Point2f(shift(rng), shift(rng))); break;
+            case 3: g.setNodePosition(g.nodeId(u), at + cv::Point2f(shift(rng) * 20.f, shift(rng) * 20.f)); break;
+            default: g.setEdgeLength(g.nodeId(u), g.nodeId(v), shift(rng) + 3.f); break;
+        }
+    }
+    std::vector<Graph::SnapResult> out;
+    for (const Graph* graph : {&g, &before}){
+        std::vector<cv::Point2f> positions = queryPositions(*graph, 4, 1000, 5);
+        graph->snapBatch(positions, 4, out);
+        for (size_t q = 0; q < positions.size(); q++)
+            checkSnap(*graph, positions[q], 4, true, out[q]);
+    }
+}
+
+// indices above 2^24 are not exact as floats: the vector paths must keep them as integers
+void nearestSegmentKeepsLargeIndices(){
+    using namespace navgraph::kernels;
+    const int first = (1 << 24) + 3, count = 77;
+    std::mt19937 rng(19);
+    std::uniform_real_distribution<float> u(-10.f, 10.f);
+    std::vector<float> x(count), y(count), dx(count), dy(count), invLen2(count);
+    for (int i = 0; i < count; i++){
+        x[i] = u(rng);
+        y[i] = u(rng);
+        dx[i] = u(rng);
+        dy[i] = u(rng);
+        invLen2[i] = 1.f / (dx[i] * dx[i] + dy[i] * dy[i]);
+    }
+    // the kernel only reads [begin, end), here the count segments stored from index first on
+    SegmentsSoA s = {x.data() - first, y.data() - first, dx.data() - first, dy.data() - first, invLen2.data() - first};
+    for (int q = 0; q < 2000; q++){
+        float px = u(rng), py = u(rng);
+        float best = std::numeric_limits<float>::max(), expected = best;
+        int bestIdx = -1, expectedIdx = -1;
+        nearestSegment(s, first, first + count, px, py, best, bestIdx);
+        for (int k = first; k < first + count; k++){
+            float d2 = pointSegmentDist2(s, k, px, py);
+            if (d2 < expected){
+                expected = d2;
+                expectedIdx = k;
+            }
+        }
+        // the scalar loop may be compiled with fused multiply-adds and the vector lanes not, so
+        // distances agree to rounding; an index that went through a float would be another segment
+        CHECK_NEAR(best, expected, 1e-5);
+        CHECK(bestIdx >= first && bestIdx < first + count);
+        CHECK_NEAR(pointSegmentDist2(s, bestIdx, px, py), expected, 1e-5);
+        CHECK(bestIdx == expectedIdx || testutils::near(pointSegmentDist2(s, expectedIdx, px, py), best, 1e-5));
+    }
+}
+
+// users walking along the corridors with some noise, now and then jumping somewhere else
+void trackedMatchesBatch(){
+    Graph g(testutils::resDir() + "/4thfloor.json", skeriMaps());
+    const navgraph::CSRAdjacency& adj = g.getAdjacency();
+    std::mt19937 rng(23);
+    std::normal_distribution<float> noise(0.f, 0.3f);
+    uint64_t hits = 0;
+    for (bool checkWalls : {true, false}){
+        Graph::SnapSession session;
+        int node = static_cast<int>(rng() % g.numNodes());
+        for (int leg = 0; leg < 200; leg++){
+            if (adj.end(node) == adj.begin(node) || rng() % 20 == 0){
+                node = static_cast<int>(rng() % g.numNodes());
+                continue;
+            }
+            int next = adj.neighbors[adj.begin(node) + static_cast<int>(rng() % (adj.end(node) - adj.begin(node)))];
+            cv::Point2f a = g.getNodeGeometry(node).positionUV, b = g.getNodeGeometry(next).positionUV;
+            for (int k = 0; k <= 10 && g.getNodeGeometry(next).floor == 4; k++){
+                cv::Point2f uv = a + (b - a) * (k / 10.f) + cv::Point2f(noise(rng), noise(rng));
+                Graph::SnapResult tracked = g.snapTracked(session, uv, 4, checkWalls), single;
+                g.snapBatch(&uv, 1, 4, &single, checkWalls);
+                // equally near edges (at a node, say) may be told apart differently
+                // positions inside a wall see no edge
+                if (!CHECK((tracked.edge >= 0) == (single.edge >= 0)) || single.edge < 0)
+                    continue;
+                CHECK_NEAR(distance(tracked.position, uv), distance(single.position, uv), 1e-5);
+                CHECK(tracked.edge != single.edge || (tracked.position == single.position && tracked.t == single.t));
+                CHECK(session.lastEdge() == tracked.edge);
+            }
+            node = next;
+        }
+        CHECK(session.hits > session.fallbacks);
+        hits += session.hits;
+    }
+    CHECK(hits > 0);
+
+    // a change to the graph starts the track over
+    Graph::SnapSession session;
+    cv::Point2f uv = g.getNodeGeometry(0).positionUV;
+    g.snapTracked(session, uv, 4);
+    g.snapTracked(session, uv, 4);
+    CHECK(session.hits == 1);
+    int u = 0, v = adj.end(0) > adj.begin(0) ? adj.neighbors[adj.begin(0)] : 0;
+    g.setEdgeEnabled(g.nodeId(u), g.nodeId(v), false);
+    Graph::SnapResult tracked = g.snapTracked(session, uv, 4), single;
+    g.snapBatch(&uv, 1, 4, &single);
+    CHECK(session.fallbacks == 2);
+    CHECK_NEAR(distance(tracked.position, uv), distance(single.position, uv), 1e-5);
+
+    // so does another graph loaded from the same file, whatever its version or address
+    Graph other(testutils::resDir() + "/4thfloor.json", skeriMaps());
+    Graph::SnapSession fresh;
+    g.snapTracked(fresh, uv, 4);
+    other.snapTracked(fresh, uv, 4);
+    CHECK(fresh.fallbacks == 2 && fresh.hits == 0);
+}
+
+} // namespace
+
+int main(){
+    testutils::run("snapping matches brute force on SKERI", snapMatchesBruteForce);
+    testutils::run("snapping skips closed edges", snapSkipsClosedEdges);
+    testutils::run("snapping follows changes to the graph", snapFollowsChanges);
+    testutils::run("nearest segment keeps indices above 2^24", nearestSegmentKeepsLargeIndices);
+    testutils::run("tracked snapping matches snapBatch", trackedMatchesBatch);
+    return testutils::testResult();
+}
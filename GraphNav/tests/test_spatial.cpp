@@ -0,0 +1,217 @@
+//
+//  test_spatial.cpp
+//  GraphNav
+//
+//  Spatial queries against brute force: the feature grid and the run-length ROI index.
+//
+
+#include "Check.hpp"
+#include "Maps/FeatureIndex.hpp"
+#include "Maps/MapFiles.hpp"
+#include "Maps/MapManager.hpp"
+#include "Maps/RoiIndex.hpp"
+#include "../benchmarks/SyntheticData.hpp"
+
+#include <opencv2/imgcodecs.hpp>
+
+#include <random>
+
+using maps::FeatureIndex;
+using maps::RoiIndex;
+
+namespace {
+
+std::string skeriFolder() { return testutils::resDir() + "/maps/SKERI"; }
+
+double distance(cv::Point2f a, cv::Point2f b){
+    cv::Point2f d = a - b;
+    return std::sqrt(static_cast<double>(d.x) * d.x + static_cast<double>(d.y) * d.y);
+}
+
+// features of the types in mask by distance, then by multimap order, as the index sorts them
+std::vector<std::pair<double, const maps::MapFeature*>> bruteForce(const std::multimap<maps::FeatureType, maps::MapFeature>& features,
+                                                                   cv::Point2f uv, maps::FeatureMask mask){
+    std::vector<std::pair<double, const maps::MapFeature*>> all;
+    for (const auto& f : features)
+        if (mask & maps::featureMask(f.second.type))
+            all.push_back({distance(f.second.position, uv), &f.second});
+    std::stable_sort(all.begin(), all.end(), [](const std::pair<double, const maps::MapFeature*>& a, const std::pair<double, const maps::MapFeature*>& b){
+        return a.first < b.first;
+    });
+    return all;
+}
+
+// queries around the box [lo, hi] of u,v positions
+void featureIndexMatches(const std::multimap<maps::FeatureType, maps::MapFeature>& features, cv::Point2f lo, cv::Point2f hi, int numQueries){
+    FeatureIndex index;
+    index.build(features);
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> u(lo.x - 5, hi.x + 5), v(lo.y - 5, hi.y + 5);
+    std::vector<FeatureIndex::Hit> hits;
+    for (int q = 0; q < numQueries; q++){
+        cv::Point2f uv(u(rng), v(rng));
+        maps::FeatureMask mask = q % 3 == 0 ? maps::ALL_FEATURES : maps::featureMask(q % 3 == 1 ? maps::EXIT_SIGN : maps::ARUCO);
+        auto expected = bruteForce(features, uv, mask);
+
+        size_t k = 1 + rng() % 12;
+        index.nearest(uv, k, mask, hits);
+        CHECK(hits.size() == std::min(k, expected.size()));
+        for (size_t i = 0; i < hits.size() && i < expected.size(); i++)
+            CHECK(hits[i].distance == expected[i].first);
+
+        double radius = (rng() % 100) / 10.0;
+        index.withinRadius(uv, radius, mask, hits);
+        size_t inside = std::count_if(expected.begin(), expected.end(), [radius](const std::pair<double, const maps::MapFeature*>& e){ return e.first <= radius; });
+        CHECK(hits.size() == inside);
+        for (size_t i = 0; i < hits.size() && i < expected.size(); i++)
+            CHECK(hits[i].distance == expected[i].first && hits[i].feature->position == expected[i].second->position);
+    }
+
+    // huge, infinite and invalid radii
+    cv::Point2f centre = (lo + hi) * 0.5f;
+    index.withinRadius(centre, std::numeric_limits<double>::infinity(), maps::ALL_FEATURES, hits);
+    CHECK(hits.size() == features.size());
+    index.withinRadius(centre, 1e30, maps::ALL_FEATURES, hits);
+    CHECK(hits.size() == features.size());
+    index.withinRadius(cv::Point2f(1e20f, -1e20f), 1.0, maps::ALL_FEATURES, hits);
+    CHECK(hits.empty());
+    index.withinRadius(centre, std::numeric_limits<double>::quiet_NaN(), maps::ALL_FEATURES, hits);
+    CHECK(hits.empty());
+    index.nearest(cv::Point2f(1e20f, -1e20f), 3, maps::ALL_FEATURES, hits);
+    CHECK(hits.size() == std::min<size_t>(3, features.size()));
+}
+
+void featureIndexOnSkeri(){
+    maps::MapManager m;
+    m.init(skeriFolder(), 4);
+    for (int floor : m.getFloors()){
+        cv::Size size = m.getMapSizePixels(floor);
+        cv::Point2f far = m.pixels2uv(cv::Point2i(size.height, size.width), floor);
+        featureIndexMatches(m.getLandmarksList(floor), cv::Point2f(0, 0), far, 3000);
+    }
+}
+
+void featureIndexOnSynthetic(){
+    std::multimap<maps::FeatureType, maps::MapFeature> features;
+    std::string text = synthetic::featuresText(2000);
+    maps::parseFeatures(text.data(), text.size(), features);
+    CHECK(features.size() == 2000);
+    cv::Point2f lo(0, 0), hi(1, 1);
+    for (const auto& f : features){
+        lo = cv::Point2f(std::min(lo.x, f.second.position.x), std::min(lo.y, f.second.position.y));
+        hi = cv::Point2f(std::max(hi.x, f.second.position.x), std::max(hi.y, f.second.position.y));
+    }
+    featureIndexMatches(features, lo, hi, 3000);
+}
+
+// label changes along a polyline, walking every sample as RoiIndex::transitions documents
+std::vector<RoiIndex::Transition> walkTransitions(const std::vector<cv::Point2i>& polyline, std::function<int(int, int)> labelAt){
+    std::vector<RoiIndex::Transition> out;
+    if (polyline.empty())
+        return out;
+    int current = labelAt(polyline[0].x, polyline[0].y);
+    for (size_t i = 0; i + 1 < polyline.size(); i++){
+        int dr = polyline[i+1].x - polyline[i].x, dc = polyline[i+1].y - polyline[i].y;
+        int span = std::max(std::abs(dr), std::abs(dc));
+        int64_t r0 = (static_cast<int64_t>(polyline[i].x) << 32) + (int64_t(1) << 19);
+        int64_t c0 = (static_cast<int64_t>(polyline[i].y) << 32) + (int64_t(1) << 19);
+        for (int k = 1; k <= span; k++){
+            int r = static_cast<int>((r0 + k * ((static_cast<int64_t>(dr) << 32) / span)) >> 32);
+            int c = static_cast<int>((c0 + k * ((static_cast<int64_t>(dc) << 32) / span)) >> 32);
+            int id = labelAt(r, c);
+            if (id != current){
+                out.push_back({current, id, static_cast<int>(i), cv::Point2i(r, c)});
+                current = id;
+            }
+        }
+    }
+    return out;
+}
+
+void roiIndexMatches(const cv::Mat& rois, const std::map<int, std::string>& dictionary, int numPolylines){
+    RoiIndex index;
+    index.build(rois, dictionary);
+    auto labelAt = [&](int r, int c){
+        if (r < 0 || c < 0 || r >= rois.rows || c >= rois.cols)
+            return 0;
+        auto it = dictionary.find(rois.at<uchar>(r, c));
+        return it == dictionary.end() || it->second.empty() ? 0 : index.labelId(it->second);
+    };
+    for (int r = -2; r < rois.rows + 2; r++){
+        for (int c = -2; c < rois.cols + 2; c++){
+            bool inside = r >= 0 && c >= 0 && r < rois.rows && c < rois.cols;
+            CHECK(index.roiAt(cv::Point2i(r, c)) == (inside ? rois.at<uchar>(r, c) : 0));
+            CHECK(index.labelIdAt(cv::Point2i(r, c)) == labelAt(r, c));
+        }
+    }
+    for (const auto& entry : dictionary){
+        if (entry.first <= 0 || entry.first > 255 || entry.second.empty())
+            continue;
+        CHECK(index.labelId(entry.second) > 0 && index.label(index.labelId(entry.second)) == entry.second);
+        CHECK(index.labelOfRoi(entry.first) == index.labelId(entry.second));
+    }
+
+    std::mt19937 rng(13);
+    std::vector<RoiIndex::Transition> got;
+    for (int p = 0; p < numPolylines; p++){
+        std::vector<cv::Point2i> polyline;
+        for (int i = 0, n = 1 + static_cast<int>(rng() % 8); i < n; i++){
+            if (i > 0 && rng() % 5 == 0)
+                polyline.push_back(polyline.back());
+            else if (i > 0 && rng() % 3 == 0)
+                polyline.push_back(polyline.back() + cv::Point2i(static_cast<int>(rng() % 7) - 3, static_cast<int>(rng() % 300) - 150));
+            else
+                polyline.push_back(cv::Point2i(static_cast<int>(rng() % (rois.rows + 40)) - 20, static_cast<int>(rng() % (rois.cols + 40)) - 20));
+        }
+        index.transitions(polyline, got);
+        std::vector<RoiIndex::Transition> expected = walkTransitions(polyline, labelAt);
+        bool same = got.size() == expected.size();
+        for (size_t i = 0; same && i < got.size(); i++)
+            same = got[i].from == expected[i].from && got[i].to == expected[i].to && got[i].segment == expected[i].segment && got[i].pixel == expected[i].pixel;
+        CHECK(same);
+    }
+}
+
+void roiIndexOnSkeri(){
+    cv::Mat rois = cv::imread(skeriFolder() + "/rois_4.bmp", cv::IMREAD_GRAYSCALE);
+    std::map<int, std::string> dictionary;
+    CHECK(!rois.empty());
+    CHECK(maps::parseMappedFile(skeriFolder() + "/rois_4.csv", [&](const char* data, size_t size){ maps::parseRoisDictionary(data, size, dictionary); }));
+    roiIndexMatches(rois, dictionary, 5000);
+
+    // the map answers point lookups from its index, also outside the image
+    maps::MapManager m;
+    m.init(skeriFolder(), 4);
+    CHECK(m.getRoiAt(cv::Point2i(-1, -1), 4) == 0);
+    CHECK(m.getRoiAt(cv::Point2i(rois.rows, rois.cols), 4) == 0);
+    CHECK(m.getRoiLabelAt(cv::Point2i(rois.rows + 100, 0), 4).empty());
+    for (int r = 0; r < rois.rows; r += 3)
+        for (int c = 0; c < rois.cols; c += 3)
+            CHECK(m.getRoiLabelAt(cv::Point2i(r, c), 4) == m.getRoiLabel(rois.at<uchar>(r, c), 4));
+}
+
+// random rectangles of a few values, several values sharing a label and one without any
+void roiIndexOnRandomImage(){
+    std::mt19937 rng(17);
+    cv::Mat rois(180, 260, CV_8U, cv::Scalar(0));
+    for (int k = 0; k < 60; k++){
+        int r = static_cast<int>(rng() % rois.rows), c = static_cast<int>(rng() % rois.cols);
+        int rows = std::min(1 + static_cast<int>(rng() % 40), rois.rows - r), cols = std::min(1 + static_cast<int>(rng() % 60), rois.cols - c);
+        uchar value = static_cast<uchar>(rng() % 12);
+        for (int i = r; i < r + rows; i++)
+            for (int j = c; j < c + cols; j++)
+                rois.at<uchar>(i, j) = value;
+    }
+    std::map<int, std::string> dictionary = {{1, "hall"}, {2, "room a"}, {3, "room b"}, {4, "hall"}, {5, ""}, {7, "stairs"}, {9, "room a"}, {11, "office"}};
+    roiIndexMatches(rois, dictionary, 5000);
+}
+
+} // namespace
+
+int main(){
+    testutils::run("feature index matches brute force on SKERI", featureIndexOnSkeri);
+    testutils::run("feature index matches brute force on synthetic markers", featureIndexOnSynthetic);
+    testutils::run("ROI index matches the SKERI image", roiIndexOnSkeri);
+    testutils::run("ROI index matches a random image", roiIndexOnRandomImage);
+    return testutils::testResult();
+}
@@ -0,0 +1,121 @@
+//
+//  test_walls.cpp
+//  GraphNav
+//
+//  The wall ray test against a walk of the walls image, with and without the wall distance field,
+//  and the bit-packed rasters it walks.
+//
+
+#include "Check.hpp"
+#include "Maps/BitRaster.hpp"
+#include "Maps/MapManager.hpp"
+
+#include <random>
+
+namespace {
+
+std::string skeriFolder() { return testutils::resDir() + "/maps/SKERI"; }
+
+// every pixel of the line from a to b, as isPathCrossingWalls documents it: one sample per step
+// along the longer axis in 32.32 fixed point, leaving the image counting as a wall
+bool walkCrossesWalls(const cv::Mat& walls, cv::Point2i a, cv::Point2i b){
+    auto wallAt = [&walls](int r, int c){ return r < 0 || c < 0 || r >= walls.rows || c >= walls.cols || walls.at<uchar>(r, c) != 0; };
+    int dr = b.x - a.x, dc = b.y - a.y;
+    int span = std::max(std::abs(dr), std::abs(dc));
+    if (span == 0)
+        return wallAt(a.x, a.y);
+    int64_t r0 = (static_cast<int64_t>(a.x) << 32) + (int64_t(1) << 19);
+    int64_t c0 = (static_cast<int64_t>(a.y) << 32) + (int64_t(1) << 19);
+    for (int k = 0; k <= span; k++){
+        int r = static_cast<int>((r0 + k * ((static_cast<int64_t>(dr) << 32) / span)) >> 32);
+        int c = static_cast<int>((c0 + k * ((static_cast<int64_t>(dc) << 32) / span)) >> 32);
+        if (wallAt(r, c))
+            return true;
+    }
+    return false;
+}
+
+// the distance field only lets segments through without walking them: the answers are the same
+void wallTestMatchesWalk(){
+    maps::MapManager withField, withoutField;
+    withField.init(skeriFolder(), 4, true);
+    withoutField.init(skeriFolder(), 4, false);
+    std::mt19937 rng(29);
+    for (int floor : withField.getFloors()){
+        std::shared_ptr<const maps::AnnotatedMap> fast = withField.getMap(floor), slow = withoutField.getMap(floor);
+        cv::Mat walls = fast->getWallsImage();
+        cv::Size size = fast->getMapSizePixels();
+        CHECK(walls.rows == size.height && walls.cols == size.width);
+        int clear = 0;
+        for (int q = 0; q < 20000; q++){
+            cv::Point2i a(static_cast<int>(rng() % (size.height + 20)) - 10, static_cast<int>(rng() % (size.width + 20)) - 10);
+            // mostly short segments, which the field can tell apart from the walls
+            int reach = (q % 4 == 0) ? std::max(size.height, size.width) : (q % 4 == 1) ? 8 : 60;
+            cv::Point2i b = (q % 50 == 0) ? a : a + cv::Point2i(static_cast<int>(rng() % (2 * reach + 1)) - reach, static_cast<int>(rng() % (2 * reach + 1)) - reach);
+            bool expected = walkCrossesWalls(walls, a, b);
+            CHECK(fast->isPathCrossingWalls(a, b) == expected);
+            CHECK(slow->isPathCrossingWalls(a, b) == expected);
+            CHECK(fast->isPathCrossingWalls(b, a) == walkCrossesWalls(walls, b, a));
+            clear += expected ? 0 : 1;
+        }
+        CHECK(clear > 1000);
+    }
+}
+
+void bitRasterMatchesImage(){
+    std::mt19937 rng(31);
+    for (int cols : {1, 7, 63, 64, 65, 128, 200}){
+        cv::Mat image(37, cols, CV_8U);
+        for (int r = 0; r < image.rows; r++)
+            for (int c = 0; c < cols; c++)
+                image.at<uchar>(r, c) = (rng() % 3 == 0) ? static_cast<uchar>(1 + rng() % 255) : 0;
+        maps::BitRaster bits(image);
+        CHECK(bits.rows() == image.rows && bits.cols() == cols && !bits.empty());
+        CHECK(bits.wordsPerRow() == static_cast<size_t>((cols + 63) / 64));
+        CHECK(bits.bytes() == bits.wordsPerRow() * 8 * image.rows);
+        bool same = true;
+        for (int r = 0; r < image.rows; r++)
+            for (int c = 0; c < cols; c++)
+                same = same && bits.test(r, c) == (image.at<uchar>(r, c) != 0);
+        CHECK(same);
+        // the padding bits stay clear
+        for (int r = 0; r < image.rows && cols % 64 != 0; r++)
+            CHECK((bits.data()[r * bits.wordsPerRow() + bits.wordsPerRow() - 1] >> (cols % 64)) == 0);
+        cv::Mat back = bits.toMat();
+        CHECK(back.rows == image.rows && back.cols == cols && back.type() == CV_8U);
+        for (int r = 0; r < image.rows; r++)
+            for (int c = 0; c < cols; c++)
+                same = same && back.at<uchar>(r, c) == (image.at<uchar>(r, c) != 0 ? 255 : 0);
+        CHECK(same);
+        // copies share the words
+        maps::BitRaster copy = bits;
+        CHECK(copy.data() == bits.data());
+    }
+    CHECK(maps::BitRaster().empty());
+
+    // the map layers answer as the images they come from
+    maps::MapManager m;
+    m.init(skeriFolder(), 4);
+    std::shared_ptr<const maps::AnnotatedMap> map = m.getMap(4);
+    cv::Mat walls = map->getWallsImage(), walkable = map->getWalkableMask();
+    bool same = true;
+    int numWalls = 0, numWalkable = 0;
+    for (int r = -1; r <= walls.rows; r++)
+        for (int c = -1; c <= walls.cols; c++){
+            bool inside = r >= 0 && c >= 0 && r < walls.rows && c < walls.cols;
+            same = same && map->isWallAt(cv::Point2i(r, c)) == (!inside || walls.at<uchar>(r, c) != 0);
+            same = same && map->isWalkable(cv::Point2i(r, c)) == (inside && walkable.at<uchar>(r, c) != 0);
+            numWalls += inside && walls.at<uchar>(r, c) != 0;
+            numWalkable += inside && walkable.at<uchar>(r, c) != 0;
+        }
+    CHECK(same);
+    CHECK(numWalls > 0 && numWalkable > 0);
+}
+
+} // namespace
+
+int main(){
+    testutils::run("wall test matches a walk of the walls image", wallTestMatchesWalk);
+    testutils::run("bit rasters match their images", bitRasterMatchesImage);
+    return testutils::testResult();
+}
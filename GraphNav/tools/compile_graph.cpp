@@ -0,0 +1,98 @@
+//
+//  compile_graph.cpp
+//  GraphNav
+//
+//  Compiles a json navigation graph into the binary format loaded by Graph::loadCompiled. With
+//  --distances, also builds its distance table, saved in the same file. With --hierarchy, also
+//  builds its contraction hierarchy and saves it next to the output file, where loadCompiled finds it.
+//
+//  usage: compile_graph <graph.json> <map folder> <floor> <output file> [--distances] [--hierarchy]
+//
+
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <chrono>
+#include <limits>
+#include <string>
+#include "../include/Maps/MapManager.hpp"
+#include "../include/Graph.hpp"
+
+namespace {
+
+int usage(const char* program){
+    std::cerr << "usage: " << program << " <graph.json> <map folder> <floor> <output file> [--distances] [--hierarchy]" << std::endl;
+    return 1;
+}
+
+// whole decimal number in [lo, hi], nothing else in text
+bool parseInteger(const char* text, long long lo, long long hi, long long& value){
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtoll(text, &end, 10);
+    return end != text && *end == '\0' && errno == 0 && value >= lo && value <= hi;
+}
+
+} // namespace
+
+int main(int argc, const char * argv[]) {
+    if (argc < 5)
+        return usage(argv[0]);
+    long long floor;
+    if (!parseInteger(argv[3], std::numeric_limits<int>::min(), std::numeric_limits<int>::max(), floor)){
+        std::cerr << "bad floor " << argv[3] << std::endl;
+        return usage(argv[0]);
+    }
+    bool distances = false, hierarchy = false;
+    for (int i = 5; i < argc; i++){
+        std::string opt = argv[i];
+        if (opt == "--distances")
+            distances = true;
+        else if (opt == "--hierarchy")
+            hierarchy = true;
+        else{
+            std::cerr << "unknown option " << opt << std::endl;
+            return usage(argv[0]);
+        }
+    }
+    std::shared_ptr<maps::MapManager> mapManager = std::make_shared<maps::MapManager>();
+    mapManager->init(argv[2], static_cast<int>(floor));
+    navgraph::Graph navGraph;
+    if (!navGraph.loadJson(argv[1], mapManager))
+        return 1;
+    if (distances){
+        auto start = std::chrono::steady_clock::now();
+        navGraph.buildDistanceTable();
+        std::chrono::duration<double> buildTime = std::chrono::steady_clock::now() - start;
+        std::cout << "distance table: " << navGraph.getDistanceTable().targets().size() << " targets, built in "
+                  << buildTime.count() << " s" << std::endl;
+    }
+    if (!navGraph.saveCompiled(argv[4])){
+        std::cerr << "cannot write " << argv[4] << std::endl;
+        return 1;
+    }
+    if (hierarchy){
+        auto start = std::chrono::steady_clock::now();
+        navGraph.buildHierarchy();
+        std::chrono::duration<double> buildTime = std::chrono::steady_clock::now() - start;
+        std::string hierarchyFile = navgraph::Graph::hierarchyFileName(argv[4]);
+        if (!navGraph.saveHierarchy(hierarchyFile)){
+            std::cerr << "cannot write " << hierarchyFile << std::endl;
+            return 1;
+        }
+        std::cout << hierarchyFile << ": " << navGraph.getHierarchy().numEdges() << " edges, built in "
+                  << buildTime.count() << " s" << std::endl;
+    }
+    
+    // check that the output loads back
+    auto start = std::chrono::steady_clock::now();
+    navgraph::Graph compiledGraph;
+    if (!compiledGraph.loadCompiled(argv[4], mapManager, true))
+        return 1;
+    std::chrono::duration<double, std::milli> loadTime = std::chrono::steady_clock::now() - start;
+    std::cout << argv[4] << ": " << compiledGraph.numNodes() << " nodes, " << compiledGraph.getAdjacency().numEdges()
+              << " edges, loads in " << loadTime.count() << " ms" << std::endl;
+    if ((hierarchy && compiledGraph.getHierarchy().empty()) || (distances && compiledGraph.getDistanceTable().empty()))
+        return 1;
+    return 0;
+}
@@ -0,0 +1,528 @@
+//
+//  graphnav_server.cpp
+//  GraphNav
+//
+//  Headless query server. Requests are newline-delimited json objects, read from stdin or from the
+//  connections to a unix socket; each gets one json line back, in completion order:
+//
+//    {"id": 1, "op": "snap", "floor": 4, "u": 2.5, "v": 10.1}     -> {"id": 1, "u": ..., "v": ..., "edge": ...}
+//    {"id": 2, "op": "nearest", "floor": 4, "u": 2.5, "v": 10.1}  -> {"id": 2, "node": ...}
+//    {"id": 3, "op": "poi", "floor": 4, "u": 2.5, "v": 10.1}      -> {"id": 3, "poi": "..."}
+//    {"id": 4, "op": "stats"}                                     -> {"id": 4, "snap": {"count": ..., "p50_us": ..., "p99_us": ...}, ...}
+//    {"id": 5, "op": "metrics"}                                   -> {"id": 5, "metrics": {"counters": ..., "histograms": ...}}
+//    {"id": 6, "op": "metrics", "format": "prometheus"}           -> {"id": 6, "metrics": "<prometheus text>"}
+//
+//  The id may be any json value and is echoed back unchanged.
+//  The library metrics (see include/Utils/Metrics.hpp) are only collected in builds with GRAPHNAV_METRICS.
+//
+//  Queries run on a work-stealing pool with one thread per core. Snap requests that arrive within
+//  a short window of each other are grouped by floor and snapped as one batch. Latency percentiles,
+//  from the time a request is read to the time its answer is written, are kept in fixed log-scale
+//  buckets (a quarter of a power of two wide) and printed to stderr at exit.
+//
+//  usage: graphnav_server <graph.json | compiled graph> <map folder> <floor>
+//                         [--socket path] [--threads n] [--batch-window-us n] [--max-batch n]
+//                         [--map-budget-mb n] [--prefetch-floors 0|1] [--preload-floors 0|1] [--raster-cache dir]
+//
+//  Floor rasters are decoded on first use; --map-budget-mb caps their memory (least recently used
+//  floors are dropped) and --prefetch-floors 1 loads the floors next to a newly loaded one in the background.
+//  --preload-floors 1 loads every floor at startup, in parallel. With --raster-cache the decoded
+//  rasters are kept in dir and mapped from there by the next runs instead of being decoded again.
+//
+
+#include "../include/Maps/MapManager.hpp"
+#include "../include/Graph.hpp"
+#include "../include/Utils/Metrics.hpp"
+#include "../include/Utils/WorkStealingPool.hpp"
+#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+std::atomic<bool> stopRequested(false);
+
+void onSignal(int) { stopRequested = true; }
+
+// one client: requests are read from inFd, answers written to outFd
+class Connection{
+public:
+    Connection(int inFd, int outFd) : _inFd(inFd), _outFd(outFd) { ; }
+    ~Connection(){
+        if (_inFd > STDERR_FILENO) close(_inFd);
+        if (_outFd > STDERR_FILENO && _outFd != _inFd) close(_outFd);
+    }
+
+    // next line without the newline; false at end of input
+    bool readLine(std::string& line){
+        while (true){
+            size_t eol = _buffer.find('\n');
+            if (eol != std::string::npos){
+                line.assign(_buffer, 0, eol);
+                _buffer.erase(0, eol + 1);
+                return true;
+            }
+            // wake up now and then to notice a stop request
+            pollfd pfd = {_inFd, POLLIN, 0};
+            int ready = poll(&pfd, 1, 200);
+            if (stopRequested)
+                return false;
+            if (ready == 0 || (ready < 0 && errno == EINTR))
+                continue;
+            char chunk[65536];
+            ssize_t n = read(_inFd, chunk, sizeof(chunk));
+            if (n <= 0){
+                if (n < 0 && errno == EINTR && !stopRequested)
+                    continue;
+                if (_buffer.empty())
+                    return false;
+                line.swap(_buffer);
+                _buffer.clear();
+                return true;
+            }
+            _buffer.append(chunk, static_cast<size_t>(n));
+        }
+    }
+
+    void writeLine(const std::string& line){
+        std::lock_guard<std::mutex> lock(_writeMutex);
+        std::string out = line + "\n";
+        size_t written = 0;
+        while (written < out.size()){
+            ssize_t n = write(_outFd, out.data() + written, out.size() - written);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return; // client went away
+            written += static_cast<size_t>(n);
+        }
+    }
+
+private:
+    int _inFd, _outFd;
+    std::string _buffer;
+    std::mutex _writeMutex;
+};
+
+enum Op { SNAP = 0, NEAREST, POI, STATS, METRICS, NUM_OPS };
+const char* OP_NAMES[NUM_OPS] = {"snap", "nearest", "poi", "stats", "metrics"};
+
+struct Request{
+    std::shared_ptr<Connection> connection;
+    std::string id; // json token, echoed back as it is
+    Op op;
+    int floor;
+    cv::Point2f uv;
+    Clock::time_point received;
+    bool prometheus = false; // metrics format
+};
+
+// per-op latency histograms with the log buckets of metricsutils, so memory stays fixed however long the server runs
+class LatencyStats{
+public:
+    void add(Op op, Clock::time_point received){
+        int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - received).count();
+        int bucket = metricsutils::bucketOf(static_cast<uint64_t>(std::max<int64_t>(0, ns)));
+        std::lock_guard<std::mutex> lock(_mutex);
+        _buckets[op][bucket]++;
+        _counts[op]++;
+    }
+
+    std::string json(){
+        std::string out;
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (int op = 0; op < NUM_OPS; op++){
+            if (_counts[op] == 0)
+                continue;
+            char buf[160];
+            snprintf(buf, sizeof(buf), "%s\"%s\": {\"count\": %llu, \"p50_us\": %.1f, \"p99_us\": %.1f}", out.empty() ? "" : ", ",
+                     OP_NAMES[op], static_cast<unsigned long long>(_counts[op]), _percentile(op, 0.5), _percentile(op, 0.99));
+            out += buf;
+        }
+        return out;
+    }
+
+private:
+    std::mutex _mutex;
+    uint64_t _buckets[NUM_OPS][metricsutils::NUM_BUCKETS] = {};
+    uint64_t _counts[NUM_OPS] = {};
+
+    // upper bound of the bucket holding the p-th quantile, in microseconds
+    double _percentile(int op, double p) const {
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * _counts[op]))), seen = 0;
+        for (int b = 0; b < metricsutils::NUM_BUCKETS; b++){
+            seen += _buckets[op][b];
+            if (seen >= rank)
+                return metricsutils::bucketUpperBound(b) * 1e-3;
+        }
+        return metricsutils::bucketUpperBound(metricsutils::NUM_BUCKETS - 1) * 1e-3;
+    }
+};
+
+std::string escapeJson(const std::string& s){
+    std::string out;
+    for (char c : s){
+        if (c == '"' || c == '\\') { out += '\\'; out += c; }
+        else if (static_cast<unsigned char>(c) < 0x20) { char buf[8]; snprintf(buf, sizeof(buf), "\\u%04x", c); out += buf; }
+        else out += c;
+    }
+    return out;
+}
+
+class Server{
+public:
+    Server(std::shared_ptr<const navgraph::Graph> graph, std::shared_ptr<const maps::MapManager> mapManager,
+           unsigned numThreads, int batchWindowUs, size_t maxBatch)
+        : _graph(graph), _mapManager(mapManager), _pool(numThreads), _batchWindow(batchWindowUs), _maxBatch(maxBatch),
+          _stopBatching(false), _batcher(&Server::_batchLoop, this) { ; }
+
+    ~Server(){
+        {
+            std::lock_guard<std::mutex> lock(_batchMutex);
+            _stopBatching = true;
+        }
+        _batchReady.notify_one();
+        _batcher.join();
+        _pool.wait();
+    }
+
+    // reads and dispatches requests until the connection closes
+    void serve(std::shared_ptr<Connection> connection){
+        std::string line;
+        while (!stopRequested && connection->readLine(line)){
+            if (line.empty())
+                continue;
+            Request req;
+            req.connection = connection;
+            req.received = Clock::now();
+            std::string error;
+            if (!_parse(line, req, error)){
+                connection->writeLine("{\"id\": " + req.id + ", \"error\": \"" + escapeJson(error) + "\"}");
+                continue;
+            }
+            if (req.op == SNAP){
+                {
+                    std::lock_guard<std::mutex> lock(_batchMutex);
+                    _pending.push_back(std::move(req));
+                }
+                _batchReady.notify_one();
+            }
+            else
+                _pool.submit([this, req](){ _answer(req); });
+        }
+    }
+
+    void drain(){
+        {
+            std::unique_lock<std::mutex> lock(_batchMutex);
+            _batchDrained.wait(lock, [this]{ return _pending.empty() && !_batchInHand; });
+        }
+        _pool.wait();
+    }
+
+    inline std::string stats() { return _stats.json(); }
+    inline unsigned numThreads() const { return _pool.size(); }
+
+private:
+    std::shared_ptr<const navgraph::Graph> _graph;
+    std::shared_ptr<const maps::MapManager> _mapManager;
+    syncutils::WorkStealingPool _pool;
+    LatencyStats _stats;
+
+    // snap requests waiting to be batched
+    std::chrono::microseconds _batchWindow;
+    size_t _maxBatch;
+    std::mutex _batchMutex;
+    std::condition_variable _batchReady, _batchDrained;
+    std::vector<Request> _pending;
+    bool _stopBatching;
+    bool _batchInHand = false; // taken from _pending, not yet submitted to the pool
+    std::thread _batcher;
+
+    bool _parse(const std::string& line, Request& req, std::string& error){
+        req.id = "null";
+        rapidjson::Document doc;
+        doc.Parse(line.c_str());
+        if (doc.HasParseError() || !doc.IsObject()){
+            error = "invalid json";
+            return false;
+        }
+        if (doc.HasMember("id")){
+            rapidjson::StringBuffer buffer;
+            rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+            doc["id"].Accept(writer);
+            req.id = buffer.GetString();
+        }
+        if (!doc.HasMember("op") || !doc["op"].IsString()){
+            error = "missing op";
+            return false;
+        }
+        std::string op = doc["op"].GetString();
+        req.op = NUM_OPS;
+        for (int k = 0; k < NUM_OPS; k++)
+            if (op == OP_NAMES[k])
+                req.op = static_cast<Op>(k);
+        if (req.op == NUM_OPS){
+            error = "unknown op " + op;
+            return false;
+        }
+        if (req.op == STATS)
+            return true;
+        if (req.op == METRICS){
+            req.prometheus = doc.HasMember("format") && doc["format"].IsString() && std::string(doc["format"].GetString()) == "prometheus";
+            return true;
+        }
+        if (!doc.HasMember("floor") || !doc["floor"].IsInt() || !doc.HasMember("u") || !doc["u"].IsNumber() ||
+            !doc.HasMember("v") || !doc["v"].IsNumber()){
+            error = "floor, u and v are required";
+            return false;
+        }
+        req.floor = doc["floor"].GetInt();
+        req.uv = cv::Point2f(doc["u"].GetFloat(), doc["v"].GetFloat());
+        if (!_mapManager->hasFloor(req.floor)){
+            error = "unknown floor";
+            return false;
+        }
+        return true;
+    }
+
+    void _answer(const Request& req){
+        char buf[128];
+        std::string out;
+        switch (req.op){
+            case NEAREST:
+                snprintf(buf, sizeof(buf), "\"node\": %d", _graph->findClosestNodeId(req.uv, req.floor));
+                out = buf;
+                break;
+            case POI:
+                out = "\"poi\": \"" + escapeJson(_mapManager->getClosestPOI(_mapManager->uv2pixels(req.uv, req.floor), req.floor)) + "\"";
+                break;
+            case STATS:
+                out = _stats.json();
+                break;
+            case METRICS:
+                out = "\"metrics\": " + (req.prometheus ? "\"" + escapeJson(metricsutils::prometheusText()) + "\"" : metricsutils::json());
+                break;
+            default:
+                break;
+        }
+        req.connection->writeLine("{\"id\": " + req.id + (out.empty() ? "" : ", ") + out + "}");
+        _stats.add(req.op, req.received);
+    }
+
+    // collects the snap requests arriving within the batch window and hands them to the pool,
+    // one task per floor
+    void _batchLoop(){
+        std::vector<Request> batch;
+        while (true){
+            {
+                std::unique_lock<std::mutex> lock(_batchMutex);
+                _batchReady.wait(lock, [this]{ return _stopBatching || !_pending.empty(); });
+                if (_pending.empty())
+                    return;
+                Clock::time_point deadline = _pending.front().received + _batchWindow;
+                _batchReady.wait_until(lock, deadline, [this]{ return _stopBatching || _pending.size() >= _maxBatch; });
+                size_t n = std::min(_pending.size(), _maxBatch);
+                batch.assign(std::make_move_iterator(_pending.begin()), std::make_move_iterator(_pending.begin() + n));
+                _pending.erase(_pending.begin(), _pending.begin() + n);
+                _batchInHand = true;
+            }
+            std::map<int, std::vector<Request>> byFloor;
+            for (Request& r : batch)
+                byFloor[r.floor].push_back(std::move(r));
+            batch.clear();
+            for (auto& f : byFloor){
+                auto requests = std::make_shared<std::vector<Request>>(std::move(f.second));
+                _pool.submit([this, requests](){ _snapBatch(*requests); });
+            }
+            std::lock_guard<std::mutex> lock(_batchMutex);
+            _batchInHand = false;
+            if (_pending.empty())
+                _batchDrained.notify_all();
+        }
+    }
+
+    void _snapBatch(const std::vector<Request>& requests){
+        static thread_local std::vector<cv::Point2f> positions;
+        static thread_local std::vector<navgraph::Graph::SnapResult> results;
+        positions.clear();
+        for (const Request& r : requests)
+            positions.push_back(r.uv);
+        _graph->snapBatch(positions, requests.front().floor, results);
+        for (size_t i = 0; i < requests.size(); i++){
+            char buf[128];
+            snprintf(buf, sizeof(buf), ", \"u\": %.6f, \"v\": %.6f, \"edge\": %d}", results[i].position.x, results[i].position.y, results[i].edge);
+            requests[i].connection->writeLine("{\"id\": " + requests[i].id + buf);
+            _stats.add(SNAP, requests[i].received);
+        }
+    }
+};
+
+int listenUnixSocket(const std::string& path){
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)){
+        close(fd);
+        return -1;
+    }
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, 64) < 0){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int usage(const char* program){
+    std::cerr << "usage: " << program << " <graph.json | compiled graph> <map folder> <floor>"
+              << " [--socket path] [--threads n] [--batch-window-us n] [--max-batch n]"
+              << " [--map-budget-mb n] [--prefetch-floors 0|1] [--preload-floors 0|1] [--raster-cache dir]" << std::endl;
+    return 1;
+}
+
+// whole decimal number in [lo, hi], nothing else in text
+bool parseInteger(const char* text, long long lo, long long hi, long long& value){
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtoll(text, &end, 10);
+    return end != text && *end == '\0' && errno == 0 && value >= lo && value <= hi;
+}
+
+} // namespace
+
+int main(int argc, const char * argv[]) {
+    if (argc < 4)
+        return usage(argv[0]);
+    long long startFloor;
+    if (!parseInteger(argv[3], std::numeric_limits<int>::min(), std::numeric_limits<int>::max(), startFloor)){
+        std::cerr << "bad floor " << argv[3] << std::endl;
+        return usage(argv[0]);
+    }
+    std::string graphFile = argv[1], socketPath;
+    unsigned numThreads = 0;
+    int batchWindowUs = 200;
+    size_t maxBatch = 64;
+    size_t mapBudgetMb = 0;
+    bool prefetchFloors = false;
+    bool preloadFloors = false;
+    std::string rasterCache;
+    // every option takes a value; the numeric ones are checked whole and in range
+    const long long maxInt = std::numeric_limits<int>::max();
+    for (int i = 4; i < argc; i += 2){
+        std::string opt = argv[i];
+        if (i + 1 == argc){
+            std::cerr << "missing value for " << opt << std::endl;
+            return usage(argv[0]);
+        }
+        const char* value = argv[i+1];
+        long long n = 0;
+        bool ok = true;
+        if (opt == "--socket") socketPath = value;
+        else if (opt == "--raster-cache") rasterCache = value;
+        else if (opt == "--threads") { ok = parseInteger(value, 0, 4096, n); numThreads = static_cast<unsigned>(n); }
+        else if (opt == "--batch-window-us") { ok = parseInteger(value, 0, maxInt, n); batchWindowUs = static_cast<int>(n); }
+        else if (opt == "--max-batch") { ok = parseInteger(value, 0, maxInt, n); maxBatch = std::max<size_t>(1, static_cast<size_t>(n)); }
+        else if (opt == "--map-budget-mb") { ok = parseInteger(value, 0, static_cast<long long>(std::numeric_limits<size_t>::max() >> 20), n); mapBudgetMb = static_cast<size_t>(n); }
+        else if (opt == "--prefetch-floors") { ok = parseInteger(value, 0, 1, n); prefetchFloors = n != 0; }
+        else if (opt == "--preload-floors") { ok = parseInteger(value, 0, 1, n); preloadFloors = n != 0; }
+        else{
+            std::cerr << "unknown option " << opt << std::endl;
+            return usage(argv[0]);
+        }
+        if (!ok){
+            std::cerr << "bad value " << value << " for " << opt << std::endl;
+            return usage(argv[0]);
+        }
+    }
+
+    std::shared_ptr<maps::MapManager> mapManager = std::make_shared<maps::MapManager>();
+    mapManager->setRasterCache(rasterCache);
+    mapManager->init(argv[2], static_cast<int>(startFloor));
+    mapManager->setMemoryBudget(mapBudgetMb << 20);
+    mapManager->setPrefetchAdjacentFloors(prefetchFloors);
+    if (preloadFloors)
+        mapManager->preloadAll();
+    if (mapManager->hasFloor(mapManager->currentFloor))
+        mapManager->preload(mapManager->currentFloor);
+    std::shared_ptr<navgraph::Graph> graph = std::make_shared<navgraph::Graph>();
+    bool isJson = graphFile.size() > 5 && graphFile.compare(graphFile.size() - 5, 5, ".json") == 0;
+    if (isJson ? !graph->loadJson(graphFile, mapManager) : !graph->loadCompiled(graphFile, mapManager))
+        return 1;
+
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    Server server(graph, mapManager, numThreads, batchWindowUs, maxBatch);
+    std::cerr << "graphnav_server: " << graph->numNodes() << " nodes, " << server.numThreads() << " threads" << std::endl;
+    if (socketPath.empty()){
+        server.serve(std::make_shared<Connection>(STDIN_FILENO, STDOUT_FILENO));
+    }
+    else{
+        int listenFd = listenUnixSocket(socketPath);
+        if (listenFd < 0){
+            std::cerr << "cannot listen on " << socketPath << std::endl;
+            return 1;
+        }
+        // every client runs on its own detached thread; the last one to finish wakes up the shutdown below
+        std::mutex clientsMutex;
+        std::condition_variable clientsDone;
+        int numClients = 0;
+        while (!stopRequested){
+            pollfd pfd = {listenFd, POLLIN, 0};
+            if (poll(&pfd, 1, 200) <= 0)
+                continue;
+            int fd = accept(listenFd, nullptr, nullptr);
+            if (fd < 0)
+                continue;
+            {
+                std::lock_guard<std::mutex> lock(clientsMutex);
+                numClients++;
+            }
+            std::thread([&server, &clientsMutex, &clientsDone, &numClients, fd](){
+                server.serve(std::make_shared<Connection>(fd, fd));
+                std::lock_guard<std::mutex> lock(clientsMutex);
+                if (--numClients == 0)
+                    clientsDone.notify_all();
+            }).detach();
+        }
+        {
+            std::unique_lock<std::mutex> lock(clientsMutex);
+            clientsDone.wait(lock, [&numClients]{ return numClients == 0; });
+        }
+        close(listenFd);
+        unlink(socketPath.c_str());
+    }
+    server.drain();
+    std::cerr << "latency: {" << server.stats() << "}" << std::endl;
+    return 0;
+}